@@ -43,16 +43,21 @@
 #include "Engine/Format.h"
 #include "Engine/Log.h"
 #include "Engine/Cache.h"
+#include "Engine/CacheTOCFile.h"
+#include "Engine/CacheStatistics.h"
 #include "Engine/Variant.h"
 #include "Engine/Knob.h"
 #include "Engine/Rect.h"
 #include "Engine/DiskCacheNode.h"
 #include "Engine/NoOp.h"
+#include "Engine/RenderMemoryCounter.h"
+#include "Engine/RenderProfiler.h"
+#include "Engine/ThreadStorage.h"
 
 BOOST_CLASS_EXPORT(Natron::FrameParams)
 BOOST_CLASS_EXPORT(Natron::ImageParams)
 
-#define NATRON_CACHE_VERSION 2
+#define NATRON_CACHE_VERSION 5
 
 using namespace Natron;
 
@@ -82,6 +87,7 @@ struct AppManagerPrivate
     mutable QMutex _wasAbortCalledMutex;
     bool _wasAbortAnyProcessingCalled; // < has abortAnyProcessing() called at least once ?
     U64 _nodesGlobalMemoryUse; //< how much memory all the nodes are using (besides the cache)
+    Natron::ThreadStorage< boost::shared_ptr<RenderMemoryCounter> > renderMemoryCounters; //< the counter of the frame rendered by each thread
     mutable QMutex _ofxLogMutex;
     QString _ofxLog;
     size_t maxCacheFiles; //< the maximum number of files the application can open for caching. This is the hard limit * 0.9
@@ -134,6 +140,7 @@ struct AppManagerPrivate
         ,_binaryPath()
         ,_wasAbortAnyProcessingCalled(false)
         ,_nodesGlobalMemoryUse(0)
+        ,renderMemoryCounters()
         ,_ofxLogMutex()
         ,_ofxLog()
         ,maxCacheFiles(0)
@@ -211,11 +218,18 @@ AppManager::printUsage(const std::string& programName)
                              " name following the this argument. If no such node exists in the project file, the process will abort."
                              "Note that if you don't pass the --writer argument, it will try to start rendering with all the writers in the project's file. After the writer node name you can pass an optional frame range in the format "
                              " firstFrame-lastFrame (e.g: 10-40). ").toStdString() << std::endl;
+    std::cout << QObject::tr("[--profile <trace file path>] or [-p] records the time spent by each node while rendering and writes it "
+                             "to the given file when the application quits, in the JSON format of the chrome://tracing page of Google Chrome.").toStdString() << std::endl;
+    std::cout << QObject::tr("[--cache-stats] prints the statistics of the caches when the application quits: the hits, misses, evictions "
+                             "and size of each cache and of the nodes that use the most of it.").toStdString() << std::endl;
     std::cout << QObject::tr("An example of usage of the renderer can be: \n"
                              "./NatronRenderer -w MyWriter 1-100 /Users/Me/MyNatronProjects/MyProject.ntp").toStdString() << std::endl;
 
 }
 
+///Set by the --cache-stats argument, the statistics are printed by the destructor of AppManager
+static bool printCachesStatisticsOnExit = false;
+
 static void appendFakeFrameRange(std::list<std::pair<int,int> >& frameRanges)
 {
     ///push a fake frame range indicating to the render engine that it needs to render using the frame range
@@ -242,6 +256,7 @@ AppManager::parseCmdLineArgs(int argc,
     *isBackground = false;
     bool expectWriterNameOnNextArg = false;
     bool expectPipeFileNameOnNextArg = false;
+    bool expectProfileFileNameOnNextArg = false;
     bool expectedFrameRange = false;
     QStringList args;
     for (int i = 0; i < argc; ++i) {
@@ -251,7 +266,7 @@ AppManager::parseCmdLineArgs(int argc,
     for (int i = 0; i < args.size(); ++i) {
         
         if ( args.at(i).contains("." NATRON_PROJECT_FILE_EXT) ) {
-            if (expectWriterNameOnNextArg || expectPipeFileNameOnNextArg) {
+            if (expectWriterNameOnNextArg || expectPipeFileNameOnNextArg || expectProfileFileNameOnNextArg) {
                 AppManager::printUsage(argv[0]);
 
                 return false;
@@ -263,7 +278,7 @@ AppManager::parseCmdLineArgs(int argc,
             projectFilename = args.at(i);
             continue;
         } else if ( (args.at(i) == "--background") || (args.at(i) == "-b") ) {
-            if (expectWriterNameOnNextArg  || expectPipeFileNameOnNextArg) {
+            if (expectWriterNameOnNextArg  || expectPipeFileNameOnNextArg || expectProfileFileNameOnNextArg) {
                 AppManager::printUsage(argv[0]);
 
                 return false;
@@ -275,7 +290,7 @@ AppManager::parseCmdLineArgs(int argc,
             *isBackground = true;
             continue;
         } else if ( (args.at(i) == "--writer") || (args.at(i) == "-w") ) {
-            if (expectWriterNameOnNextArg  || expectPipeFileNameOnNextArg) {
+            if (expectWriterNameOnNextArg  || expectPipeFileNameOnNextArg || expectProfileFileNameOnNextArg) {
                 AppManager::printUsage(argv[0]);
 
                 return false;
@@ -287,7 +302,7 @@ AppManager::parseCmdLineArgs(int argc,
             expectWriterNameOnNextArg = true;
             continue;
         } else if (args.at(i) == "--IPCpipe") {
-            if (expectWriterNameOnNextArg || expectPipeFileNameOnNextArg) {
+            if (expectWriterNameOnNextArg || expectPipeFileNameOnNextArg || expectProfileFileNameOnNextArg) {
                 AppManager::printUsage(argv[0]);
 
                 return false;
@@ -298,6 +313,30 @@ AppManager::parseCmdLineArgs(int argc,
             }
             expectPipeFileNameOnNextArg = true;
             continue;
+        } else if ( (args.at(i) == "--profile") || (args.at(i) == "-p") ) {
+            if (expectWriterNameOnNextArg || expectPipeFileNameOnNextArg || expectProfileFileNameOnNextArg) {
+                AppManager::printUsage(argv[0]);
+
+                return false;
+            }
+            if (expectedFrameRange) {
+                expectedFrameRange = false;
+                appendFakeFrameRange(frameRanges);
+            }
+            expectProfileFileNameOnNextArg = true;
+            continue;
+        } else if (args.at(i) == "--cache-stats") {
+            if (expectWriterNameOnNextArg || expectPipeFileNameOnNextArg || expectProfileFileNameOnNextArg) {
+                AppManager::printUsage(argv[0]);
+
+                return false;
+            }
+            if (expectedFrameRange) {
+                expectedFrameRange = false;
+                appendFakeFrameRange(frameRanges);
+            }
+            printCachesStatisticsOnExit = true;
+            continue;
         }
         
         if (expectedFrameRange) {
@@ -348,6 +387,12 @@ AppManager::parseCmdLineArgs(int argc,
             expectPipeFileNameOnNextArg = false;
             continue;
         }
+        if (expectProfileFileNameOnNextArg) {
+            ///record from the start, the trace is written by the destructor of AppManager
+            Natron::RenderProfiler::start( args.at(i).toStdString() );
+            expectProfileFileNameOnNextArg = false;
+            continue;
+        }
     }
 
     return true;
@@ -410,6 +455,20 @@ AppManager::load(int &argc,
 AppManager::~AppManager()
 {
     assert( _imp->_appInstances.empty() );
+
+    if ( Natron::RenderProfiler::isRecording() ) {
+        std::string traceFilePath = Natron::RenderProfiler::getTraceFilePath();
+        if ( Natron::RenderProfiler::stop() ) {
+            std::cout << QObject::tr("Renders profile written to ").toStdString() << traceFilePath << std::endl;
+        } else {
+            std::cout << QObject::tr("Could not write the renders profile to ").toStdString() << traceFilePath << std::endl;
+        }
+    }
+    
+    ///Before the caches are saved, which empties their memory portion
+    if (printCachesStatisticsOnExit) {
+        printCachesStatistics(std::cout,10);
+    }
     
     for (PluginsMap::iterator it = _imp->_plugins.begin(); it != _imp->_plugins.end(); ++it) {
         for (PluginMajorsOrdered::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
@@ -530,6 +589,12 @@ AppManager::loadInternal(const QString & projectFilename,
     _imp->_nodeCache.reset( new Cache<Image>("NodeCache",NATRON_CACHE_VERSION, maxCacheRAM - playbackSize,1.) );
     _imp->_diskCache.reset( new Cache<Image>("DiskCache",NATRON_CACHE_VERSION, maxDiskCacheNode,0.) );
     _imp->_viewerCache.reset( new Cache<FrameEntry>("ViewerCache",NATRON_CACHE_VERSION,viewerCacheSize,(double)playbackSize / (double)viewerCacheSize) );
+    _imp->_nodeCache->setEvictionPolicy( _imp->_settings->getNodeCacheEvictionPolicy() );
+    _imp->_viewerCache->setEvictionPolicy( _imp->_settings->getViewerCacheEvictionPolicy() );
+    if ( _imp->_settings->isDiskCacheSharedBetweenProcesses() ) {
+        _imp->_nodeCache->setSharedBetweenProcesses(true);
+        _imp->_diskCache->setSharedBetweenProcesses(true);
+    }
 
     setLoadingStatus( tr("Restoring the image cache...") );
     _imp->restoreCaches();
@@ -862,6 +927,18 @@ AppManager::setPlaybackCacheMaximumSize(double p)
     _imp->_viewerCache->setMaximumInMemorySize( (double)playbackSize / (double)maxDiskCacheSize );
 }
 
+void
+AppManager::setNodeCacheEvictionPolicy(Natron::CacheEvictionPolicyEnum policy)
+{
+    _imp->_nodeCache->setEvictionPolicy(policy);
+}
+
+void
+AppManager::setViewerCacheEvictionPolicy(Natron::CacheEvictionPolicyEnum policy)
+{
+    _imp->_viewerCache->setEvictionPolicy(policy);
+}
+
 void
 AppManager::loadAllPlugins()
 {
@@ -1365,6 +1442,37 @@ AppManager::getCachesTotalMemorySize() const
     return _imp->_viewerCache->getMemoryCacheSize() + _imp->_nodeCache->getMemoryCacheSize();
 }
 
+void
+AppManager::getCachesStatistics(std::list<Natron::CacheStatistics>* stats) const
+{
+    stats->resize(3);
+    std::list<Natron::CacheStatistics>::iterator it = stats->begin();
+    _imp->_nodeCache->getStatistics(&*it);
+    ++it;
+    _imp->_diskCache->getStatistics(&*it);
+    ++it;
+    _imp->_viewerCache->getStatistics(&*it);
+}
+
+void
+AppManager::resetCachesStatistics()
+{
+    _imp->_nodeCache->resetStatistics();
+    _imp->_diskCache->resetStatistics();
+    _imp->_viewerCache->resetStatistics();
+}
+
+void
+AppManager::printCachesStatistics(std::ostream & stream,
+                                  int maxNodesCount) const
+{
+    std::list<Natron::CacheStatistics> stats;
+    getCachesStatistics(&stats);
+    for (std::list<Natron::CacheStatistics>::iterator it = stats.begin(); it != stats.end(); ++it) {
+        it->print(stream,maxNodesCount);
+    }
+}
+
 Natron::CacheSignalEmitter*
 AppManager::getOrActivateViewerCacheSignalEmitter() const
 {
@@ -1412,36 +1520,14 @@ AppManager::registerEngineMetaTypes() const
 template <typename T>
 void saveCache(Natron::Cache<T>* cache)
 {
-    std::ofstream ofile;
-    ofile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    std::string cacheRestoreFilePath = cache->getRestoreFilePath();
-    try {
-        ofile.open(cacheRestoreFilePath.c_str(),std::ofstream::out);
-    } catch (const std::ofstream::failure & e) {
-        qDebug() << "Exception occured when opening file " <<  cacheRestoreFilePath.c_str() << ": " << e.what();
-        
-        return;
-    }
+    std::vector<Natron::CacheTOCFile::Entry> toc;
+    Natron::CacheTOCFile::SegmentTags segments;
+    cache->save(&toc,&segments);
     
-    if ( !ofile.good() ) {
+    std::string cacheRestoreFilePath = cache->getRestoreFilePath();
+    if ( !Natron::CacheTOCFile::write(cacheRestoreFilePath,cache->cacheVersion(),segments,&toc) ) {
         qDebug() << "Failed to save cache to " << cacheRestoreFilePath.c_str();
-        
-        return;
     }
-    
-    typename Natron::Cache<T>::CacheTOC toc;
-    cache->save(&toc);
-    unsigned int version = cache->cacheVersion();
-    try {
-        boost::archive::binary_oarchive oArchive(ofile);
-        oArchive << version;
-        oArchive << toc;
-    } catch (const std::exception & e) {
-        qDebug() << "Failed to serialize the cache table of contents: " << e.what();
-    }
-    
-    ofile.close();
-
 }
 
 void
@@ -1476,49 +1562,18 @@ template <typename T>
 void restoreCache(AppManagerPrivate* p,Natron::Cache<T>* cache)
 {
     if ( p->checkForCacheDiskStructure( cache->getCachePath() ) ) {
-        std::ifstream ifile;
-        std::string settingsFilePath = cache->getRestoreFilePath();
-        try {
-            ifile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-            ifile.open(settingsFilePath.c_str(),std::ifstream::in);
-        } catch (const std::ifstream::failure & e) {
-            qDebug() << "Failed to open the cache restoration file: " << e.what();
-            
-            return;
-        }
+        ///Only the header is read here, the entries are restored the first time they are looked up
+        boost::shared_ptr<Natron::CacheTOCFile> tableOfContents =
+            Natron::CacheTOCFile::open(cache->getRestoreFilePath(),cache->cacheVersion());
         
-        if ( !ifile.good() ) {
-            qDebug() << "Failed to cache file for restoration: " <<  settingsFilePath.c_str();
-            ifile.close();
+        //Only load caches with same version, otherwise wipe it!
+        if (!tableOfContents) {
+            qDebug() << "The cache table of contents is invalid or was saved by another version, wiping the cache.";
+            p->cleanUpCacheDiskStructure(cache->getCachePath());
             
             return;
         }
         
-        typename Natron::Cache<T>::CacheTOC tableOfContents;
-        unsigned int cacheVersion = 0x1; //< default to 1 before NATRON_CACHE_VERSION was introduced
-        try {
-            boost::archive::binary_iarchive iArchive(ifile);
-            if (cache->cacheVersion() >= NATRON_CACHE_VERSION) {
-                iArchive >> cacheVersion;
-            }
-            //Only load caches with same version, otherwise wipe it!
-            if (cacheVersion == cache->cacheVersion()) {
-                iArchive >> tableOfContents;
-            } else {
-                p->cleanUpCacheDiskStructure(cache->getCachePath());
-            }
-        } catch (const std::exception & e) {
-            qDebug() << e.what();
-            ifile.close();
-            
-            return;
-        }
-        
-        ifile.close();
-        
-        QFile restoreFile( settingsFilePath.c_str() );
-        restoreFile.remove();
-        
         cache->restore(tableOfContents);
     }
 }
@@ -1565,10 +1620,10 @@ AppManagerPrivate::restoreCaches()
     //            _nodeCache->restore(tableOfContents);
     //        }
     //    }
-    if (!appPTR->isBackground()) {
-        restoreCache<FrameEntry>(this, _viewerCache.get());
-        restoreCache<Image>(this, _diskCache.get());
-    }
+    ///Restoring is cheap, background processes restore the caches too so that they benefit from the images
+    ///rendered by previous sessions
+    restoreCache<FrameEntry>(this, _viewerCache.get());
+    restoreCache<Image>(this, _diskCache.get());
 } // restoreCaches
 
 bool
@@ -1582,38 +1637,6 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath)
 
         return false;
     }
-    QDir directory(cachePath);
-    QStringList files = directory.entryList(QDir::AllDirs);
-
-
-    /*Now counting actual data files in the cache*/
-    /*check if there's 256 subfolders, otherwise reset cache.*/
-    int count = 0; // -1 because of the restoreFile
-    int subFolderCount = 0;
-    for (int i = 0; i < files.size(); ++i) {
-        QString subFolder(cachePath);
-        subFolder.append( QDir::separator() );
-        subFolder.append(files[i]);
-        if ( ( subFolder.right(1) == QString(".") ) || ( subFolder.right(2) == QString("..") ) ) {
-            continue;
-        }
-        QDir d(subFolder);
-        if ( d.exists() ) {
-            ++subFolderCount;
-            QStringList items = d.entryList();
-            for (int j = 0; j < items.size(); ++j) {
-                if ( ( items[j] != QString(".") ) && ( items[j] != QString("..") ) ) {
-                    ++count;
-                }
-            }
-        }
-    }
-    if (subFolderCount < 256) {
-        qDebug() << cachePath << " doesn't contain sub-folders indexed from 00 to FF. Reseting.";
-        cleanUpCacheDiskStructure(cachePath);
-
-        return false;
-    }
 
     return true;
 }
@@ -1633,23 +1656,6 @@ AppManagerPrivate::cleanUpCacheDiskStructure(const QString & cachePath)
     }
 #endif
     cacheFolder.mkpath(".");
-
-    QStringList etr = cacheFolder.entryList(QDir::NoDotAndDotDot);
-    // if not 256 subdirs, we re-create the cache
-    if (etr.size() < 256) {
-        foreach(QString e, etr) {
-            cacheFolder.rmdir(e);
-        }
-    }
-    for (U32 i = 0x00; i <= 0xF; ++i) {
-        for (U32 j = 0x00; j <= 0xF; ++j) {
-            std::ostringstream oss;
-            oss << std::hex <<  i;
-            oss << std::hex << j;
-            std::string str = oss.str();
-            cacheFolder.mkdir( str.c_str() );
-        }
-    }
 }
 
 void
@@ -1815,6 +1821,48 @@ AppManager::getTotalNodesMemoryRegistered() const
     return _imp->_nodesGlobalMemoryUse;
 }
 
+void
+AppManager::notifyRenderMemoryAllocated(std::size_t nBytes)
+{
+    boost::shared_ptr<RenderMemoryCounter> counter = getThreadRenderMemoryCounter();
+
+    if (counter) {
+        counter->notifyAllocated(nBytes);
+    }
+}
+
+void
+AppManager::notifyRenderMemoryFreed(std::size_t nBytes)
+{
+    boost::shared_ptr<RenderMemoryCounter> counter = getThreadRenderMemoryCounter();
+
+    if (counter) {
+        counter->notifyFreed(nBytes);
+    }
+}
+
+void
+AppManager::setThreadRenderMemoryCounter(const boost::shared_ptr<RenderMemoryCounter> & counter)
+{
+    _imp->renderMemoryCounters.setLocalData(counter);
+}
+
+boost::shared_ptr<RenderMemoryCounter>
+AppManager::getThreadRenderMemoryCounter() const
+{
+    if ( !_imp->renderMemoryCounters.hasLocalData() ) {
+        return boost::shared_ptr<RenderMemoryCounter>();
+    }
+
+    return _imp->renderMemoryCounters.localData();
+}
+
+std::size_t
+AppManager::getRenderMemoryBudget() const
+{
+    return _imp->_nodeCache->getMaximumMemorySize();
+}
+
 QString
 AppManager::getOfxLog_mt_safe() const
 {
@@ -11,6 +11,9 @@
 #ifndef NATRON_GLOBAL_APPMANAGER_H_
 #define NATRON_GLOBAL_APPMANAGER_H_
 
+#include <list>
+#include <ostream>
+
 #include "Global/GlobalDefines.h"
 CLANG_DIAG_OFF(deprecated)
 // /usr/include/qt5/QtCore/qgenericatomic.h:177:13: warning: 'register' storage class specifier is deprecated [-Wdeprecated]
@@ -39,6 +42,7 @@ class Settings;
 class KnobHolder;
 class NodeSerialization;
 class KnobSerialization;
+class RenderMemoryCounter;
 
 namespace Natron {
 class Node;
@@ -52,6 +56,7 @@ class FrameParams;
 class FrameEntry;
 class Plugin;
 class CacheSignalEmitter;
+struct CacheStatistics;
 
 enum AppInstanceStatusEnum
 {
@@ -193,6 +198,37 @@ public:
 
     U64 getCachesTotalMemorySize() const;
 
+    /**
+     * @brief Returns the statistics of the node cache, the disk cache (of the DiskCache nodes) and the viewer cache,
+     * in this order. See Natron::Cache::getStatistics()
+     **/
+    void getCachesStatistics(std::list<Natron::CacheStatistics>* stats) const;
+
+    void resetCachesStatistics();
+
+    ///Writes the statistics of the caches with those of the maxNodesCount nodes with the most bytes in each cache
+    void printCachesStatistics(std::ostream & stream,int maxNodesCount) const;
+
+    /**
+     * @brief Called whenever memory is allocated for a render: the images and the viewer textures allocated in the RAM,
+     * the tiles of the tiled images and the memory registered by the plug-ins. The memory is accounted to the
+     * RenderMemoryCounter of the calling thread, if any. This is MT-safe.
+     **/
+    void notifyRenderMemoryAllocated(std::size_t nBytes);
+
+    ///Same as notifyRenderMemoryAllocated() when the memory is freed
+    void notifyRenderMemoryFreed(std::size_t nBytes);
+
+    ///The counter of the frame rendered by the calling thread, set by RenderMemoryCounterSetter
+    void setThreadRenderMemoryCounter(const boost::shared_ptr<RenderMemoryCounter> & counter);
+    boost::shared_ptr<RenderMemoryCounter> getThreadRenderMemoryCounter() const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief The memory the frames rendered in parallel may use: the in-memory portion of the node cache.
+     * Beyond that the images of a frame evict those of the other frames before they are used.
+     **/
+    std::size_t getRenderMemoryBudget() const WARN_UNUSED_RETURN;
+
     Natron::CacheSignalEmitter* getOrActivateViewerCacheSignalEmitter() const;
 
     void setApplicationsCachesMaximumMemoryPercent(double p);
@@ -202,6 +238,10 @@ public:
     void setApplicationsCachesMaximumDiskSpace(unsigned long long size);
 
     void setPlaybackCacheMaximumSize(double p);
+    
+    void setNodeCacheEvictionPolicy(Natron::CacheEvictionPolicyEnum policy);
+    
+    void setViewerCacheEvictionPolicy(Natron::CacheEvictionPolicyEnum policy);
 
     void removeFromNodeCache(const boost::shared_ptr<Natron::Image> & image);
     void removeFromViewerCache(const boost::shared_ptr<Natron::FrameEntry> & texture);
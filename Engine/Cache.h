@@ -19,6 +19,7 @@
 #include <list>
 #include <cstddef>
 #include <utility>
+#include <algorithm>
 
 #include "Global/GlobalDefines.h"
 #include "Global/MemoryInfo.h"
@@ -26,6 +27,8 @@ CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QMutexLocker>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QObject>
 #include <QtCore/QTextStream>
 #include <QtCore/QBuffer>
@@ -34,6 +37,7 @@ CLANG_DIAG_OFF(deprecated)
 CLANG_DIAG_ON(deprecated)
 #ifndef Q_MOC_RUN
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 CLANG_DIAG_OFF(unused-parameter)
 // /opt/local/include/boost/serialization/smart_cast.hpp:254:25: warning: unused parameter 'u' [-Wunused-parameter]
 #include <boost/archive/binary_iarchive.hpp>
@@ -53,17 +57,28 @@ CLANG_DIAG_ON(unused-parameter)
 #include "Engine/FrameEntrySerialization.h"
 #include "Engine/FrameParamsSerialization.h"
 #include "Engine/CacheEntry.h"
+#include "Engine/CacheSegmentStore.h"
+#include "Engine/CacheTOCFile.h"
+#include "Engine/CacheSharedIndex.h"
 #include "Engine/LRUHashTable.h"
+#include "Engine/CacheEvictionPolicy.h"
+#include "Engine/CacheStatistics.h"
 #include "Engine/StandardPaths.h"
 #include "Engine/ImageLocker.h"
+#include "Engine/Timer.h"
 #include "Global/MemoryInfo.h"
 
-#define SERIALIZED_ENTRY_INTRODUCES_SIZE 2
-#define SERIALIZED_ENTRY_VERSION SERIALIZED_ENTRY_INTRODUCES_SIZE
-
 //Beyond that percentage of occupation, the cache will start evicting LRU entries
 #define NATRON_CACHE_LIMIT_PERCENT 0.9
 
+///The cache is split into this many buckets, each protected by its own lock. The bucket of an entry
+///is selected from its hash key so that concurrent look-ups of different entries do not contend.
+#define NATRON_CACHE_BUCKETS_COUNT 256
+
+///Maximum number of entries waiting to be written to the disk portion of the cache. Threads evicting
+///entries from the memory portion block when the write-back queue is full.
+#define NATRON_CACHE_WRITE_BACK_QUEUE_SIZE 32
+
 ///When defined, number of opened files, memory size and disk size of the cache are printed whenever there's activity.
 //#define NATRON_DEBUG_CACHE
 
@@ -184,6 +199,244 @@ private:
     }
 };
 
+
+template <typename EntryType>
+class Cache;
+
+/**
+ * @brief Entries evicted from the memory portion of the cache that have a backing file are moved right away
+ * to the disk portion, but the expensive part of the move (writing the memory mapping to the file and
+ * releasing it) is done by this thread so that the rendering thread which triggered the eviction does not stall.
+ * Queued entries are written by batches, sorted by their location in the segment files: entries that are
+ * contiguous in a segment are written with a single sequential write.
+ * The queue is bounded: appendToQueue() blocks while it is full.
+ **/
+template <typename EntryType>
+class WriteBackThread : public QThread
+{
+    typedef boost::shared_ptr<EntryType> EntryTypePtr;
+    
+    struct DiskLocation
+    {
+        int segment;
+        std::size_t offset;
+        std::size_t length;
+        std::size_t index; //< of the entry in the batch
+        
+        bool operator<(const DiskLocation& other) const
+        {
+            return segment < other.segment || (segment == other.segment && offset < other.offset);
+        }
+    };
+    
+    mutable QMutex _queueMutex; //< protects all members below except _cache
+    std::list<EntryTypePtr> _queue;
+    int _queueDepth; //< number of entries in _queue and being written
+    std::size_t _queueBytes; //< size of the entries in _queue and being written
+    QWaitCondition _queueNotEmptyCond;
+    QWaitCondition _queueNotFullCond;
+    QWaitCondition _queueEmptyCond;
+    bool _mustQuit;
+    
+    U64 _bytesWritten;
+    double _timeSpentWriting; //< in seconds
+    
+    const Cache<EntryType>* _cache;
+    
+public:
+    
+    WriteBackThread(const Cache<EntryType>* cache)
+    : QThread()
+    , _queueMutex()
+    , _queue()
+    , _queueDepth(0)
+    , _queueBytes(0)
+    , _queueNotEmptyCond()
+    , _queueNotFullCond()
+    , _queueEmptyCond()
+    , _mustQuit(false)
+    , _bytesWritten(0)
+    , _timeSpentWriting(0.)
+    , _cache(cache)
+    {
+        setObjectName("CacheWriteBack");
+    }
+    
+    virtual ~WriteBackThread() {}
+    
+    /**
+     * @brief Queues entries whose memory must be written to their backing file. This blocks while the queue is full.
+     * No lock of the cache must be taken by the caller.
+     **/
+    void appendToQueue(const std::list<EntryTypePtr>& entries)
+    {
+        if ( entries.empty() ) {
+            return;
+        }
+        
+        {
+            QMutexLocker k(&_queueMutex);
+            for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                while (_queueDepth >= NATRON_CACHE_WRITE_BACK_QUEUE_SIZE && !_mustQuit) {
+                    _queueNotFullCond.wait(&_queueMutex);
+                }
+                _queue.push_back(*it);
+                ++_queueDepth;
+                _queueBytes += (*it)->size();
+            }
+            _queueNotEmptyCond.wakeOne();
+            
+            ///Started under the mutex so that quitThread() cannot miss the thread while entries are queued
+            if ( !isRunning() ) {
+                start();
+            }
+        }
+    }
+    
+    /**
+     * @brief Blocks until all queued entries have been written to disk.
+     **/
+    void waitForQueueEmpty()
+    {
+        QMutexLocker k(&_queueMutex);
+        while (_queueDepth > 0) {
+            _queueEmptyCond.wait(&_queueMutex);
+        }
+    }
+    
+    /**
+     * @brief Writes all entries left in the queue and stops the thread.
+     **/
+    void quitThread()
+    {
+        {
+            QMutexLocker k(&_queueMutex);
+            _mustQuit = true;
+            if ( !isRunning() ) {
+                if ( _queue.empty() ) {
+                    return;
+                }
+                ///The thread exits once the queue is empty
+                start();
+            }
+            _queueNotEmptyCond.wakeOne();
+        }
+        wait();
+    }
+    
+    /**
+     * @brief Returns the number of entries waiting to be written, including the ones being written.
+     **/
+    int getQueueDepth() const
+    {
+        QMutexLocker k(&_queueMutex);
+        return _queueDepth;
+    }
+    
+    /**
+     * @brief Returns the size in bytes of the entries waiting to be written, including the ones being written.
+     **/
+    std::size_t getQueueBytes() const
+    {
+        QMutexLocker k(&_queueMutex);
+        return _queueBytes;
+    }
+    
+    U64 getBytesWritten() const
+    {
+        QMutexLocker k(&_queueMutex);
+        return _bytesWritten;
+    }
+    
+    /**
+     * @brief Returns the average write bandwidth, in bytes per second, of the time spent writing entries.
+     **/
+    double getBandwidth() const
+    {
+        QMutexLocker k(&_queueMutex);
+        return _timeSpentWriting > 0. ? _bytesWritten / _timeSpentWriting : 0.;
+    }
+    
+private:
+    
+    virtual void run() OVERRIDE FINAL
+    {
+        for (;;) {
+            std::vector<EntryTypePtr> batch;
+            {
+                QMutexLocker k(&_queueMutex);
+                while (_queue.empty() && !_mustQuit) {
+                    _queueNotEmptyCond.wait(&_queueMutex);
+                }
+                if ( _queue.empty() ) {
+                    return;
+                }
+                batch.insert( batch.end(), _queue.begin(), _queue.end() );
+                _queue.clear();
+            }
+            
+            std::vector<DiskLocation> locations;
+            std::size_t batchBytes = 0;
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                batchBytes += batch[i]->size();
+                DiskLocation loc;
+                batch[i]->getDiskLocation(&loc.segment,&loc.offset,&loc.length);
+                loc.index = i;
+                if (loc.segment != -1) {
+                    locations.push_back(loc);
+                }
+            }
+            std::sort( locations.begin(), locations.end() );
+            
+            TimeLapse timer;
+            std::vector<bool> flushed(batch.size(), false);
+            boost::shared_ptr<CacheSegmentStore> store = _cache->getSegmentStore();
+            typename std::vector<DiskLocation>::iterator locIt = locations.begin();
+            while ( store && locIt != locations.end() ) {
+                ///Merge the regions that are contiguous (up to the alignment of the segments) into a single write
+                typename std::vector<DiskLocation>::iterator runBegin = locIt;
+                DiskLocation run = *locIt;
+                std::size_t runEnd = run.offset + run.length;
+                for (++locIt; locIt != locations.end(); ++locIt) {
+                    if ( locIt->segment != run.segment || locIt->offset > runEnd + NATRON_CACHE_SEGMENT_ALIGNMENT ) {
+                        break;
+                    }
+                    runEnd = std::max(runEnd, locIt->offset + locIt->length);
+                }
+                if ( store->flush(run.segment, run.offset, runEnd - run.offset) ) {
+                    for (; runBegin != locIt; ++runBegin) {
+                        flushed[runBegin->index] = true;
+                    }
+                } else {
+                    qDebug() << "Failed to flush cache entries to the segment file " << run.segment;
+                }
+            }
+            double elapsed = timer.getTimeSinceCreation();
+            
+            ///Now that the data is on disk, releasing the memory is cheap. The entries whose run could not be flushed
+            ///are synced again one by one.
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                _cache->onEntryWrittenBack(batch[i],flushed[i]);
+            }
+            
+            {
+                QMutexLocker k(&_queueMutex);
+                _queueDepth -= (int)batch.size();
+                ///Entries may have been resized after being queued if they were reused in the meantime
+                _queueBytes = (batchBytes > _queueBytes || _queueDepth == 0) ? 0 : _queueBytes - batchBytes;
+                _bytesWritten += batchBytes;
+                _timeSpentWriting += elapsed;
+                _queueNotFullCond.wakeAll();
+                if (_queueDepth == 0) {
+                    _queueEmptyCond.wakeAll();
+                }
+            }
+            
+            ///Wake-up threads waiting for memory to be released in getOrCreate()
+            _cache->notifyMemoryDeallocated();
+        }
+    }
+};
     
 class CacheSignalEmitter
     : public QObject
@@ -255,52 +508,7 @@ public:
     typedef typename EntryType::param_t param_t;
     typedef boost::shared_ptr<param_t> ParamsTypePtr;
     typedef boost::shared_ptr<EntryType> EntryTypePtr;
- 
-    struct SerializedEntry
-    {
-        hash_type hash;
-        typename EntryType::key_type key;
-        ParamsTypePtr params;
-        std::size_t size; //< the data size in bytes
-        std::string filePath; //< we need to serialize it as several entries can have the same hash, hence we index them
-        
-        SerializedEntry()
-        : hash(0)
-        , key()
-        , params()
-        , size(0)
-        , filePath()
-        {
-            
-        }
-
-        template<class Archive>
-        void save(Archive & ar,
-                       const unsigned int /*version*/) const
-        {
-            ar & boost::serialization::make_nvp("Hash",hash);
-            ar & boost::serialization::make_nvp("Key",key);
-            ar & boost::serialization::make_nvp("Params",params);
-            ar & boost::serialization::make_nvp("Size",size);
-            ar & boost::serialization::make_nvp("Filename",filePath);
-        }
-        
-        template<class Archive>
-        void load(Archive & ar,
-                       const unsigned int /*version*/)
-        {
-            ar & boost::serialization::make_nvp("Hash",hash);
-            ar & boost::serialization::make_nvp("Key",key);
-            ar & boost::serialization::make_nvp("Params",params);
-            ar & boost::serialization::make_nvp("Size",size);
-            ar & boost::serialization::make_nvp("Filename",filePath);
-        }
-        
-        BOOST_SERIALIZATION_SPLIT_MEMBER()
-
-    };
-
-    typedef std::list< SerializedEntry > CacheTOC;
+    typedef CacheEvictionPolicyI<EntryType> EvictionPolicy;
 
 public:
 
@@ -366,7 +574,33 @@ public:
 #endif // USE_VARIADIC_TEMPLATES
 
 private:
-
+    
+    /**
+     * @brief A bucket holds the portion of the cache whose entries hash into it. Each bucket has its own LRU containers
+     * and its own locks so that threads looking up entries with different hash keys never wait for each other.
+     * Entries sharing the same hash key always live in the same bucket, for both the memory and disk portions.
+     **/
+    struct CacheBucket
+    {
+        QReadWriteLock lock; //< protects memoryCache & diskCache. Cache hits only take it for reading
+        QMutex getLock; //< prevents get() and getOrCreate() to be called simultaneously for entries of this bucket
+        CacheContainer memoryCache;
+        CacheContainer diskCache;
+        boost::scoped_ptr<EvictionPolicy> policy; //< selects which entry of memoryCache to evict
+        QMutex statsLock; //< protects stats, it may be taken while lock is taken but not the other way around
+        Natron::CacheStatistics stats; //< the counters of the entries of this bucket, merged by getStatistics()
+        
+        CacheBucket()
+        : lock()
+        , getLock()
+        , memoryCache()
+        , diskCache()
+        , policy( createCacheEvictionPolicy<EntryType>(Natron::eCacheEvictionPolicyLRU) )
+        , statsLock()
+        , stats()
+        {
+        }
+    };
 
     std::size_t _maximumInMemorySize;     // the maximum size of the in-memory portion of the cache.(in % of the maximum cache size)
     std::size_t _maximumCacheSize;     // maximum size allowed for the cache
@@ -378,14 +612,14 @@ private:
     mutable std::size_t _diskCacheSize;
     mutable QMutex _sizeLock; // protects _memoryCacheSize & _diskCacheSize & _maximumInMemorySize & _maximumCacheSize
     
-    mutable QMutex _lock; //protects _memoryCache & _diskCache
-
-    mutable QMutex _getLock;  //prevents get() and getOrCreate() to be called simultaneously
-
-    /*These 2 are mutable because we need to modify the LRU list even
+    /*mutable because we need to modify the LRU list even
          when we call get() and we want this function to be const.*/
-    mutable CacheContainer _memoryCache;
-    mutable CacheContainer _diskCache;
+    mutable CacheBucket _buckets[NATRON_CACHE_BUCKETS_COUNT];
+    
+    ///The bucket from which the next LRU eviction will start, incremented on every eviction
+    ///so that evictions are spread over all buckets
+    mutable QAtomicInt _evictionCursor;
+    
     const std::string _cacheName;
     const unsigned int _version;
 
@@ -401,6 +635,27 @@ private:
     mutable Natron::DeleterThread<EntryType> _deleterThread;
     mutable QWaitCondition _memoryFullCondition; //< protected by _sizeLock
     
+    ///Writes the entries moved from the memory portion to the disk portion to their backing file
+    mutable Natron::WriteBackThread<EntryType> _writeBackThread;
+    friend class Natron::WriteBackThread<EntryType>;
+    
+    ///Holds the data of the entries stored on disk, created the first time it is needed.
+    ///Entries keep a reference to it so it may outlive the cache.
+    mutable boost::shared_ptr<CacheSegmentStore> _segmentStore;
+    mutable QMutex _segmentStoreMutex; //< protects _segmentStore
+    
+    ///The table of contents of the previous session, entries are restored from it the first time they are looked up
+    mutable boost::shared_ptr<CacheTOCFile> _tableOfContents;
+    mutable QMutex _tableOfContentsMutex; //< protects _tableOfContents
+    
+    ///When true, the entries written to the disk portion are published in a shared index so that other processes using
+    ///the same cache directory can read them, and conversely
+    bool _sharedBetweenProcesses;
+    mutable boost::shared_ptr<CacheSharedIndex> _sharedIndex; //< created along with the segment store
+    
+    ///The clock of the insertion time of the entries, to compute their lifetime in the statistics
+    TimeLapse _clock;
+    
 public:
 
 
@@ -417,10 +672,7 @@ public:
           ,_memoryCacheSize(0)
           ,_diskCacheSize(0)
           ,_sizeLock()
-          ,_lock()
-          , _getLock()
-          ,_memoryCache()
-          ,_diskCache()
+          ,_evictionCursor(0)
           ,_cacheName(cacheName)
           ,_version(version)
           ,_signalEmitter(new CacheSignalEmitter)
@@ -428,23 +680,63 @@ public:
           ,_tearingDown(false)
           ,_deleterThread(this)
           ,_memoryFullCondition()
+          ,_writeBackThread(this)
+          ,_segmentStore()
+          ,_segmentStoreMutex()
+          ,_tableOfContents()
+          ,_tableOfContentsMutex()
+          ,_sharedBetweenProcesses(false)
+          ,_sharedIndex()
+          ,_clock()
     {
     }
 
     virtual ~Cache()
     {
-        QMutexLocker locker(&_lock);
+        _writeBackThread.quitThread();
         _tearingDown = true;
-        _memoryCache.clear();
-        _diskCache.clear();
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            QWriteLocker locker(&_buckets[i].lock);
+            _buckets[i].memoryCache.clear();
+            _buckets[i].diskCache.clear();
+        }
         delete _signalEmitter;
         
     }
     
     void waitForDeleterThread()
     {
+        _writeBackThread.quitThread();
         _deleterThread.quitThread();
     }
+    
+    /**
+     * @brief Changes the policy used to select which entries are evicted from the in-memory portion.
+     * What was learnt by the previous policy (if anything) is lost.
+     **/
+    void setEvictionPolicy(Natron::CacheEvictionPolicyEnum type)
+    {
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            QWriteLocker locker(&_buckets[i].lock);
+            if (_buckets[i].policy->getType() != type) {
+                _buckets[i].policy.reset( createCacheEvictionPolicy<EntryType>(type) );
+            }
+        }
+    }
+    
+    Natron::CacheEvictionPolicyEnum getEvictionPolicy() const
+    {
+        QReadLocker locker(&_buckets[0].lock);
+        return _buckets[0].policy->getType();
+    }
+    
+    /**
+     * @brief Returns the index of the bucket in which the entries with the given hash key are stored.
+     **/
+    static int getBucketIndex(hash_type hash)
+    {
+        return (int)( (hash >> 56) % NATRON_CACHE_BUCKETS_COUNT );
+    }
 
     /**
      * @brief Look-up the cache for an entry whose key matches the params.
@@ -460,13 +752,33 @@ public:
     bool get(const typename EntryType::key_type & key,
              std::list<EntryTypePtr>* returnValue) const
     {
+        CacheBucket & bucket = _buckets[getBucketIndex( key.getHash() )];
+        
+        ///Fast path: a hit in the memory portion only needs the bucket for reading
+        {
+            QReadLocker readLocker(&bucket.lock);
+            if ( getFromMemoryInternal(bucket,key,returnValue) ) {
+                returnValue->back()->addStatisticsHit();
+                return true;
+            }
+        }
+        
+        bool reopenedFromDisk = false;
+        bool ret;
+        {
+            ///Be atomic, so it cannot be created by another thread in the meantime
+            QMutexLocker getlocker(&bucket.getLock);
 
-        ///Be atomic, so it cannot be created by another thread in the meantime
-        QMutexLocker getlocker(&_getLock);
-
-        ///lock the cache before reading it.
-        QMutexLocker locker(&_lock);
-        return getInternal(key,returnValue);
+            ///lock the bucket before reading it.
+            QWriteLocker locker(&bucket.lock);
+            ret = getInternal(bucket,key,returnValue,&reopenedFromDisk);
+            recordLookup(bucket,key,ret,reopenedFromDisk);
+        }
+        if (reopenedFromDisk) {
+            ///now clear extra entries from the other buckets so it doesn't exceed the RAM limit.
+            clearExceedingEntries();
+        }
+        return ret;
         
     } // get
     
@@ -479,17 +791,11 @@ public:
                     EntryTypePtr* returnValue) const
     {
         
-        ///Be atomic, so it cannot be created by another thread in the meantime
-        QMutexLocker getlocker(&_getLock);
-        
-        ///lock the cache before reading it.
         std::list<EntryTypePtr> entries;
-        {
-            QMutexLocker locker(&_lock);
-            return getInternal(key,entries);
+        if ( !get(key,&entries) ) {
+            return false;
         }
         
-        
         for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
             if (*(*it)->getParams() == *params) {
                 *returnValue = *it;
@@ -502,30 +808,17 @@ public:
 
 private:
     
-    void createInternal(const typename EntryType::key_type & key,
-                const ParamsTypePtr& params,
-                ImageLockerHelper<EntryType>* imageLocker,
-                EntryTypePtr* returnValue) const
+    void createInternal(CacheBucket & bucket,
+                        const typename EntryType::key_type & key,
+                        const ParamsTypePtr& params,
+                        ImageLockerHelper<EntryType>* imageLocker,
+                        EntryTypePtr* returnValue) const
     {
-        //_lock must not be taken here
+        //bucket.lock must not be taken here
         
         ///Before allocating the memory check that there's enough space to fit in memory
         appPTR->checkCacheFreeMemoryIsGoodEnough();
         
-        
-        ///Just in case, we don't allow more than X files to be removed at once.
-        int safeCounter = 0;
-        ///If too many files are opened, fall-back on RAM storage.
-        while ( appPTR->isNCacheFilesOpenedCapped() && safeCounter < 1000 ) {
-#ifdef NATRON_DEBUG_CACHE
-            qDebug() << "Reached maximum cache files opened limit,clearing last recently used one...";
-#endif
-            if ( !evictLRUDiskEntry() ) {
-                break;
-            }
-            ++safeCounter;
-        }
-        
         U64 memoryCacheSize,maximumInMemorySize;
         {
             QMutexLocker k(&_sizeLock);
@@ -534,24 +827,17 @@ private:
             
         }
         {
-            QMutexLocker locker(&_lock);
             std::list<EntryTypePtr> entriesToBeDeleted;
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             ///While the current cache size can't fit the new entry, erase the last recently used entries.
             ///Also if the total free RAM is under the limit of the system free RAM to keep free, erase LRU entries.
             while (occupationPercentage > NATRON_CACHE_LIMIT_PERCENT) {
                 
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictEntry(deleted) ) {
+                std::size_t memoryFreed = 0;
+                if ( !tryEvictInMemoryEntryFromAnyBucket(entriesToBeDeleted,&memoryFreed) ) {
                     break;
                 }
-                
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    if (!(*it)->isStoredOnDisk()) {
-                        memoryCacheSize -= (*it)->size();
-                    }
-                    entriesToBeDeleted.push_back(*it);
-                }
+                memoryCacheSize = memoryFreed > memoryCacheSize ? 0 : memoryCacheSize - memoryFreed;
                 
                 occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             }
@@ -573,14 +859,14 @@ private:
             
             //_memoryCacheSize member will get updated while images are being destroyed by the parallel thread.
             //we wait for cache memory occupation to be < 100% to be sure we don't hit swap here
-            while (occupationPercentage >= 1. && _deleterThread.isWorking()) {
+            while ( occupationPercentage >= 1. && ( _deleterThread.isWorking() || _writeBackThread.getQueueDepth() > 0 ) ) {
                 _memoryFullCondition.wait(&_sizeLock);
                 occupationPercentage =  _maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / _maximumCacheSize;
             }
             
         }
         {
-            QMutexLocker locker(&_lock);
+            QWriteLocker locker(&bucket.lock);
             
             Natron::StorageModeEnum storage;
             if (params->getCost() == 0) {
@@ -593,8 +879,7 @@ private:
             
             
             try {
-                returnValue->reset( new EntryType(key,params,this,storage,
-                                                  storage == Natron::eStorageModeDisk ? QString( getCachePath() + QDir::separator() ).toStdString() : std::string()) );
+                returnValue->reset( new EntryType(key,params,this,storage) );
                 
                 ///Don't call allocateMemory() here because we're still under the lock and we might force tons of threads to wait unnecesserarily
                 
@@ -607,7 +892,7 @@ private:
                 assert(imageLocker);
                 imageLocker->lock(*returnValue);
                 
-                sealEntry(*returnValue, true);
+                sealEntry(bucket, *returnValue, true);
             }
             
         }
@@ -652,28 +937,54 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         
+        CacheBucket & bucket = _buckets[getBucketIndex( key.getHash() )];
+        
+        ///Fast path: a hit in the memory portion only needs the bucket for reading
+        {
+            std::list<EntryTypePtr> entries;
+            QReadLocker readLocker(&bucket.lock);
+            if ( getFromMemoryInternal(bucket,key,&entries) ) {
+                for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                    if (*(*it)->getParams() == *params) {
+                        *returnValue = *it;
+                        (*it)->addStatisticsHit();
+                        return true;
+                    }
+                }
+            }
+        }
+        
+        bool reopenedFromDisk = false;
+        bool found = false;
         {
             ///Be atomic, so it cannot be created by another thread in the meantime
-            QMutexLocker getlocker(&_getLock);
+            QMutexLocker getlocker(&bucket.getLock);
             
             std::list<EntryTypePtr> entries;
-            bool didGetSucceed;
             {
-                QMutexLocker locker(&_lock);
-                didGetSucceed = getInternal(key,&entries);
+                QWriteLocker locker(&bucket.lock);
+                getInternal(bucket,key,&entries,&reopenedFromDisk);
             }
             
             for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
                 if (*(*it)->getParams() == *params) {
                     *returnValue = *it;
-                    return true;
+                    found = true;
+                    break;
                 }
             }
             
-            createInternal(key,params,imageLocker,returnValue);
-            return false;
+            recordLookup(bucket,key,found,found && reopenedFromDisk);
+            if (!found) {
+                createInternal(bucket,key,params,imageLocker,returnValue);
+            }
             
         } // getlocker
+        
+        if (reopenedFromDisk) {
+            clearExceedingEntries();
+        }
+        return found;
     }
     
     /**
@@ -688,13 +999,17 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type,EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            if ( evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->removeAnyBackingFile();
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            QWriteLocker locker(&bucket.lock);
+            std::pair<hash_type,EntryTypePtr> evictedFromMemory = bucket.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                recordEviction(bucket,evictedFromMemory.second,Natron::eCacheEvictionReasonCleared,true);
+                if ( evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->removeAnyBackingFile();
+                }
+                evictedFromMemory = bucket.memoryCache.evict();
             }
-            evictedFromMemory = _memoryCache.evict();
         }
 
         if (_signalEmitter) {
@@ -713,19 +1028,36 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-
-        /// An entry which has a use_count greater than 1 is not removable:
-        /// The backing file must not be removed because it might be read/written to
-        /// at the same time. The best we can do is just let it here in the cache.
-        std::pair<hash_type,EntryTypePtr> evictedFromDisk = _diskCache.evict();
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        while (evictedFromDisk.second) {
-            evictedFromDisk.second->removeAnyBackingFile();
-            evictedFromDisk = _diskCache.evict();
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            QWriteLocker locker(&bucket.lock);
+
+            /// An entry which has a use_count greater than 1 is not removable:
+            /// The backing file must not be removed because it might be read/written to
+            /// at the same time. The best we can do is just let it here in the cache.
+            std::pair<hash_type,EntryTypePtr> evictedFromDisk = bucket.diskCache.evict();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            while (evictedFromDisk.second) {
+                recordEviction(bucket,evictedFromDisk.second,Natron::eCacheEvictionReasonCleared,true);
+                evictedFromDisk.second->removeAnyBackingFile();
+                evictedFromDisk = bucket.diskCache.evict();
+            }
+        }
+        
+        ///Forget the entries of the previous session that were not restored yet, their segment files are removed
+        ///along with the other unused ones
+        bool hadTableOfContents;
+        {
+            QMutexLocker k(&_tableOfContentsMutex);
+            hadTableOfContents = _tableOfContents.get() != 0;
+            _tableOfContents.reset();
+        }
+        if (hadTableOfContents) {
+            boost::shared_ptr<CacheSegmentStore> store = getSegmentStore();
+            store->unpinSegments();
+            store->removeUnusedSegmentFiles();
         }
-
         
         _signalEmitter->blockSignals(false);
         _signalEmitter->emitClearedDiskPortion();
@@ -740,50 +1072,56 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type,EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            ///move back the entry on disk if it can be store on disk
-            if ( evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->deallocate();
-                /*insert it back into the disk portion */
-
-                U64 diskCacheSize,maximumCacheSize;
-                {
-                    QMutexLocker k(&_sizeLock);
-                    diskCacheSize = _diskCacheSize;
-                    maximumCacheSize = _maximumCacheSize;
-                }
-                
-                /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-                while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
-                    
-                    {
-                        std::pair<hash_type,EntryTypePtr> evictedFromDisk = _diskCache.evict();
-                        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-                        //we'll let the user of these entries purge the extra entries left in the cache later on
-                        if (!evictedFromDisk.second) {
-                            break;
-                        }
-                        ///Erase the file from the disk if we reach the limit.
-                        evictedFromDisk.second->removeAnyBackingFile();
-                    }
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            QWriteLocker locker(&bucket.lock);
+            std::pair<hash_type,EntryTypePtr> evictedFromMemory = bucket.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                recordEviction( bucket,evictedFromMemory.second,Natron::eCacheEvictionReasonCleared,
+                                !evictedFromMemory.second->isStoredOnDisk() );
+                ///move back the entry on disk if it can be store on disk
+                if ( evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->deallocate();
+                    /*insert it back into the disk portion */
+
+                    U64 diskCacheSize,maximumCacheSize;
                     {
                         QMutexLocker k(&_sizeLock);
                         diskCacheSize = _diskCacheSize;
                         maximumCacheSize = _maximumCacheSize;
                     }
-                }
+                    
+                    /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
+                    while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
+                        
+                        {
+                            std::pair<hash_type,EntryTypePtr> evictedFromDisk = bucket.diskCache.evict();
+                            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+                            //we'll let the user of these entries purge the extra entries left in the cache later on
+                            if (!evictedFromDisk.second) {
+                                break;
+                            }
+                            recordEviction(bucket,evictedFromDisk.second,Natron::eCacheEvictionReasonDiskFull,true);
+                            ///Erase the file from the disk if we reach the limit.
+                            evictedFromDisk.second->removeAnyBackingFile();
+                        }
+                        {
+                            QMutexLocker k(&_sizeLock);
+                            diskCacheSize = _diskCacheSize;
+                            maximumCacheSize = _maximumCacheSize;
+                        }
+                    }
 
-                /*update the disk cache size*/
-                CacheIterator existingDiskCacheEntry = _diskCache( evictedFromMemory.second->getHashKey() );
-                /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-                if ( existingDiskCacheEntry == _diskCache.end() ) {
-                    _diskCache.insert(evictedFromMemory.second->getHashKey(),evictedFromMemory.second);
+                    /*update the disk cache size*/
+                    CacheIterator existingDiskCacheEntry = bucket.diskCache( evictedFromMemory.second->getHashKey() );
+                    /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
+                    if ( existingDiskCacheEntry == bucket.diskCache.end() ) {
+                        bucket.diskCache.insert(evictedFromMemory.second->getHashKey(),evictedFromMemory.second);
+                    }
                 }
-            }
 
-            evictedFromMemory = _memoryCache.evict();
+                evictedFromMemory = bucket.memoryCache.evict();
+            }
         }
 
         _signalEmitter->blockSignals(false);
@@ -792,37 +1130,32 @@ public:
     
     
 
-    void clearExceedingEntries()
+    void clearExceedingEntries() const
     {
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
         
+        U64 memoryCacheSize,maximumInMemorySize;
         {
-            QMutexLocker locker(&_lock);
+            QMutexLocker k(&_sizeLock);
+            memoryCacheSize = _memoryCacheSize;
+            maximumInMemorySize = std::max((std::size_t)1,_maximumInMemorySize);
+        }
+        double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
+        while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
             
-            U64 memoryCacheSize,maximumInMemorySize;
-            {
-                QMutexLocker k(&_sizeLock);
-                memoryCacheSize = _memoryCacheSize;
-                maximumInMemorySize = std::max((std::size_t)1,_maximumInMemorySize);
-            }
-            double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
-            while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
-       
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictEntry(deleted) ) {
-                    break;
-                }
-                
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    if (!(*it)->isStoredOnDisk()) {
-                        memoryCacheSize -= (*it)->size();
-                    }
-                    entriesToBeDeleted.push_back(*it);
-                }
-                occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
+            std::size_t memoryFreed = 0;
+            if ( !tryEvictInMemoryEntryFromAnyBucket(entriesToBeDeleted,&memoryFreed) ) {
+                break;
             }
+            memoryCacheSize = memoryFreed > memoryCacheSize ? 0 : memoryCacheSize - memoryFreed;
+            occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
+        }
+        
+        if (!entriesToBeDeleted.empty()) {
+            _deleterThread.appendToQueue(entriesToBeDeleted);
+            entriesToBeDeleted.clear();
         }
     }
     
@@ -833,21 +1166,24 @@ public:
      **/
     void getCopy(std::list<EntryTypePtr>* copy) const
     {
-        QMutexLocker locker(&_lock);
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            QWriteLocker locker(&bucket.lock);
 
-        for (CacheIterator it = _memoryCache.begin(); it != _memoryCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert(copy->end(),entries.begin(),entries.end());
-        }
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert(copy->end(),entries.begin(),entries.end());
+            for (CacheIterator it = bucket.memoryCache.begin(); it != bucket.memoryCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert(copy->end(),entries.begin(),entries.end());
+            }
+            for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert(copy->end(),entries.begin(),entries.end());
+            }
         }
     }
     
     /**
-     * @brief Removes the last recently used entry from the in-memory cache.
-     * This is expensive since it takes the lock. Returns false
+     * @brief Removes from the in-memory cache the entry selected by the eviction policy,
+     * that is the last recently used entry by default. This is expensive since it takes the lock. Returns false
      * if there's nothing left to evict.
      **/
     bool evictLRUInMemoryEntry() const
@@ -855,13 +1191,9 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
+        std::size_t memoryFreed;
         
-        bool ret ;
-        {
-            QMutexLocker locker(&_lock);
-            ret = tryEvictEntry(entriesToBeDeleted);
-        }
-        return ret;
+        return tryEvictInMemoryEntryFromAnyBucket(entriesToBeDeleted,&memoryFreed);
     }
 
     /**
@@ -870,20 +1202,27 @@ public:
      * if there's nothing left to evict.
      **/
     bool evictLRUDiskEntry() const {
-        QMutexLocker locker(&_lock);
         
-        std::pair<hash_type,EntryTypePtr> evicted = _diskCache.evict();
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        if (!evicted.second) {
-            return false;
-        }
-        /*if it is stored on disk, remove it from memory*/
-        
-        assert( evicted.second.unique() );
-        evicted.second->removeAnyBackingFile();
-        
-        return true;
+        unsigned int start = (unsigned int)_evictionCursor.fetchAndAddRelaxed(1);
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[(start + i) % NATRON_CACHE_BUCKETS_COUNT];
+            QWriteLocker locker(&bucket.lock);
+            
+            std::pair<hash_type,EntryTypePtr> evicted = bucket.diskCache.evict();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            if (!evicted.second) {
+                continue;
+            }
+            /*if it is stored on disk, remove it from memory*/
+            
+            assert( evicted.second.unique() );
+            recordEviction(bucket,evicted.second,Natron::eCacheEvictionReasonDiskFull,true);
+            evicted.second->removeAnyBackingFile();
+            
+            return true;
+        }
+        return false;
     }
 
     /**
@@ -893,14 +1232,19 @@ public:
     virtual void notifyEntrySizeChanged(std::size_t oldSize,
                                         std::size_t newSize) const OVERRIDE FINAL
     {
+        ///This function can only be called for RAM buffers or while a memory mapped file is mapped into the RAM, so
+        ///we just have to modify the RAM size. This is how the tiles of tiled images are accounted when they are allocated.
+        qint64 diff = (qint64)newSize - (qint64)oldSize;
+        if (diff > 0) {
+            appPTR->notifyRenderMemoryAllocated( (std::size_t)diff );
+        } else if (diff < 0) {
+            appPTR->notifyRenderMemoryFreed( (std::size_t)-diff );
+        }
+
         ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache
         QMutexLocker k(&_sizeLock);
 
-        ///This function can only be called for RAM buffers or while a memory mapped file is mapped into the RAM, so
-        ///we just have to modify the RAM size.
-
         ///Avoid overflows, _memoryCacheSize may not always fallback to 0
-        qint64 diff = (qint64)newSize - (qint64)oldSize;
         if (diff < 0) {
             _memoryCacheSize = diff > (qint64)_memoryCacheSize ? 0 : _memoryCacheSize + diff;
         } else {
@@ -916,18 +1260,17 @@ public:
      **/
     virtual void notifyEntryAllocated(int time,
                                       std::size_t size,
-                                      Natron::StorageModeEnum storage) const OVERRIDE FINAL
+                                      Natron::StorageModeEnum /*storage*/) const OVERRIDE FINAL
     {
+        ///Entries in the disk portion are mapped in the RAM when they are allocated, as for _memoryCacheSize
+        appPTR->notifyRenderMemoryAllocated(size);
+        
         ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache, hence the
         ///lock should already be taken.
         QMutexLocker k(&_sizeLock);
         
         _memoryCacheSize += size;
         _signalEmitter->emitAddedEntry(time);
-
-        if (storage == Natron::eStorageModeDisk) {
-            appPTR->increaseNCacheFilesOpened();
-        }
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
 #endif
@@ -940,6 +1283,10 @@ public:
                                       std::size_t size,
                                       Natron::StorageModeEnum storage) const OVERRIDE FINAL
     {
+        if (storage == Natron::eStorageModeRAM) {
+            appPTR->notifyRenderMemoryFreed(size);
+        }
+        
         QMutexLocker k(&_sizeLock);
 
         if (storage == Natron::eStorageModeRAM) {
@@ -977,6 +1324,11 @@ public:
         if (_tearingDown) {
             return;
         }
+        if (oldStorage == Natron::eStorageModeRAM) {
+            appPTR->notifyRenderMemoryFreed(size);
+        } else if (newStorage == Natron::eStorageModeRAM) {
+            appPTR->notifyRenderMemoryAllocated(size);
+        }
         QMutexLocker k(&_sizeLock);
         
         assert(oldStorage != newStorage);
@@ -988,8 +1340,6 @@ public:
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
 #endif
-            ///We switched from RAM to DISK that means the MemoryFile object has been destroyed hence the file has been closed.
-            appPTR->decreaseNCacheFilesOpened();
         } else if (oldStorage == Natron::eStorageModeDisk) {
             _memoryCacheSize += size;
             _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
@@ -997,8 +1347,6 @@ public:
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
 #endif
-            ///We switched from DISK to RAM that means the MemoryFile object has been created and the file opened
-            appPTR->increaseNCacheFilesOpened();
         } else {
             if (newStorage == Natron::eStorageModeRAM) {
                 _memoryCacheSize += size;
@@ -1011,9 +1359,45 @@ public:
         
     }
 
-    virtual void backingFileClosed() const OVERRIDE FINAL
+    virtual boost::shared_ptr<CacheSegmentStore> getSegmentStore() const OVERRIDE FINAL
+    {
+        QMutexLocker k(&_segmentStoreMutex);
+        if (!_segmentStore) {
+            QString path = getCachePath();
+            QDir().mkpath(path);
+            _segmentStore.reset( new CacheSegmentStore( path.toStdString() ) );
+            if (_sharedBetweenProcesses) {
+                _segmentStore->setSharedBetweenProcesses(true);
+                _sharedIndex.reset( new CacheSharedIndex(getSharedIndexFilePath(),_version) );
+            }
+        }
+        return _segmentStore;
+    }
+    
+    virtual void notifyEntryDiskDataReleased(U64 hash,
+                                             int segment,
+                                             std::size_t offset) const OVERRIDE FINAL
+    {
+        boost::shared_ptr<CacheSharedIndex> index = getSharedIndex();
+        if (index) {
+            index->unpublish( hash, getSegmentStore()->getSegmentTag(segment), offset );
+        }
+    }
+    
+    /**
+     * @brief Shares the disk portion of the cache with the other processes using the same cache directory which called this
+     * function too, see CacheSharedIndex. This must be called before the cache is used.
+     **/
+    void setSharedBetweenProcesses(bool shared)
     {
-        appPTR->decreaseNCacheFilesOpened();
+        QMutexLocker k(&_segmentStoreMutex);
+        assert(!_segmentStore);
+        _sharedBetweenProcesses = shared;
+    }
+    
+    bool isSharedBetweenProcesses() const
+    {
+        return _sharedBetweenProcesses;
     }
 
     // const data member: no need to take the lock
@@ -1042,6 +1426,16 @@ public:
         return cacheFolderName;
     }
 
+    std::string getSharedIndexFilePath() const
+    {
+        QString newCachePath( getCachePath() );
+
+        newCachePath.append( QDir::separator() );
+        newCachePath.append("sharedIndex." NATRON_CACHE_FILE_EXT);
+
+        return newCachePath.toStdString();
+    }
+
     std::string getRestoreFilePath() const
     {
         QString newCachePath( getCachePath() );
@@ -1083,6 +1477,114 @@ public:
     {
         QMutexLocker k(&_sizeLock); return _diskCacheSize;
     }
+    
+    /**
+     * @brief Blocks until all entries moved to the disk portion have been written to their backing file.
+     **/
+    void waitForWriteBack() const
+    {
+        _writeBackThread.waitForQueueEmpty();
+    }
+    
+    /**
+     * @brief Returns the number of entries waiting to be written to the disk portion.
+     **/
+    int getWriteBackQueueDepth() const
+    {
+        return _writeBackThread.getQueueDepth();
+    }
+    
+    /**
+     * @brief Returns the memory in bytes held by the entries waiting to be written to the disk portion.
+     **/
+    std::size_t getWriteBackQueueSize() const
+    {
+        return _writeBackThread.getQueueBytes();
+    }
+    
+    /**
+     * @brief Returns the total amount of bytes written to the disk portion by the write-back thread.
+     **/
+    U64 getWriteBackBytesWritten() const
+    {
+        return _writeBackThread.getBytesWritten();
+    }
+    
+    /**
+     * @brief Returns the average write bandwidth to the disk portion in bytes per second.
+     **/
+    double getWriteBackBandwidth() const
+    {
+        return _writeBackThread.getBandwidth();
+    }
+    
+    /**
+     * @brief Returns the counters of the cache since it was created or since resetStatistics() was called, in total and
+     * by node. The bytes of a node are those of its entries in the memory and disk portions whereas the total bytes are
+     * the sizes accounted by the cache, which include the entries that are still being deleted.
+     **/
+    void getStatistics(Natron::CacheStatistics* stats) const
+    {
+        stats->cacheName = _cacheName;
+        stats->total = Natron::CacheCounters();
+        stats->nodes.clear();
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            
+            ///Evictions add the hits of the entries to the bucket counters under the write lock, so hold the read lock
+            ///while merging both so that they are not counted twice
+            QReadLocker locker(&bucket.lock);
+            {
+                QMutexLocker k(&bucket.statsLock);
+                stats->merge(bucket.stats);
+            }
+            for (CacheIterator it = bucket.memoryCache.begin(); it != bucket.memoryCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                for (typename std::list<EntryTypePtr>::const_iterator it2 = entries.begin(); it2 != entries.end(); ++it2) {
+                    U64 nodeHash = (*it2)->getKey().getTreeVersion();
+                    stats->nodes[nodeHash].memoryBytes += (*it2)->size();
+                    stats->addHits( nodeHash, (*it2)->getStatisticsHits() );
+                }
+            }
+            for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                for (typename std::list<EntryTypePtr>::const_iterator it2 = entries.begin(); it2 != entries.end(); ++it2) {
+                    U64 nodeHash = (*it2)->getKey().getTreeVersion();
+                    ///size() is 0 once the memory was released, the data size is known by the params
+                    stats->nodes[nodeHash].diskBytes += (*it2)->getParams()->getElementsCount() * sizeof(data_t);
+                    stats->addHits( nodeHash, (*it2)->getStatisticsHits() );
+                }
+            }
+        }
+        
+        QMutexLocker k(&_sizeLock);
+        stats->total.memoryBytes = _memoryCacheSize;
+        stats->total.diskBytes = _diskCacheSize;
+    }
+    
+    /**
+     * @brief Resets the counters returned by getStatistics(), except the number of entries in the cache.
+     **/
+    void resetStatistics()
+    {
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            QReadLocker locker(&bucket.lock);
+            {
+                QMutexLocker k(&bucket.statsLock);
+                bucket.stats.resetCounters();
+            }
+            for (int c = 0; c < 2; ++c) {
+                CacheContainer & container = c == 0 ? bucket.memoryCache : bucket.diskCache;
+                for (CacheIterator it = container.begin(); it != container.end(); ++it) {
+                    const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                    for (typename std::list<EntryTypePtr>::const_iterator it2 = entries.begin(); it2 != entries.end(); ++it2) {
+                        (void)(*it2)->takeStatisticsHits();
+                    }
+                }
+            }
+        }
+    }
 
     CacheSignalEmitter* activateSignalEmitter() const
     {
@@ -1101,33 +1603,36 @@ public:
             return;
         }
 
-        QMutexLocker l(&_lock);
-        CacheIterator existingEntry = _memoryCache( entry->getHashKey() );
-        if ( existingEntry != _memoryCache.end() ) {
+        CacheBucket & bucket = _buckets[getBucketIndex( entry->getHashKey() )];
+        QWriteLocker l(&bucket.lock);
+        CacheIterator existingEntry = bucket.memoryCache( entry->getHashKey() );
+        if ( existingEntry != bucket.memoryCache.end() ) {
             std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
             for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( (*it)->getKey() == entry->getKey() ) {
+                    recordEviction(bucket,*it,Natron::eCacheEvictionReasonRemoved,true);
                     (*it)->scheduleForDestruction();
                     ret.erase(it);
                     break;
                 }
             }
             if ( ret.empty() ) {
-                _memoryCache.erase(existingEntry);
+                bucket.memoryCache.erase(existingEntry);
             }
         } else {
-            existingEntry = _diskCache( entry->getHashKey() );
-            if ( existingEntry != _diskCache.end() ) {
+            existingEntry = bucket.diskCache( entry->getHashKey() );
+            if ( existingEntry != bucket.diskCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     if ( (*it)->getKey() == entry->getKey() ) {
+                        recordEviction(bucket,*it,Natron::eCacheEvictionReasonRemoved,true);
                         (*it)->scheduleForDestruction();
                         ret.erase(it);
                         break;
                     }
                 }
                 if ( ret.empty() ) {
-                    _diskCache.erase(existingEntry);
+                    bucket.diskCache.erase(existingEntry);
                 }
             }
         }
@@ -1135,23 +1640,26 @@ public:
     
     void removeEntry(U64 hash)
     {
-        QMutexLocker l(&_lock);
-        CacheIterator existingEntry = _memoryCache( hash);
-        if ( existingEntry != _memoryCache.end() ) {
+        CacheBucket & bucket = _buckets[getBucketIndex(hash)];
+        QWriteLocker l(&bucket.lock);
+        CacheIterator existingEntry = bucket.memoryCache( hash);
+        if ( existingEntry != bucket.memoryCache.end() ) {
             std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
             for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                recordEviction(bucket,*it,Natron::eCacheEvictionReasonRemoved,true);
                 (*it)->scheduleForDestruction();
             }
-            _memoryCache.erase(existingEntry);
+            bucket.memoryCache.erase(existingEntry);
             
         } else {
-            existingEntry = _diskCache( hash );
-            if ( existingEntry != _diskCache.end() ) {
+            existingEntry = bucket.diskCache( hash );
+            if ( existingEntry != bucket.diskCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                    recordEviction(bucket,*it,Natron::eCacheEvictionReasonRemoved,true);
                     (*it)->scheduleForDestruction();
                 }
-                _diskCache.erase(existingEntry);
+                bucket.diskCache.erase(existingEntry);
             
             }
         }
@@ -1161,11 +1669,13 @@ public:
     void removeAllImagesFromCacheWithMatchingKey(U64 treeVersion)
     {
         std::list<EntryTypePtr> toDelete;
-        CacheContainer newMemCache,newDiskCache;
-        {
-            QMutexLocker locker(&_lock);
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            CacheContainer newMemCache,newDiskCache;
+            
+            QWriteLocker locker(&bucket.lock);
             
-            for (CacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
+            for (CacheIterator memIt = bucket.memoryCache.begin(); memIt != bucket.memoryCache.end(); ++memIt) {
                 
                 std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
                 if (!entries.empty()) {
@@ -1175,6 +1685,7 @@ public:
                     if (front->getKey().getTreeVersion() == treeVersion) {
                         
                         for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            recordEviction(bucket,*it,Natron::eCacheEvictionReasonInvalidated,true);
                             (*it)->scheduleForDestruction();
                             toDelete.push_back(*it);
                         }
@@ -1186,7 +1697,7 @@ public:
                 }
             }
             
-            for (CacheIterator dIt = _diskCache.begin(); dIt != _diskCache.end(); ++dIt) {
+            for (CacheIterator dIt = bucket.diskCache.begin(); dIt != bucket.diskCache.end(); ++dIt) {
                 
                 std::list<EntryTypePtr> & entries = getValueFromIterator(dIt);
                 if (!entries.empty()) {
@@ -1196,6 +1707,7 @@ public:
                     if (front->getKey().getTreeVersion() == treeVersion) {
                         
                         for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            recordEviction(bucket,*it,Natron::eCacheEvictionReasonInvalidated,true);
                             (*it)->scheduleForDestruction();
                             toDelete.push_back(*it);
                         }
@@ -1207,9 +1719,8 @@ public:
                 }
             }
             
-            _memoryCache = newMemCache;
-            _diskCache = newDiskCache;
-            
+            bucket.memoryCache = newMemCache;
+            bucket.diskCache = newDiskCache;
             
         }
         if (!toDelete.empty()) {
@@ -1222,81 +1733,125 @@ public:
     }
 
     
-    /*Saves cache to disk as a settings file.
-     */
-    void save(CacheTOC* tableOfContents)
+    /**
+     * @brief Collects the table of contents of the disk portion, to be written with CacheTOCFile::write() when the
+     * application quits. The entries of the previous table of contents that were never looked up are carried over.
+     * The cache should not be used afterwards.
+     **/
+    void save(std::vector<CacheTOCFile::Entry>* tableOfContents,
+              CacheTOCFile::SegmentTags* segments)
     {
         clearInMemoryPortion();
-        QMutexLocker l(&_lock);     // must be locked
-
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
-            for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
-                if ( (*it2)->isStoredOnDisk() ) {
-                    SerializedEntry serialization;
-                    serialization.hash = (*it2)->getHashKey();
-                    serialization.params = (*it2)->getParams();
-                    serialization.key = (*it2)->getKey();
-                    serialization.size = (*it2)->dataSize();
-                    serialization.filePath = (*it2)->getFilePath();
-                    tableOfContents->push_back(serialization);
-#ifdef DEBUG
-                    if (!CacheAPI::checkFileNameMatchesHash(serialization.filePath, serialization.hash)) {
-                        qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
+        
+        ///Make sure all backing files are up to date
+        waitForWriteBack();
+        
+        compactDiskPortion();
+        
+        boost::shared_ptr<CacheSegmentStore> store = getSegmentStore();
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            QWriteLocker l(&bucket.lock);     // must be locked
+
+            for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
+                std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
+                for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
+                    CacheTOCFile::Entry entry;
+                    if ( (*it2)->isStoredOnDisk() && makeTableOfContentsEntry(*it2,&entry) ) {
+                        (*segments)[entry.segment] = store->getSegmentTag(entry.segment);
+                        tableOfContents->push_back(entry);
                     }
-#endif
                 }
             }
         }
+        
+        boost::shared_ptr<CacheTOCFile> previous;
+        {
+            QMutexLocker k(&_tableOfContentsMutex);
+            previous = _tableOfContents;
+            _tableOfContents.reset();
+        }
+        if (previous) {
+            std::list<CacheTOCFile::Entry> remaining;
+            previous->takeAllRemainingEntries(&remaining);
+            const CacheTOCFile::SegmentTags & previousSegments = previous->getSegments();
+            for (std::list<CacheTOCFile::Entry>::iterator it = remaining.begin(); it != remaining.end(); ++it) {
+                CacheTOCFile::SegmentTags::const_iterator found = previousSegments.find(it->segment);
+                if ( found != previousSegments.end() ) {
+                    (*segments)[it->segment] = found->second;
+                    tableOfContents->push_back(*it);
+                }
+            }
+        }
+        
+        ///The entries the other processes sharing the cache did not release are saved too, whichever process quits last
+        ///writes the table of contents of all of them
+        boost::shared_ptr<CacheSharedIndex> index = getSharedIndex();
+        if (index) {
+            std::list<CacheTOCFile::Entry> remaining;
+            index->takeAllRemainingEntries(&remaining,segments);
+            tableOfContents->insert( tableOfContents->end(), remaining.begin(), remaining.end() );
+        }
+        ///The segment files are kept on disk, they are referenced by the new table of contents
+        store->unpinSegments();
     }
 
 
-    /*Restores the cache from disk.*/
-    void restore(const CacheTOC & tableOfContents)
+    /**
+     * @brief Restores the cache from the table of contents of a previous session. The entries are not read at this point,
+     * each of them is restored the first time its hash key is looked up.
+     **/
+    void restore(const boost::shared_ptr<CacheTOCFile> & tableOfContents)
     {
-
-        ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
-        ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
-        std::list<EntryTypePtr> entriesToBeDeleted;
-
-        for (typename CacheTOC::const_iterator it =
-                 tableOfContents.begin(); it != tableOfContents.end(); ++it) {
-            if ( it->hash != it->key.getHash() ) {
-                /*
-                 * If this warning is printed this means that the value computed by it->key()
-                 * is different than the value stored prior to serialiazing this entry. In other words there're
-                 * 2 possibilities:
-                 * 1) The key has changed since it has been added to the cache: maybe you forgot to serialize some
-                 * members of the key or you didn't save them correctly.
-                 * 2) The hash key computation is unreliable and is depending upon changing or non-deterministic
-                 * parameters which is wrong.
-                 */
-                qDebug() << "WARNING: serialized hash key different than the restored one";
-            }
-            
-#ifdef DEBUG
-            if (!checkFileNameMatchesHash(it->filePath, it->hash)) {
-                qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
-            }
-#endif
+        boost::shared_ptr<CacheSegmentStore> store = getSegmentStore();
+        store->pinSegments( tableOfContents->getSegments() );
+        {
+            QMutexLocker k(&_tableOfContentsMutex);
+            _tableOfContents = tableOfContents;
+        }
+        
+        ///Segment files that are referenced by none of the entries are garbage
+        store->removeUnusedSegmentFiles();
+    }
+    
+    /**
+     * @brief Moves the entries of the disk portion that live in mostly empty segment files to the current segment file,
+     * so that the emptied segment files are removed and the disk space held by released entries is reclaimed.
+     * Entries that are being read or written are left where they are.
+     **/
+    void compactDiskPortion()
+    {
+        boost::shared_ptr<CacheSegmentStore> store;
+        {
+            QMutexLocker k(&_segmentStoreMutex);
+            store = _segmentStore;
+        }
+        if (!store) {
+            return;
+        }
+        std::list<int> segments;
+        store->getSegmentsToCompact(&segments);
+        if ( segments.empty() ) {
+            return;
+        }
+        
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[i];
+            QWriteLocker l(&bucket.lock);
             
-            EntryType* value = NULL;
-
-            Natron::StorageModeEnum storage = Natron::eStorageModeDisk;
-
-            try {
-                value = new EntryType(it->key,it->params,this,storage,it->filePath);
-                
-                ///This will not put the entry back into RAM, instead we just insert back the entry into the disk cache
-                value->restoreMetaDataFromFile(it->size);
-            } catch (const std::bad_alloc & e) {
-                qDebug() << e.what();
-                continue;
-            }
-
-            {
-                QMutexLocker locker(&_lock);
-                sealEntry(EntryTypePtr(value), false);
+            for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
+                std::list<EntryTypePtr> & listOfValues = getValueFromIterator(it);
+                for (typename std::list<EntryTypePtr>::iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
+                    int segment;
+                    std::size_t offset,length;
+                    (*it2)->getDiskLocation(&segment,&offset,&length);
+                    if ( segment == -1 || (*it2)->isPendingWriteBack() ||
+                         std::find(segments.begin(), segments.end(), segment) == segments.end() ) {
+                        continue;
+                    }
+                    ///The entry is not mapped, which cannot change while the bucket lock is taken
+                    (*it2)->relocateDiskData();
+                }
             }
         }
     }
@@ -1304,38 +1859,98 @@ public:
 private:
 
     
-    bool getInternal(const typename EntryType::key_type & key,
-             std::list<EntryTypePtr>* returnValue) const
+    /**
+     * @brief Counts a look-up of the slow path, which holds the bucket lock for writing. The hits of the fast path only
+     * take a lock-free counter of the entry (see AbstractCacheEntry::addStatisticsHit()) so that concurrent readers do not
+     * serialize on statsLock, they are merged by recordEviction() and getStatistics().
+     **/
+    void recordLookup(CacheBucket & bucket,
+                      const typename EntryType::key_type & key,
+                      bool hit,
+                      bool fromDisk) const
+    {
+        QMutexLocker k(&bucket.statsLock);
+        bucket.stats.addLookup(key.getTreeVersion(),hit,fromDisk);
+    }
+    
+    /**
+     * @brief Counts the eviction of the entry from the bucket. If leftCache is false the entry only moved to the disk portion.
+     **/
+    void recordEviction(CacheBucket & bucket,
+                        const EntryTypePtr & entry,
+                        Natron::CacheEvictionReasonEnum reason,
+                        bool leftCache) const
+    {
+        double lifetime = _clock.getTimeSinceCreation() - entry->getInsertionTime();
+        U64 nodeHash = entry->getKey().getTreeVersion();
+        QMutexLocker k(&bucket.statsLock);
+        bucket.stats.addHits( nodeHash, entry->takeStatisticsHits() );
+        bucket.stats.addEviction(nodeHash,reason,leftCache,lifetime);
+    }
+    
+    /**
+     * @brief Looks-up the memory portion of the bucket only. This does not modify the bucket containers:
+     * the entries found are just marked as accessed and the LRU order is updated lazily by the eviction
+     * (see LRUHashTable.h), hence the bucket lock only needs to be taken for reading.
+     **/
+    bool getFromMemoryInternal(CacheBucket & bucket,
+                               const typename EntryType::key_type & key,
+                               std::list<EntryTypePtr>* returnValue) const
     {
         ///Private should be locked
-        assert(!_lock.tryLock());
+        assert( !bucket.lock.tryLockForWrite() );
         
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache( key.getHash() );
+        CacheIterator memoryCached = bucket.memoryCache.find( key.getHash() );
         
-        if ( memoryCached != _memoryCache.end() ) {
-            ///we found something with a matching hash key. There may be several entries linked to
-             ///this key, we need to find one with matching params
-            std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
-            for (typename std::list<EntryTypePtr>::const_iterator it = ret.begin(); it != ret.end(); ++it) {
-                if ((*it)->getKey() == key) {
-                    returnValue->push_back(*it);
-                    
-                    ///emit te added signal otherwise when first reading something that's already cached
-                    ///the timeline wouldn't update
-                    if (_signalEmitter) {
-                        _signalEmitter->emitAddedEntry( key.getTime() );
-                    }
-                    
+        if ( memoryCached == bucket.memoryCache.end() ) {
+            return false;
+        }
+        
+        ///we found something with a matching hash key. There may be several entries linked to
+        ///this key, we need to find one with matching params
+        std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
+        bool found = false;
+        for (typename std::list<EntryTypePtr>::const_iterator it = ret.begin(); it != ret.end(); ++it) {
+            if ((*it)->getKey() == key) {
+                (*it)->markAccessed();
+                returnValue->push_back(*it);
+                found = true;
+                
+                ///emit te added signal otherwise when first reading something that's already cached
+                ///the timeline wouldn't update
+                if (_signalEmitter) {
+                    _signalEmitter->emitAddedEntry( key.getTime() );
                 }
+                
             }
-            
-            return returnValue->size() > 0;
+        }
+        return found;
+    }
+    
+    bool getInternal(CacheBucket & bucket,
+                     const typename EntryType::key_type & key,
+                     std::list<EntryTypePtr>* returnValue,
+                     bool* reopenedFromDisk) const
+    {
+        ///Private should be locked
+        assert( !bucket.lock.tryLockForWrite() );
+        
+        if ( bucket.memoryCache.find( key.getHash() ) != bucket.memoryCache.end() ) {
+            return getFromMemoryInternal(bucket,key,returnValue);
         } else {
+            bucket.policy->onMiss( key.getHash() );
+            
+            restoreFromTableOfContents( bucket, key.getHash() );
+            
             ///fallback on the disk cache internal container
-            CacheIterator diskCached = _diskCache( key.getHash() );
+            CacheIterator diskCached = bucket.diskCache( key.getHash() );
             
-            if ( diskCached == _diskCache.end() ) {
+            if ( diskCached == bucket.diskCache.end() && restoreFromSharedIndex( bucket, key.getHash() ) ) {
+                diskCached = bucket.diskCache( key.getHash() );
+            }
+            
+            if ( diskCached == bucket.diskCache.end() ) {
                 /*the entry was neither in memory or disk, just allocate a new one*/
                 return false;
             } else {
@@ -1350,54 +1965,57 @@ private:
                          we re-open the mapping to the RAM put the entry
                          back into the memoryCache.*/
                         
-                        if ( ret.empty() ) {
-                            _diskCache.erase(diskCached);
+                        if ( (*it)->isPendingWriteBack() ) {
+                            ///The write-back thread did not release the memory yet, just take the entry back
+                            EntryTypePtr entry = *it;
+                            entry->setPendingWriteBack(false);
+                            ret.erase(it);
+                            if ( ret.empty() ) {
+                                bucket.diskCache.erase(diskCached);
+                            }
+                            bucket.memoryCache.insert(entry->getHashKey(),entry);
+                            entry->markAccessed();
+                            returnValue->push_back(entry);
+                            if (_signalEmitter) {
+                                _signalEmitter->emitAddedEntry( key.getTime() );
+                            }
+                            return true;
                         }
                         
                         try {
                             (*it)->reOpenFileMapping();
                         } catch (const std::exception & e) {
                             qDebug() << "Error while reopening cache file: " << e.what();
+                            recordEviction(bucket,*it,Natron::eCacheEvictionReasonRemoved,true);
                             ret.erase(it);
-                            
+                            if ( ret.empty() ) {
+                                bucket.diskCache.erase(diskCached);
+                            }
                             return false;
                         } catch (...) {
                             qDebug() << "Error while reopening cache file";
+                            recordEviction(bucket,*it,Natron::eCacheEvictionReasonRemoved,true);
                             ret.erase(it);
-                            
+                            if ( ret.empty() ) {
+                                bucket.diskCache.erase(diskCached);
+                            }
                             return false;
                         }
                         
-                        //put it back into the RAM
-                        _memoryCache.insert((*it)->getHashKey(),*it);
-                        
-                        U64 memoryCacheSize,maximumInMemorySize;
-                        {
-                            QMutexLocker k(&_sizeLock);
-                            memoryCacheSize = _memoryCacheSize;
-                            maximumInMemorySize = _maximumInMemorySize;
-                            
+                        EntryTypePtr entry = *it;
+                        ret.erase(it);
+                        if ( ret.empty() ) {
+                            bucket.diskCache.erase(diskCached);
                         }
                         
-                        std::list<EntryTypePtr> entriesToBeDeleted;
+                        //put it back into the RAM
+                        bucket.memoryCache.insert(entry->getHashKey(),entry);
                         
-                        //now clear extra entries from the disk cache so it doesn't exceed the RAM limit.
-                        while (memoryCacheSize > maximumInMemorySize) {
-                            if ( !tryEvictEntry(entriesToBeDeleted) ) {
-                                break;
-                            }
-                            
-                            {
-                                QMutexLocker k(&_sizeLock);
-                                memoryCacheSize = _memoryCacheSize;
-                                maximumInMemorySize = _maximumInMemorySize;
-                                
-                            }
-
-                        }
+                        ///The caller is responsible for evicting entries from the memory portion
+                        ///once the bucket lock is released, since that may touch other buckets.
+                        *reopenedFromDisk = true;
                         
-                        returnValue->push_back(*it);
-                        ret.erase(it);
+                        returnValue->push_back(entry);
                         ///emit te added signal otherwise when first reading something that's already cached
                         ///the timeline wouldn't update
                         if (_signalEmitter) {
@@ -1415,20 +2033,166 @@ private:
         }
     }
 
+    /**
+     * @brief Inserts into the disk portion of the bucket the entries of the previous session with the given hash key
+     * that were not restored yet.
+     **/
+    void restoreFromTableOfContents(CacheBucket & bucket,
+                                    hash_type hash) const
+    {
+        boost::shared_ptr<CacheTOCFile> tableOfContents;
+        {
+            QMutexLocker k(&_tableOfContentsMutex);
+            tableOfContents = _tableOfContents;
+        }
+        if (!tableOfContents) {
+            return;
+        }
+        std::list<CacheTOCFile::Entry> entries;
+        tableOfContents->takeEntries(hash,&entries);
+        restoreEntries(bucket,entries);
+    }
+    
+    /**
+     * @brief Inserts into the disk portion of the bucket the entries with the given hash key published by other processes.
+     * Returns true if any entry was inserted.
+     **/
+    bool restoreFromSharedIndex(CacheBucket & bucket,
+                                hash_type hash) const
+    {
+        boost::shared_ptr<CacheSharedIndex> index = getSharedIndex();
+        if (!index) {
+            return false;
+        }
+        std::list<CacheTOCFile::Entry> entries;
+        CacheTOCFile::SegmentTags segments;
+        index->takeEntries(hash,&entries,&segments);
+        if ( entries.empty() ) {
+            return false;
+        }
+        ///The segment files of the other processes are never removed by this process
+        getSegmentStore()->pinSegments(segments);
+        return restoreEntries(bucket,entries) > 0;
+    }
+    
+    /**
+     * @brief Inserts the given entries, whose data is already in the segment files, into the disk portion of the bucket.
+     * Returns the number of entries inserted.
+     **/
+    int restoreEntries(CacheBucket & bucket,
+                       const std::list<CacheTOCFile::Entry> & entries) const
+    {
+        ///Private should be locked
+        assert( !bucket.lock.tryLockForWrite() );
+        
+        int ret = 0;
+        for (std::list<CacheTOCFile::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+            typename EntryType::key_type key;
+            ParamsTypePtr params;
+            try {
+                std::istringstream ss(it->blob);
+                boost::archive::binary_iarchive iArchive(ss,boost::archive::no_header);
+                iArchive >> key;
+                iArchive >> params;
+            } catch (const std::exception & e) {
+                qDebug() << "Failed to deserialize cache entry: " << e.what();
+                continue;
+            }
+            if ( !params || (it->hash != key.getHash()) ) {
+                /*
+                 * If this warning is printed this means that the value computed by key.getHash()
+                 * is different than the value stored prior to serialiazing this entry. In other words there're
+                 * 2 possibilities:
+                 * 1) The key has changed since it has been added to the cache: maybe you forgot to serialize some
+                 * members of the key or you didn't save them correctly.
+                 * 2) The hash key computation is unreliable and is depending upon changing or non-deterministic
+                 * parameters which is wrong.
+                 */
+                qDebug() << "WARNING: serialized hash key different than the restored one";
+                continue;
+            }
+            
+            EntryType* value = NULL;
+            try {
+                value = new EntryType(key,params,this,Natron::eStorageModeDisk);
+                
+                ///This will not put the entry back into RAM, instead we just insert back the entry into the disk cache
+                value->restoreMetaDataFromSegment(it->segment,it->offset,it->length);
+            } catch (const std::bad_alloc & e) {
+                qDebug() << "Could not restore cache entry from segment " << it->segment << ": " << e.what();
+                delete value;
+                continue;
+            }
+            sealEntry(bucket, EntryTypePtr(value), false);
+            ++ret;
+        }
+        return ret;
+    }
+    
+    boost::shared_ptr<CacheSharedIndex> getSharedIndex() const
+    {
+        if (!_sharedBetweenProcesses) {
+            return boost::shared_ptr<CacheSharedIndex>();
+        }
+        getSegmentStore();
+        QMutexLocker k(&_segmentStoreMutex);
+        return _sharedIndex;
+    }
+    
+    /**
+     * @brief Serializes the key and params of the entry along with the location of its data.
+     * Returns false if the entry is not on disk or could not be serialized.
+     **/
+    static bool makeTableOfContentsEntry(const EntryTypePtr & entry,
+                                         CacheTOCFile::Entry* tocEntry)
+    {
+        std::size_t offset,length;
+        entry->getDiskLocation(&tocEntry->segment,&offset,&length);
+        if (tocEntry->segment == -1) {
+            return false;
+        }
+        try {
+            std::ostringstream ss;
+            {
+                boost::archive::binary_oarchive oArchive(ss,boost::archive::no_header);
+                const typename EntryType::key_type & key = entry->getKey();
+                ParamsTypePtr params = entry->getParams();
+                oArchive << key;
+                oArchive << params;
+            }
+            tocEntry->blob = ss.str();
+        } catch (const std::exception & e) {
+            qDebug() << "Failed to serialize cache entry: " << e.what();
+            return false;
+        }
+        tocEntry->hash = entry->getHashKey();
+        tocEntry->offset = offset;
+        tocEntry->length = length;
+        return true;
+    }
+
     /** @brief Inserts into the cache an entry that was previously allocated by the createInternal()
      * function. This is called directly by createInternal() if the allocation was successful
      **/
-    void sealEntry(const EntryTypePtr & entry,bool inMemory) const
+    void sealEntry(CacheBucket & bucket,
+                   const EntryTypePtr & entry,
+                   bool inMemory) const
     {
-        assert( !_lock.tryLock() );   // must be locked
+        assert( !bucket.lock.tryLockForWrite() );   // must be locked
         typename EntryType::hash_type hash = entry->getHashKey();
         
+        entry->setInsertionTime( _clock.getTimeSinceCreation() );
+        {
+            QMutexLocker k(&bucket.statsLock);
+            bucket.stats.addInsertion( entry->getKey().getTreeVersion() );
+        }
+        
         if (inMemory) {
             
             /*if the entry doesn't exist on the memory cache,make a new list and insert it*/
-            CacheIterator existingEntry = _memoryCache(hash);
-            if ( existingEntry == _memoryCache.end() ) {
-                _memoryCache.insert(hash,entry);
+            CacheIterator existingEntry = bucket.memoryCache(hash);
+            if ( existingEntry == bucket.memoryCache.end() ) {
+                bucket.memoryCache.insert(hash,entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
@@ -1436,9 +2200,9 @@ private:
             
         } else {
             
-            CacheIterator existingEntry = _diskCache(hash);
-            if ( existingEntry == _diskCache.end() ) {
-                _diskCache.insert(hash,entry);
+            CacheIterator existingEntry = bucket.diskCache(hash);
+            if ( existingEntry == bucket.diskCache.end() ) {
+                bucket.diskCache.insert(hash,entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
@@ -1447,22 +2211,107 @@ private:
         }
     }
     
-    bool tryEvictEntry(std::list<EntryTypePtr>& entriesToBeDeleted) const
+    /**
+     * @brief Evicts an entry, as selected by the eviction policy, from the first bucket that has something to evict. Buckets are
+     * visited in a round-robin fashion so that evictions are spread across the whole cache, which
+     * approximates a global LRU while never holding more than one bucket lock at once.
+     * The bucket locks must not be taken by the caller.
+     **/
+    bool tryEvictInMemoryEntryFromAnyBucket(std::list<EntryTypePtr>& entriesToBeDeleted,
+                                            std::size_t* memoryFreed) const
     {
-        assert( !_lock.tryLock() );
-        std::pair<hash_type,EntryTypePtr> evicted = _memoryCache.evict();
+        unsigned int start = (unsigned int)_evictionCursor.fetchAndAddRelaxed(1);
+        for (int i = 0; i < NATRON_CACHE_BUCKETS_COUNT; ++i) {
+            CacheBucket & bucket = _buckets[(start + i) % NATRON_CACHE_BUCKETS_COUNT];
+            std::list<EntryTypePtr> entriesToWriteBack;
+            bool evicted;
+            {
+                QWriteLocker locker(&bucket.lock);
+                evicted = tryEvictEntry(bucket, entriesToBeDeleted, entriesToWriteBack, memoryFreed);
+            }
+            if (evicted) {
+                ///Must be done without the bucket lock since this may block until the write-back thread,
+                ///which takes the bucket locks, made room in the queue.
+                _writeBackThread.appendToQueue(entriesToWriteBack);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    /**
+     * @brief Called by the write-back thread once the memory of the entry was written to its backing file.
+     * Unless the entry was moved back to the memory portion in the meantime, its memory is released.
+     * flushed is true if the write-back thread already synced the region of the entry in the segment file.
+     **/
+    void onEntryWrittenBack(const EntryTypePtr& entry,
+                            bool flushed) const
+    {
+        CacheTOCFile::Entry published;
+        boost::shared_ptr<CacheSharedIndex> index = getSharedIndex();
+        {
+            CacheBucket & bucket = _buckets[getBucketIndex( entry->getHashKey() )];
+            QWriteLocker locker(&bucket.lock);
+            
+            ///The entry was taken back in the memory portion (or removed) since it was queued, it is not on disk
+            if ( !entry->isPendingWriteBack() ) {
+                return;
+            }
+            entry->setPendingWriteBack(false);
+            try {
+                entry->deallocate(flushed);
+            } catch (const std::exception & e) {
+                qDebug() << "Error while writing cache entry to disk: " << e.what();
+                index.reset();
+            }
+            if ( index && !makeTableOfContentsEntry(entry,&published) ) {
+                index.reset();
+            }
+        }
+        ///Only the data of the segment files created by this process is published, the entries read from
+        ///the segment files of other processes are already known by them
+        if ( index && getSegmentStore()->isSegmentOwned(published.segment) ) {
+            index->publish( published, getSegmentStore()->getSegmentTag(published.segment) );
+        }
+    }
+    
+    /**
+     * @brief Evicts an entry from the memory portion of the bucket. Entries that have a backing file are moved
+     * to the disk portion right away but they are only appended to entriesToWriteBack: the caller must give them
+     * to the write-back thread once the bucket lock is released. The other entries are appended to entriesToBeDeleted.
+     * memoryFreed is set to the amount of memory that was or will be released.
+     **/
+    bool tryEvictEntry(CacheBucket & bucket,
+                       std::list<EntryTypePtr>& entriesToBeDeleted,
+                       std::list<EntryTypePtr>& entriesToWriteBack,
+                       std::size_t* memoryFreed) const
+    {
+        assert( !bucket.lock.tryLockForWrite() );
+        typename EvictionPolicy::CandidatesList candidates;
+        bucket.memoryCache.getEvictionCandidates(bucket.policy->getCandidatesCount(), &candidates);
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
-        if (!evicted.second) {
+        if ( candidates.empty() ) {
+            return false;
+        }
+        std::pair<hash_type,EntryTypePtr> evicted = *bucket.policy->selectVictim(candidates);
+        
+        ///Release the references held by the candidates list so that the evicted entry is unique again
+        candidates.clear();
+        if ( !bucket.memoryCache.remove(evicted.first,evicted.second) ) {
             return false;
         }
+        bucket.policy->onEntryEvicted(evicted.second);
+        recordEviction( bucket,evicted.second,Natron::eCacheEvictionReasonMemoryFull,!evicted.second->isStoredOnDisk() );
+        *memoryFreed = evicted.second->size();
         /*if it is stored on disk, remove it from memory*/
 
         if ( evicted.second->isStoredOnDisk() ) {
             assert( evicted.second.unique() );
             
-            ///This is EXPENSIVE! it calls msync
-            evicted.second->deallocate();
+            ///Writing the memory to the backing file is EXPENSIVE (it calls msync), this is left to the write-back thread.
+            evicted.second->setPendingWriteBack(true);
+            entriesToWriteBack.push_back(evicted.second);
             
             /*insert it back into the disk portion */
             
@@ -1474,10 +2323,12 @@ private:
                 maximumCacheSize = _maximumCacheSize;
             }
 
-            /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
+            /*before that we need to clear the disk cache if it exceeds the maximum size allowed.
+             Only the disk portion of this bucket is trimmed since we cannot take another bucket lock here,
+             any remaining excess will be trimmed by the next evictions.*/
             while ( ( diskCacheSize  + evicted.second->size() ) >= (maximumCacheSize - maximumInMemorySize) ) {
                 {
-                    std::pair<hash_type,EntryTypePtr> evictedFromDisk = _diskCache.evict();
+                    std::pair<hash_type,EntryTypePtr> evictedFromDisk = bucket.diskCache.evict();
                     //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
                     //we'll let the user of these entries purge the extra entries left in the cache later on
                     if (!evictedFromDisk.second) {
@@ -1485,6 +2336,7 @@ private:
                     }
                     
                     ///Erase the file from the disk if we reach the limit.
+                    recordEviction(bucket,evictedFromDisk.second,Natron::eCacheEvictionReasonDiskFull,true);
                     evictedFromDisk.second->scheduleForDestruction();
                     
                     
@@ -1498,10 +2350,10 @@ private:
                 }
             }
 
-            CacheIterator existingDiskCacheEntry = _diskCache(evicted.first);
+            CacheIterator existingDiskCacheEntry = bucket.diskCache(evicted.first);
             /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-            if ( existingDiskCacheEntry == _diskCache.end() ) {
-                _diskCache.insert(evicted.first,evicted.second);
+            if ( existingDiskCacheEntry == bucket.diskCache.end() ) {
+                bucket.diskCache.insert(evicted.first,evicted.second);
             } else {   /*append to the existing list*/
                 getValueFromIterator(existingDiskCacheEntry).push_back(evicted.second);
             }
@@ -4,12 +4,16 @@
 #include <iostream>
 #include <cassert>
 #include <cstdio> // for std::remove
+#include <cstring> // for std::memcpy
 #include <stdexcept>
 #include <vector>
+#include <algorithm>
+#include <climits>
 #include <fstream>
 #include <QtCore/QFile>
 #include <QtCore/QDir>
 #include <QtCore/QDebug>
+#include <QtCore/QAtomicInt>
 #ifndef Q_MOC_RUN
 #include <boost/utility.hpp>
 #include <boost/shared_ptr.hpp>
@@ -17,6 +21,7 @@
 #endif
 #include "Engine/Hash64.h"
 #include "Engine/MemoryFile.h"
+#include "Engine/CacheSegmentStore.h"
 #include "Engine/NonKeyParams.h"
 #include <SequenceParsing.h> // for removePath
 
@@ -32,6 +37,8 @@ namespace Natron {
  * 0 means RAM and >= 1 means the data will be stored on disk using mmap. We could see this
  * scheme evolve in the future with other storage devices such as OpenGL textures, Cuda buffers,
  * ... etc
+ * On disk, the data is a region of a segment file of the CacheSegmentStore of the cache. The region is
+ * "mapped" while its data is accessible in memory (it then counts in the memory portion of the cache).
  *
  * Thread safety : This class is not thread-safe but is used ONLY by the CacheEntryHelper class
  * which is itself manipulated by the Cache which is thread-safe.
@@ -46,9 +53,12 @@ public:
 
 
     Buffer()
-        : _path()
-          , _buffer()
-          , _backingFile()
+        : _buffer()
+          , _store()
+          , _segment(-1)
+          , _offset(0)
+          , _length(0)
+          , _mappedData(0)
           , _storageMode(eStorageModeRAM)
     {
     }
@@ -60,36 +70,31 @@ public:
 
     void allocate( U64 count,
                    Natron::StorageModeEnum storage,
-                   std::string path = std::string() )
+                   const boost::shared_ptr<CacheSegmentStore> & store = boost::shared_ptr<CacheSegmentStore>() )
     {
         /*allocate should be called only once.*/
-        assert( _path.empty() );
-        assert( ( (_buffer.size() == 0) && !_backingFile ) || ( (_buffer.size() != 0) && !_backingFile ) || (!(_buffer.size() != 0) && _backingFile) );
-        if ( (_buffer.size() > 0) || _backingFile ) {
+        assert(_segment == -1);
+        if ( (_buffer.size() > 0) || (_segment != -1) ) {
             return;
         }
 
 
         if (storage == Natron::eStorageModeDisk) {
-            _storageMode = eStorageModeDisk;
-            _path = path;
-            try {
-                _backingFile.reset( new MemoryFile(_path,MemoryFile::if_exists_keep_if_dont_exists_create) );
-            } catch (const std::runtime_error & r) {
-                std::cout << r.what() << std::endl;
+            std::size_t length = count * sizeof(DataType);
+            if ( !store || !store->allocate(length,&_segment,&_offset) ) {
+                std::cout << "Failed to allocate " << length << " bytes in the disk cache, falling back on RAM." << std::endl;
 
-                ///if opening the file mapping failed, just call allocate again, but this time on RA%!
-                _backingFile.reset();
-                _path.clear();
-                allocate(count,Natron::eStorageModeRAM, path);
+                ///if opening the file mapping failed, just call allocate again, but this time on RAM!
+                _segment = -1;
+                allocate(count,Natron::eStorageModeRAM);
 
                 return;
             }
-
-            if ( !path.empty() && (count != 0) ) {
-                //if the backing file has already the good size and we just wanted to re-open the mapping
-                _backingFile->resize(count);
-            }
+            _storageMode = eStorageModeDisk;
+            _store = store;
+            _length = length;
+            _mappedData = _store->getData(_segment,_offset);
+            assert(_mappedData);
         } else if (storage == Natron::eStorageModeRAM) {
             _storageMode = eStorageModeRAM;
             _buffer.resize(count);
@@ -108,40 +113,88 @@ public:
             assert(_buffer.size() > 0); // could be 0 if we allocate 0...
             _buffer.resize(count);
         } else if (_storageMode == eStorageModeDisk) {
-            assert(_backingFile);
-            _backingFile->resize( count * sizeof(DataType) );
+            assert(_mappedData);
+            ///Regions cannot grow in place, move the data to a new region
+            std::size_t length = count * sizeof(DataType);
+            int segment;
+            std::size_t offset;
+            if ( !_store->allocate(length,&segment,&offset) ) {
+                throw std::bad_alloc();
+            }
+            char* data = _store->getData(segment,offset);
+            std::memcpy( data,_mappedData,std::min(length,_length) );
+            _store->release(_segment,_offset,_length);
+            _segment = segment;
+            _offset = offset;
+            _length = length;
+            _mappedData = data;
         }
     }
-    
-    const std::string& getFilePath() const {
-        return _path;
+
+    /**
+     * @brief Returns where the data lives in the segment files. The segment is -1 if the buffer is not on disk.
+     **/
+    void getDiskLocation(int* segment,
+                         std::size_t* offset,
+                         std::size_t* length) const
+    {
+        *segment = _segment;
+        *offset = _offset;
+        *length = _length;
     }
 
     void reOpenFileMapping() const
     {
-        assert(!_backingFile && _storageMode == eStorageModeDisk);
-        try{
-            _backingFile.reset( new MemoryFile(_path,MemoryFile::if_exists_keep_if_dont_exists_create) );
-        } catch (const std::exception & e) {
-            _backingFile.reset();
+        assert(!_mappedData && _storageMode == eStorageModeDisk);
+        _mappedData = _store ? _store->getData(_segment,_offset) : 0;
+        if (!_mappedData) {
             throw std::bad_alloc();
         }
     }
 
-    void restoreBufferFromFile(const std::string & path)
+    void restoreBufferFromSegment(const boost::shared_ptr<CacheSegmentStore> & store,
+                                  int segment,
+                                  std::size_t offset,
+                                  std::size_t length)
     {
-        _path = path;
+        if ( !store->restoreRegion(segment,offset,length) ) {
+            throw std::bad_alloc();
+        }
+        _store = store;
+        _segment = segment;
+        _offset = offset;
+        _length = length;
         _storageMode = eStorageModeDisk;
     }
 
-    void deallocate()
+    /**
+     * @brief Moves the data of a buffer that is on disk but not mapped to another segment.
+     * Returns false if it could not be moved.
+     **/
+    bool relocate()
+    {
+        if ( (_storageMode != eStorageModeDisk) || _mappedData || (_segment == -1) ) {
+            return false;
+        }
+
+        return _store->relocate(&_segment,&_offset,_length);
+    }
+
+    /**
+     * @brief Releases the memory of the buffer. If alreadyFlushed is true the caller synced the region
+     * of the buffer in its segment file, e.g the write-back thread of the cache which syncs contiguous entries at once.
+     **/
+    void deallocate(bool alreadyFlushed = false)
     {
         if (_storageMode == eStorageModeRAM) {
             _buffer.clear();
         } else {
-            if (_backingFile) {
-                bool flushOk = _backingFile->flush();
-                _backingFile.reset();
+            if (_mappedData) {
+                bool flushOk = alreadyFlushed || _store->flush(_segment,_offset,_length);
+                if (flushOk) {
+                    _store->discard(_segment,_offset,_length);
+                }
+                _mappedData = 0;
                 if (!flushOk) {
                     throw std::runtime_error("Failed to flush RAM data to backing file.");
                 }
@@ -149,20 +202,16 @@ public:
         }
     }
 
-    bool removeAnyBackingFile() const
+    /**
+     * @brief Releases the region of the buffer in its segment file, the data is lost.
+     **/
+    void removeAnyBackingFile() const
     {
-        if (_storageMode == eStorageModeDisk) {
-            if (_backingFile) {
-                _backingFile->remove();
-                _backingFile.reset();
-                return true;
-            } else {
-                int ret_code = std::remove( _path.c_str() );
-                (void)ret_code;
-                return false;
-            }
+        if ( (_storageMode == eStorageModeDisk) && (_segment != -1) ) {
+            _store->release(_segment,_offset,_length);
+            _segment = -1;
+            _mappedData = 0;
         }
-        return false;
     }
 
     /**
@@ -173,23 +222,19 @@ public:
         if (_storageMode == eStorageModeRAM) {
             return _buffer.size() * sizeof(DataType);
         } else {
-            return _backingFile ? _backingFile->size() : 0;
+            return _mappedData ? _length : 0;
         }
     }
 
     bool isAllocated() const
     {
-        return (_buffer.size() > 0) || ( _backingFile && _backingFile->data() );
+        return (_buffer.size() > 0) || _mappedData;
     }
 
     DataType* writable()
     {
         if (_storageMode == eStorageModeDisk) {
-            if (_backingFile) {
-                return (DataType*)_backingFile->data();
-            } else {
-                return NULL;
-            }
+            return (DataType*)_mappedData;
         } else {
             return &_buffer.front();
         }
@@ -198,7 +243,7 @@ public:
     const DataType* readable() const
     {
         if (_storageMode == eStorageModeDisk) {
-            return (const DataType*)_backingFile->data();
+            return (const DataType*)_mappedData;
         } else {
             return &_buffer.front();
         }
@@ -211,12 +256,17 @@ public:
 
 private:
 
-    std::string _path;
     std::vector<DataType> _buffer;
+    boost::shared_ptr<CacheSegmentStore> _store;
 
-    /*mutable so the reOpenFileMapping function can reopen the mmaped file. It doesn't
+    /*mutable so that removeAnyBackingFile() can release the region. It doesn't change the underlying data*/
+    mutable int _segment;
+    std::size_t _offset;
+    std::size_t _length;
+
+    /*mutable so the reOpenFileMapping function can map the region again. It doesn't
        change the underlying data*/
-    mutable boost::scoped_ptr<MemoryFile> _backingFile;
+    mutable char* _mappedData;
     Natron::StorageModeEnum _storageMode;
 };
 
@@ -252,9 +302,9 @@ public:
     virtual void notifyMemoryDeallocated() const = 0;
 
     /**
-     * @brief To be called when a backing file has been closed
+     * @brief Returns the store in which the entries on disk keep their data, creating it if needed.
      **/
-    virtual void backingFileClosed() const = 0;
+    virtual boost::shared_ptr<CacheSegmentStore> getSegmentStore() const = 0;
 
     /**
      * @brief To be called whenever an entry is deallocated from memory and put back on disk or whenever
@@ -262,60 +312,11 @@ public:
      **/
     virtual void notifyEntryStorageChanged(Natron::StorageModeEnum oldStorage,Natron::StorageModeEnum newStorage,
                                            int time,size_t size) const = 0;
-    
-    
-#ifdef DEBUG
-    static bool checkFileNameMatchesHash(const std::string &originalFileName,U64 hash)
-    {
-        
-        std::string filename = originalFileName;
-        std::string path = SequenceParsing::removePath(filename);
-        //remove extension from filename
-        {
-            size_t lastdot = filename.find_last_of('.');
-            if (lastdot != std::string::npos) {
-                filename.erase(lastdot, std::string::npos);
-            }
-        }
-        
-        //remove index if it has one
-        {
-            std::size_t foundSep = filename.find_last_of('_');
-            if (foundSep != std::string::npos) {
-                filename.erase(foundSep, std::string::npos);
-            }
-        }
-        
-        QString hashKeyStr(filename.c_str());
-        
-        //prepend the 2 digits of the containing directory
-        {
-            if (path.size() > 0) {
-                if (path[path.size() - 1] == '\\' || path[path.size() -1] == '/') {
-                    path.erase(path.size() - 1, 1);
-                }
-                
-                std::size_t foundSep = path.find_last_of('/');
-                if (foundSep == std::string::npos) {
-                    foundSep = path.find_last_of('\\');
-                }
-                assert(foundSep != std::string::npos);
-                std::string enclosingDirName = path.substr(foundSep + 1, std::string::npos);
-                hashKeyStr.prepend(enclosingDirName.c_str());
-            }
-        }
-        
-        
-        U64 hashKey = hashKeyStr.toULongLong(0,16); //< to hex (base 16)
-        if (hashKey == hash) {
-            return true;
-        } else {
-            return false;
-        }
-        
-    }
-#endif
-    
+
+    /**
+     * @brief To be called by a CacheEntry right before it releases its region of the segment files.
+     **/
+    virtual void notifyEntryDiskDataReleased(U64 hash,int segment,std::size_t offset) const = 0;
 };
 
 
@@ -332,6 +333,11 @@ public:
     typedef KeyType key_type;
 
     AbstractCacheEntry()
+    : _accessed(0)
+    , _accessCount(0)
+    , _computeTimeMs(0)
+    , _statisticsHits(0)
+    , _insertionTime(0.)
     {
     };
 
@@ -343,6 +349,93 @@ public:
     virtual hash_type getHashKey() const = 0;
     virtual size_t size() const = 0;
     virtual SequenceTime getTime() const = 0;
+    
+    /**
+     * @brief Called by the cache when a look-up returns this entry. This is lock-free so that cache hits
+     * do not need to modify the LRU containers, the access bit is consumed lazily on eviction.
+     **/
+    void markAccessed() const
+    {
+        _accessed.fetchAndStoreRelaxed(1);
+        _accessCount.fetchAndAddRelaxed(1);
+    }
+    
+    /**
+     * @brief Returns whether the entry was accessed since the last call and clears the access bit.
+     **/
+    bool testAndClearAccessed() const
+    {
+        return _accessed.fetchAndStoreRelaxed(0) != 0;
+    }
+    
+    /**
+     * @brief Returns the number of cache hits on this entry since it was inserted in the cache.
+     * This is used by the eviction policies to tell apart recently and frequently used entries.
+     **/
+    int getAccessCount() const
+    {
+        return (int)_accessCount;
+    }
+    
+    /**
+     * @brief Accumulates the time (in seconds) it took to compute the content of this entry.
+     * This is what it would cost to render it again if it were evicted.
+     **/
+    void addComputeTime(double seconds) const
+    {
+        int ms = seconds <= 0. ? 0 : (int)std::min(seconds * 1000., (double)INT_MAX / 2);
+        _computeTimeMs.fetchAndAddRelaxed(ms);
+    }
+    
+    /**
+     * @brief Returns the time in milliseconds recorded with addComputeTime()
+     **/
+    int getComputeTimeMs() const
+    {
+        return (int)_computeTimeMs;
+    }
+    
+    /**
+     * @brief Called by the cache when the entry is inserted, with the time of the cache clock in seconds.
+     * This is used to compute the lifetime of the entries in the cache statistics.
+     **/
+    void setInsertionTime(double time) const
+    {
+        _insertionTime = time;
+    }
+    
+    double getInsertionTime() const
+    {
+        return _insertionTime;
+    }
+    
+    /**
+     * @brief Counts a hit of the lock-free look-up path of the cache. These hits are not in the statistics of the cache
+     * bucket yet: they are added to it by takeStatisticsHits() when the entry is evicted, or read by Cache::getStatistics().
+     **/
+    void addStatisticsHit() const
+    {
+        _statisticsHits.fetchAndAddRelaxed(1);
+    }
+    
+    int getStatisticsHits() const
+    {
+        return (int)_statisticsHits;
+    }
+    
+    ///Returns the hits counted by addStatisticsHit() and resets them
+    int takeStatisticsHits() const
+    {
+        return _statisticsHits.fetchAndStoreRelaxed(0);
+    }
+    
+private:
+    
+    mutable QAtomicInt _accessed;
+    mutable QAtomicInt _accessCount;
+    mutable QAtomicInt _computeTimeMs;
+    mutable QAtomicInt _statisticsHits;
+    mutable double _insertionTime; //< only accessed while the bucket lock of the cache is taken
 };
 
 /** @brief Implements AbstractCacheEntry. This class represents a combinaison of
@@ -371,6 +464,7 @@ public:
     , _cache()
     , _removeBackingFileBeforeDestruction(false)
     , _requestedStorage(eStorageModeNone)
+    , _pendingWriteBack(false)
     {
     }
 
@@ -383,15 +477,14 @@ public:
     CacheEntryHelper(const KeyType & key,
                      const boost::shared_ptr<ParamsType> & params,
                      const CacheAPI* cache,
-                     Natron::StorageModeEnum storage,
-                     const std::string & path)
+                     Natron::StorageModeEnum storage)
         : _key(key)
           , _params(params)
           , _data()
           , _cache(cache)
           , _removeBackingFileBeforeDestruction(false)
-          , _requestedPath(path)
           , _requestedStorage(storage)
+          , _pendingWriteBack(false)
     {
     }
 
@@ -406,14 +499,12 @@ public:
     void setCacheEntry(const KeyType & key,
                        const boost::shared_ptr<ParamsType> & params,
                        const CacheAPI* cache,
-                       Natron::StorageModeEnum storage,
-                       const std::string & path)
+                       Natron::StorageModeEnum storage)
     {
         assert(!_params && _cache == NULL);
         _key = key;
         _params = params;
         _cache = cache;
-        _requestedPath = path;
         _requestedStorage = storage;
     }
 
@@ -428,7 +519,7 @@ public:
             return;
         }
 
-        allocate(_params->getElementsCount(),_requestedStorage,_requestedPath);
+        allocate(_params->getElementsCount(),_requestedStorage);
         onMemoryAllocated(false);
 
         if (_cache) {
@@ -437,28 +528,31 @@ public:
     }
     
     /**
-     * @brief To be called for disk-cached entries when restoring them from a file.
-     * The file-path will be the one passed to the constructor
+     * @brief To be called for disk-cached entries when restoring them from the segment files of the cache.
+     * The data is not read, the entry is just inserted back in the disk portion.
+     * WARNING: This function throws a std::bad_alloc if the region does not exist in the segment file.
      **/
-    void restoreMetaDataFromFile(std::size_t size)
+    void restoreMetaDataFromSegment(int segment,
+                                    std::size_t offset,
+                                    std::size_t size)
     {
         if (!_cache || _requestedStorage != Natron::eStorageModeDisk) {
             return;
         }
         
-        assert(!_requestedPath.empty());
-        
-        restoreBufferFromFile(_requestedPath);
-        
-        if (_cache) {
-            _cache->notifyEntryStorageChanged(Natron::eStorageModeNone, Natron::eStorageModeDisk, getTime(),size);
+        boost::shared_ptr<CacheSegmentStore> store = _cache->getSegmentStore();
+        if (!store) {
+            throw std::bad_alloc();
         }
+        _data.restoreBufferFromSegment(store,segment,offset,size);
+        
+        _cache->notifyEntryStorageChanged(Natron::eStorageModeNone, Natron::eStorageModeDisk, getTime(),size);
         onMemoryAllocated(true);
     }
 
     /**
      * @brief Called right away once the buffer is allocated. Used in debug mode to initialize image with a default color.
-     * @param diskRestoration If true, this is called by restoreMetaDataFromFile() and the memory is in fact not allocated, this should
+     * @param diskRestoration If true, this is called by restoreMetaDataFromSegment() and the memory is in fact not allocated, this should
      * just restore meta-data
      **/
     virtual void onMemoryAllocated(bool /*diskRestoration*/)
@@ -471,8 +565,15 @@ public:
         return _key;
     }
     
-    const std::string& getFilePath() const {
-        return _data.getFilePath();
+    /**
+     * @brief Returns where the data of the entry lives in the segment files of the cache.
+     * The segment is -1 if the entry is not stored on disk.
+     **/
+    void getDiskLocation(int* segment,
+                         std::size_t* offset,
+                         std::size_t* length) const
+    {
+        _data.getDiskLocation(segment,offset,length);
     }
 
     typename AbstractCacheEntry<KeyType>::hash_type getHashKey() const OVERRIDE FINAL
@@ -480,37 +581,6 @@ public:
         return _key.getHash();
     }
 
-    std::string generateStringFromHash(const std::string & path,U64 hashKey) const
-    {
-        std::string name(path);
-
-        if ( path.empty() ) {
-            QDir subfolder( path.c_str() );
-            if ( !subfolder.exists() ) {
-                std::cout << "(" << std::hex <<
-                    this << ") " <<   "Something is wrong in cache... couldn't find : " << path << std::endl;
-                throw std::invalid_argument(path);
-            }
-        }
-        QString hashKeyStr = QString::number(hashKey,16); //< hex is base 16
-        for (int i = 0; i < 2; ++i) {
-            if (i >= hashKeyStr.size()) {
-                break;
-            }
-            name.push_back(hashKeyStr[i].toAscii());
-        }
-        name.append("/");
-        int i = 2;
-        while (i < hashKeyStr.size()) {
-            name.push_back(hashKeyStr[i].toAscii());
-            ++i;
-        }
-        
-        name.append("." NATRON_CACHE_FILE_EXT);
-
-        return name;
-    }
-
     /** @brief This function is called by the get() function of the Cache when the entry is
      * living only in the disk portion of the cache. No locking is required here because the
      * caller is already preventing other threads to call this function.
@@ -524,15 +594,39 @@ public:
     }
 
     /**
-     * @brief Can be called several times without harm
+     * @brief Set by the cache when the entry was moved to the disk portion but its memory is not yet written
+     * to its segment file and released. The cache only reads and writes this flag under the lock of the bucket
+     * containing the entry.
+     **/
+    void setPendingWriteBack(bool pending) const
+    {
+        _pendingWriteBack = pending;
+    }
+
+    bool isPendingWriteBack() const
+    {
+        return _pendingWriteBack;
+    }
+
+    /**
+     * @brief Moves the data of an entry of the disk portion to the current segment file, so that
+     * mostly empty segment files can be removed. The entry must not be mapped. Returns false if it was not moved.
+     **/
+    bool relocateDiskData()
+    {
+        return _data.relocate();
+    }
+
+    /**
+     * @brief Can be called several times without harm. See Buffer::deallocate() for alreadyFlushed.
      **/
-    void deallocate()
+    void deallocate(bool alreadyFlushed = false)
     {
         std::size_t sz = size();
         bool dataAllocated = _data.isAllocated();
         int time = getTime();
         
-        _data.deallocate();
+        _data.deallocate(alreadyFlushed);
         
         if (_cache) {
             if ( isStoredOnDisk() ) {
@@ -573,7 +667,7 @@ public:
     }
 
     /**
-     * @brief An entry stored on disk is effectively destroyed when its backing file is removed.
+     * @brief An entry stored on disk is effectively destroyed when its region of the segment file is released.
      **/
     void removeAnyBackingFile() const
     {
@@ -581,11 +675,14 @@ public:
             return;
         }
         
-        bool isAlloc = _data.isAllocated();
-        bool hasRemovedFile = _data.removeAnyBackingFile();
-        if (hasRemovedFile) {
-            _cache->backingFileClosed();
+        int segment;
+        std::size_t offset,length;
+        _data.getDiskLocation(&segment,&offset,&length);
+        if (segment != -1) {
+            _cache->notifyEntryDiskDataReleased(getHashKey(),segment,offset);
         }
+        bool isAlloc = _data.isAllocated();
+        _data.removeAnyBackingFile();
         if ( isAlloc ) {
             _cache->notifyEntryDestroyed(getTime(), _params->getElementsCount() * sizeof(DataType),Natron::eStorageModeRAM);
         } else {
@@ -616,79 +713,29 @@ protected:
 
     void reallocate(U64 elemCount)
     {
+        size_t oldSize = size();
         _params->setElementsCount(elemCount);
         _data.reallocate(elemCount);
         if (_cache) {
-            size_t oldSize = size();
-            _cache->notifyEntrySizeChanged( oldSize,size(),_data.getStorageMode() );
+            _cache->notifyEntrySizeChanged( oldSize,size() );
         }
     }
 
 private:
 
-    static bool fileExists(const std::string& filename)
-    {
-        std::ifstream f(filename.c_str());
-        bool ret = f.good();
-        f.close();
-        return ret;
-    }
-
     /** @brief This function is called in allocateMeory(...) and before the object is exposed
      * to other threads. Hence this function doesn't need locking mechanism at all.
      * We must ensure that this function is called ONLY by allocateMemory(), that's why
      * it is private.
      **/
-    void allocate( U64 count,
-                   Natron::StorageModeEnum storage,
-                   std::string path = std::string() )
-    {
-        std::string fileName;
-
-        if (storage == Natron::eStorageModeDisk) {
-            
-            typename AbstractCacheEntry<KeyType>::hash_type hashKey = getHashKey();
-            try {
-                fileName = generateStringFromHash(path,hashKey);
-            } catch (const std::invalid_argument & e) {
-                std::cout << "Path is empty but required for disk caching: " << e.what() << std::endl;
-                return;
-            }
-            
-            assert(!fileName.empty());
-            //Check if the filename already exists, if so append a 0-based index after the hash (separated by a '_')
-            //and try again
-            int index = 0;
-            if (fileExists(fileName)) {
-                fileName.insert(fileName.size() - 4,"_0");
-            }
-            while (fileExists(fileName)) {
-                ++index;
-                std::stringstream ss;
-                ss << index;
-                fileName.replace(fileName.size() - 1,std::string::npos,ss.str());
-            }
-#ifdef DEBUG
-            if (!CacheAPI::checkFileNameMatchesHash(fileName, hashKey)) {
-                qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
-            }
-#endif
-        }
-        _data.allocate(count, storage, fileName);
-    }
-
-    /** @brief This function is called in allocateMeory() and before the object is exposed
-     * to other threads. Hence this function doesn't need locking mechanism at all.
-     * We must ensure that this function is called ONLY by allocateMemory(), that's why
-     * it is private.
-     **/
-    void restoreBufferFromFile(const std::string & path)
+    void allocate(U64 count,
+                  Natron::StorageModeEnum storage)
     {
-        if (!fileExists(path)) {
-            throw std::bad_alloc();
+        boost::shared_ptr<CacheSegmentStore> store;
+        if ( (storage == Natron::eStorageModeDisk) && _cache ) {
+            store = _cache->getSegmentStore();
         }
-        _data.restoreBufferFromFile(path);
-       
+        _data.allocate(count, storage, store);
     }
 
 protected:
@@ -698,8 +745,8 @@ protected:
     Buffer<DataType> _data;
     const CacheAPI* _cache;
     bool _removeBackingFileBeforeDestruction;
-    std::string _requestedPath;
     Natron::StorageModeEnum _requestedStorage;
+    mutable bool _pendingWriteBack;
 };
 }
 
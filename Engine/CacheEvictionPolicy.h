@@ -0,0 +1,294 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_CACHEEVICTIONPOLICY_H_
+#define NATRON_ENGINE_CACHEEVICTIONPOLICY_H_
+
+#include <list>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#endif
+#include "Global/Macros.h"
+#include "Global/Enums.h"
+
+///Number of least recently used entries examined by the policies which do not simply evict the LRU entry
+#define NATRON_CACHE_EVICTION_SAMPLES 8
+
+///Maximum number of evicted hash keys remembered by the ARC policy, per ghost list and per cache bucket
+#define NATRON_CACHE_ARC_GHOST_SIZE 64
+
+namespace Natron {
+
+/**
+ * @brief Interface of the eviction policies of Natron::Cache. Each bucket of the cache owns its own policy
+ * object, which is only ever called while the bucket lock is taken for writing.
+ * When the in-memory portion of a bucket must shrink, the cache collects up to getCandidatesCount() entries
+ * that are not referenced anywhere else, ordered from the least recently used, and the policy picks which
+ * one is evicted.
+ **/
+template <typename EntryType>
+class CacheEvictionPolicyI
+{
+public:
+
+    typedef typename EntryType::hash_type hash_type;
+    typedef boost::shared_ptr<EntryType> EntryTypePtr;
+    typedef std::list<std::pair<hash_type,EntryTypePtr> > CandidatesList;
+
+    CacheEvictionPolicyI() {}
+
+    virtual ~CacheEvictionPolicyI() {}
+
+    virtual Natron::CacheEvictionPolicyEnum getType() const = 0;
+
+    /**
+     * @brief How many candidates should be collected for a single eviction.
+     **/
+    virtual std::size_t getCandidatesCount() const = 0;
+
+    /**
+     * @brief Returns the candidate to evict. The list is never empty.
+     **/
+    virtual typename CandidatesList::const_iterator selectVictim(const CandidatesList& candidates) = 0;
+
+    /**
+     * @brief Called once the entry returned by selectVictim() has been removed from the in-memory portion.
+     **/
+    virtual void onEntryEvicted(const EntryTypePtr& /*entry*/) {}
+
+    /**
+     * @brief Called when a look-up of the given hash key missed the in-memory portion.
+     **/
+    virtual void onMiss(hash_type /*hash*/) {}
+};
+
+/**
+ * @brief Evicts the least recently used entry. This is the historical behaviour of the cache.
+ **/
+template <typename EntryType>
+class LRUCacheEvictionPolicy
+    : public CacheEvictionPolicyI<EntryType>
+{
+public:
+
+    typedef typename CacheEvictionPolicyI<EntryType>::CandidatesList CandidatesList;
+
+    LRUCacheEvictionPolicy() {}
+
+    virtual ~LRUCacheEvictionPolicy() {}
+
+    virtual Natron::CacheEvictionPolicyEnum getType() const OVERRIDE FINAL
+    {
+        return Natron::eCacheEvictionPolicyLRU;
+    }
+
+    virtual std::size_t getCandidatesCount() const OVERRIDE FINAL
+    {
+        return 1;
+    }
+
+    virtual typename CandidatesList::const_iterator selectVictim(const CandidatesList& candidates) OVERRIDE FINAL
+    {
+        return candidates.begin();
+    }
+};
+
+/**
+ * @brief Among the least recently used entries, evicts the one that is the cheapest to recompute
+ * relatively to the memory it occupies, using the compute time recorded on the entry.
+ * This prevents one large but cheap image (e.g: a big Roto mask) from pushing many expensive images out.
+ **/
+template <typename EntryType>
+class CostAwareCacheEvictionPolicy
+    : public CacheEvictionPolicyI<EntryType>
+{
+public:
+
+    typedef typename CacheEvictionPolicyI<EntryType>::CandidatesList CandidatesList;
+
+    CostAwareCacheEvictionPolicy() {}
+
+    virtual ~CostAwareCacheEvictionPolicy() {}
+
+    virtual Natron::CacheEvictionPolicyEnum getType() const OVERRIDE FINAL
+    {
+        return Natron::eCacheEvictionPolicyCostAware;
+    }
+
+    virtual std::size_t getCandidatesCount() const OVERRIDE FINAL
+    {
+        return NATRON_CACHE_EVICTION_SAMPLES;
+    }
+
+    virtual typename CandidatesList::const_iterator selectVictim(const CandidatesList& candidates) OVERRIDE FINAL
+    {
+        typename CandidatesList::const_iterator ret = candidates.begin();
+        double minCost = getCostPerByte(ret->second);
+        typename CandidatesList::const_iterator it = ret;
+        for (++it; it != candidates.end(); ++it) {
+            double cost = getCostPerByte(it->second);
+            ///On equal cost, the least recently used entry is preferred
+            if (cost < minCost) {
+                minCost = cost;
+                ret = it;
+            }
+        }
+        return ret;
+    }
+
+private:
+
+    static double getCostPerByte(const typename CacheEvictionPolicyI<EntryType>::EntryTypePtr& entry)
+    {
+        ///Add 1ms so that entries whose compute time was not recorded are still sorted by size
+        return (entry->getComputeTimeMs() + 1.) / std::max( (std::size_t)1, entry->size() );
+    }
+};
+
+/**
+ * @brief An approximation of the Adaptive Replacement Cache (ARC) policy.
+ * Entries that were never hit since they were inserted are "recent", the others are "frequent".
+ * The hash keys of the evicted entries are remembered in 2 bounded ghost lists depending on their kind.
+ * A miss on a key of the recent ghost list means the recent entries were evicted too early, hence the target
+ * share of recent entries grows. Conversely a miss on the frequent ghost list makes it shrink.
+ * The victim is the least recently used candidate of the kind exceeding its target share.
+ * Scrubbing back and forth on the timeline turns the viewed frames into frequent entries which are then
+ * protected from a single pass over many new frames.
+ **/
+template <typename EntryType>
+class ARCCacheEvictionPolicy
+    : public CacheEvictionPolicyI<EntryType>
+{
+public:
+
+    typedef typename CacheEvictionPolicyI<EntryType>::hash_type hash_type;
+    typedef typename CacheEvictionPolicyI<EntryType>::EntryTypePtr EntryTypePtr;
+    typedef typename CacheEvictionPolicyI<EntryType>::CandidatesList CandidatesList;
+
+    ARCCacheEvictionPolicy()
+    : _recentTarget(0.5)
+    , _recentGhosts()
+    , _nRecentGhosts(0)
+    , _frequentGhosts()
+    , _nFrequentGhosts(0)
+    {
+    }
+
+    virtual ~ARCCacheEvictionPolicy() {}
+
+    virtual Natron::CacheEvictionPolicyEnum getType() const OVERRIDE FINAL
+    {
+        return Natron::eCacheEvictionPolicyARC;
+    }
+
+    virtual std::size_t getCandidatesCount() const OVERRIDE FINAL
+    {
+        return NATRON_CACHE_EVICTION_SAMPLES;
+    }
+
+    virtual typename CandidatesList::const_iterator selectVictim(const CandidatesList& candidates) OVERRIDE FINAL
+    {
+        typename CandidatesList::const_iterator firstRecent = candidates.end();
+        typename CandidatesList::const_iterator firstFrequent = candidates.end();
+        int nRecent = 0;
+        int nCandidates = 0;
+        for (typename CandidatesList::const_iterator it = candidates.begin(); it != candidates.end(); ++it, ++nCandidates) {
+            if (it->second->getAccessCount() == 0) {
+                if ( firstRecent == candidates.end() ) {
+                    firstRecent = it;
+                }
+                ++nRecent;
+            } else if ( firstFrequent == candidates.end() ) {
+                firstFrequent = it;
+            }
+        }
+        if ( firstRecent == candidates.end() ) {
+            return firstFrequent;
+        } else if ( firstFrequent == candidates.end() ) {
+            return firstRecent;
+        }
+        return (double)nRecent / nCandidates > _recentTarget ? firstRecent : firstFrequent;
+    }
+
+    virtual void onEntryEvicted(const EntryTypePtr& entry) OVERRIDE FINAL
+    {
+        if (entry->getAccessCount() == 0) {
+            pushGhost(entry->getHashKey(), _recentGhosts, _nRecentGhosts);
+        } else {
+            pushGhost(entry->getHashKey(), _frequentGhosts, _nFrequentGhosts);
+        }
+    }
+
+    virtual void onMiss(hash_type hash) OVERRIDE FINAL
+    {
+        const double step = 1. / NATRON_CACHE_ARC_GHOST_SIZE;
+        if ( removeGhost(hash, _recentGhosts, _nRecentGhosts) ) {
+            double delta = _nRecentGhosts >= _nFrequentGhosts ? 1. : (double)_nFrequentGhosts / std::max(1,_nRecentGhosts);
+            _recentTarget = std::min(1., _recentTarget + delta * step);
+        } else if ( removeGhost(hash, _frequentGhosts, _nFrequentGhosts) ) {
+            double delta = _nFrequentGhosts >= _nRecentGhosts ? 1. : (double)_nRecentGhosts / std::max(1,_nFrequentGhosts);
+            _recentTarget = std::max(0., _recentTarget - delta * step);
+        }
+    }
+
+private:
+
+    static void pushGhost(hash_type hash,
+                          std::list<hash_type>& ghosts,
+                          int& nGhosts)
+    {
+        ghosts.push_back(hash);
+        ++nGhosts;
+        if (nGhosts > NATRON_CACHE_ARC_GHOST_SIZE) {
+            ghosts.pop_front();
+            --nGhosts;
+        }
+    }
+
+    static bool removeGhost(hash_type hash,
+                            std::list<hash_type>& ghosts,
+                            int& nGhosts)
+    {
+        typename std::list<hash_type>::iterator found = std::find(ghosts.begin(), ghosts.end(), hash);
+        if ( found == ghosts.end() ) {
+            return false;
+        }
+        ghosts.erase(found);
+        --nGhosts;
+        return true;
+    }
+
+    double _recentTarget; //< the share of recent entries, in [0,1], the in-memory portion should aim for
+    std::list<hash_type> _recentGhosts; //< hash keys of evicted recent entries, oldest first
+    int _nRecentGhosts;
+    std::list<hash_type> _frequentGhosts; //< hash keys of evicted frequent entries, oldest first
+    int _nFrequentGhosts;
+};
+
+/**
+ * @brief Returns a new eviction policy of the given type, the caller takes ownership of it.
+ **/
+template <typename EntryType>
+CacheEvictionPolicyI<EntryType>*
+createCacheEvictionPolicy(Natron::CacheEvictionPolicyEnum type)
+{
+    switch (type) {
+    case Natron::eCacheEvictionPolicyARC:
+        return new ARCCacheEvictionPolicy<EntryType>();
+    case Natron::eCacheEvictionPolicyCostAware:
+        return new CostAwareCacheEvictionPolicy<EntryType>();
+    case Natron::eCacheEvictionPolicyLRU:
+    default:
+        return new LRUCacheEvictionPolicy<EntryType>();
+    }
+}
+
+} // namespace Natron
+
+#endif // NATRON_ENGINE_CACHEEVICTIONPOLICY_H_
@@ -0,0 +1,546 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CacheSegmentStore.h"
+
+#include <map>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#endif
+#include <QtCore/QMutex>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QDebug>
+#include <QtCore/QDateTime>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QAtomicInt>
+
+#include "Engine/AppManager.h"
+#include "Engine/MemoryFile.h"
+
+#define SEGMENT_FILE_PREFIX "segment"
+#define SEGMENT_MAGIC "NTCSEG01"
+#define SEGMENT_MAGIC_SIZE 8
+
+using namespace Natron;
+
+namespace {
+
+struct Segment
+{
+    boost::shared_ptr<MemoryFile> file;
+    U64 tag;
+    std::size_t end; //< where the next region will be appended
+    std::size_t liveBytes; //< bytes of the regions that were not released
+    bool sealed; //< no region can be appended to a sealed segment
+    bool owned; //< true if the segment file was created by this store
+
+    Segment()
+    : file()
+    , tag(0)
+    , end(0)
+    , liveBytes(0)
+    , sealed(false)
+    , owned(false)
+    {
+    }
+};
+
+typedef std::map<int,Segment> SegmentsMap;
+
+std::size_t
+alignedLength(std::size_t length)
+{
+    std::size_t ret = ( (length + NATRON_CACHE_SEGMENT_ALIGNMENT - 1) / NATRON_CACHE_SEGMENT_ALIGNMENT ) * NATRON_CACHE_SEGMENT_ALIGNMENT;
+
+    return ret == 0 ? NATRON_CACHE_SEGMENT_ALIGNMENT : ret;
+}
+
+///Returns the index of the segment from its file name, or -1 if this is not a segment file
+int
+getSegmentIndexFromFileName(const QString & fileName)
+{
+    QString ext("." NATRON_CACHE_FILE_EXT);
+    if ( !fileName.startsWith(SEGMENT_FILE_PREFIX) || !fileName.endsWith(ext) ) {
+        return -1;
+    }
+    int prefixLength = QString(SEGMENT_FILE_PREFIX).size();
+    bool ok;
+    int index = fileName.mid(prefixLength, fileName.size() - prefixLength - ext.size()).toInt(&ok);
+
+    return ok ? index : -1;
+}
+
+///Returns the tag of the segment file, or 0 if it does not have a valid header
+U64
+readSegmentTag(const MemoryFile & file)
+{
+    if ( !file.data() || (file.size() < NATRON_CACHE_SEGMENT_HEADER_SIZE) ||
+         (std::memcmp(file.data(),SEGMENT_MAGIC,SEGMENT_MAGIC_SIZE) != 0) ) {
+        return 0;
+    }
+    U64 tag;
+    std::memcpy(&tag,file.data() + SEGMENT_MAGIC_SIZE,sizeof(U64));
+
+    return tag;
+}
+
+}
+
+struct Natron::CacheSegmentStorePrivate
+{
+    QString directoryPath;
+    mutable QMutex lock; //< protects all members below
+    SegmentsMap segments;
+    std::map<int,U64> pinnedSegments; //< segments of a previous session regions may still be restored from, with their tag
+    int currentSegment; //< the segment regions are appended to, -1 if none
+    int nextSegmentIndex;
+    bool shared;
+
+    CacheSegmentStorePrivate(const std::string & directoryPath)
+    : directoryPath( directoryPath.c_str() )
+    , lock()
+    , segments()
+    , pinnedSegments()
+    , currentSegment(-1)
+    , nextSegmentIndex(0)
+    , shared(false)
+    {
+    }
+
+    std::string getSegmentFilePath(int index) const
+    {
+        QString ret(directoryPath);
+        if ( !ret.endsWith('/') && !ret.endsWith('\\') ) {
+            ret.append( QDir::separator() );
+        }
+        ret.append(SEGMENT_FILE_PREFIX);
+        ret.append( QString::number(index) );
+        ret.append("." NATRON_CACHE_FILE_EXT);
+
+        return ret.toStdString();
+    }
+
+    ///Creates a new segment file able to hold regions of the given total size, returns its index or -1 on failure.
+    ///Must be called under lock.
+    int createSegment(std::size_t capacity)
+    {
+        Segment segment;
+        int index = -1;
+        ///Another process using the same directory may create a segment file with the same index in the meantime
+        for (int attempt = 0; attempt < 16 && index == -1; ++attempt) {
+            int candidate = nextSegmentIndex++;
+            try {
+                segment.file.reset( new MemoryFile(getSegmentFilePath(candidate),MemoryFile::if_exists_fail_if_not_exists_create) );
+                index = candidate;
+            } catch (const std::exception & e) {
+                segment.file.reset();
+            }
+        }
+        if (index == -1) {
+            std::cout << "Failed to create a cache segment file in " << directoryPath.toStdString() << std::endl;
+
+            return -1;
+        }
+        try {
+            segment.file->resize(NATRON_CACHE_SEGMENT_HEADER_SIZE + capacity);
+        } catch (const std::exception & e) {
+            std::cout << e.what() << std::endl;
+            segment.file->remove();
+
+            return -1;
+        }
+        segment.tag = CacheSegmentStore::generateTag();
+        std::memcpy(segment.file->data(),SEGMENT_MAGIC,SEGMENT_MAGIC_SIZE);
+        std::memcpy(segment.file->data() + SEGMENT_MAGIC_SIZE,&segment.tag,sizeof(U64));
+        segment.end = NATRON_CACHE_SEGMENT_HEADER_SIZE;
+        segment.owned = true;
+        appPTR->increaseNCacheFilesOpened();
+        segments.insert( std::make_pair(index,segment) );
+
+        return index;
+    }
+
+    ///Closes the segment file and removes it from the disk. Must be called under lock.
+    void removeSegment(SegmentsMap::iterator it)
+    {
+        if (it->first == currentSegment) {
+            currentSegment = -1;
+        }
+        if ( ( pinnedSegments.find(it->first) != pinnedSegments.end() ) || (shared && !it->second.owned) ) {
+            ///Regions that were not restored yet may live in the file, or another process may use it
+            appPTR->decreaseNCacheFilesOpened();
+            segments.erase(it);
+
+            return;
+        }
+        try {
+            it->second.file->remove();
+        } catch (const std::exception & e) {
+            std::cout << e.what() << std::endl;
+        }
+        appPTR->decreaseNCacheFilesOpened();
+        segments.erase(it);
+    }
+
+    boost::shared_ptr<MemoryFile> getSegmentFile(int index) const
+    {
+        QMutexLocker k(&lock);
+        SegmentsMap::const_iterator found = segments.find(index);
+
+        return found == segments.end() ? boost::shared_ptr<MemoryFile>() : found->second.file;
+    }
+};
+
+CacheSegmentStore::CacheSegmentStore(const std::string & directoryPath)
+    : _imp( new CacheSegmentStorePrivate(directoryPath) )
+{
+    ///Never overwrite the segment files of a previous session, they may still be restored
+    QDir directory(_imp->directoryPath);
+    QStringList files = directory.entryList(QDir::Files);
+    for (int i = 0; i < files.size(); ++i) {
+        int index = getSegmentIndexFromFileName(files[i]);
+        if (index >= _imp->nextSegmentIndex) {
+            _imp->nextSegmentIndex = index + 1;
+        }
+    }
+}
+
+U64
+CacheSegmentStore::generateTag()
+{
+    static QAtomicInt counter(0);
+    U64 ret = (U64)QDateTime::currentMSecsSinceEpoch() << 24;
+
+    ret ^= (U64)QCoreApplication::applicationPid() << 8;
+    ret ^= (U64)counter.fetchAndAddRelaxed(1);
+
+    return ret == 0 ? 1 : ret;
+}
+
+void
+CacheSegmentStore::setSharedBetweenProcesses(bool shared)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->shared = shared;
+}
+
+CacheSegmentStore::~CacheSegmentStore()
+{
+    ///The segment files holding data are kept on disk, they are referenced by the table of contents of the cache.
+    ///removeSegment() keeps pinned files on disk.
+    while ( !_imp->segments.empty() ) {
+        SegmentsMap::iterator it = _imp->segments.begin();
+        if (it->second.liveBytes == 0) {
+            _imp->removeSegment(it);
+        } else {
+            appPTR->decreaseNCacheFilesOpened();
+            _imp->segments.erase(it);
+        }
+    }
+}
+
+bool
+CacheSegmentStore::allocate(std::size_t length,
+                            int* segment,
+                            std::size_t* offset)
+{
+    std::size_t aligned = alignedLength(length);
+    QMutexLocker k(&_imp->lock);
+
+    if (aligned > NATRON_CACHE_SEGMENT_SIZE) {
+        ///Too large to share a segment
+        int index = _imp->createSegment(aligned);
+        if (index == -1) {
+            return false;
+        }
+        Segment & s = _imp->segments[index];
+        s.end += aligned;
+        s.liveBytes = aligned;
+        s.sealed = true;
+        *segment = index;
+        *offset = NATRON_CACHE_SEGMENT_HEADER_SIZE;
+
+        return true;
+    }
+
+    SegmentsMap::iterator current = _imp->segments.find(_imp->currentSegment);
+    if ( (current != _imp->segments.end()) && (current->second.end + aligned > current->second.file->size()) ) {
+        current->second.sealed = true;
+        if (current->second.liveBytes == 0) {
+            _imp->removeSegment(current);
+        }
+        current = _imp->segments.end();
+        _imp->currentSegment = -1;
+    }
+    if ( current == _imp->segments.end() ) {
+        _imp->currentSegment = _imp->createSegment(NATRON_CACHE_SEGMENT_SIZE);
+        if (_imp->currentSegment == -1) {
+            return false;
+        }
+        current = _imp->segments.find(_imp->currentSegment);
+    }
+
+    *segment = current->first;
+    *offset = current->second.end;
+    current->second.end += aligned;
+    current->second.liveBytes += aligned;
+
+    return true;
+}
+
+void
+CacheSegmentStore::release(int segment,
+                           std::size_t /*offset*/,
+                           std::size_t length)
+{
+    QMutexLocker k(&_imp->lock);
+    SegmentsMap::iterator found = _imp->segments.find(segment);
+
+    if ( found == _imp->segments.end() ) {
+        return;
+    }
+    std::size_t aligned = alignedLength(length);
+    found->second.liveBytes = aligned > found->second.liveBytes ? 0 : found->second.liveBytes - aligned;
+    if (found->second.liveBytes == 0) {
+        if ( (segment == _imp->currentSegment) && !_imp->shared ) {
+            ///Nothing lives in the current segment anymore, start over from its beginning
+            found->second.end = NATRON_CACHE_SEGMENT_HEADER_SIZE;
+        } else {
+            _imp->removeSegment(found);
+        }
+    }
+}
+
+char*
+CacheSegmentStore::getData(int segment,
+                           std::size_t offset) const
+{
+    boost::shared_ptr<MemoryFile> file = _imp->getSegmentFile(segment);
+
+    if (!file || !file->data() || offset >= file->size()) {
+        return NULL;
+    }
+
+    return file->data() + offset;
+}
+
+bool
+CacheSegmentStore::flush(int segment,
+                         std::size_t offset,
+                         std::size_t length) const
+{
+    ///The segment cannot be closed while one of its regions is alive, no need to hold the lock while writing
+    boost::shared_ptr<MemoryFile> file = _imp->getSegmentFile(segment);
+
+    if (!file) {
+        return false;
+    }
+
+    return file->flush(offset,length);
+}
+
+void
+CacheSegmentStore::discard(int segment,
+                           std::size_t offset,
+                           std::size_t length) const
+{
+    boost::shared_ptr<MemoryFile> file = _imp->getSegmentFile(segment);
+
+    if (file) {
+        file->discard(offset,length);
+    }
+}
+
+U64
+CacheSegmentStore::getSegmentTag(int segment) const
+{
+    QMutexLocker k(&_imp->lock);
+    SegmentsMap::const_iterator found = _imp->segments.find(segment);
+
+    if ( found != _imp->segments.end() ) {
+        return found->second.tag;
+    }
+    std::map<int,U64>::const_iterator pinned = _imp->pinnedSegments.find(segment);
+
+    return pinned == _imp->pinnedSegments.end() ? 0 : pinned->second;
+}
+
+bool
+CacheSegmentStore::isSegmentOwned(int segment) const
+{
+    QMutexLocker k(&_imp->lock);
+    SegmentsMap::const_iterator found = _imp->segments.find(segment);
+
+    return found != _imp->segments.end() && found->second.owned;
+}
+
+void
+CacheSegmentStore::pinSegments(const std::map<int,U64> & segments)
+{
+    QMutexLocker k(&_imp->lock);
+
+    for (std::map<int,U64>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        _imp->pinnedSegments[it->first] = it->second;
+        if (it->first >= _imp->nextSegmentIndex) {
+            _imp->nextSegmentIndex = it->first + 1;
+        }
+    }
+}
+
+void
+CacheSegmentStore::unpinSegments()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->pinnedSegments.clear();
+}
+
+bool
+CacheSegmentStore::restoreRegion(int segment,
+                                 std::size_t offset,
+                                 std::size_t length)
+{
+    QMutexLocker k(&_imp->lock);
+    SegmentsMap::iterator found = _imp->segments.find(segment);
+
+    if ( found == _imp->segments.end() ) {
+        std::map<int,U64>::iterator pinned = _imp->pinnedSegments.find(segment);
+        if ( pinned == _imp->pinnedSegments.end() ) {
+            return false;
+        }
+        Segment s;
+        try {
+            s.file.reset( new MemoryFile(_imp->getSegmentFilePath(segment),MemoryFile::if_exists_keep_if_dont_exists_fail) );
+        } catch (const std::exception & e) {
+            return false;
+        }
+        s.tag = readSegmentTag(*s.file);
+        if (s.tag != pinned->second) {
+            ///Not the file the regions were written to
+            return false;
+        }
+        ///Only the current segment of this session is appended to
+        s.end = s.file->size();
+        s.sealed = true;
+        appPTR->increaseNCacheFilesOpened();
+        found = _imp->segments.insert( std::make_pair(segment,s) ).first;
+    }
+    std::size_t aligned = alignedLength(length);
+    if ( (offset < NATRON_CACHE_SEGMENT_HEADER_SIZE) || (offset + aligned > found->second.file->size()) ) {
+        return false;
+    }
+    found->second.liveBytes += aligned;
+
+    return true;
+}
+
+void
+CacheSegmentStore::removeUnusedSegmentFiles()
+{
+    QMutexLocker k(&_imp->lock);
+
+    for (SegmentsMap::iterator it = _imp->segments.begin(); it != _imp->segments.end();) {
+        if ( (it->second.liveBytes == 0) && (it->first != _imp->currentSegment) &&
+             ( _imp->pinnedSegments.find(it->first) == _imp->pinnedSegments.end() ) ) {
+            SegmentsMap::iterator next = it;
+            ++next;
+            _imp->removeSegment(it);
+            it = next;
+        } else {
+            ++it;
+        }
+    }
+
+    if (_imp->shared) {
+        ///The other segment files may be in use by other processes
+        return;
+    }
+    QDir directory(_imp->directoryPath);
+    QStringList files = directory.entryList(QDir::Files);
+    for (int i = 0; i < files.size(); ++i) {
+        int index = getSegmentIndexFromFileName(files[i]);
+        if ( (index != -1) && ( _imp->segments.find(index) == _imp->segments.end() ) &&
+             ( _imp->pinnedSegments.find(index) == _imp->pinnedSegments.end() ) ) {
+            directory.remove(files[i]);
+        }
+    }
+}
+
+void
+CacheSegmentStore::getSegmentsToCompact(std::list<int>* segments) const
+{
+    QMutexLocker k(&_imp->lock);
+
+    if (_imp->shared) {
+        ///Other processes may be reading the regions
+        return;
+    }
+    for (SegmentsMap::const_iterator it = _imp->segments.begin(); it != _imp->segments.end(); ++it) {
+        if ( it->second.sealed && ( _imp->pinnedSegments.find(it->first) == _imp->pinnedSegments.end() ) &&
+             ( it->second.liveBytes < (it->second.end - NATRON_CACHE_SEGMENT_HEADER_SIZE) * NATRON_CACHE_SEGMENT_COMPACTION_THRESHOLD ) ) {
+            segments->push_back(it->first);
+        }
+    }
+}
+
+bool
+CacheSegmentStore::relocate(int* segment,
+                            std::size_t* offset,
+                            std::size_t length)
+{
+    char* src = getData(*segment,*offset);
+
+    if (!src) {
+        return false;
+    }
+    int newSegment;
+    std::size_t newOffset;
+    if ( !allocate(length,&newSegment,&newOffset) ) {
+        return false;
+    }
+    char* dst = getData(newSegment,newOffset);
+    if (!dst) {
+        release(newSegment,newOffset,length);
+
+        return false;
+    }
+    std::memcpy(dst,src,length);
+    if ( flush(newSegment,newOffset,length) ) {
+        discard(newSegment,newOffset,length);
+    }
+    release(*segment,*offset,length);
+    *segment = newSegment;
+    *offset = newOffset;
+
+    return true;
+}
+
+int
+CacheSegmentStore::getSegmentsCount() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return (int)_imp->segments.size();
+}
+
+std::size_t
+CacheSegmentStore::getFragmentedSize() const
+{
+    QMutexLocker k(&_imp->lock);
+    std::size_t ret = 0;
+
+    for (SegmentsMap::const_iterator it = _imp->segments.begin(); it != _imp->segments.end(); ++it) {
+        ret += it->second.end - NATRON_CACHE_SEGMENT_HEADER_SIZE - it->second.liveBytes;
+    }
+
+    return ret;
+}
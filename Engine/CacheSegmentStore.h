@@ -0,0 +1,175 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_CACHESEGMENTSTORE_H_
+#define NATRON_ENGINE_CACHESEGMENTSTORE_H_
+
+#include <string>
+#include <list>
+#include <map>
+#include <cstddef>
+#ifndef Q_MOC_RUN
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#endif
+
+#include "Global/Macros.h"
+#include "Global/GlobalDefines.h"
+
+///Capacity of a segment file, in bytes. Entries larger than this get a segment of their own.
+#define NATRON_CACHE_SEGMENT_SIZE (256 * 1024 * 1024)
+
+///Entries are stored at offsets multiple of this, in bytes
+#define NATRON_CACHE_SEGMENT_ALIGNMENT 64
+
+///Each segment file starts with a header identifying it, regions are stored after it
+#define NATRON_CACHE_SEGMENT_HEADER_SIZE NATRON_CACHE_SEGMENT_ALIGNMENT
+
+///A sealed segment whose live data falls below this ratio of its used size should be compacted
+#define NATRON_CACHE_SEGMENT_COMPACTION_THRESHOLD 0.5
+
+namespace Natron {
+
+struct CacheSegmentStorePrivate;
+
+/**
+ * @brief Stores the data of the disk portion of a cache in a few large append-only segment files
+ * instead of one file per entry, so that the number of opened files and inodes does not grow with
+ * the number of entries.
+ *
+ * Each segment file is memory mapped as a whole, the data of an entry is addressed by
+ * (segment, offset, length). New data is always appended to the current segment, and a new segment
+ * is opened when it is full. Released regions are only accounted for: a segment file is removed
+ * once all of its regions have been released, and relocate() moves the live regions of mostly empty
+ * segments (see getSegmentsToCompact()) to the current segment.
+ *
+ * The regions are never moved behind the back of their owner: pointers returned by getData() stay valid
+ * until the region is released or relocated.
+ *
+ * Each segment file has a tag, a random number written in its header when it is created. Regions of a previous
+ * session can only be restored from a segment whose tag matches the one recorded along with them, so that a
+ * segment file that was removed and whose index was reused since is never mistaken for the original one.
+ *
+ * When the store is shared between processes (see setSharedBetweenProcesses()), other processes may read the regions
+ * of the segment files it created: offsets are never reused, the segment files created by other processes are never
+ * removed and the segments are never compacted.
+ *
+ * This class is thread-safe.
+ **/
+class CacheSegmentStore
+    : boost::noncopyable
+{
+public:
+
+    /**
+     * @brief The segment files are created in the given directory.
+     **/
+    CacheSegmentStore(const std::string & directoryPath);
+
+    ~CacheSegmentStore();
+
+    /**
+     * @brief Returns a number that is unlikely to be returned by any other call, in this process or another one.
+     * This is never 0.
+     **/
+    static U64 generateTag();
+
+    /**
+     * @brief Must be called before any region is allocated, see the class documentation.
+     **/
+    void setSharedBetweenProcesses(bool shared);
+
+    /**
+     * @brief Reserves a region of length bytes at the end of the current segment.
+     * Returns false if the segment file could not be created or mapped.
+     **/
+    bool allocate(std::size_t length, int* segment, std::size_t* offset) WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Releases a region previously returned by allocate() or declared by restoreRegion().
+     * The segment file is removed if nothing else lives in it.
+     **/
+    void release(int segment, std::size_t offset, std::size_t length);
+
+    /**
+     * @brief Returns a pointer to the beginning of the region in the memory mapping of its segment,
+     * or NULL if the segment does not exist.
+     **/
+    char* getData(int segment, std::size_t offset) const;
+
+    /**
+     * @brief Writes the region to its segment file.
+     **/
+    bool flush(int segment, std::size_t offset, std::size_t length) const;
+
+    /**
+     * @brief Drops the memory pages of the region, which must have been flushed before. The data is read back
+     * from the segment file on the next access.
+     **/
+    void discard(int segment, std::size_t offset, std::size_t length) const;
+
+    /**
+     * @brief Returns the tag of the segment, or 0 if the segment is unknown.
+     **/
+    U64 getSegmentTag(int segment) const;
+
+    /**
+     * @brief Returns true if the segment file was created by this store.
+     **/
+    bool isSegmentOwned(int segment) const;
+
+    /**
+     * @brief Declares segment files written by a previous session, with their tag, which still hold regions that
+     * may be restored with restoreRegion(). These files are kept on disk even if none of their regions is alive
+     * until unpinSegments() is called.
+     **/
+    void pinSegments(const std::map<int,U64> & segments);
+
+    void unpinSegments();
+
+    /**
+     * @brief Declares a region of a segment file written by a previous session. The segment must have been pinned,
+     * its file is opened if needed. Returns false if the segment file does not exist, does not have the tag it was
+     * pinned with or is too small to contain the region.
+     **/
+    bool restoreRegion(int segment, std::size_t offset, std::size_t length) WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Removes the segment files of the directory that neither contain any region nor are pinned.
+     **/
+    void removeUnusedSegmentFiles();
+
+    /**
+     * @brief Returns the segments that are worth compacting, i.e: those that are no longer appended to, not pinned and whose
+     * live data is below NATRON_CACHE_SEGMENT_COMPACTION_THRESHOLD of their used size.
+     **/
+    void getSegmentsToCompact(std::list<int>* segments) const;
+
+    /**
+     * @brief Moves the region to the current segment: the data is copied and the old region released.
+     * The caller must make sure nobody is accessing the region. Returns false if the relocation failed,
+     * in which case the region is left untouched.
+     **/
+    bool relocate(int* segment, std::size_t* offset, std::size_t length) WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Returns the number of segment files currently opened.
+     **/
+    int getSegmentsCount() const;
+
+    /**
+     * @brief Returns the amount of bytes held by released regions that were not reclaimed yet.
+     **/
+    std::size_t getFragmentedSize() const;
+
+private:
+
+    boost::scoped_ptr<CacheSegmentStorePrivate> _imp;
+};
+
+} // namespace Natron
+
+#endif // NATRON_ENGINE_CACHESEGMENTSTORE_H_
@@ -0,0 +1,431 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CacheSharedIndex.h"
+
+#include <map>
+#include <set>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <QtCore/QMutex>
+#include <QtCore/QFile>
+#include <QtCore/QByteArray>
+
+#ifdef __NATRON_WIN32__
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/file.h>
+#endif
+
+#include "Engine/CacheSegmentStore.h"
+
+#define SHARED_INDEX_MAGIC "NATRNSHI"
+#define SHARED_INDEX_MAGIC_SIZE 8
+
+/*
+ * Layout of the file, all integers are stored in the native byte order:
+ *
+ * Header (SHARED_INDEX_HEADER_SIZE bytes):
+ *  magic (8 bytes), format version (U32), cache version (U32), generation (U64), reserved (40 bytes)
+ * Records (SHARED_INDEX_RECORD_SIZE bytes each, followed by the blob of the entry):
+ *  type (U32), blob length (U32), hash (U64), writer (U64), segment tag (U64), offset (U64), length (U64),
+ *  segment (S32), reserved (4 bytes)
+ *
+ * The generation changes whenever the file is rewritten, readers then read it again from the beginning.
+ */
+#define SHARED_INDEX_HEADER_SIZE 64
+#define SHARED_INDEX_RECORD_SIZE 56
+
+#define SHARED_INDEX_RECORD_PUBLISH 1
+#define SHARED_INDEX_RECORD_UNPUBLISH 2
+
+using namespace Natron;
+
+namespace {
+
+struct Record
+{
+    CacheTOCFile::Entry entry;
+    U64 tag;
+    U64 writer; //< identifies the process that published the entry
+
+    Record()
+    : entry()
+    , tag(0)
+    , writer(0)
+    {
+    }
+};
+
+///Identifies a region of a segment file
+typedef std::pair<U64,U64> RegionKey;
+
+typedef std::multimap<U64,Record> RecordsMap;
+
+template <typename T>
+void
+writeValue(char* dst,
+           T value)
+{
+    std::memcpy( dst, &value, sizeof(T) );
+}
+
+template <typename T>
+T
+readValue(const char* src)
+{
+    T ret;
+
+    std::memcpy( &ret, src, sizeof(T) );
+
+    return ret;
+}
+
+void
+appendRecord(U32 type,
+             const Record & record,
+             QByteArray* buffer)
+{
+    char header[SHARED_INDEX_RECORD_SIZE];
+    std::memset(header, 0, SHARED_INDEX_RECORD_SIZE);
+    writeValue<U32>(header, type);
+    writeValue<U32>(header + 4, (U32)record.entry.blob.size());
+    writeValue<U64>(header + 8, record.entry.hash);
+    writeValue<U64>(header + 16, record.writer);
+    writeValue<U64>(header + 24, record.tag);
+    writeValue<U64>(header + 32, record.entry.offset);
+    writeValue<U64>(header + 40, record.entry.length);
+    writeValue<boost::int32_t>(header + 48, record.entry.segment);
+    buffer->append(header, SHARED_INDEX_RECORD_SIZE);
+    buffer->append( record.entry.blob.data(), (int)record.entry.blob.size() );
+}
+
+void
+appendHeader(unsigned int cacheVersion,
+             U64 generation,
+             QByteArray* buffer)
+{
+    char header[SHARED_INDEX_HEADER_SIZE];
+    std::memset(header, 0, SHARED_INDEX_HEADER_SIZE);
+    std::memcpy(header, SHARED_INDEX_MAGIC, SHARED_INDEX_MAGIC_SIZE);
+    writeValue<U32>(header + 8, NATRON_CACHE_SHARED_INDEX_FORMAT_VERSION);
+    writeValue<U32>(header + 12, cacheVersion);
+    writeValue<U64>(header + 16, generation);
+    buffer->append(header, SHARED_INDEX_HEADER_SIZE);
+}
+
+///Takes an advisory lock on the whole file for the lifetime of the object
+class FileLocker
+{
+    QFile & _file;
+    bool _locked;
+
+public:
+
+    FileLocker(QFile & file,
+               bool exclusive)
+    : _file(file)
+    , _locked(false)
+    {
+#ifdef __NATRON_WIN32__
+        HANDLE handle = (HANDLE)_get_osfhandle( _file.handle() );
+        OVERLAPPED overlapped;
+        std::memset( &overlapped, 0, sizeof(OVERLAPPED) );
+        _locked = LockFileEx(handle, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+#else
+        _locked = flock(_file.handle(), exclusive ? LOCK_EX : LOCK_SH) == 0;
+#endif
+    }
+
+    ~FileLocker()
+    {
+        if (!_locked) {
+            return;
+        }
+#ifdef __NATRON_WIN32__
+        HANDLE handle = (HANDLE)_get_osfhandle( _file.handle() );
+        OVERLAPPED overlapped;
+        std::memset( &overlapped, 0, sizeof(OVERLAPPED) );
+        UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+        flock(_file.handle(), LOCK_UN);
+#endif
+    }
+
+    bool isLocked() const
+    {
+        return _locked;
+    }
+};
+}
+
+struct Natron::CacheSharedIndexPrivate
+{
+    QFile file;
+    unsigned int cacheVersion;
+    U64 writer;
+    mutable QMutex lock; //< protects all members below
+    U64 generation; //< the generation of the file when it was last read
+    qint64 readPosition; //< where the records that were not read yet start in the file
+    RecordsMap records; //< the records that are alive, by hash key
+    std::set<RegionKey> taken; //< regions already handed out by takeEntries()
+    std::set<RegionKey> published; //< regions published by this process
+    QByteArray pendingRecords; //< records to append along with the next write
+
+    CacheSharedIndexPrivate(const std::string & filePath,
+                            unsigned int cacheVersion)
+    : file( filePath.c_str() )
+    , cacheVersion(cacheVersion)
+    , writer( CacheSegmentStore::generateTag() )
+    , lock()
+    , generation(0)
+    , readPosition(SHARED_INDEX_HEADER_SIZE)
+    , records()
+    , taken()
+    , published()
+    , pendingRecords()
+    {
+    }
+
+    ///Returns true if the header of the file is valid for this version, in which case its generation is returned.
+    ///Must be called under the file lock.
+    bool readHeader(U64* fileGeneration)
+    {
+        if ( !file.seek(0) ) {
+            return false;
+        }
+        QByteArray header = file.read(SHARED_INDEX_HEADER_SIZE);
+        if ( (header.size() < SHARED_INDEX_HEADER_SIZE) || (std::memcmp(header.constData(), SHARED_INDEX_MAGIC, SHARED_INDEX_MAGIC_SIZE) != 0) ||
+             (readValue<U32>(header.constData() + 8) != NATRON_CACHE_SHARED_INDEX_FORMAT_VERSION) ||
+             (readValue<U32>(header.constData() + 12) != cacheVersion) ) {
+            return false;
+        }
+        *fileGeneration = readValue<U64>(header.constData() + 16);
+
+        return true;
+    }
+
+    ///Replaces the content of the file by the header and the records that are alive. Must be called under the exclusive file lock.
+    void rewrite()
+    {
+        QByteArray buffer;
+        generation = CacheSegmentStore::generateTag();
+        appendHeader(cacheVersion, generation, &buffer);
+        for (RecordsMap::const_iterator it = records.begin(); it != records.end(); ++it) {
+            appendRecord(SHARED_INDEX_RECORD_PUBLISH, it->second, &buffer);
+        }
+        if ( !file.resize(0) || !file.seek(0) || (file.write(buffer) != buffer.size()) ) {
+            std::cout << "Failed to write the cache shared index " << file.fileName().toStdString() << std::endl;
+        }
+        file.flush();
+        readPosition = buffer.size();
+    }
+
+    void applyRecord(U32 type,
+                     const Record & record)
+    {
+        RegionKey key(record.tag,record.entry.offset);
+        std::pair<RecordsMap::iterator,RecordsMap::iterator> range = records.equal_range(record.entry.hash);
+
+        for (RecordsMap::iterator it = range.first; it != range.second; ++it) {
+            if ( (it->second.tag == key.first) && (it->second.entry.offset == key.second) ) {
+                records.erase(it);
+                break;
+            }
+        }
+        if (type == SHARED_INDEX_RECORD_PUBLISH) {
+            records.insert( std::make_pair(record.entry.hash,record) );
+        } else {
+            taken.erase(key);
+        }
+    }
+
+    ///Reads the records appended since the last call. Must be called under the file lock.
+    void readNewRecords()
+    {
+        U64 fileGeneration;
+        if ( !readHeader(&fileGeneration) ) {
+            return;
+        }
+        if ( (fileGeneration != generation) || (file.size() < readPosition) ) {
+            ///The file was rewritten, read it again from the beginning
+            generation = fileGeneration;
+            readPosition = SHARED_INDEX_HEADER_SIZE;
+            records.clear();
+        }
+        if ( !file.seek(readPosition) ) {
+            return;
+        }
+        QByteArray data = file.readAll();
+        const char* ptr = data.constData();
+        const char* end = ptr + data.size();
+        while (end - ptr >= SHARED_INDEX_RECORD_SIZE) {
+            U32 blobLength = readValue<U32>(ptr + 4);
+            if ( (U64)(end - ptr - SHARED_INDEX_RECORD_SIZE) < blobLength ) {
+                break;
+            }
+            U32 type = readValue<U32>(ptr);
+            Record record;
+            record.entry.hash = readValue<U64>(ptr + 8);
+            record.writer = readValue<U64>(ptr + 16);
+            record.tag = readValue<U64>(ptr + 24);
+            record.entry.offset = readValue<U64>(ptr + 32);
+            record.entry.length = readValue<U64>(ptr + 40);
+            record.entry.segment = readValue<boost::int32_t>(ptr + 48);
+            record.entry.blob.assign(ptr + SHARED_INDEX_RECORD_SIZE, blobLength);
+            if ( (type == SHARED_INDEX_RECORD_PUBLISH) || (type == SHARED_INDEX_RECORD_UNPUBLISH) ) {
+                applyRecord(type,record);
+            }
+            ptr += SHARED_INDEX_RECORD_SIZE + blobLength;
+            readPosition += SHARED_INDEX_RECORD_SIZE + blobLength;
+        }
+    }
+
+    ///Appends the pending records and the given ones to the file. Must be called under the exclusive file lock
+    ///after readNewRecords().
+    void appendRecords(const QByteArray & buffer)
+    {
+        QByteArray toWrite = pendingRecords;
+        toWrite.append(buffer);
+        pendingRecords.clear();
+        if ( toWrite.isEmpty() ) {
+            return;
+        }
+        if ( !file.seek( file.size() ) || (file.write(toWrite) != toWrite.size()) ) {
+            std::cout << "Failed to write the cache shared index " << file.fileName().toStdString() << std::endl;
+        }
+        file.flush();
+        readNewRecords();
+        if (file.size() > NATRON_CACHE_SHARED_INDEX_MAX_SIZE) {
+            rewrite();
+        }
+    }
+
+    ///Reads the records appended since the last call, and writes the pending records if any.
+    void synchronize()
+    {
+        if ( !file.isOpen() ) {
+            return;
+        }
+        FileLocker locker( file, !pendingRecords.isEmpty() );
+        if ( !locker.isLocked() ) {
+            return;
+        }
+        readNewRecords();
+        if ( !pendingRecords.isEmpty() ) {
+            appendRecords( QByteArray() );
+        }
+    }
+
+    void takeRecord(const Record & record,
+                    std::list<CacheTOCFile::Entry>* entries,
+                    CacheTOCFile::SegmentTags* segments)
+    {
+        if (record.writer == writer) {
+            return;
+        }
+        if ( !taken.insert( RegionKey(record.tag,record.entry.offset) ).second ) {
+            return;
+        }
+        entries->push_back(record.entry);
+        (*segments)[record.entry.segment] = record.tag;
+    }
+};
+
+CacheSharedIndex::CacheSharedIndex(const std::string & filePath,
+                                   unsigned int cacheVersion)
+    : _imp( new CacheSharedIndexPrivate(filePath,cacheVersion) )
+{
+    if ( !_imp->file.open(QIODevice::ReadWrite | QIODevice::Unbuffered) ) {
+        std::cout << "Failed to open the cache shared index " << filePath << std::endl;
+
+        return;
+    }
+    FileLocker locker(_imp->file,true);
+    U64 fileGeneration;
+    if ( locker.isLocked() && !_imp->readHeader(&fileGeneration) ) {
+        ///New file, or written by another version
+        _imp->rewrite();
+    }
+}
+
+CacheSharedIndex::~CacheSharedIndex()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->synchronize();
+}
+
+void
+CacheSharedIndex::publish(const CacheTOCFile::Entry & entry,
+                          U64 segmentTag)
+{
+    QMutexLocker k(&_imp->lock);
+
+    if ( !_imp->file.isOpen() || ( _imp->published.find( RegionKey(segmentTag,entry.offset) ) != _imp->published.end() ) ) {
+        return;
+    }
+    Record record;
+    record.entry = entry;
+    record.tag = segmentTag;
+    record.writer = _imp->writer;
+    QByteArray buffer;
+    appendRecord(SHARED_INDEX_RECORD_PUBLISH, record, &buffer);
+
+    FileLocker locker(_imp->file,true);
+    if ( !locker.isLocked() ) {
+        return;
+    }
+    _imp->published.insert( RegionKey(segmentTag,entry.offset) );
+    _imp->readNewRecords();
+    _imp->appendRecords(buffer);
+}
+
+void
+CacheSharedIndex::unpublish(U64 hash,
+                            U64 segmentTag,
+                            U64 offset)
+{
+    QMutexLocker k(&_imp->lock);
+
+    if ( _imp->published.erase( RegionKey(segmentTag,offset) ) == 0 ) {
+        return;
+    }
+    Record record;
+    record.entry.hash = hash;
+    record.entry.offset = offset;
+    record.tag = segmentTag;
+    record.writer = _imp->writer;
+    appendRecord(SHARED_INDEX_RECORD_UNPUBLISH, record, &_imp->pendingRecords);
+}
+
+void
+CacheSharedIndex::takeEntries(U64 hash,
+                              std::list<CacheTOCFile::Entry>* entries,
+                              CacheTOCFile::SegmentTags* segments)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->synchronize();
+    std::pair<RecordsMap::iterator,RecordsMap::iterator> range = _imp->records.equal_range(hash);
+    for (RecordsMap::iterator it = range.first; it != range.second; ++it) {
+        _imp->takeRecord(it->second, entries, segments);
+    }
+}
+
+void
+CacheSharedIndex::takeAllRemainingEntries(std::list<CacheTOCFile::Entry>* entries,
+                                          CacheTOCFile::SegmentTags* segments)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->synchronize();
+    for (RecordsMap::iterator it = _imp->records.begin(); it != _imp->records.end(); ++it) {
+        _imp->takeRecord(it->second, entries, segments);
+    }
+}
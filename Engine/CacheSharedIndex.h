@@ -0,0 +1,90 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_CACHESHAREDINDEX_H_
+#define NATRON_ENGINE_CACHESHAREDINDEX_H_
+
+#include <string>
+#include <list>
+#ifndef Q_MOC_RUN
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#endif
+
+#include "Global/Macros.h"
+#include "Global/GlobalDefines.h"
+#include "Engine/CacheTOCFile.h"
+
+///Version of the binary layout of the shared index file, independent of NATRON_CACHE_VERSION
+#define NATRON_CACHE_SHARED_INDEX_FORMAT_VERSION 1
+
+///When the shared index file grows beyond this size, in bytes, it is rewritten with only the entries that are still alive
+#define NATRON_CACHE_SHARED_INDEX_MAX_SIZE (16 * 1024 * 1024)
+
+namespace Natron {
+
+struct CacheSharedIndexPrivate;
+
+/**
+ * @brief Lets processes of the same machine find the entries that the other processes wrote to the disk portion of
+ * a cache sharing the same directory, e.g: several NatronRenderer processes rendering different frame ranges of the
+ * same project.
+ *
+ * The index is a journal file: each process appends a record when the data of one of its entries has been written to
+ * its segment file (publish()) and when it releases it (unpublish()). The journal is protected by an advisory lock on
+ * the file, taken exclusively to append and shared to read. Each process reads the records appended since its last
+ * read when looking up a hash key, so a look-up only reads what changed.
+ *
+ * Records reference the data of the entries by (segment, tag, offset, length), the tag of the segment file makes sure
+ * a segment file that was removed by its owner and whose index was reused is never read by mistake.
+ * The segment stores of the processes must be shared (see CacheSegmentStore::setSharedBetweenProcesses()) so that
+ * published regions are never overwritten.
+ *
+ * This class is thread-safe.
+ **/
+class CacheSharedIndex
+    : boost::noncopyable
+{
+public:
+
+    /**
+     * @brief The journal file is created if it does not exist or if it was written with another format or cache version.
+     **/
+    CacheSharedIndex(const std::string & filePath,
+                     unsigned int cacheVersion);
+
+    ~CacheSharedIndex();
+
+    /**
+     * @brief Makes the entry visible to the other processes. Its data must have been written to the segment file.
+     **/
+    void publish(const CacheTOCFile::Entry & entry, U64 segmentTag);
+
+    /**
+     * @brief Tells the other processes the region is no longer valid. This does nothing if the region was not published by
+     * this process. No I/O is made: the record is appended along with the next publication or look-up.
+     **/
+    void unpublish(U64 hash, U64 segmentTag, U64 offset);
+
+    /**
+     * @brief Appends to entries the entries with the given hash key published by other processes that were not taken yet,
+     * and marks them taken. The tags of their segments are inserted in segments.
+     **/
+    void takeEntries(U64 hash, std::list<CacheTOCFile::Entry>* entries, CacheTOCFile::SegmentTags* segments);
+
+    /**
+     * @brief Same as takeEntries() for all hash keys.
+     **/
+    void takeAllRemainingEntries(std::list<CacheTOCFile::Entry>* entries, CacheTOCFile::SegmentTags* segments);
+
+private:
+
+    boost::scoped_ptr<CacheSharedIndexPrivate> _imp;
+};
+
+} // namespace Natron
+
+#endif // NATRON_ENGINE_CACHESHAREDINDEX_H_
@@ -0,0 +1,258 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CacheStatistics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+#include "Global/MemoryInfo.h"
+
+using namespace Natron;
+
+namespace {
+bool
+compareNodesBytes(const std::pair<U64, const CacheCounters*> & lhs,
+                  const std::pair<U64, const CacheCounters*> & rhs)
+{
+    return ( lhs.second->memoryBytes + lhs.second->diskBytes ) > ( rhs.second->memoryBytes + rhs.second->diskBytes );
+}
+
+void
+printCounters(std::ostream & stream,
+              const CacheCounters & counters,
+              const std::string & indent)
+{
+    stream << indent << counters.getLookupsCount() << " look-ups, " << std::fixed << std::setprecision(1)
+           << counters.getHitRatio() * 100. << "% hits (" << counters.diskHits << " read back from disk), "
+           << counters.misses << " misses" << std::endl;
+    stream << indent << counters.getEvictionsCount() << " evictions:";
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        stream << (i == 0 ? " " : ", ") << counters.evictions[i] << ' '
+               << getCacheEvictionReasonName( (CacheEvictionReasonEnum)i );
+    }
+    stream << std::endl;
+    stream << indent << counters.entriesCount << " entries, " << printAsRAM(counters.memoryBytes).toStdString() << " in RAM, "
+           << printAsRAM(counters.diskBytes).toStdString() << " on disk, average lifetime "
+           << std::setprecision(2) << counters.getAverageLifetime() << " s" << std::endl;
+}
+}
+
+CacheCounters::CacheCounters()
+    : hits(0)
+      , diskHits(0)
+      , misses(0)
+      , entriesCount(0)
+      , memoryBytes(0)
+      , diskBytes(0)
+      , removedEntriesCount(0)
+      , lifetimeSum(0.)
+{
+    std::fill(evictions, evictions + eCacheEvictionReasonCount, 0);
+}
+
+void
+CacheCounters::add(const CacheCounters & other)
+{
+    hits += other.hits;
+    diskHits += other.diskHits;
+    misses += other.misses;
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        evictions[i] += other.evictions[i];
+    }
+    entriesCount += other.entriesCount;
+    memoryBytes += other.memoryBytes;
+    diskBytes += other.diskBytes;
+    removedEntriesCount += other.removedEntriesCount;
+    lifetimeSum += other.lifetimeSum;
+}
+
+U64
+CacheCounters::getLookupsCount() const
+{
+    return hits + misses;
+}
+
+double
+CacheCounters::getHitRatio() const
+{
+    U64 lookups = getLookupsCount();
+
+    return lookups == 0 ? 0. : (double)hits / lookups;
+}
+
+U64
+CacheCounters::getEvictionsCount() const
+{
+    U64 ret = 0;
+
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        ret += evictions[i];
+    }
+
+    return ret;
+}
+
+double
+CacheCounters::getAverageLifetime() const
+{
+    return removedEntriesCount == 0 ? 0. : lifetimeSum / removedEntriesCount;
+}
+
+CacheStatistics::CacheStatistics()
+    : cacheName()
+    , total()
+    , nodes()
+    , _nodesPruneSize(NATRON_CACHE_STATISTICS_MAX_NODES)
+{
+}
+
+void
+CacheStatistics::addLookup(U64 nodeHash,
+                           bool hit,
+                           bool fromDisk)
+{
+    CacheCounters & node = nodes[nodeHash];
+
+    if (hit) {
+        ++total.hits;
+        ++node.hits;
+        if (fromDisk) {
+            ++total.diskHits;
+            ++node.diskHits;
+        }
+    } else {
+        ++total.misses;
+        ++node.misses;
+    }
+}
+
+void
+CacheStatistics::addHits(U64 nodeHash,
+                         U64 count)
+{
+    if (count == 0) {
+        return;
+    }
+    total.hits += count;
+    nodes[nodeHash].hits += count;
+}
+
+void
+CacheStatistics::addInsertion(U64 nodeHash)
+{
+    if (nodes.size() >= _nodesPruneSize) {
+        for (NodesCounters::iterator it = nodes.begin(); it != nodes.end();) {
+            if ( (it->second.entriesCount == 0) && (it->first != nodeHash) ) {
+                nodes.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+        ///If most nodes still have entries, do not scan again before the map doubled
+        _nodesPruneSize = std::max<std::size_t>(NATRON_CACHE_STATISTICS_MAX_NODES, nodes.size() * 2);
+    }
+    ++total.entriesCount;
+    ++nodes[nodeHash].entriesCount;
+}
+
+void
+CacheStatistics::addEviction(U64 nodeHash,
+                             Natron::CacheEvictionReasonEnum reason,
+                             bool leftCache,
+                             double lifetime)
+{
+    CacheCounters* counters[2] = { &total, &nodes[nodeHash] };
+
+    for (int i = 0; i < 2; ++i) {
+        ++counters[i]->evictions[reason];
+        if (leftCache) {
+            if (counters[i]->entriesCount > 0) {
+                --counters[i]->entriesCount;
+            }
+            ++counters[i]->removedEntriesCount;
+            counters[i]->lifetimeSum += std::max(lifetime, 0.);
+        }
+    }
+}
+
+void
+CacheStatistics::merge(const CacheStatistics & other)
+{
+    total.add(other.total);
+    for (NodesCounters::const_iterator it = other.nodes.begin(); it != other.nodes.end(); ++it) {
+        nodes[it->first].add(it->second);
+    }
+}
+
+void
+CacheStatistics::resetCounters()
+{
+    NodesCounters previousNodes;
+
+    previousNodes.swap(nodes);
+    for (NodesCounters::iterator it = previousNodes.begin(); it != previousNodes.end(); ++it) {
+        if (it->second.entriesCount > 0) {
+            nodes[it->first].entriesCount = it->second.entriesCount;
+        }
+    }
+    U64 entriesCount = total.entriesCount;
+    total = CacheCounters();
+    total.entriesCount = entriesCount;
+}
+
+void
+CacheStatistics::print(std::ostream & stream,
+                       int maxNodesCount) const
+{
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+
+    stream << cacheName << ':' << std::endl;
+    printCounters(stream, total, "    ");
+
+    std::vector<std::pair<U64, const CacheCounters*> > sortedNodes;
+    for (NodesCounters::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+        sortedNodes.push_back( std::make_pair(it->first, &it->second) );
+    }
+    std::stable_sort(sortedNodes.begin(), sortedNodes.end(), compareNodesBytes);
+    if ( (int)sortedNodes.size() > maxNodesCount ) {
+        sortedNodes.resize(maxNodesCount);
+    }
+    for (std::size_t i = 0; i < sortedNodes.size(); ++i) {
+        stream << "    Node hash " << std::hex << sortedNodes[i].first << std::dec << ':' << std::endl;
+        printCounters(stream, *sortedNodes[i].second, "        ");
+    }
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+const char*
+Natron::getCacheEvictionReasonName(Natron::CacheEvictionReasonEnum reason)
+{
+    switch (reason) {
+    case eCacheEvictionReasonMemoryFull:
+
+        return "memory full";
+    case eCacheEvictionReasonDiskFull:
+
+        return "disk full";
+    case eCacheEvictionReasonRemoved:
+
+        return "removed";
+    case eCacheEvictionReasonInvalidated:
+
+        return "invalidated";
+    case eCacheEvictionReasonCleared:
+
+        return "cleared";
+    case eCacheEvictionReasonCount:
+        break;
+    }
+
+    return "";
+}
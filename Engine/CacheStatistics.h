@@ -0,0 +1,111 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_CACHESTATISTICS_H_
+#define NATRON_ENGINE_CACHESTATISTICS_H_
+
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "Global/Macros.h"
+#include "Global/Enums.h"
+#include "Global/GlobalDefines.h"
+
+///When a bucket of the cache holds the counters of more nodes than this, those of the nodes that have no entry left
+///in it are forgotten: the hash of a node changes along with its parameters, which would otherwise grow the map forever.
+///The map is only scanned again once it doubled since the last scan, so that the cost of an insertion stays amortized.
+#define NATRON_CACHE_STATISTICS_MAX_NODES 1024
+
+namespace Natron {
+
+/**
+ * @brief Counters of a cache, or of the entries of a cache that were produced by a single node.
+ **/
+struct CacheCounters
+{
+    U64 hits; //< look-ups which found an entry, in the memory or the disk portion
+    U64 diskHits; //< hits which had to read the entry back from the disk portion
+    U64 misses;
+    U64 evictions[eCacheEvictionReasonCount];
+    U64 entriesCount; //< entries currently in the cache
+    U64 memoryBytes; //< set by Cache::getStatistics()
+    U64 diskBytes; //< set by Cache::getStatistics()
+    U64 removedEntriesCount; //< entries which left the cache, their time spent in the cache is summed in lifetimeSum
+    double lifetimeSum;
+
+    CacheCounters();
+
+    void add(const CacheCounters & other);
+
+    U64 getLookupsCount() const WARN_UNUSED_RETURN;
+
+    ///Between 0 and 1, 0 if there was no look-up
+    double getHitRatio() const WARN_UNUSED_RETURN;
+
+    U64 getEvictionsCount() const WARN_UNUSED_RETURN;
+
+    ///The average time in seconds the entries which left the cache spent in it, 0 if none left it yet
+    double getAverageLifetime() const WARN_UNUSED_RETURN;
+};
+
+/**
+ * @brief The counters of a cache, in total and by node. The nodes are identified by the hash of their entries' keys
+ * (see getTreeVersion()), which is the hash of the node for the images and the hash of the tree upstream of the viewer
+ * for the viewer textures.
+ **/
+struct CacheStatistics
+{
+    typedef std::map<U64, CacheCounters> NodesCounters;
+
+    std::string cacheName;
+    CacheCounters total;
+    NodesCounters nodes;
+
+    CacheStatistics();
+
+    void addLookup(U64 nodeHash,
+                   bool hit,
+                   bool fromDisk);
+
+    ///Adds count hits at once, e.g those counted by an entry on the lock-free path of the cache (see recordLookup())
+    void addHits(U64 nodeHash,
+                 U64 count);
+
+    void addInsertion(U64 nodeHash);
+
+    /**
+     * @brief Counts an eviction. If leftCache is false the entry only moved from the memory portion to the disk portion,
+     * otherwise it is no longer in the cache and lifetime is the time it spent in it.
+     **/
+    void addEviction(U64 nodeHash,
+                     Natron::CacheEvictionReasonEnum reason,
+                     bool leftCache,
+                     double lifetime);
+
+    ///Adds the counters of other, e.g of another bucket of the same cache
+    void merge(const CacheStatistics & other);
+
+    ///Resets the counters, except the entries currently in the cache
+    void resetCounters();
+
+    /**
+     * @brief Writes the counters in a human readable form, followed by those of the maxNodesCount nodes with the most
+     * bytes in the cache.
+     **/
+    void print(std::ostream & stream,
+               int maxNodesCount) const;
+
+private:
+
+    ///The size of nodes at which addInsertion() forgets the nodes without entries
+    std::size_t _nodesPruneSize;
+};
+
+const char* getCacheEvictionReasonName(Natron::CacheEvictionReasonEnum reason) WARN_UNUSED_RETURN;
+} // namespace Natron
+
+#endif // NATRON_ENGINE_CACHESTATISTICS_H_
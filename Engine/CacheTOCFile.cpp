@@ -0,0 +1,312 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CacheTOCFile.h"
+
+#include <set>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <QtCore/QMutex>
+#include <QtCore/QFile>
+#include <QtCore/QCoreApplication>
+
+#include "Engine/MemoryFile.h"
+
+#define TOC_MAGIC "NATRNTOC"
+#define TOC_MAGIC_SIZE 8
+
+/*
+ * Layout of the file, all integers are stored in the native byte order:
+ *
+ * Header (TOC_HEADER_SIZE bytes):
+ *  magic (8 bytes), format version (U32), cache version (U32), entries count (U64), segments count (U64),
+ *  offset of the segments table (U64), offset of the records table (U64), file size (U64), reserved (8 bytes)
+ * Segments table (TOC_SEGMENT_SIZE bytes per segment):
+ *  index (S32), reserved (4 bytes), tag (U64)
+ * Records table (TOC_RECORD_SIZE bytes per record), sorted by hash key:
+ *  hash (U64), offset (U64), length (U64), blob offset (U64), blob length (U32), segment (S32)
+ * Blobs
+ */
+#define TOC_HEADER_SIZE 64
+#define TOC_SEGMENT_SIZE 16
+#define TOC_RECORD_SIZE 40
+
+using namespace Natron;
+
+namespace {
+
+template <typename T>
+void
+writeValue(char* dst,
+           T value)
+{
+    std::memcpy( dst, &value, sizeof(T) );
+}
+
+template <typename T>
+T
+readValue(const char* src)
+{
+    T ret;
+
+    std::memcpy( &ret, src, sizeof(T) );
+
+    return ret;
+}
+
+bool
+entryHashLess(const CacheTOCFile::Entry & a,
+              const CacheTOCFile::Entry & b)
+{
+    return a.hash < b.hash;
+}
+
+}
+
+struct Natron::CacheTOCFilePrivate
+{
+    MemoryFile file;
+    CacheTOCFile::SegmentTags segments;
+    U64 entriesCount;
+    const char* records; //< points to the records table in the mapping
+    QMutex takenLock; //< protects taken
+    std::set<U64> taken; //< indexes of the records already handed out
+
+    CacheTOCFilePrivate()
+    : file()
+    , segments()
+    , entriesCount(0)
+    , records(0)
+    , takenLock()
+    , taken()
+    {
+    }
+
+    U64 getRecordHash(U64 index) const
+    {
+        return readValue<U64>(records + index * TOC_RECORD_SIZE);
+    }
+
+    ///Returns false if the record points outside of the file
+    bool readRecord(U64 index,
+                    CacheTOCFile::Entry* entry) const
+    {
+        const char* record = records + index * TOC_RECORD_SIZE;
+        U64 blobOffset = readValue<U64>(record + 24);
+        U32 blobLength = readValue<U32>(record + 32);
+
+        if ( (blobOffset > file.size()) || (blobLength > file.size() - blobOffset) ) {
+            return false;
+        }
+        entry->hash = readValue<U64>(record);
+        entry->offset = readValue<U64>(record + 8);
+        entry->length = readValue<U64>(record + 16);
+        entry->segment = readValue<boost::int32_t>(record + 36);
+        entry->blob.assign(file.data() + blobOffset,blobLength);
+
+        return true;
+    }
+};
+
+CacheTOCFile::CacheTOCFile()
+    : _imp( new CacheTOCFilePrivate() )
+{
+}
+
+CacheTOCFile::~CacheTOCFile()
+{
+}
+
+bool
+CacheTOCFile::write(const std::string & filePath,
+                    unsigned int cacheVersion,
+                    const SegmentTags & segments,
+                    std::vector<Entry>* entries)
+{
+    std::stable_sort(entries->begin(), entries->end(), entryHashLess);
+
+    U64 segmentsOffset = TOC_HEADER_SIZE;
+    U64 recordsOffset = segmentsOffset + segments.size() * TOC_SEGMENT_SIZE;
+    U64 fileSize = recordsOffset + entries->size() * TOC_RECORD_SIZE;
+    for (std::vector<Entry>::const_iterator it = entries->begin(); it != entries->end(); ++it) {
+        fileSize += it->blob.size();
+    }
+
+    ///Several processes sharing the cache may save it at the same time
+    std::ostringstream tmpFilePath;
+    tmpFilePath << filePath << '.' << QCoreApplication::applicationPid() << ".tmp";
+    bool ok = true;
+    {
+        std::ofstream ofile;
+        ofile.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        try {
+            ofile.open(tmpFilePath.str().c_str(),std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+
+            char header[TOC_HEADER_SIZE];
+            std::memset(header, 0, TOC_HEADER_SIZE);
+            std::memcpy(header, TOC_MAGIC, TOC_MAGIC_SIZE);
+            writeValue<U32>(header + 8, NATRON_CACHE_TOC_FORMAT_VERSION);
+            writeValue<U32>(header + 12, cacheVersion);
+            writeValue<U64>(header + 16, entries->size());
+            writeValue<U64>(header + 24, segments.size());
+            writeValue<U64>(header + 32, segmentsOffset);
+            writeValue<U64>(header + 40, recordsOffset);
+            writeValue<U64>(header + 48, fileSize);
+            ofile.write(header, TOC_HEADER_SIZE);
+
+            for (SegmentTags::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+                char segment[TOC_SEGMENT_SIZE];
+                std::memset(segment, 0, TOC_SEGMENT_SIZE);
+                writeValue<boost::int32_t>(segment, it->first);
+                writeValue<U64>(segment + 8, it->second);
+                ofile.write(segment, TOC_SEGMENT_SIZE);
+            }
+
+            U64 blobOffset = recordsOffset + entries->size() * TOC_RECORD_SIZE;
+            for (std::vector<Entry>::const_iterator it = entries->begin(); it != entries->end(); ++it) {
+                char record[TOC_RECORD_SIZE];
+                writeValue<U64>(record, it->hash);
+                writeValue<U64>(record + 8, it->offset);
+                writeValue<U64>(record + 16, it->length);
+                writeValue<U64>(record + 24, blobOffset);
+                writeValue<U32>(record + 32, (U32)it->blob.size());
+                writeValue<boost::int32_t>(record + 36, it->segment);
+                ofile.write(record, TOC_RECORD_SIZE);
+                blobOffset += it->blob.size();
+            }
+
+            for (std::vector<Entry>::const_iterator it = entries->begin(); it != entries->end(); ++it) {
+                ofile.write( it->blob.data(), it->blob.size() );
+            }
+
+            ofile.close();
+        } catch (const std::exception & e) {
+            std::cout << "Failed to write the cache table of contents to " << tmpFilePath.str() << ": " << e.what() << std::endl;
+            ok = false;
+        }
+    }
+    if (!ok) {
+        QFile::remove( tmpFilePath.str().c_str() );
+
+        return false;
+    }
+
+    if (std::rename( tmpFilePath.str().c_str(), filePath.c_str() ) != 0) {
+        ///On Windows rename() does not replace an existing file
+        QFile::remove( filePath.c_str() );
+        if (std::rename( tmpFilePath.str().c_str(), filePath.c_str() ) != 0) {
+            QFile::remove( tmpFilePath.str().c_str() );
+
+            return false;
+        }
+    }
+
+    return true;
+} // write
+
+boost::shared_ptr<CacheTOCFile>
+CacheTOCFile::open(const std::string & filePath,
+                   unsigned int cacheVersion)
+{
+    boost::shared_ptr<CacheTOCFile> ret( new CacheTOCFile() );
+
+    try {
+        ret->_imp->file.open(filePath,MemoryFile::if_exists_keep_if_dont_exists_fail);
+    } catch (const std::exception & e) {
+        return boost::shared_ptr<CacheTOCFile>();
+    }
+
+    const char* data = ret->_imp->file.data();
+    U64 fileSize = ret->_imp->file.size();
+    if ( !data || (fileSize < TOC_HEADER_SIZE) || (std::memcmp(data, TOC_MAGIC, TOC_MAGIC_SIZE) != 0) ) {
+        return boost::shared_ptr<CacheTOCFile>();
+    }
+    if ( (readValue<U32>(data + 8) != NATRON_CACHE_TOC_FORMAT_VERSION) || (readValue<U32>(data + 12) != cacheVersion) ||
+         (readValue<U64>(data + 48) != fileSize) ) {
+        return boost::shared_ptr<CacheTOCFile>();
+    }
+
+    U64 entriesCount = readValue<U64>(data + 16);
+    U64 segmentsCount = readValue<U64>(data + 24);
+    U64 segmentsOffset = readValue<U64>(data + 32);
+    U64 recordsOffset = readValue<U64>(data + 40);
+    if ( (segmentsOffset > fileSize) || (segmentsCount > (fileSize - segmentsOffset) / TOC_SEGMENT_SIZE) ||
+         (recordsOffset > fileSize) || (entriesCount > (fileSize - recordsOffset) / TOC_RECORD_SIZE) ) {
+        return boost::shared_ptr<CacheTOCFile>();
+    }
+
+    for (U64 i = 0; i < segmentsCount; ++i) {
+        const char* segment = data + segmentsOffset + i * TOC_SEGMENT_SIZE;
+        ret->_imp->segments[readValue<boost::int32_t>(segment)] = readValue<U64>(segment + 8);
+    }
+    ret->_imp->entriesCount = entriesCount;
+    ret->_imp->records = data + recordsOffset;
+
+    return ret;
+}
+
+U64
+CacheTOCFile::getEntriesCount() const
+{
+    return _imp->entriesCount;
+}
+
+const CacheTOCFile::SegmentTags &
+CacheTOCFile::getSegments() const
+{
+    return _imp->segments;
+}
+
+void
+CacheTOCFile::takeEntries(U64 hash,
+                          std::list<Entry>* entries)
+{
+    ///Find the first record with the given hash
+    U64 first = 0;
+    U64 count = _imp->entriesCount;
+
+    while (count > 0) {
+        U64 step = count / 2;
+        if (_imp->getRecordHash(first + step) < hash) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+
+    QMutexLocker k(&_imp->takenLock);
+    for (U64 i = first; i < _imp->entriesCount && _imp->getRecordHash(i) == hash; ++i) {
+        if ( !_imp->taken.insert(i).second ) {
+            continue;
+        }
+        Entry entry;
+        if ( _imp->readRecord(i,&entry) ) {
+            entries->push_back(entry);
+        }
+    }
+}
+
+void
+CacheTOCFile::takeAllRemainingEntries(std::list<Entry>* entries)
+{
+    QMutexLocker k(&_imp->takenLock);
+
+    for (U64 i = 0; i < _imp->entriesCount; ++i) {
+        if ( !_imp->taken.insert(i).second ) {
+            continue;
+        }
+        Entry entry;
+        if ( _imp->readRecord(i,&entry) ) {
+            entries->push_back(entry);
+        }
+    }
+}
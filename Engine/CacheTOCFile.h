@@ -0,0 +1,116 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_CACHETOCFILE_H_
+#define NATRON_ENGINE_CACHETOCFILE_H_
+
+#include <string>
+#include <list>
+#include <map>
+#include <vector>
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#endif
+
+#include "Global/Macros.h"
+#include "Global/GlobalDefines.h"
+
+///Version of the binary layout of the table of contents file, independent of NATRON_CACHE_VERSION
+#define NATRON_CACHE_TOC_FORMAT_VERSION 1
+
+namespace Natron {
+
+struct CacheTOCFilePrivate;
+
+/**
+ * @brief The table of contents of the disk portion of a cache, saved when the application quits so that the
+ * next session can find the entries again.
+ *
+ * The file is memory mapped: opening it only validates its header, whatever its size. The records are sorted
+ * by hash key so that the records of a given key are found by a binary search the first time the cache
+ * misses this key. Each record holds the location of the entry data in the segment files and an opaque blob
+ * (the serialized key and params of the entry) which is only deserialized and validated by the cache when the
+ * entry is looked up.
+ *
+ * The file is written to a temporary file first and then renamed over the previous one, hence a reader never
+ * sees a partially written table of contents.
+ *
+ * This class is thread-safe.
+ **/
+class CacheTOCFile
+    : boost::noncopyable
+{
+public:
+
+    struct Entry
+    {
+        U64 hash;
+        int segment; //< the index of the segment file holding the data
+        U64 offset; //< the offset of the data in the segment file
+        U64 length; //< the length of the data in the segment file
+        std::string blob; //< the serialized key and params of the entry
+
+        Entry()
+        : hash(0)
+        , segment(-1)
+        , offset(0)
+        , length(0)
+        , blob()
+        {
+        }
+    };
+
+    ///The tag of each segment file referenced by the entries, see CacheSegmentStore
+    typedef std::map<int,U64> SegmentTags;
+
+    /**
+     * @brief Writes the table of contents to the given file path. The entries are sorted by hash key in the process.
+     * Returns false on failure, in which case the previous file, if any, is left untouched.
+     **/
+    static bool write(const std::string & filePath,
+                      unsigned int cacheVersion,
+                      const SegmentTags & segments,
+                      std::vector<Entry>* entries) WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Maps the given file. Returns NULL if the file does not exist, is not a valid table of contents or
+     * was written with another format or cache version.
+     **/
+    static boost::shared_ptr<CacheTOCFile> open(const std::string & filePath,
+                                                unsigned int cacheVersion);
+
+    ~CacheTOCFile();
+
+    /**
+     * @brief Returns the number of records of the file, including the ones already taken.
+     **/
+    U64 getEntriesCount() const;
+
+    const SegmentTags & getSegments() const;
+
+    /**
+     * @brief Appends to entries the records with the given hash key that were not taken yet and marks them taken.
+     * Records pointing outside of the file are ignored.
+     **/
+    void takeEntries(U64 hash, std::list<Entry>* entries);
+
+    /**
+     * @brief Appends to entries all the records that were not taken yet and marks them taken.
+     **/
+    void takeAllRemainingEntries(std::list<Entry>* entries);
+
+private:
+
+    CacheTOCFile();
+
+    boost::scoped_ptr<CacheTOCFilePrivate> _imp;
+};
+
+} // namespace Natron
+
+#endif // NATRON_ENGINE_CACHETOCFILE_H_
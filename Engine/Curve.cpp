@@ -284,6 +284,7 @@ Curve::clearKeyFrames()
     QWriteLocker l(&_imp->_lock);
 
     _imp->keyFrames.clear();
+    _imp->invalidateFlatKeyFrames();
 }
 
 bool
@@ -302,6 +303,7 @@ Curve::clone(const Curve & other)
 
     _imp->keyFrames.clear();
     std::transform( otherKeys.begin(), otherKeys.end(), std::inserter( _imp->keyFrames, _imp->keyFrames.begin() ), KeyFrameCloner() );
+    _imp->invalidateFlatKeyFrames();
 }
 
 void
@@ -327,6 +329,7 @@ Curve::clone(const Curve & other,
         }
         _imp->keyFrames.insert(k);
     }
+    _imp->invalidateFlatKeyFrames();
 }
 
 double
@@ -371,6 +374,7 @@ Curve::addKeyFrame(KeyFrame key)
 std::pair<KeyFrameSet::iterator,bool> Curve::addKeyFrameNoUpdate(const KeyFrame & cp)
 {
     // PRIVATE - should not lock
+    _imp->invalidateFlatKeyFrames();
     if (!_imp->isParametric) { //< if keyframes are clamped to integers
         std::pair<KeyFrameSet::iterator,bool> newKey = _imp->keyFrames.insert(cp);
         // keyframe at this time exists, erase and insert again
@@ -427,6 +431,7 @@ Curve::removeKeyFrame(KeyFrameSet::const_iterator it)
     }
 
     _imp->keyFrames.erase(it);
+    _imp->invalidateFlatKeyFrames();
 
     if (mustRefreshPrev) {
         refreshDerivatives( eCurveChangedReasonDerivativesChanged,find( prevKey.getTime() ) );
@@ -466,10 +471,11 @@ Curve::getKeyFrameWithIndex(int index,
 {
     assert(k);
     QReadLocker l(&_imp->_lock);
-    if ( index >= (int)_imp->keyFrames.size() ) {
+    if ( (index < 0) || ( index >= (int)_imp->keyFrames.size() ) ) {
         return false;
     }
-    *k = *atIndex(index);
+    ensureFlatKeyFrames();
+    *k = _imp->flatKeyFrames[index];
 
     return true;
 }
@@ -598,13 +604,15 @@ Curve::getKeyFrameWithTime(double time,
 {
     assert(k);
     QReadLocker l(&_imp->_lock);
-    KeyFrameSet::const_iterator it = find(time);
+    ensureFlatKeyFrames();
 
-    if ( it == _imp->keyFrames.end() ) {
+    const std::vector<double> & keyTimes = _imp->keyTimes;
+    std::vector<double>::const_iterator it = std::lower_bound(keyTimes.begin(), keyTimes.end(), time);
+    if ( ( it == keyTimes.end() ) || (*it != time) ) {
         return false;
     }
 
-    *k = *it;
+    *k = _imp->flatKeyFrames[it - keyTimes.begin()];
 
     return true;
 }
@@ -666,49 +674,92 @@ interParams(const KeyFrameSet &keyFrames,
     }
 }
 
-double
-Curve::getValueAt(double t,bool doClamp) const
+void
+Curve::ensureFlatKeyFrames() const
 {
-    QReadLocker l(&_imp->_lock);
+    // PRIVATE - should not lock _lock, which must be locked by the caller
+    ///Acquire pairs with the release in the build below, so that the arrays are seen fully built
+    if ( _imp->flatKeyFramesValid.testAndSetAcquire(1, 1) ) {
+        return;
+    }
+    QMutexLocker k(&_imp->flatKeyFramesMutex);
+    if ( (int)_imp->flatKeyFramesValid ) {
+        return;
+    }
 
-    if ( _imp->keyFrames.empty() ) {
-        throw std::runtime_error("Curve has no control points!");
+    const KeyFrameSet & keyFrames = _imp->keyFrames;
+    _imp->flatKeyFrames.assign( keyFrames.begin(), keyFrames.end() );
+    _imp->keyTimes.resize( keyFrames.size() );
+    _imp->segments.resize( keyFrames.empty() ? 0 : keyFrames.size() + 1 );
+
+    ///segment i is the interpolation used by getValueAt() for times such that upper_bound() returns the i-th keyframe
+    KeyFrameSet::const_iterator itup = keyFrames.begin();
+    for (std::size_t i = 0; i < _imp->segments.size(); ++i) {
+        double t;
+        if (itup == keyFrames.begin()) {
+            t = itup->getTime() - 1.;
+        } else {
+            KeyFrameSet::const_iterator itcur = itup;
+            --itcur;
+            t = itcur->getTime();
+            _imp->keyTimes[i - 1] = t;
+        }
+        double tcur,tnext;
+        double vcurDerivRight,vnextDerivLeft,vcur,vnext;
+        Natron::KeyframeTypeEnum interp,interpNext;
+        interParams(keyFrames,
+                    t,
+                    itup,
+                    &tcur,
+                    &vcur,
+                    &vcurDerivRight,
+                    &interp,
+                    &tnext,
+                    &vnext,
+                    &vnextDerivLeft,
+                    &interpNext);
+        CurveSegment & segment = _imp->segments[i];
+        Natron::interpolationCoefficients(tcur,vcur,
+                                          vcurDerivRight,
+                                          vnextDerivLeft,
+                                          tnext,vnext,
+                                          interp,
+                                          interpNext,
+                                          &segment.tStart,
+                                          &segment.duration,
+                                          segment.coeffs);
+        if ( itup != keyFrames.end() ) {
+            ++itup;
+        }
     }
+    _imp->flatKeyFramesValid.fetchAndStoreRelease(1);
+}
+
+double
+Curve::getValueAt_internal(double t,
+                           const std::pair<double,double>* yRange) const
+{
+    // PRIVATE - should not lock, ensureFlatKeyFrames() must have been called and the curve must have keyframes
+    assert( !_imp->segments.empty() );
 
-    // even when there is only one keyframe, there may be tangents!
-    //if (_imp->keyFrames.size() == 1) {
-    //    //if there's only 1 keyframe, don't bother interpolating
-    //    return (*_imp->keyFrames.begin()).getValue();
-    //}
-    double tcur,tnext;
-    double vcurDerivRight,vnextDerivLeft,vcur,vnext;
-    Natron::KeyframeTypeEnum interp,interpNext;
-    KeyFrame k(t,0.);
     // find the first keyframe with time greater than t
-    KeyFrameSet::const_iterator itup;
-    itup = _imp->keyFrames.upper_bound(k);
-    interParams(_imp->keyFrames,
-                t,
-                itup,
-                &tcur,
-                &vcur,
-                &vcurDerivRight,
-                &interp,
-                &tnext,
-                &vnext,
-                &vnextDerivLeft,
-                &interpNext);
+    std::size_t index = std::upper_bound(_imp->keyTimes.begin(), _imp->keyTimes.end(), t) - _imp->keyTimes.begin();
+    const CurveSegment & segment = _imp->segments[index];
 
-    double v = Natron::interpolate(tcur,vcur,
-                                   vcurDerivRight,
-                                   vnextDerivLeft,
-                                   tnext,vnext,
-                                   t,
-                                   interp,
-                                   interpNext);
+    return convertValue(Natron::interpolationEval(segment.tStart, segment.duration, segment.coeffs, t), yRange);
+}
 
-    if ( doClamp && mustClamp() ) {
-        v = clampValueToCurveYRange(v);
+double
+Curve::convertValue(double v,
+                    const std::pair<double,double>* yRange) const
+{
+    // PRIVATE - should not lock
+    if (yRange) {
+        if (v > yRange->second) {
+            v = yRange->second;
+        } else if (v < yRange->first) {
+            v = yRange->first;
+        }
     }
 
     switch (_imp->type) {
@@ -726,8 +777,79 @@ Curve::getValueAt(double t,bool doClamp) const
 
         return v;
     }
+}
+
+double
+Curve::getValueAt(double t,bool doClamp) const
+{
+    double ret;
+
+    if ( !getValueAtIfAnimated(t, doClamp, &ret) ) {
+        throw std::runtime_error("Curve has no control points!");
+    }
+
+    return ret;
 } // getValueAt
 
+bool
+Curve::getValueAtIfAnimated(double t,
+                            bool doClamp,
+                            double* value) const
+{
+    QReadLocker l(&_imp->_lock);
+
+    // even when there is only one keyframe, there may be tangents!
+    if ( _imp->keyFrames.empty() ) {
+        return false;
+    }
+    ensureFlatKeyFrames();
+    if ( doClamp && mustClamp() ) {
+        std::pair<double,double> yRange = getCurveYRange();
+        *value = getValueAt_internal(t, &yRange);
+    } else {
+        *value = getValueAt_internal(t, NULL);
+    }
+
+    return true;
+}
+
+void
+Curve::getValuesAt(const double* times,
+                   int count,
+                   bool doClamp,
+                   double* values) const
+{
+    QReadLocker l(&_imp->_lock);
+
+    if ( _imp->keyFrames.empty() ) {
+        throw std::runtime_error("Curve has no control points!");
+    }
+    ensureFlatKeyFrames();
+
+    std::pair<double,double> yRange;
+    const std::pair<double,double>* clampRange = NULL;
+    if ( doClamp && mustClamp() ) {
+        yRange = getCurveYRange();
+        clampRange = &yRange;
+    }
+
+    const std::vector<double> & keyTimes = _imp->keyTimes;
+    std::size_t index = 0;
+    for (int i = 0; i < count; ++i) {
+        double t = times[i];
+        if ( (i > 0) && (t >= times[i - 1]) ) {
+            ///the segment of t is at or after the previous one
+            while ( index < keyTimes.size() && !(t < keyTimes[index]) ) {
+                ++index;
+            }
+        } else {
+            index = std::upper_bound(keyTimes.begin(), keyTimes.end(), t) - keyTimes.begin();
+        }
+        const CurveSegment & segment = _imp->segments[index];
+        values[i] = convertValue(Natron::interpolationEval(segment.tStart, segment.duration, segment.coeffs, t), clampRange);
+    }
+}
+
 double
 Curve::getDerivativeAt(double t) const
 {
@@ -1250,6 +1372,7 @@ Curve::refreshDerivatives(Curve::CurveChangedReasonEnum reason,
         newKeyIt = _imp->keyFrames.insert(newKey);
         assert(newKeyIt.second);
     }
+    _imp->invalidateFlatKeyFrames();
     key = newKeyIt.first;
 
     if (reason != eCurveChangedReasonDerivativesChanged) {
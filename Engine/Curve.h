@@ -217,6 +217,19 @@ public:
 
     double getValueAt(double t,bool clamp = true) const WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Same as getValueAt() but returns false instead of throwing if the curve has no keyframe, so that the caller
+     * does not have to check getKeyFramesCount() first.
+     **/
+    bool getValueAtIfAnimated(double t,bool clamp,double* value) const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Evaluates the curve as getValueAt() would at the count times, e.g a frame range, in values.
+     * The curve is locked once and, for increasing times, the keyframes are walked along instead of being searched
+     * for each time. Throws like getValueAt() if the curve has no keyframe.
+     **/
+    void getValuesAt(const double* times,int count,bool clamp,double* values) const;
+
     double getDerivativeAt(double t) const WARN_UNUSED_RETURN;
 
     double getIntegrateFromTo(double t1, double t2) const WARN_UNUSED_RETURN;
@@ -277,6 +290,15 @@ private:
     KeyFrameSet::const_iterator end() const WARN_UNUSED_RETURN;
     std::pair<double,double> getCurveYRange_internal() const WARN_UNUSED_RETURN;
 
+    ///Builds the flat keyframes and segments of CurvePrivate if the keyframes changed, the lock must be held for reading
+    void ensureFlatKeyFrames() const;
+
+    ///Evaluates the segments at t and calls convertValue()
+    double getValueAt_internal(double t,const std::pair<double,double>* yRange) const WARN_UNUSED_RETURN;
+
+    ///Clamps v to yRange if not NULL, then rounds it for integer and boolean curves
+    double convertValue(double v,const std::pair<double,double>* yRange) const WARN_UNUSED_RETURN;
+
     void removeKeyFrame(KeyFrameSet::const_iterator it);
 
     double clampValueToCurveYRange(double v) const WARN_UNUSED_RETURN;
@@ -11,10 +11,14 @@
 #ifndef NATRON_ENGINE_CURVEPRIVATE_H_
 #define NATRON_ENGINE_CURVEPRIVATE_H_
 
+#include <vector>
+
 #ifndef Q_MOC_RUN
 #include <boost/shared_ptr.hpp>
 #endif
 #include <QReadWriteLock>
+#include <QMutex>
+#include <QAtomicInt>
 
 #include "Engine/Rect.h"
 #include "Engine/Variant.h"
@@ -26,6 +30,16 @@ class Curve;
 class KeyFrame;
 class KnobI;
 
+/**
+ * @brief The cubic interpolating a Curve between two consecutive keyframes, see Natron::interpolationCoefficients().
+ **/
+struct CurveSegment
+{
+    double tStart;
+    double duration;
+    double coeffs[4];
+};
+
 struct CurvePrivate
 {
     enum CurveTypeEnum
@@ -48,6 +62,16 @@ struct CurvePrivate
     bool hasYRange;
     mutable QReadWriteLock _lock; //< the plug-ins can call getValueAt at any moment and we must make sure the user is not playing around
 
+    ///keyFrames in contiguous arrays for the evaluation, built by the first reader after a change, see Curve::ensureFlatKeyFrames().
+    ///segments[i] interpolates between flatKeyFrames[i - 1] and flatKeyFrames[i], i.e it holds the times t such that
+    ///keyTimes[i - 1] <= t < keyTimes[i]: segments.front() and segments.back() extend the curve before the first keyframe and
+    ///after the last one.
+    std::vector<KeyFrame> flatKeyFrames;
+    std::vector<double> keyTimes;
+    std::vector<CurveSegment> segments;
+    QAtomicInt flatKeyFramesValid; //< 0 if keyFrames changed since the arrays were built, read without the flatKeyFramesMutex
+    QMutex flatKeyFramesMutex; //< serializes the builds of the arrays by concurrent readers
+
 
     CurvePrivate()
         : keyFrames()
@@ -61,15 +85,31 @@ struct CurvePrivate
           , yMax(INT_MAX)
           , hasYRange(false)
           , _lock(QReadWriteLock::Recursive)
+          , flatKeyFrames()
+          , keyTimes()
+          , segments()
+          , flatKeyFramesValid(0)
+          , flatKeyFramesMutex()
     {
     }
 
     CurvePrivate(const CurvePrivate & other)
         : _lock(QReadWriteLock::Recursive)
+          , flatKeyFrames()
+          , keyTimes()
+          , segments()
+          , flatKeyFramesValid(0)
+          , flatKeyFramesMutex()
     {
         *this = other;
     }
 
+    ///Must be called after any change of keyFrames, with _lock locked for writing
+    void invalidateFlatKeyFrames()
+    {
+        flatKeyFramesValid.fetchAndStoreRelease(0);
+    }
+
     void operator=(const CurvePrivate & other)
     {
         keyFrames = other.keyFrames;
@@ -82,6 +122,7 @@ struct CurvePrivate
         yMin = other.yMin;
         yMax = other.yMax;
         hasYRange = other.hasYRange;
+        invalidateFlatKeyFrames();
     }
 };
 
@@ -33,8 +33,15 @@ void
 Curve::serialize(Archive & ar,
                  const unsigned int /*version*/)
 {
-    QReadLocker l(&_imp->_lock);
-    ar & boost::serialization::make_nvp("KeyFrameSet",_imp->keyFrames);
+    if (Archive::is_loading::value) {
+        ///Loading modifies the keyframes: the flat arrays built by concurrent readers are no longer valid
+        QWriteLocker l(&_imp->_lock);
+        ar & boost::serialization::make_nvp("KeyFrameSet",_imp->keyFrames);
+        _imp->invalidateFlatKeyFrames();
+    } else {
+        QReadLocker l(&_imp->_lock);
+        ar & boost::serialization::make_nvp("KeyFrameSet",_imp->keyFrames);
+    }
 }
 
 #endif // NATRON_ENGINE_CURVESERIALIZATION_H_
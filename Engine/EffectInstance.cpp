@@ -10,9 +10,10 @@
  */
 
 #include "EffectInstance.h"
+#include <algorithm>
+#include <cmath>
 #include <map>
 #include <sstream>
-#include <QtConcurrentMap>
 #include <QReadWriteLock>
 #include <QCoreApplication>
 #include <QtConcurrentRun>
@@ -32,6 +33,8 @@
 #include "Engine/OfxEffectInstance.h"
 #include "Engine/OfxImageEffectInstance.h"
 #include "Engine/KnobTypes.h"
+#include "Engine/KnobsSnapshot.h"
+#include "Engine/RenderMemoryCounter.h"
 #include "Engine/PluginMemory.h"
 #include "Engine/Project.h"
 #include "Engine/BlockingBackgroundRender.h"
@@ -40,8 +43,11 @@
 #include "Engine/Settings.h"
 #include "Engine/RotoContext.h"
 #include "Engine/OutputSchedulerThread.h"
+#include "Engine/RenderProfiler.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/Transform.h"
 #include "Engine/DiskCacheNode.h"
+#include "Engine/Timer.h"
 
 using namespace Natron;
 
@@ -287,6 +293,44 @@ struct EffectInstance::RenderArgs
 };
 
 
+///The time spent in the tiles of a render by each of the threads which rendered some
+struct EffectInstance::TilesLoadStats
+{
+    QMutex lock;
+    std::map<const QThread*, double> busyTimes;
+
+    TilesLoadStats()
+        : lock()
+          , busyTimes()
+    {
+    }
+
+    void addBusyTime(const QThread* thread,
+                     double time)
+    {
+        QMutexLocker l(&lock);
+
+        busyTimes[thread] += time;
+    }
+
+    ///The mean of the busy times of the usableThreadsCount threads the render could use divided by the maximum:
+    ///1 when all of them worked as long. The threads that did not get any tile count as idle.
+    double getLoadBalance(int usableThreadsCount)
+    {
+        QMutexLocker l(&lock);
+        double total = 0.;
+        double maxTime = 0.;
+
+        for (std::map<const QThread*, double>::const_iterator it = busyTimes.begin(); it != busyTimes.end(); ++it) {
+            total += it->second;
+            maxTime = std::max(maxTime, it->second);
+        }
+        std::size_t threadsCount = std::max(busyTimes.size(), (std::size_t)std::max(usableThreadsCount, 1));
+
+        return maxTime <= 0. ? 1. : total / (threadsCount * maxTime);
+    }
+};
+
 struct EffectInstance::Implementation
 {
     Implementation()
@@ -309,6 +353,12 @@ struct EffectInstance::Implementation
           , imagesBeingRenderedMutex()
           , imagesBeingRendered()
 #endif
+          , hostSMPStatsMutex()
+          , hostSMPRendersCount(0)
+          , hostSMPLoadBalanceSum(0.)
+          , knobsSnapshotsMutex()
+          , knobsSnapshots()
+          , knobsSnapshotsGeneration(0)
     {
     }
 
@@ -364,6 +414,68 @@ struct EffectInstance::Implementation
     typedef std::map<ImagePtr,IBRPtr > IBRMap;
     IBRMap imagesBeingRendered;
 #endif
+
+    ///The load balance of the renders split in tiles by the host, @see getHostSMPLoadBalance()
+    mutable QMutex hostSMPStatsMutex;
+    int hostSMPRendersCount;
+    double hostSMPLoadBalanceSum;
+
+    ///The snapshots of the knobs for the frames being rendered, the most recently used first, with the node hash they
+    ///were taken for. Cleared whenever a knob changes.
+    QMutex knobsSnapshotsMutex;
+    std::list< std::pair<U64, boost::shared_ptr<KnobsSnapshot> > > knobsSnapshots;
+    U64 knobsSnapshotsGeneration; //< incremented by each clear, protected by knobsSnapshotsMutex
+
+    void addHostSMPLoadBalance(double balance)
+    {
+        QMutexLocker l(&hostSMPStatsMutex);
+
+        ++hostSMPRendersCount;
+        hostSMPLoadBalanceSum += balance;
+    }
+
+    ///Returns the snapshot of knobs for the given node hash and time, taking it if it is not cached yet
+    boost::shared_ptr<KnobsSnapshot> getKnobsSnapshot(const std::vector< boost::shared_ptr<KnobI> > & knobs,
+                                                      U64 nodeHash,
+                                                      int time)
+    {
+        typedef std::list< std::pair<U64, boost::shared_ptr<KnobsSnapshot> > > KnobsSnapshots;
+        U64 generation;
+        {
+            QMutexLocker l(&knobsSnapshotsMutex);
+            generation = knobsSnapshotsGeneration;
+            for (KnobsSnapshots::iterator it = knobsSnapshots.begin(); it != knobsSnapshots.end(); ++it) {
+                if ( (it->first == nodeHash) && (it->second->getTime() == time) ) {
+                    knobsSnapshots.splice(knobsSnapshots.begin(), knobsSnapshots, it);
+
+                    return knobsSnapshots.front().second;
+                }
+            }
+        }
+
+        ///Taken without holding the mutex: it locks the knobs, which may be waiting for another thread to clear the snapshots
+        boost::shared_ptr<KnobsSnapshot> snapshot = KnobsSnapshot::create(time, knobs);
+
+        QMutexLocker l(&knobsSnapshotsMutex);
+        ///A knob changed while the snapshot was taken: it may hold the old value, don't keep it for the next frames
+        if (generation != knobsSnapshotsGeneration) {
+            return snapshot;
+        }
+        knobsSnapshots.push_front( std::make_pair(nodeHash, snapshot) );
+        if ( (int)knobsSnapshots.size() > NATRON_KNOBS_SNAPSHOTS_CACHE_SIZE ) {
+            knobsSnapshots.pop_back();
+        }
+
+        return snapshot;
+    }
+
+    void clearKnobsSnapshots()
+    {
+        QMutexLocker l(&knobsSnapshotsMutex);
+
+        knobsSnapshots.clear();
+        ++knobsSnapshotsGeneration;
+    }
     
     void setDuringInteractAction(bool b)
     {
@@ -617,6 +729,27 @@ struct EffectInstance::Implementation
     }
 };
 
+///Sets back the value a thread storage had when it goes out of scope
+template <typename T>
+class ThreadStorageRestorer
+{
+    ThreadStorage<T>* storage;
+    T value;
+    
+public:
+    
+    ThreadStorageRestorer(ThreadStorage<T>* storage)
+    : storage(storage)
+    , value( storage->localData() )
+    {
+    }
+    
+    ~ThreadStorageRestorer()
+    {
+        storage->setLocalData(value);
+    }
+};
+
 class InputImagesHolder_RAII
 {
     ThreadStorage< std::list< boost::shared_ptr<Natron::Image> > > *storage;
@@ -730,6 +863,14 @@ EffectInstance::setParallelRenderArgs(int time,
     
     args.canAbort = canAbort;
     
+    ///The getters of the knobs read the snapshot during the render, which spares them the locks and the interpolation
+    ///of the curves. Not when the plug-in may call setValue: it expects to read back the values it sets.
+    ///The snapshot of the args is reset first, it would otherwise be read while taking the new one.
+    args.knobsSnapshot.reset();
+    if (!canSetValue) {
+        args.knobsSnapshot = _imp->getKnobsSnapshot(getKnobs(), nodeHash, time);
+    }
+    
     ++args.validArgs;
     
 }
@@ -740,6 +881,9 @@ EffectInstance::invalidateParallelRenderArgs()
     if (_imp->frameRenderArgs.hasLocalData()) {
         ParallelRenderArgs& args = _imp->frameRenderArgs.localData();
         --args.validArgs;
+        if (args.validArgs <= 0) {
+            args.knobsSnapshot.reset();
+        }
         return args.canSetValue;
     } else {
         qDebug() << "Frame render args thread storage not set, this is probably because the graph changed while rendering.";
@@ -1478,6 +1622,7 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool useCache,
                                                     const std::list<boost::shared_ptr<Natron::Image> >& inputImages,
                                                     boost::shared_ptr<Natron::Image>* image)
 {
+    RenderProfilerSpan profilerSpan(this, kRenderProfilerCategoryCache, "cache lookup", key.getTime());
     ImageList cachedImages;
     bool isCached = false;
     
@@ -1578,6 +1723,7 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool useCache,
                                                                                oldParams->getFramesNeeded());
                 
                 imageParams->setMipMapLevel(mipMapLevel);
+                imageParams->setTiled( oldParams->isTiled() );
                 
                 
                 ///Allocate the image in the cache, it may be useful later
@@ -1597,6 +1743,7 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool useCache,
                 } else {
                     img.reset(new Image(key, imageParams));
                 }
+                RenderProfilerSpan convertSpan(this, kRenderProfilerCategoryCache, "downscale cached image", key.getTime());
                 imageToConvert->downscaleMipMap(imageToConvert->getBounds(),
                                                 imageToConvert->getMipMapLevel(), img->getMipMapLevel() ,
                                                 useCache && imageToConvert->usesBitMap(),
@@ -1616,12 +1763,13 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool useCache,
             ///When calling allocateMemory() on the image, the cache already has the lock since it added it
             ///so taking this lock now ensures the image will be allocated completetly
 
+            RenderProfilerSpan waitSpan(this, kRenderProfilerCategoryLock, "wait for cached image", key.getTime());
             ImageLocker locker(this,*image);
             assert(*image);
         }
         
     }
-
+    profilerSpan.setName(*image ? "cache hit" : "cache miss");
 }
 
 bool
@@ -1776,7 +1924,7 @@ public:
 boost::shared_ptr<Natron::Image>
 EffectInstance::renderRoI(const RenderRoIArgs & args)
 {
-   
+    RenderProfilerSpan profilerSpan(this, kRenderProfilerCategoryRender, "renderRoI", args.time);
     ParallelRenderArgs& frameRenderArgs = _imp->frameRenderArgs.localData();
     if (!frameRenderArgs.validArgs) {
         qDebug() << "Thread-storage for the render of the frame was not set, this is a bug.";
@@ -2275,6 +2423,9 @@ EffectInstance::renderRoI(const RenderRoIArgs & args)
                                                         outputComponents,
                                                         outputDepth,
                                                         framesNeeded);
+            if (createInCache && !useDiskCacheNode) {
+                cachedImgParams->setTiled( appPTR->getCurrentSettings()->areNodeCacheImagesTiled() );
+            }
             
             //Take the lock after getting the image from the cache or while allocating it
             ///to make sure a thread will not attempt to write to the image while its being allocated.
@@ -2335,6 +2486,9 @@ EffectInstance::renderRoI(const RenderRoIArgs & args)
                                                                                                        outputComponents,
                                                                                                        outputDepth,
                                                                                                        framesNeeded);
+                if (createInCache && !useDiskCacheNode) {
+                    upscaledImageParams->setTiled( appPTR->getCurrentSettings()->areNodeCacheImagesTiled() );
+                }
 
                 if (createInCache) {
                     //The upscaled image will be rendered with input images at full def, it is then the best possibly rendered image so cache it!
@@ -2404,6 +2558,8 @@ EffectInstance::renderRoI(const RenderRoIArgs & args)
                 qDebug() << "rect: " << "x1= " <<  it->x1 << " , x2= " << it->x2 << " , y1= " << it->y1 << " , y2= " << it->y2;
             }
 # endif
+            ///Record how long it takes to render the image, this is used by the cost-aware cache eviction policy
+            TimeLapse renderTimer;
             renderRetCode = renderRoIInternal(args.time,
                                               args.mipMapLevel,
                                               args.view,
@@ -2425,6 +2581,9 @@ EffectInstance::renderRoI(const RenderRoIArgs & args)
                                               ,&isBeingRenderedElsewhere
 #endif
                                               );
+            if (renderRetCode != eRenderRoIStatusRenderFailed) {
+                (useImageAsOutput ? image : downscaledImage)->addComputeTime( renderTimer.getTimeSinceCreation() );
+            }
         }
         
 #if NATRON_ENABLE_TRIMAP
@@ -2434,6 +2593,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args)
             if (renderRetCode == eRenderRoIStatusRenderFailed || !isBeingRenderedElsewhere) {
                 _imp->unmarkImageAsBeingRendered(useImageAsOutput ? image : downscaledImage,renderRetCode == eRenderRoIStatusRenderFailed);
             } else {
+                RenderProfilerSpan waitSpan(this, kRenderProfilerCategoryLock, "wait for image rendered elsewhere", args.time);
                 _imp->waitForImageBeingRenderedElsewhereAndUnmark(roi, useImageAsOutput ? image: downscaledImage);
             }
         }
@@ -2886,13 +3046,18 @@ EffectInstance::renderRoIInternal(SequenceTime time,
         ///as it would lead to a deadlock when the project is loading.
         ///Just fall back to Fully_safe
         int nbThreads = appPTR->getCurrentSettings()->getNumberOfThreads();
+        int tilePixelsCount = 0;
         if (safety == eRenderSafetyFullySafeFrame) {
             ///If the plug-in is eRenderSafetyFullySafeFrame that means it wants the host to perform SMP aka slice up the RoI into chunks
             ///but if the effect doesn't support tiles it won't work.
             ///Also check that the number of threads indicating by the settings are appropriate for this render mode.
+            ///The tiles don't need free threads: this thread renders them too while waiting for the task scheduler.
+            tilePixelsCount = getHostSMPTilePixelsCount(downscaledImage);
             if ( !tilesSupported || (nbThreads == -1) || (nbThreads == 1) ||
-                ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ||
-                 ( QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount() ) ) {
+                ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ) {
+                safety = eRenderSafetyFullySafe;
+            } else if ( (U64)downscaledRectToRender.area() <= (U64)tilePixelsCount ) {
+                ///a window that fits in a single tile is not worth the threading overhead
                 safety = eRenderSafetyFullySafe;
             } else {
                 if ( !getApp()->getProject()->tryLock() ) {
@@ -2909,10 +3074,11 @@ EffectInstance::renderRoIInternal(SequenceTime time,
         switch (safety) {
         case eRenderSafetyFullySafeFrame: {     // the plugin will not perform any per frame SMP threading
             // we can split the frame in tiles and do per frame SMP threading (see kOfxImageEffectPluginPropHostFrameThreading)
-            if (nbThreads == 0) {
-                nbThreads = QThreadPool::globalInstance()->maxThreadCount();
-            }
-            std::vector<RectI> splitRects = RectI::splitRectIntoSmallerRect(downscaledRectToRender, nbThreads);
+            ///many small tiles rather than one per thread: the threads that are done pick the next tile, so that an expensive
+            ///area of the image does not leave the other threads idle. The threads get at least one tile each.
+            int threadsCount = Natron::TaskScheduler::globalInstance()->getMaxThreadCount() + 1;
+            tilePixelsCount = std::min( tilePixelsCount, (int)std::ceil( (double)downscaledRectToRender.area() / threadsCount ) );
+            std::vector<RectI> splitRects = RectI::splitRectIntoTiles(downscaledRectToRender, tilePixelsCount);
             
             TiledRenderingFunctorArgs tiledArgs;
             tiledArgs.args = &args;
@@ -2925,16 +3091,22 @@ EffectInstance::renderRoIInternal(SequenceTime time,
             tiledArgs.renderMappedImage = renderMappedImage;
             tiledArgs.par = par;
             tiledArgs.renderFullScaleThenDownscale = renderFullScaleThenDownscale;
+            tiledArgs.renderMemoryCounter = appPTR->getThreadRenderMemoryCounter();
             
             // the bitmap is checked again at the beginning of EffectInstance::tiledRenderingFunctor()
-            QFuture<EffectInstance::RenderingFunctorRet> ret = QtConcurrent::mapped( splitRects,
-                                                                                    boost::bind(&EffectInstance::tiledRenderingFunctor,
-                                                                                                this,
-                                                                                                tiledArgs,
-                                                                                                frameArgs,
-                                                                                                true,
-                                                                                                _1) );
-            ret.waitForFinished();
+            std::vector<RenderingFunctorRet> ret( splitRects.size() );
+            TilesLoadStats loadStats;
+            Natron::TaskScheduler::globalInstance()->parallelFor( (int)splitRects.size(),
+                                                                  boost::bind(&EffectInstance::tiledRenderingTask,
+                                                                              this,
+                                                                              tiledArgs,
+                                                                              frameArgs,
+                                                                              QThread::currentThread(),
+                                                                              &splitRects,
+                                                                              &ret,
+                                                                              &loadStats,
+                                                                              _1) );
+            _imp->addHostSMPLoadBalance( loadStats.getLoadBalance( std::min( threadsCount, (int)splitRects.size() ) ) );
 
             ///never call endsequence render here if the render is sequential
 
@@ -2949,7 +3121,7 @@ EffectInstance::renderRoIInternal(SequenceTime time,
                 }
             }
             
-            for (QFuture<EffectInstance::RenderingFunctorRet>::const_iterator it2 = ret.begin(); it2 != ret.end(); ++it2) {
+            for (std::vector<RenderingFunctorRet>::const_iterator it2 = ret.begin(); it2 != ret.end(); ++it2) {
                 if ( (*it2) == EffectInstance::eRenderingFunctorFailed ) {
                     renderStatus = eStatusFailed;
                     break;
@@ -2978,11 +3150,13 @@ EffectInstance::renderRoIInternal(SequenceTime time,
             QMutexLocker *locker = 0;
 
             if (safety == eRenderSafetyInstanceSafe) {
+                RenderProfilerSpan waitSpan(this, kRenderProfilerCategoryLock, "wait for instance lock", time);
                 locker = new QMutexLocker( &getNode()->getRenderInstancesSharedMutex() );
             } else if (safety == eRenderSafetyUnsafe) {
                 const Natron::Plugin* p = _node->getPlugin();
                 assert(p);
                 
+                RenderProfilerSpan waitSpan(this, kRenderProfilerCategoryLock, "wait for plug-in lock", time);
                 locker = new QMutexLocker( appPTR->getMutexForPlugin(p->getPluginID(), p->getMajorVersion(), p->getMinorVersion()) );
             }
             ///For eRenderSafetyFullySafe, don't take any lock, the image already has a lock on itself so we're sure it can't be written to by 2 different threads.
@@ -3055,6 +3229,59 @@ EffectInstance::tiledRenderingFunctor(const TiledRenderingFunctorArgs& args,
                                  args.renderMappedImage);
 }
 
+void
+EffectInstance::tiledRenderingTask(const TiledRenderingFunctorArgs& args,
+                                   const ParallelRenderArgs& frameArgs,
+                                   const QThread* callerThread,
+                                   const std::vector<RectI>* splitRects,
+                                   std::vector<RenderingFunctorRet>* results,
+                                   TilesLoadStats* loadStats,
+                                   int i)
+{
+    TimeLapse timer;
+
+    if (QThread::currentThread() != callerThread) {
+        ///the memory allocated for the tile belongs to the frame of the caller
+        RenderMemoryCounterSetter counterSetter(args.renderMemoryCounter);
+        (*results)[i] = tiledRenderingFunctor(args, frameArgs, true, (*splitRects)[i]);
+    } else {
+        ///the tile sets the thread-local storage of its own render window: the caller still needs its own afterwards
+        ThreadStorageRestorer<RenderArgs> renderArgsRestorer(&_imp->renderArgs);
+        ThreadStorageRestorer<std::list<boost::shared_ptr<Natron::Image> > > inputImagesRestorer(&_imp->inputImages);
+        (*results)[i] = tiledRenderingFunctor(args, frameArgs, true, (*splitRects)[i]);
+    }
+    loadStats->addBusyTime( QThread::currentThread(), timer.getTimeSinceCreation() );
+}
+
+int
+EffectInstance::getHostSMPTilePixelsCount(const boost::shared_ptr<Natron::Image> & image)
+{
+    int tilePixelsCount = appPTR->getCurrentSettings()->getHostSMPTileSize();
+
+    if (tilePixelsCount <= 0) {
+        int pixelSize = getElementsCountForComponents( image->getComponents() ) * getSizeOfForBitDepth( image->getBitDepth() );
+        tilePixelsCount = std::max(1, NATRON_HOST_SMP_CACHE_SIZE / (2 * pixelSize) );
+    }
+
+    return tilePixelsCount;
+}
+
+double
+EffectInstance::getHostSMPLoadBalance() const
+{
+    QMutexLocker l(&_imp->hostSMPStatsMutex);
+
+    return _imp->hostSMPRendersCount == 0 ? 1. : _imp->hostSMPLoadBalanceSum / _imp->hostSMPRendersCount;
+}
+
+int
+EffectInstance::getHostSMPRendersCount() const
+{
+    QMutexLocker l(&_imp->hostSMPStatsMutex);
+
+    return _imp->hostSMPRendersCount;
+}
+
 EffectInstance::RenderingFunctorRet
 EffectInstance::tiledRenderingFunctor(const RenderArgs & args,
                                       const ParallelRenderArgs& frameArgs,
@@ -3197,15 +3424,41 @@ EffectInstance::tiledRenderingFunctor(const RenderArgs & args,
     originalScale.x = downscaledImage->getScale();
     originalScale.y = originalScale.x;
 
-    Natron::StatusEnum st = render_public(time,
-                                          originalScale,
-                                          renderMappedScale,
-                                          renderRectToRender, view,
-                                          isSequentialRender,
-                                          isRenderResponseToUserInteraction,
-                                          renderMappedImage);
+    ///Plug-ins expect rows of pixels with a constant stride: a tiled image is rendered in place tile by tile,
+    ///each render action seeing the stride of its tile (see OfxImage)
+    std::vector<RectI> renderRects;
+    if ( renderMappedImage->isTiled() ) {
+        for (int y = renderRectToRender.y1; y < renderRectToRender.y2;) {
+            int tileY2 = renderMappedImage->getTileBounds(renderRectToRender.x1, y).y2;
+            for (int x = renderRectToRender.x1; x < renderRectToRender.x2;) {
+                RectI tileRect = renderMappedImage->getTileBounds(x, y);
+                tileRect.intersect(renderRectToRender, &tileRect);
+                renderRects.push_back(tileRect);
+                x = tileRect.x2;
+            }
+            y = tileY2;
+        }
+    } else {
+        renderRects.push_back(renderRectToRender);
+    }
     
-    bool renderAborted = aborted();
+    Natron::StatusEnum st = eStatusOK;
+    bool renderAborted = false;
+    for (std::vector<RectI>::iterator it = renderRects.begin(); it != renderRects.end() && st == eStatusOK && !renderAborted; ++it) {
+        ///The output clip of the plug-in hands out the render window of the thread-local storage
+        _imp->renderArgs.localData()._renderWindowPixel = *it;
+        st = render_public(time,
+                           originalScale,
+                           renderMappedScale,
+                           *it, view,
+                           isSequentialRender,
+                           isRenderResponseToUserInteraction,
+                           renderMappedImage);
+        renderAborted = aborted();
+    }
+    _imp->renderArgs.localData()._renderWindowPixel = renderRectToRender;
+    
+    renderAborted = aborted();
     
     if (st != eStatusOK) {
 #if NATRON_ENABLE_TRIMAP
@@ -3719,6 +3972,7 @@ EffectInstance::render_public(SequenceTime time,
                               boost::shared_ptr<Natron::Image> output)
 {
     NON_RECURSIVE_ACTION();
+    RenderProfilerSpan profilerSpan(this, kRenderProfilerCategoryAction, "render", time);
     return render(time, originalScale, mappedScale, roi, view, isSequentialRender, isRenderResponseToUserInteraction, output);
 
 }
@@ -3768,6 +4022,7 @@ EffectInstance::isIdentity_public(U64 hash,
         
         ///EDIT: We now allow isIdentity to be called recursively.
         RECURSIVE_ACTION();
+        RenderProfilerSpan profilerSpan(this, kRenderProfilerCategoryAction, "isIdentity", time);
         
         bool ret = false;
         
@@ -3851,6 +4106,7 @@ EffectInstance::getRegionOfDefinition_public(U64 hash,
         scaleOne.x = scaleOne.y = 1.;
         {
             RECURSIVE_ACTION();
+            RenderProfilerSpan profilerSpan(this, kRenderProfilerCategoryAction, "getRegionOfDefinition", time);
             ret = getRegionOfDefinition(hash,time, supportsRenderScaleMaybe() == eSupportsNo ? scaleOne : scale, view, rod);
             
             if ( (ret != eStatusOK) && (ret != eStatusReplyDefault) ) {
@@ -4079,6 +4335,8 @@ EffectInstance::onKnobValueChanged_public(KnobI* k,
                                           SequenceTime time,
                                           bool originatedFromMainThread)
 {
+    ///The frames rendered from now on must see the new value, even if it doesn't change the hash of the node
+    _imp->clearKnobsSnapshots();
 
     if ( isEvaluationBlocked() ) {
         return;
@@ -4280,9 +4538,7 @@ EffectInstance::getNearestNonIdentity(int time)
 void
 EffectInstance::onNodeHashChanged(U64 hash)
 {
-    
-    ///Always running in the MAIN THREAD
-    assert(QThread::currentThread() == qApp->thread());
+    ///MT-safe: the actions cache has its own lock, the hash may be updated from any thread
     
     ///Invalidate actions cache
     _imp->actionsCache.invalidateAll(hash);
@@ -4300,6 +4556,17 @@ EffectInstance::getCurrentTime() const
     return getThreadLocalRenderTime();
 }
 
+const KnobsSnapshot*
+EffectInstance::getRenderKnobsSnapshot() const
+{
+    if ( !_imp->frameRenderArgs.hasLocalData() ) {
+        return NULL;
+    }
+    const ParallelRenderArgs & args = _imp->frameRenderArgs.localData();
+
+    return args.validArgs > 0 ? args.knobsSnapshot.get() : NULL;
+}
+
 #ifdef DEBUG
 void
 EffectInstance::checkCanSetValueAndWarn() const
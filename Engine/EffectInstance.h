@@ -23,6 +23,7 @@
 #include "Engine/ImageLocker.h"
 
 class Hash64;
+class QThread;
 class Format;
 class TimeLine;
 class OverlaySupport;
@@ -30,6 +31,7 @@ class PluginMemory;
 class BlockingBackgroundRender;
 class RenderEngine;
 class BufferableObject;
+class RenderMemoryCounter;
 namespace Transform {
 struct Matrix3x3;
 }
@@ -78,6 +80,9 @@ struct ParallelRenderArgs
     ///Can the plug-in call setValue while the action is active
     bool canSetValue;
     
+    ///The values of the knobs at the time of the frame, NULL if canSetValue is true
+    boost::shared_ptr<KnobsSnapshot> knobsSnapshot;
+    
     ParallelRenderArgs()
     : time(0)
     , timeline(0)
@@ -89,6 +94,7 @@ struct ParallelRenderArgs
     , isSequentialRender(false)
     , canAbort(false)
     , canSetValue(false)
+    , knobsSnapshot()
     {
         
     }
@@ -223,6 +229,17 @@ public:
      **/
     void setKnobsAge(U64 age);
 
+    /**
+     * @brief Returns how well the work was spread across threads in the renders this effect let the host split into tiles:
+     * the average time the threads the render could use spent rendering tiles divided by the time of the busiest thread,
+     * averaged over the renders. 1 means the threads were busy for the same time. Returns 1 if no render was split.
+     * This is shown in the cache information of the node graph.
+     **/
+    double getHostSMPLoadBalance() const WARN_UNUSED_RETURN;
+
+    ///The number of renders getHostSMPLoadBalance() is averaged over
+    int getHostSMPRendersCount() const WARN_UNUSED_RETURN;
+
     /**
      * @brief Forwarded to the node's name
      **/
@@ -574,6 +591,8 @@ public:
 
     virtual SequenceTime getCurrentTime() const OVERRIDE FINAL WARN_UNUSED_RETURN;
 
+    virtual const KnobsSnapshot* getRenderKnobsSnapshot() const OVERRIDE FINAL WARN_UNUSED_RETURN;
+
     virtual bool getCanTransform() const { return false; }
 
     virtual bool getCanApplyTransform(Natron::EffectInstance** /*effect*/) const { return false; }
@@ -1036,7 +1055,7 @@ public:
 
     /**
      * @brief Called when the associated node's hash has changed.
-     * This is always called on the main-thread.
+     * This may be called from any thread.
      **/
     void onNodeHashChanged(U64 hash);
 
@@ -1228,6 +1247,7 @@ private:
     struct Implementation;
     boost::scoped_ptr<Implementation> _imp; // PIMPL: hide implementation details
     struct RenderArgs;
+    struct TilesLoadStats;
     enum RenderRoIStatusEnum
     {
         eRenderRoIStatusImageAlreadyRendered = 0, // there was nothing left to render
@@ -1362,6 +1382,7 @@ private:
         boost::shared_ptr<Natron::Image>  downscaledImage;
         boost::shared_ptr<Natron::Image>  fullScaleImage;
         boost::shared_ptr<Natron::Image>  renderMappedImage;
+        boost::shared_ptr<RenderMemoryCounter> renderMemoryCounter; //< the counter of the frame, set on the threads rendering the tiles
     };
 
     enum RenderingFunctorRet
@@ -1397,6 +1418,20 @@ private:
                                              bool setThreadLocalStorage,
                                              const RectI & downscaledRectToRender );
 
+    ///Renders the tile i of splitRects into results[i], in the TaskScheduler. The thread that started the render runs some of the
+    ///tiles too, after which its own thread-local storage is restored.
+    void tiledRenderingTask(const TiledRenderingFunctorArgs& args,
+                            const ParallelRenderArgs& frameArgs,
+                            const QThread* callerThread,
+                            const std::vector<RectI>* splitRects,
+                            std::vector<RenderingFunctorRet>* results,
+                            TilesLoadStats* loadStats,
+                            int i);
+
+    ///The maximum number of pixels of the tiles rendered in the TaskScheduler, from the settings or sized so that
+    ///a tile of image and one of an input of the same format fit in the processor cache.
+    static int getHostSMPTilePixelsCount(const boost::shared_ptr<Natron::Image> & image);
+
     RenderingFunctorRet tiledRenderingFunctor(const RenderArgs & args,
                                              const ParallelRenderArgs& frameArgs,
                                              const std::list<boost::shared_ptr<Natron::Image> >& inputImages,
@@ -48,6 +48,10 @@ SOURCES += \
     AppInstance.cpp \
     AppManager.cpp \
     BlockingBackgroundRender.cpp \
+    CacheSegmentStore.cpp \
+    CacheSharedIndex.cpp \
+    CacheStatistics.cpp \
+    CacheTOCFile.cpp \
     Curve.cpp \
     CurveSerialization.cpp \
     DiskCacheNode.cpp \
@@ -62,12 +66,15 @@ SOURCES += \
     Image.cpp \
     ImageKey.cpp \
     ImageParamsSerialization.cpp \
+    ImageSIMD.cpp \
+    ImageStatistics.cpp \
     Interpolation.cpp \
     Knob.cpp \
     KnobSerialization.cpp \
     KnobFactory.cpp \
     KnobFile.cpp \
     KnobTypes.cpp \
+    KnobsSnapshot.cpp \
     LibraryBinary.cpp \
     Log.cpp \
     Lut.cpp \
@@ -89,17 +96,23 @@ SOURCES += \
     PluginMemory.cpp \
     ProcessHandler.cpp \
     Project.cpp \
+    ProjectBinarySerialization.cpp \
     ProjectPrivate.cpp \
     ProjectSerialization.cpp \
+    RenderMemoryCounter.cpp \
+    RenderProfiler.cpp \
     RotoContext.cpp \
+    RotoRasterizer.cpp \
     RotoSerialization.cpp  \
     Settings.cpp \
     StandardPaths.cpp \
     StringAnimationManager.cpp \
+    TaskScheduler.cpp \
     TimeLine.cpp \
     Timer.cpp \
     Transform.cpp \
     ViewerInstance.cpp \
+    ViewerTexture.cpp \
     ../libs/SequenceParsing/SequenceParsing.cpp
 
 HEADERS += \
@@ -107,7 +120,12 @@ HEADERS += \
     AppManager.h \
     BlockingBackgroundRender.h \
     Cache.h \
+    CacheEvictionPolicy.h \
     CacheEntry.h \
+    CacheSegmentStore.h \
+    CacheSharedIndex.h \
+    CacheStatistics.h \
+    CacheTOCFile.h \
     Curve.h \
     CurveSerialization.h \
     CurvePrivate.h \
@@ -122,6 +140,7 @@ HEADERS += \
     FrameParams.h \
     FrameParamsSerialization.h \
     Hash64.h \
+    HashPropagation.h \
     HistogramCPU.h \
     ImageInfo.h \
     Image.h \
@@ -130,6 +149,8 @@ HEADERS += \
     ImageSerialization.h \
     ImageParams.h \
     ImageParamsSerialization.h \
+    ImageSIMD.h \
+    ImageStatistics.h \
     Interpolation.h \
     KeyHelper.h \
     Knob.h \
@@ -139,6 +160,7 @@ HEADERS += \
     KnobFactory.h \
     KnobFile.h \
     KnobTypes.h \
+    KnobsSnapshot.h \
     LibraryBinary.h \
     Log.h \
     LRUHashTable.h \
@@ -164,16 +186,21 @@ HEADERS += \
     PluginMemory.h \
     ProcessHandler.h \
     Project.h \
+    ProjectBinarySerialization.h \
     ProjectPrivate.h \
     ProjectSerialization.h \
     Rect.h \
+    RenderMemoryCounter.h \
+    RenderProfiler.h \
     RotoContext.h \
     RotoContextPrivate.h \
+    RotoRasterizer.h \
     RotoSerialization.h \
     Settings.h \
     Singleton.h \
     StandardPaths.h \
     StringAnimationManager.h \
+    TaskScheduler.h \
     TextureRect.h \
     TextureRectSerialization.h \
     ThreadStorage.h \
@@ -183,6 +210,7 @@ HEADERS += \
     Variant.h \
     ViewerInstance.h \
     ViewerInstancePrivate.h \
+    ViewerTexture.h \
     ../Global/Enums.h \
     ../Global/GitVersion.h \
     ../Global/GLIncludes.h \
@@ -39,9 +39,8 @@ public:
     FrameEntry(const FrameKey & key,
                const boost::shared_ptr<FrameParams> &  params,
                const Natron::CacheAPI* cache,
-               Natron::StorageModeEnum storage,
-               const std::string & path)
-        : CacheEntryHelper<U8,FrameKey,FrameParams>(key,params,cache,storage,path)
+               Natron::StorageModeEnum storage)
+        : CacheEntryHelper<U8,FrameKey,FrameParams>(key,params,cache,storage)
         , _aborted(false)
         , _abortedMutex()
     {
@@ -11,10 +11,6 @@
 
 #include "Hash64.h"
 
-#include <algorithm>  // for std::for_each
-#ifndef Q_MOC_RUN
-#include <boost/crc.hpp>
-#endif
 #include <QtCore/QString>
 
 #include "Engine/Node.h"
@@ -24,20 +20,25 @@ using namespace Natron;
 void
 Hash64::computeHash()
 {
-    if ( node_values.empty() ) {
+    if (count == 0) {
         return;
     }
 
-    const unsigned char* data = reinterpret_cast<const unsigned char*>( &node_values.front() );
-    boost::crc_optimal<64,0x42F0E1EBA9EA3693ULL,0,0,false,false> crc_64;
-    crc_64 = std::for_each( data, data + node_values.size() * sizeof(node_values[0]), crc_64 );
-    hash = crc_64();
+    ///the values are mixed already, only the avalanche remains
+    U64 h = state + count * sizeof(U64);
+    h ^= h >> 33;
+    h *= NATRON_HASH64_PRIME2;
+    h ^= h >> 29;
+    h *= NATRON_HASH64_PRIME3;
+    h ^= h >> 32;
+    hash = h;
 }
 
 void
 Hash64::reset()
 {
-    node_values.clear();
+    state = NATRON_HASH64_SEED;
+    count = 0;
     hash = 0;
 }
 
@@ -45,8 +46,21 @@ void
 Hash64_appendQString(Hash64* hash,
                      const QString & str)
 {
-    for (int i = 0; i < str.size(); ++i) {
-        hash->append<unsigned short>( str.at(i).unicode() );
+    ///the size distinguishes trailing null characters from the padding of the last value
+    const int size = str.size();
+    hash->append(size);
+
+    ///4 UTF-16 characters per value
+    const ushort* chars = str.utf16();
+    int i = 0;
+    for (; i + 4 <= size; i += 4) {
+        hash->append( (U64)chars[i] | ( (U64)chars[i + 1] << 16 ) | ( (U64)chars[i + 2] << 32 ) | ( (U64)chars[i + 3] << 48 ) );
+    }
+    if (i < size) {
+        U64 last = 0;
+        for (int shift = 0; i < size; ++i, shift += 16) {
+            last |= (U64)chars[i] << shift;
+        }
+        hash->append(last);
     }
 }
-
@@ -12,7 +12,6 @@
 #ifndef NATRON_ENGINE_HASH64_H_
 #define NATRON_ENGINE_HASH64_H_
 
-#include <vector>
 #ifndef Q_MOC_RUN
 #include <boost/static_assert.hpp>
 #endif
@@ -20,6 +19,13 @@
 #include "Global/GlobalDefines.h"
 
 
+///The primes of xxHash64
+#define NATRON_HASH64_PRIME1 0x9E3779B185EBCA87ULL
+#define NATRON_HASH64_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define NATRON_HASH64_PRIME3 0x165667B19E3779F9ULL
+#define NATRON_HASH64_PRIME4 0x85EBCA77C2B2AE63ULL
+#define NATRON_HASH64_SEED 0x27D4EB2F165667C5ULL
+
 class QString;
 
 namespace Natron {
@@ -30,17 +36,20 @@ class Node;
     - the hash values for the  tree upstream
  */
 
+/**
+ * @brief The values are mixed into a fixed-size state as they are appended, with the 64-bit round of xxHash,
+ * and computeHash() applies the final avalanche of xxHash to the state and the number of values.
+ * The keys differ from the CRC-64 of the previous versions: NATRON_CACHE_VERSION is different so that
+ * their disk caches are cleared when they are restored.
+ **/
 class Hash64
 {
 public:
     Hash64()
+        : hash(0)
+          , state(NATRON_HASH64_SEED)
+          , count(0)
     {
-        hash = 0;
-    }
-
-    ~Hash64()
-    {
-        node_values.clear();
     }
 
     U64 value() const
@@ -70,7 +79,10 @@ public:
     template<typename T>
     void append(T value)
     {
-        node_values.push_back( toU64(value) );
+        U64 v = toU64(value) * NATRON_HASH64_PRIME2;
+        v = rotateLeft(v, 31) * NATRON_HASH64_PRIME1;
+        state = rotateLeft(state ^ v, 27) * NATRON_HASH64_PRIME1 + NATRON_HASH64_PRIME4;
+        ++count;
     }
 
     bool operator== (const Hash64 & h) const
@@ -84,6 +96,12 @@ public:
     }
 
 private:
+    static U64 rotateLeft(U64 x,
+                          int r)
+    {
+        return (x << r) | ( x >> (64 - r) );
+    }
+
     template<typename T>
     struct alias_cast_t
     {
@@ -100,7 +118,8 @@ private:
     };
 
     U64 hash;
-    std::vector<U64> node_values;
+    U64 state;
+    U64 count; //< the number of values appended
 };
 
 void Hash64_appendQString(Hash64* hash, const QString & str);
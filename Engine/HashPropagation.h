@@ -0,0 +1,91 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_HASHPROPAGATION_H_
+#define NATRON_ENGINE_HASHPROPAGATION_H_
+
+#include <list>
+#include <set>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Propagation of a node hash change to the nodes downstream, used by Node::computeHash().
+ * The functions are templates over the node type so that they can be exercised on synthetic graphs.
+ * NodeT must provide:
+ * - void getOutputs_mt_safe(std::list<NodeT*> & outputs) const;
+ * - bool recomputeOwnHash(); which recomputes the hash of the node from the hashes of its inputs
+ *   and returns true if it changed.
+ **/
+namespace Natron {
+namespace HashPropagation {
+
+/**
+ * @brief Fills sorted with root and all the nodes downstream of it, each of them once, so that every node
+ * comes after all the nodes of the list that are its inputs. The graph must not have any cycle.
+ * The traversal is iterative so that deep graphs cannot overflow the stack.
+ **/
+template <typename NodeT>
+void
+getDownstreamNodesSorted(NodeT* root,
+                         std::list<NodeT*>* sorted)
+{
+    std::set<NodeT*> visited;
+    ///the nodes being visited, with the outputs that remain to visit
+    std::vector< std::pair<NodeT*, std::list<NodeT*> > > stack;
+
+    visited.insert(root);
+    stack.push_back( std::make_pair( root, std::list<NodeT*>() ) );
+    root->getOutputs_mt_safe(stack.back().second);
+    while ( !stack.empty() ) {
+        std::list<NodeT*> & remainingOutputs = stack.back().second;
+        if ( remainingOutputs.empty() ) {
+            ///all the nodes downstream are in the list already: a reverse post-order is a topological order
+            sorted->push_front(stack.back().first);
+            stack.pop_back();
+        } else {
+            NodeT* output = remainingOutputs.front();
+            remainingOutputs.pop_front();
+            if ( visited.insert(output).second ) {
+                stack.push_back( std::make_pair( output, std::list<NodeT*>() ) );
+                output->getOutputs_mt_safe(stack.back().second);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Recomputes the hash of root, then of the nodes downstream in topological order: each node is
+ * rehashed at most once, after all its inputs, and only if the hash of one of its inputs changed.
+ * The nodes whose hash changed are appended to changed, root is always appended.
+ **/
+template <typename NodeT>
+void
+updateDownstreamHashes(NodeT* root,
+                       std::list<NodeT*>* changed)
+{
+    std::list<NodeT*> sorted;
+
+    getDownstreamNodesSorted(root, &sorted);
+
+    std::set<NodeT*> dirty;
+    dirty.insert(root);
+    for (typename std::list<NodeT*>::iterator it = sorted.begin(); it != sorted.end(); ++it) {
+        if ( dirty.find(*it) == dirty.end() ) {
+            continue;
+        }
+        if ( (*it)->recomputeOwnHash() || (*it == root) ) {
+            changed->push_back(*it);
+            std::list<NodeT*> outputs;
+            (*it)->getOutputs_mt_safe(outputs);
+            dirty.insert( outputs.begin(), outputs.end() );
+        }
+    }
+}
+} // namespace HashPropagation
+} // namespace Natron
+
+#endif // NATRON_ENGINE_HASHPROPAGATION_H_
@@ -11,6 +11,10 @@
 #include <QWaitCondition>
 
 #include "Engine/Image.h"
+#include "Engine/ImageStatistics.h"
+
+///the histograms are computed with upscale more bins, then smoothed and downsampled
+#define NATRON_HISTOGRAM_UPSCALE 5
 
 
 struct HistogramRequest
@@ -22,6 +26,7 @@ struct HistogramRequest
     double vmin;
     double vmax;
     int smoothingKernelSize;
+    boost::shared_ptr<const Natron::ImageStatistics> statistics;
 
     HistogramRequest()
         : binsCount(0)
@@ -31,6 +36,7 @@ struct HistogramRequest
           , vmin(0)
           , vmax(0)
           , smoothingKernelSize(0)
+          , statistics()
     {
     }
 
@@ -40,7 +46,8 @@ struct HistogramRequest
                      const RectI & rect,
                      double vmin,
                      double vmax,
-                     int smoothingKernelSize)
+                     int smoothingKernelSize,
+                     const boost::shared_ptr<const Natron::ImageStatistics> & statistics)
         : binsCount(binsCount)
           , mode(mode)
           , image(image)
@@ -48,6 +55,7 @@ struct HistogramRequest
           , vmin(vmin)
           , vmax(vmax)
           , smoothingKernelSize(smoothingKernelSize)
+          , statistics(statistics)
     {
     }
 };
@@ -117,13 +125,14 @@ HistogramCPU::computeHistogram(int mode,      //< corresponds to the enum Histog
                                int binsCount,
                                double vmin,
                                double vmax,
-                               int smoothingKernelSize)
+                               int smoothingKernelSize,
+                               const boost::shared_ptr<const Natron::ImageStatistics> & statistics)
 {
     /*Starting or waking-up the thread*/
     QMutexLocker quitLocker(&_imp->mustQuitMutex);
     QMutexLocker locker(&_imp->requestMutex);
 
-    _imp->requests.push_back( HistogramRequest(binsCount,mode,image,rect,vmin,vmax,smoothingKernelSize) );
+    _imp->requests.push_back( HistogramRequest(binsCount,mode,image,rect,vmin,vmax,smoothingKernelSize,statistics) );
     if (!isRunning() && !_imp->mustQuit) {
         quitLocker.unlock();
         start(HighestPriority);
@@ -133,6 +142,12 @@ HistogramCPU::computeHistogram(int mode,      //< corresponds to the enum Histog
     }
 }
 
+int
+HistogramCPU::getStatisticsBinsCount(int binsCount)
+{
+    return binsCount * NATRON_HISTOGRAM_UPSCALE;
+}
+
 void
 HistogramCPU::quitAnyComputation()
 {
@@ -190,76 +205,6 @@ HistogramCPU::getMostRecentlyProducedHistogram(std::vector<float>* histogram1,
     return true;
 }
 
-///putting these in an anonymous namespace will yield this error on gcc 4.2:
-///"function has not external linkage"
-struct pix_red
-{
-    static float val(float *pix)
-    {
-        return pix[0];
-    }
-};
-
-struct pix_green
-{
-    static float val(float *pix)
-    {
-        return pix[1];
-    }
-};
-
-struct pix_blue
-{
-    static float val(float *pix)
-    {
-        return pix[2];
-    }
-};
-
-struct pix_alpha
-{
-    static float val(float *pix)
-    {
-        return pix[3];
-    }
-};
-
-struct pix_lum
-{
-    static float val(float *pix)
-    {
-        return 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
-    }
-};
-
-
-template <float pix_func(float*)>
-void
-computeHisto(const HistogramRequest & request,
-             int upscale,
-             std::vector<float> *histo)
-{
-    assert(histo);
-    histo->resize(request.binsCount * upscale);
-    std::fill(histo->begin(), histo->end(), 0.f);
-    double binSize = (request.vmax - request.vmin) / histo->size();
-
-    ///Images come from the viewer which is in float.
-    assert(request.image->getBitDepth() == Natron::eImageBitDepthFloat);
-
-    for (int y = request.rect.bottom(); y < request.rect.top(); ++y) {
-        for (int x = request.rect.left(); x < request.rect.right(); ++x) {
-            float *pix = (float*)request.image->pixelAt(x, y);
-            float v = pix_func(pix);
-            if ( (request.vmin <= v) && (v < request.vmax) ) {
-                int index = (int)( (v - request.vmin) / binSize );
-                assert( 0 <= index && index < (int)histo->size() );
-                (*histo)[index] += 1.f;
-            }
-        }
-    }
-}
-
 /// IIR Gaussian filter: recursive implementation.
 
 static void
@@ -398,10 +343,11 @@ iir_1d_filter(SrcIterator src,
 
 static void
 computeHistogramStatic(const HistogramRequest & request,
+                       const Natron::ImageStatistics & statistics,
                        boost::shared_ptr<FinishedHistogram> ret,
                        int histogramIndex)
 {
-    const int upscale = 5;
+    const int upscale = NATRON_HISTOGRAM_UPSCALE;
     std::vector<float> *histo = 0;
 
     switch (histogramIndex) {
@@ -433,19 +379,19 @@ computeHistogramStatic(const HistogramRequest & request,
     std::vector<float> histo_upscaled;
     switch (mode) {
     case 1:     //< A
-        computeHisto<&pix_alpha::val>(request, upscale, &histo_upscaled);
+        histo_upscaled = statistics.getHistogram(Natron::ImageStatistics::eChannelAlpha);
         break;
     case 2:     //<Y
-        computeHisto<&pix_lum::val>(request, upscale, &histo_upscaled);
+        histo_upscaled = statistics.getHistogram(Natron::ImageStatistics::eChannelLuminance);
         break;
     case 3:     //< R
-        computeHisto<&pix_red::val>(request, upscale, &histo_upscaled);
+        histo_upscaled = statistics.getHistogram(Natron::ImageStatistics::eChannelRed);
         break;
     case 4:     //< G
-        computeHisto<&pix_green::val>(request, upscale, &histo_upscaled);
+        histo_upscaled = statistics.getHistogram(Natron::ImageStatistics::eChannelGreen);
         break;
     case 5:     //< B
-        computeHisto<&pix_blue::val>(request, upscale, &histo_upscaled);
+        histo_upscaled = statistics.getHistogram(Natron::ImageStatistics::eChannelBlue);
         break;
 
     default:
@@ -512,19 +458,31 @@ HistogramCPU::run()
         ret->vmin = request.vmin;
         ret->vmax = request.vmax;
 
+        ///All the histograms are read from the same statistics: use those of the viewer if they match
+        ///the request, otherwise read the image once for all the channels.
+        boost::shared_ptr<const Natron::ImageStatistics> statistics = request.statistics;
+        const int statisticsBinsCount = getStatisticsBinsCount(request.binsCount);
+        if ( !statistics || !statistics->isComputedFor(request.image, request.rect) ||
+             !statistics->hasHistograms(request.vmin, request.vmax, statisticsBinsCount) ) {
+            ///Images come from the viewer which is in float.
+            assert(request.image->getBitDepth() == Natron::eImageBitDepthFloat);
+            boost::shared_ptr<Natron::ImageStatistics> computed(new Natron::ImageStatistics);
+            computed->compute(request.image, request.rect, request.vmin, request.vmax, statisticsBinsCount, true);
+            statistics = computed;
+        }
 
         switch (request.mode) {
         case 0:     //< RGB
-            computeHistogramStatic(request, ret, 1);
-            computeHistogramStatic(request, ret, 2);
-            computeHistogramStatic(request, ret, 3);
+            computeHistogramStatic(request, *statistics, ret, 1);
+            computeHistogramStatic(request, *statistics, ret, 2);
+            computeHistogramStatic(request, *statistics, ret, 3);
             break;
         case 1:
         case 2:
         case 3:
         case 4:
         case 5:
-            computeHistogramStatic(request, ret, 1);
+            computeHistogramStatic(request, *statistics, ret, 1);
             break;
         default:
             assert(false);     //< unknown case.
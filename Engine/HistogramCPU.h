@@ -15,6 +15,7 @@
 #include "Global/Macros.h"
 namespace Natron {
 class Image;
+class ImageStatistics;
 }
 class RectI;
 struct HistogramCPUPrivate;
@@ -29,13 +30,23 @@ public:
 
     virtual ~HistogramCPU();
 
+    /**
+     * @brief Requests the histogram of image in rect. If statistics is not NULL and was computed for the same
+     * portion of image with histograms matching getStatisticsBinsCount(binsCount), vmin and vmax, they are used
+     * instead of reading the image again. Otherwise the histograms of all the channels are computed in a single pass.
+     **/
     void computeHistogram(int mode, //< corresponds to the enum Histogram::DisplayMode
                           const boost::shared_ptr<Natron::Image> & image,
                           const RectI & rect,
                           int binsCount,
                           double vmin,
                           double vmax,
-                          int smoothingKernelSize);
+                          int smoothingKernelSize,
+                          const boost::shared_ptr<const Natron::ImageStatistics> & statistics = boost::shared_ptr<const Natron::ImageStatistics>());
+
+    ///Returns the number of bins of the Natron::ImageStatistics histograms used to produce a histogram of binsCount bins,
+    ///they are smoothed and downsampled to binsCount.
+    static int getStatisticsBinsCount(int binsCount) WARN_UNUSED_RETURN;
 
     ////Returns true if a new histogram fully computed is available
     bool hasProducedHistogram() const;
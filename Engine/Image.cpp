@@ -16,156 +16,195 @@
 #include <boost/math/special_functions/fpclassify.hpp>
 #endif
 #include "Engine/AppManager.h"
+#include "Engine/ImageSIMD.h"
 #include "Engine/Lut.h"
 
 using namespace Natron;
 
-#define BM_GET(i,j) &_map[( i - _bounds.bottom() ) * _bounds.width() + ( j - _bounds.left() )]
-
 #define PIXEL_UNAVAILABLE 2
 
-template <int trimap>
-RectI minimalNonMarkedBbox_internal(const RectI& roi, const RectI& _bounds,const std::vector<char>& _map,
-                                    bool* isBeingRenderedElsewhere)
+namespace {
+///Returned by the const version of Image::pixelAt() for the tiles that are not allocated yet.
+///It is large enough for a tile of any components and bit depth and stays in the zero-filled bss.
+unsigned char emptyTile[NATRON_IMAGE_TILE_SIZE * NATRON_IMAGE_TILE_SIZE * 4 * sizeof(float)];
+}
+
+namespace {
+    
+///Returns the first pixel of [x1,x2) that does not belong to a span of the row, or x2 if they all do
+int
+firstNonMarked(const Bitmap::Row & row,
+               int x1,
+               int x2)
 {
-    RectI bbox;
+    int x = x1;
+    for (Bitmap::Row::const_iterator it = row.begin(); it != row.end() && it->x1 <= x; ++it) {
+        if (it->x2 > x) {
+            x = it->x2;
+        }
+    }
     
-    roi.intersect(_bounds, &bbox); // be safe
-    //find bottom
-    for (int i = bbox.bottom(); i < bbox.top(); ++i) {
-        const char* buf = BM_GET(i, _bounds.left());
-        
-        if (trimap) {
-            
-            const char* lineEnd = buf + _bounds.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-            }
-        } else {
-            if ( !memchr( buf, 0, _bounds.width() ) ) {
-                bbox.set_bottom(bbox.bottom() + 1);
-            } else {
-                break;
-            }
+    return std::min(x, x2);
+}
+
+///Returns the end of the last pixel of [x1,x2) that does not belong to a span of the row, or x1 if they all do
+int
+lastNonMarked(const Bitmap::Row & row,
+              int x1,
+              int x2)
+{
+    int x = x2;
+    for (Bitmap::Row::const_reverse_iterator it = row.rbegin(); it != row.rend() && it->x2 >= x; ++it) {
+        if (it->x1 < x) {
+            x = it->x1;
         }
     }
     
-    //find top (will do zero iteration if the bbox is already empty)
-    for (int i = bbox.top() - 1; i >= bbox.bottom(); --i) {
-        const char* buf = BM_GET(i, _bounds.left());
-        
-        if (trimap) {
-            
-            const char* lineEnd = buf + _bounds.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-            }
-            
-        } else {
-            if ( !memchr( buf, 0, _bounds.width() ) ) {
-                bbox.set_top(bbox.top() - 1);
-            } else {
-                break;
-            }
+    return std::max(x, x1);
+}
+
+///Returns the first pixel of [x1,x2) that belongs to a span of the row, or x2 if none does
+int
+firstMarked(const Bitmap::Row & row,
+            int x1,
+            int x2)
+{
+    for (Bitmap::Row::const_iterator it = row.begin(); it != row.end(); ++it) {
+        if (it->x2 > x1) {
+            return std::min( std::max(it->x1, x1), x2 );
         }
     }
     
-    // avoid making bbox.width() iterations for nothing
-    if ( bbox.isNull() ) {
-        return bbox;
+    return x2;
+}
+
+///Returns the end of the last pixel of [x1,x2) that belongs to a span of the row, or x1 if none does
+int
+lastMarked(const Bitmap::Row & row,
+           int x1,
+           int x2)
+{
+    for (Bitmap::Row::const_reverse_iterator it = row.rbegin(); it != row.rend(); ++it) {
+        if (it->x1 < x2) {
+            return std::max( std::min(it->x2, x2), x1 );
+        }
     }
     
-    //find left
-    for (int j = bbox.left(); j < bbox.right(); ++j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
+    return x1;
+}
 
-        bool metUnavailablePixel = false;
+///Appends a span to a row, merging it with the last span if they are adjacent with the same state
+void
+appendSpan(Bitmap::Row* row,
+           const Bitmap::Span & span)
+{
+    if (span.x1 >= span.x2) {
+        return;
+    }
+    if ( !row->empty() && row->back().x2 == span.x1 && row->back().state == span.state ) {
+        row->back().x2 = span.x2;
+    } else {
+        row->push_back(span);
+    }
+}
+    
+}
 
-        for (int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width()) {
-            if (!*pix) {
-                pix = 0;
-                break;
-            }
-            
-            else if (trimap && *pix == PIXEL_UNAVAILABLE) {
-                metUnavailablePixel = true;
-            }
-            
-        }
-        if (pix) {
-            bbox.set_left(bbox.left() + 1);
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
-            }
-        } else {
+void
+Bitmap::replaceSpans(int y,
+                     int x1,
+                     int x2,
+                     const Row & spans)
+{
+    assert(y >= _bounds.y1 && y < _bounds.y2);
+    Row & row = _rows[y - _bounds.y1];
+    Row newRow;
+    newRow.reserve(row.size() + spans.size() + 1);
+    
+    Row::const_iterator it = row.begin();
+    
+    ///Spans on the left of x1, the last one may be cut
+    for (; it != row.end() && it->x1 < x1; ++it) {
+        appendSpan( &newRow, Span(it->x1, std::min(it->x2, x1), it->state) );
+        if (it->x2 > x2) {
             break;
         }
     }
+    for (Row::const_iterator it2 = spans.begin(); it2 != spans.end(); ++it2) {
+        assert(it2->x1 >= x1 && it2->x2 <= x2 && it2->state != 0);
+        appendSpan(&newRow, *it2);
+    }
     
-    //find right
-    for (int j = bbox.right() - 1; j >= bbox.left(); --j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
-
-        bool metUnavailablePixel = false;
-
-        for (int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width()) {
-            if (!*pix) {
-                pix = 0;
-                break;
-            }
-
-            else if (trimap && *pix == PIXEL_UNAVAILABLE) {
-                metUnavailablePixel = true;
-            }
-
+    ///Spans on the right of x2, the first one may be cut
+    for (; it != row.end(); ++it) {
+        if (it->x2 > x2) {
+            appendSpan( &newRow, Span(std::max(it->x1, x2), it->x2, it->state) );
         }
-        if (pix) {
-            bbox.set_right(bbox.right() - 1);
+    }
+    row.swap(newRow);
+}
 
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
-            }
+void
+Bitmap::setSpan(int y,
+                int x1,
+                int x2,
+                char state)
+{
+    Row spans;
+    if (state) {
+        spans.push_back( Span(x1, x2, state) );
+    }
+    replaceSpans(y, x1, x2, spans);
+}
 
-        } else {
-            break;
+void
+Bitmap::setTo1()
+{
+    for (int y = _bounds.y1; y < _bounds.y2; ++y) {
+        setSpan(y, _bounds.x1, _bounds.x2, 1);
+    }
+}
+
+RectI
+Bitmap::minimalNonMarkedBbox_internal(const RectI & roi) const
+{
+    RectI bbox;
+    
+    if ( !roi.intersect(_bounds, &bbox) ) { // be safe
+        return bbox;
+    }
+    
+    int left = bbox.x2;
+    int right = bbox.x1;
+    int bottom = bbox.y2;
+    int top = bbox.y1;
+    for (int y = bbox.y1; y < bbox.y2; ++y) {
+        const Row & row = _rows[y - _bounds.y1];
+        int first = firstNonMarked(row, bbox.x1, bbox.x2);
+        if (first == bbox.x2) {
+            continue;
         }
+        left = std::min(left, first);
+        right = std::max( right, lastNonMarked(row, first, bbox.x2) );
+        bottom = std::min(bottom, y);
+        top = y + 1;
     }
     
-    return bbox;
-
+    if (bottom >= top) {
+        ///Everything is rendered, return an empty rectangle inside the roi
+        bbox.set_bottom( bbox.top() );
+        
+        return bbox;
+    }
+    
+    return RectI(left, bottom, right, top);
 }
 
-
-template <int trimap>
 void
-minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std::vector<char>& _map,
-                               std::list<RectI>& ret,bool* isBeingRenderedElsewhere)
+Bitmap::minimalNonMarkedRects_internal(const RectI & roi,
+                                       std::list<RectI>& ret) const
 {
-    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(roi, _bounds, _map, isBeingRenderedElsewhere);
+    RectI bboxM = minimalNonMarkedBbox_internal(roi);
     
     //#define NATRON_BITMAP_DISABLE_OPTIMIZATION
 #ifdef NATRON_BITMAP_DISABLE_OPTIMIZATION
@@ -201,150 +240,49 @@ minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std
     // First, find if there's an "A" rectangle, and push it to the result
     //find bottom
     RectI bboxX = bboxM;
-    RectI bboxA = bboxX;
-    bboxA.set_top( bboxX.bottom() );
-    for (int i = bboxX.bottom(); i < bboxX.top(); ++i) {
-        const char* buf = BM_GET(i, bboxX.left());
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                bboxX.set_bottom(bboxX.bottom() + 1);
-                bboxA.set_top( bboxX.bottom() );
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                bboxX.set_bottom(bboxX.bottom() + 1);
-                bboxA.set_top( bboxX.bottom() );
-            } else {
-                break;
-            }
-        }
+    while ( bboxX.bottom() < bboxX.top() &&
+            firstMarked(_rows[bboxX.bottom() - _bounds.y1], bboxX.left(), bboxX.right()) == bboxX.right() ) {
+        bboxX.set_bottom(bboxX.bottom() + 1);
     }
+    RectI bboxA = bboxM;
+    bboxA.set_top( bboxX.bottom() );
     if ( !bboxA.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxA);
     }
     
     // Now, find the "B" rectangle
     //find top
+    while ( bboxX.top() > bboxX.bottom() &&
+            firstMarked(_rows[bboxX.top() - 1 - _bounds.y1], bboxX.left(), bboxX.right()) == bboxX.right() ) {
+        bboxX.set_top(bboxX.top() - 1);
+    }
     RectI bboxB = bboxX;
     bboxB.set_bottom( bboxX.top() );
-    for (int i = bboxX.top() - 1; i >= bboxX.bottom(); --i) {
-        const char* buf = BM_GET(i, bboxX.left());
-        
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                bboxX.set_top(bboxX.top() - 1);
-                bboxB.set_bottom( bboxX.top() );
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                bboxX.set_top(bboxX.top() - 1);
-                bboxB.set_bottom( bboxX.top() );
-            } else {
-                break;
-            }
-            
-        }
-    }
+    bboxB.set_top( bboxM.top() );
     if ( !bboxB.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxB);
     }
     
-    //find left
-    RectI bboxC = bboxX;
-    bboxC.set_right( bboxX.left() );
-    for (int j = bboxX.left(); j < bboxX.right(); ++j) {
-        const char* pix = BM_GET(bboxX.bottom(), j);
-        
-        bool metUnavailablePixel = false;
-        
-        for (int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width()) {
-            if (*pix == 1) {
-                pix = 0;
-                break;
-            } else if (trimap && *pix == PIXEL_UNAVAILABLE) {
-                pix = 0;
-                metUnavailablePixel = true;
-                break;
-            }
-        }
-        if (pix) {
-            bboxX.set_left(bboxX.left() + 1);
-            bboxC.set_right( bboxX.left() );
-        } else {
-            if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true;
-            }
-            break;
-        }
+    //find left: the columns on the left of the first marked pixel of all the rows
+    int left = bboxX.right();
+    for (int y = bboxX.bottom(); y < bboxX.top(); ++y) {
+        left = std::min( left, firstMarked(_rows[y - _bounds.y1], bboxX.left(), bboxX.right()) );
     }
+    RectI bboxC = bboxX;
+    bboxC.set_right(left);
+    bboxX.set_left(left);
     if ( !bboxC.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxC);
     }
     
     //find right
-    RectI bboxD = bboxX;
-    bboxD.set_left( bboxX.right() );
-    for (int j = bboxX.right() - 1; j >= bboxX.left(); --j) {
-        const char* pix = BM_GET(bboxX.bottom(), j);
-        
-        bool metUnavailablePixel = false;
-        
-        for (int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width()) {
-            if (*pix == 1) {
-                pix = 0;
-                break;
-            } else if (trimap && *pix == PIXEL_UNAVAILABLE) {
-                pix = 0;
-                metUnavailablePixel = true;
-                break;
-            }
-        }
-        if (pix) {
-            bboxX.set_right(bboxX.right() - 1);
-            bboxD.set_left( bboxX.right() );
-        } else {
-            if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true;
-            }
-            break;
-        }
+    int right = bboxX.left();
+    for (int y = bboxX.bottom(); y < bboxX.top(); ++y) {
+        right = std::max( right, lastMarked(_rows[y - _bounds.y1], bboxX.left(), bboxX.right()) );
     }
+    RectI bboxD = bboxX;
+    bboxD.set_left(right);
+    bboxX.set_right(right);
     if ( !bboxD.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxD);
     }
@@ -370,7 +308,7 @@ minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std
     assert( bboxD.bottom() == bboxX.bottom() );
     
     // get the bounding box of what's left (the X rectangle in the drawing above)
-    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX,_bounds,_map,isBeingRenderedElsewhere);
+    bboxX = minimalNonMarkedBbox_internal(bboxX);
     
     if ( !bboxX.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxX);
@@ -383,36 +321,84 @@ minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std
 RectI
 Bitmap::minimalNonMarkedBbox(const RectI & roi) const
 {
-    return minimalNonMarkedBbox_internal<0>(roi, _bounds, _map, NULL);
+    return minimalNonMarkedBbox_internal(roi);
 }
 
 void
 Bitmap::minimalNonMarkedRects(const RectI & roi,std::list<RectI>& ret) const
 {
-    minimalNonMarkedRects_internal<0>(roi, _bounds, _map,ret , NULL);
+    minimalNonMarkedRects_internal(roi, ret);
 }
 
 #if NATRON_ENABLE_TRIMAP
+bool
+Bitmap::hasPixelsBeingRenderedOutside(const RectI & roi,
+                                      const std::list<RectI>& rects) const
+{
+    RectI area;
+    if ( !roi.intersect(_bounds, &area) ) {
+        return false;
+    }
+    for (int y = area.y1; y < area.y2; ++y) {
+        const Row & row = _rows[y - _bounds.y1];
+        for (Row::const_iterator it = row.begin(); it != row.end(); ++it) {
+            if (it->state != PIXEL_UNAVAILABLE || it->x2 <= area.x1 || it->x1 >= area.x2) {
+                continue;
+            }
+            
+            ///Advance x through the rectangles covering the span
+            int x = std::max(it->x1, area.x1);
+            int end = std::min(it->x2, area.x2);
+            bool advanced = true;
+            while (x < end && advanced) {
+                advanced = false;
+                for (std::list<RectI>::const_iterator r = rects.begin(); r != rects.end(); ++r) {
+                    if (r->y1 <= y && y < r->y2 && r->x1 <= x && x < r->x2) {
+                        x = r->x2;
+                        advanced = true;
+                    }
+                }
+            }
+            if (x < end) {
+                return true;
+            }
+        }
+    }
+    
+    return false;
+}
+
 RectI
 Bitmap::minimalNonMarkedBbox_trimap(const RectI & roi,bool* isBeingRenderedElsewhere) const
 {
-    return minimalNonMarkedBbox_internal<1>(roi, _bounds, _map, isBeingRenderedElsewhere);
+    RectI bbox = minimalNonMarkedBbox_internal(roi);
+    std::list<RectI> rects;
+    rects.push_back(bbox);
+    if ( hasPixelsBeingRenderedOutside(roi, rects) ) {
+        *isBeingRenderedElsewhere = true;
+    }
+    
+    return bbox;
 }
 
 
 void
 Bitmap::minimalNonMarkedRects_trimap(const RectI & roi,std::list<RectI>& ret,bool* isBeingRenderedElsewhere) const
 {
-    minimalNonMarkedRects_internal<1>(roi, _bounds, _map ,ret , isBeingRenderedElsewhere);
-} 
+    std::list<RectI> rects;
+    minimalNonMarkedRects_internal(roi, rects);
+    if ( hasPixelsBeingRenderedOutside(roi, rects) ) {
+        *isBeingRenderedElsewhere = true;
+    }
+    ret.insert(ret.end(), rects.begin(), rects.end());
+}
 #endif
 
 void
 Natron::Bitmap::markForRendered(const RectI & roi)
 {
-    char* buf = BM_GET(roi.bottom(), roi.left());
-    for (int i = roi.bottom(); i < roi.top(); ++i, buf += _bounds.width()) {
-        memset( buf, 1, roi.width() );
+    for (int y = roi.bottom(); y < roi.top(); ++y) {
+        setSpan(y, roi.left(), roi.right(), 1);
     }
 }
 
@@ -420,9 +406,8 @@ Natron::Bitmap::markForRendered(const RectI & roi)
 void
 Natron::Bitmap::markForRendering(const RectI & roi)
 {
-    char* buf = BM_GET(roi.bottom(), roi.left());
-    for (int i = roi.bottom(); i < roi.top(); ++i, buf += _bounds.width()) {
-        memset( buf, PIXEL_UNAVAILABLE , roi.width() );
+    for (int y = roi.bottom(); y < roi.top(); ++y) {
+        setSpan(y, roi.left(), roi.right(), PIXEL_UNAVAILABLE);
     }
 }
 #endif
@@ -430,59 +415,81 @@ Natron::Bitmap::markForRendering(const RectI & roi)
 void
 Natron::Bitmap::clear(const RectI& roi)
 {
-    char* buf = BM_GET(roi.bottom(), roi.left());
-    for (int i = roi.bottom(); i < roi.top(); ++i, buf += _bounds.width()) {
-        memset( buf, 0 , roi.width() );
+    for (int y = roi.bottom(); y < roi.top(); ++y) {
+        setSpan(y, roi.left(), roi.right(), 0);
     }
 }
 
-const char*
-Natron::Bitmap::getBitmapAt(int x,
-                            int y) const
+void
+Natron::Bitmap::getRowStates(int y,
+                             int x1,
+                             int x2,
+                             char* states) const
 {
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y,x);
-    } else {
-        return NULL;
+    assert(y >= _bounds.y1 && y < _bounds.y2 && x1 >= _bounds.x1 && x2 <= _bounds.x2);
+    std::fill(states, states + (x2 - x1), 0);
+    const Row & row = _rows[y - _bounds.y1];
+    for (Row::const_iterator it = row.begin(); it != row.end(); ++it) {
+        int spanX1 = std::max(it->x1, x1);
+        int spanX2 = std::min(it->x2, x2);
+        if (spanX1 < spanX2) {
+            std::fill(states + (spanX1 - x1), states + (spanX2 - x1), it->state);
+        }
     }
 }
 
-char*
-Natron::Bitmap::getBitmapAt(int x,
-                            int y)
+void
+Natron::Bitmap::setRowStates(int y,
+                             int x1,
+                             int x2,
+                             const char* states)
 {
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y,x);
-    } else {
-        return NULL;
+    Row spans;
+    for (int x = x1; x < x2; ++x) {
+        char state = states[x - x1];
+        if (state) {
+            appendSpan( &spans, Span(x, x + 1, state) );
+        }
     }
+    replaceSpans(y, x1, x2, spans);
 }
 
 Image::Image(const ImageKey & key,
              const boost::shared_ptr<Natron::ImageParams>& params,
              const Natron::CacheAPI* cache,
-             Natron::StorageModeEnum storage,
-             const std::string & path)
-    : CacheEntryHelper<unsigned char, ImageKey,ImageParams>(key, params, cache,storage,path)
+             Natron::StorageModeEnum storage)
+    : CacheEntryHelper<unsigned char, ImageKey,ImageParams>(key, params, cache,storage)
     , _useBitmap(true)
+    , _tiled(false)
+    , _tiles()
+    , _tilesPerRow(0)
+    , _tilesDataSizeLock()
+    , _tilesDataSize(0)
 {
     _components = params->getComponents();
     _bitDepth = params->getBitDepth();
     _rod = params->getRoD();
     _bounds = params->getBounds();
     _par = params->getPixelAspectRatio();
+    initializeTiles();
 }
 
 Image::Image(const ImageKey & key,
              const boost::shared_ptr<Natron::ImageParams>& params)
-: CacheEntryHelper<unsigned char, ImageKey,ImageParams>(key, params, NULL,Natron::eStorageModeRAM,std::string())
+: CacheEntryHelper<unsigned char, ImageKey,ImageParams>(key, params, NULL,Natron::eStorageModeRAM)
 , _useBitmap(false)
+, _tiled(false)
+, _tiles()
+, _tilesPerRow(0)
+, _tilesDataSizeLock()
+, _tilesDataSize(0)
 {
     _components = params->getComponents();
     _bitDepth = params->getBitDepth();
     _rod = params->getRoD();
     _bounds = params->getBounds();
     _par = params->getPixelAspectRatio();
+    initializeTiles();
     allocateMemory();
 }
 
@@ -499,6 +506,11 @@ Image::Image(ImageComponentsEnum components,
              bool useBitmap)
     : CacheEntryHelper<unsigned char,ImageKey,ImageParams>()
     , _useBitmap(useBitmap)
+    , _tiled(false)
+    , _tiles()
+    , _tilesPerRow(0)
+    , _tilesDataSizeLock()
+    , _tilesDataSize(0)
 {
     setCacheEntry(makeKey(0,false,0,0),
                   boost::shared_ptr<ImageParams>( new ImageParams( 0,
@@ -511,8 +523,7 @@ Image::Image(ImageComponentsEnum components,
                                                                    components,
                                                                    std::map<int,std::vector<RangeD> >() ) ),
                   NULL,
-                  Natron::eStorageModeRAM,
-                  std::string()
+                  Natron::eStorageModeRAM
                   );
 
     _components = components;
@@ -535,14 +546,170 @@ Image::onMemoryAllocated(bool diskRestoration)
     }
     
 #ifdef DEBUG
-    if (!diskRestoration) {
+    if (!diskRestoration && !_tiled) {
         ///fill with red, to recognize unrendered pixels
+        ///(this would allocate all the tiles of a tiled image)
         fill(_bounds,1.,0.,0.,1.);
     }
 #endif
     
 }
 
+void
+Image::initializeTiles()
+{
+    if ( !_params->isTiled() ) {
+        return;
+    }
+    if (_requestedStorage != Natron::eStorageModeRAM) {
+        ///Only images in RAM can be tiled, the disk cache stores an image in a single region of its segment files
+        _params->setTiled(false);
+        
+        return;
+    }
+    _tiled = true;
+    _tilesPerRow = (_bounds.width() + NATRON_IMAGE_TILE_SIZE - 1) / NATRON_IMAGE_TILE_SIZE;
+    int tilesPerColumn = (_bounds.height() + NATRON_IMAGE_TILE_SIZE - 1) / NATRON_IMAGE_TILE_SIZE;
+    _tiles.resize( _tilesPerRow * tilesPerColumn, QAtomicPointer<unsigned char>(0) );
+}
+
+void
+Image::deallocateTiles()
+{
+    if (!_tiled) {
+        return;
+    }
+    for (std::vector<QAtomicPointer<unsigned char> >::iterator it = _tiles.begin(); it != _tiles.end(); ++it) {
+        delete [] it->fetchAndStoreAcquire(0);
+    }
+    std::size_t freedSize;
+    {
+        QMutexLocker k(&_tilesDataSizeLock);
+        freedSize = _tilesDataSize;
+        _tilesDataSize = 0;
+    }
+    
+    ///The buffer of the entry is empty, hence CacheEntryHelper::deallocate() does not notify the cache: notify the bitmap as well
+    freedSize += _bitmap.getMemorySize();
+    if (_cache && freedSize > 0) {
+        _cache->notifyEntryDestroyed(getTime(), freedSize, Natron::eStorageModeRAM);
+    }
+}
+
+std::size_t
+Image::getTilesDataSize() const
+{
+    if (!_tiled) {
+        return 0;
+    }
+    QMutexLocker k(&_tilesDataSizeLock);
+    
+    return _tilesDataSize;
+}
+
+std::size_t
+Image::getAllocatedTilesCount() const
+{
+    std::size_t ret = 0;
+    for (std::vector<QAtomicPointer<unsigned char> >::const_iterator it = _tiles.begin(); it != _tiles.end(); ++it) {
+        if ( (unsigned char*)*it ) {
+            ++ret;
+        }
+    }
+    
+    return ret;
+}
+
+unsigned char*
+Image::getTile(int x,
+               int y,
+               bool allocate,
+               RectI* tileBounds) const
+{
+    assert(_tiled);
+    *tileBounds = getTileBounds(x, y);
+    QAtomicPointer<unsigned char> & tile = _tiles[ ( (y - _bounds.y1) / NATRON_IMAGE_TILE_SIZE ) * _tilesPerRow
+                                                   + (x - _bounds.x1) / NATRON_IMAGE_TILE_SIZE ];
+    
+    ///Qt 4 has no load-acquire: a tile published by another thread must be read with acquire semantics
+    ///so that its zero-filled content is visible
+    unsigned char* ret = tile.fetchAndAddAcquire(0);
+    if (ret || !allocate) {
+        return ret;
+    }
+    
+    std::size_t allocatedSize = (std::size_t)tileBounds->area() * getElementsCountForComponents(_components) * getSizeOfForBitDepth(_bitDepth);
+    ///Value-initialized so that pixels that are never rendered are black, as in images that are not tiled
+    unsigned char* newTile = new unsigned char[allocatedSize]();
+    if ( !tile.testAndSetOrdered(0, newTile) ) {
+        ///Another thread published the tile first
+        delete [] newTile;
+        
+        return tile.fetchAndAddAcquire(0);
+    }
+    {
+        QMutexLocker k(&_tilesDataSizeLock);
+        _tilesDataSize += allocatedSize;
+    }
+    
+    ///Do not notify the cache under the lock, the cache may call size()
+    if (_cache) {
+        std::size_t newSize = size();
+        _cache->notifyEntrySizeChanged(newSize - allocatedSize, newSize);
+    }
+    
+    return newTile;
+}
+
+RectI
+Image::getTileBounds(int x,
+                     int y) const
+{
+    if (!_tiled) {
+        return _bounds;
+    }
+    RectI ret;
+    ret.x1 = _bounds.x1 + ( (x - _bounds.x1) / NATRON_IMAGE_TILE_SIZE ) * NATRON_IMAGE_TILE_SIZE;
+    ret.y1 = _bounds.y1 + ( (y - _bounds.y1) / NATRON_IMAGE_TILE_SIZE ) * NATRON_IMAGE_TILE_SIZE;
+    ret.x2 = std::min(ret.x1 + NATRON_IMAGE_TILE_SIZE, _bounds.x2);
+    ret.y2 = std::min(ret.y1 + NATRON_IMAGE_TILE_SIZE, _bounds.y2);
+    
+    return ret;
+}
+
+int
+Image::getContiguousRowEnd(int x) const
+{
+    if (!_tiled) {
+        return _bounds.x2;
+    }
+    int tileX1 = _bounds.x1 + ( (x - _bounds.x1) / NATRON_IMAGE_TILE_SIZE ) * NATRON_IMAGE_TILE_SIZE;
+    
+    return std::min(tileX1 + NATRON_IMAGE_TILE_SIZE, _bounds.x2);
+}
+
+boost::shared_ptr<Natron::Image>
+Image::makeContiguousView(const RectI & roi) const
+{
+    RectI viewBounds;
+    if ( !roi.intersect(_bounds, &viewBounds) ) {
+        return boost::shared_ptr<Natron::Image>();
+    }
+    boost::shared_ptr<ImageParams> params = makeParams(_params->getCost(),
+                                                       _rod,
+                                                       viewBounds,
+                                                       _par,
+                                                       _params->getMipMapLevel(),
+                                                       _params->isRodProjectFormat(),
+                                                       _components,
+                                                       _bitDepth,
+                                                       _params->getFramesNeeded());
+    boost::shared_ptr<Natron::Image> ret( new Natron::Image(_key, params) );
+    ret->pasteFrom(*this, viewBounds, false);
+    
+    return ret;
+}
+
 
 ImageKey  
 Image::makeKey(U64 nodeHashKey,
@@ -645,9 +812,14 @@ Image::pasteFromForDepth(const Natron::Image & srcImg,
     }
     // now we're safe: both images contain the area in roi
     for (int y = roi.y1; y < roi.y2; ++y) {
-        const PIX* src = (const PIX*)srcImg.pixelAt(roi.x1, y);
-        PIX* dst = (PIX*)pixelAt(roi.x1, y);
-        memcpy(dst, src, roi.width() * sizeof(PIX) * components);
+        ///Copy at once the pixels that are contiguous in both images, that is the whole row if none is tiled
+        for (int x = roi.x1; x < roi.x2;) {
+            int spanEnd = std::min( roi.x2, std::min( srcImg.getContiguousRowEnd(x), getContiguousRowEnd(x) ) );
+            const PIX* src = (const PIX*)srcImg.pixelAt(x, y);
+            PIX* dst = (PIX*)pixelAt(x, y);
+            memcpy(dst, src, (spanEnd - x) * sizeof(PIX) * components);
+            x = spanEnd;
+        }
     }
 }
 
@@ -697,19 +869,22 @@ Image::fillForDepth(const RectI & roi_,
         return;
     }
 
-    int rowElems = (int)getRowElements();
     const float fillValue[4] = {
         comps == Natron::eImageComponentAlpha ? a : r, g, b, a
     };
     int nComps = getElementsCountForComponents(comps);
 
     // now we're safe: the image contains the area in roi
-    PIX* dst = (PIX*)pixelAt(roi.x1, roi.y1);
-    for ( int i = 0; i < roi.height(); ++i, dst += (rowElems - roi.width() * nComps) ) {
-        for (int j = 0; j < roi.width(); ++j, dst += nComps) {
-            for (int k = 0; k < nComps; ++k) {
-                dst[k] = fillValue[k] * maxValue;
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        for (int x = roi.x1; x < roi.x2;) {
+            int spanEnd = std::min( roi.x2, getContiguousRowEnd(x) );
+            PIX* dst = (PIX*)pixelAt(x, y);
+            for (int j = x; j < spanEnd; ++j, dst += nComps) {
+                for (int k = 0; k < nComps; ++k) {
+                    dst[k] = fillValue[k] * maxValue;
+                }
             }
+            x = spanEnd;
         }
     }
 }
@@ -748,6 +923,15 @@ Image::pixelAt(int x,
     } else {
         int compDataSize = getSizeOfForBitDepth( getBitDepth() ) * compsCount;
         
+        if (_tiled) {
+            RectI tileBounds;
+            unsigned char* tile = getTile(x, y, true, &tileBounds);
+            
+            return tile
+            + (qint64)( y - tileBounds.bottom() ) * compDataSize * tileBounds.width()
+            + (qint64)( x - tileBounds.left() ) * compDataSize;
+        }
+        
         return (unsigned char*)(this->_data.writable())
         + (qint64)( y - _bounds.bottom() ) * compDataSize * _bounds.width()
         + (qint64)( x - _bounds.left() ) * compDataSize;
@@ -765,6 +949,18 @@ Image::pixelAt(int x,
     } else {
         int compDataSize = getSizeOfForBitDepth( getBitDepth() ) * compsCount;
         
+        if (_tiled) {
+            RectI tileBounds;
+            const unsigned char* tile = getTile(x, y, false, &tileBounds);
+            if (!tile) {
+                tile = emptyTile;
+            }
+            
+            return tile
+            + (qint64)( y - tileBounds.bottom() ) * compDataSize * tileBounds.width()
+            + (qint64)( x - tileBounds.left() ) * compDataSize;
+        }
+        
         return (unsigned char*)(this->_data.readable())
         + (qint64)( y - _bounds.bottom() ) * compDataSize * _bounds.width()
         + (qint64)( x - _bounds.left() ) * compDataSize;
@@ -916,6 +1112,8 @@ Image::halveRoIForDepth(const RectI & roi,
     const RectI &dstBmBounds = output->_bitmap.getBounds();
     assert(!copyBitMap || usesBitMap());
     assert(!usesBitMap() ||(srcBmBounds == srcBounds && dstBmBounds == dstBounds));
+    ///downscaleMipMap() copies tiled images to a contiguous image first
+    assert(!isTiled() && !output->isTiled());
 
     // the srcRoD of the output should be enclosed in half the roi.
     // It does not have to be exactly half of the input.
@@ -943,9 +1141,7 @@ Image::halveRoIForDepth(const RectI & roi,
     QReadLocker k2(&_lock);
     
     const PIX* const srcPixels      = (const PIX*)pixelAt(srcBounds.x1,   srcBounds.y1);
-    const char* const srcBmPixels   = _bitmap.getBitmapAt(srcBmBounds.x1, srcBmBounds.y1);
     PIX* const dstPixels          = (PIX*)output->pixelAt(dstBounds.x1,   dstBounds.y1);
-    char* const dstBmPixels = output->_bitmap.getBitmapAt(dstBmBounds.x1, dstBmBounds.y1);
 
     int srcRowSize = srcBounds.width() * nComponents;
     int dstRowSize = dstBounds.width() * nComponents;
@@ -954,17 +1150,24 @@ Image::halveRoIForDepth(const RectI & roi,
     const PIX* const srcData = srcPixels - (srcBounds.x1 * nComponents + srcRowSize * srcBounds.y1);
     PIX* const dstData       = dstPixels - (dstBounds.x1 * nComponents + dstRowSize * dstBounds.y1);
 
-    const int srcBmRowSize = srcBmBounds.width();
-    const int dstBmRowSize = dstBmBounds.width();
+    ///The bitmaps are unpacked row by row: the source rows cover [dstRoI.x1 * 2, dstRoI.x2 * 2)
+    ///and pixels out of the source bounds stay at 0
+    std::vector<char> srcBmThisRow, srcBmNextRow, dstBmRow;
+    if (copyBitMap) {
+        srcBmThisRow.resize(dstRoI.width() * 2);
+        srcBmNextRow.resize(dstRoI.width() * 2);
+        dstBmRow.resize( dstRoI.width() );
+    }
+    const int srcBmX1 = std::max(dstRoI.x1 * 2, srcBmBounds.x1);
+    const int srcBmX2 = std::min(dstRoI.x2 * 2, srcBmBounds.x2);
 
-    const char* const srcBmData = srcBmPixels - (srcBmBounds.x1 + srcBmRowSize * srcBmBounds.y1);
-    char* const dstBmData       = dstBmPixels - (dstBmBounds.x1 + dstBmRowSize * dstBmBounds.y1);
+    ///The columns whose 2x2 source block is entirely within srcBounds
+    const int fullX1 = std::max( dstRoI.x1, (int)std::ceil(srcBounds.x1 / 2.) );
+    const int fullX2 = std::min( dstRoI.x2, (int)std::floor(srcBounds.x2 / 2.) );
 
     for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
         const PIX* const srcLineStart    = srcData + y * 2 * srcRowSize;
         PIX* const dstLineStart          = dstData + y     * dstRowSize;
-        const char* const srcBmLineStart = srcBmData + y * 2 * srcBmRowSize;
-        char* const dstBmLineStart       = dstBmData + y     * dstBmRowSize;
 
         // The current dst row, at y, covers the src rows y*2 (thisRow) and y*2+1 (nextRow).
         // Check that if are within srcBounds.
@@ -974,12 +1177,30 @@ Image::halveRoIForDepth(const RectI & roi,
 
         int sumH = (int)pickNextRow + (int)pickThisRow;
         assert(sumH == 1 || sumH == 2);
+
+        ///The vectorized kernels handle the full 2x2 blocks, the scalar loop below does the remaining columns
+        int simdX1 = fullX1, simdX2 = fullX1;
+        if (sumH == 2 && fullX1 < fullX2) {
+            simdX2 += Natron::ImageSIMD::halveRow(srcLineStart + fullX1 * 2 * nComponents,
+                                                  srcLineStart + fullX1 * 2 * nComponents + srcRowSize,
+                                                  dstLineStart + fullX1 * nComponents,
+                                                  nComponents, fullX2 - fullX1);
+        }
+        
+        if (copyBitMap) {
+            std::fill(srcBmThisRow.begin(), srcBmThisRow.end(), 0);
+            std::fill(srcBmNextRow.begin(), srcBmNextRow.end(), 0);
+            if (pickThisRow && srcBmX1 < srcBmX2) {
+                _bitmap.getRowStates(srcy, srcBmX1, srcBmX2, &srcBmThisRow[srcBmX1 - dstRoI.x1 * 2]);
+            }
+            if (pickNextRow && srcBmX1 < srcBmX2) {
+                _bitmap.getRowStates(srcy + 1, srcBmX1, srcBmX2, &srcBmNextRow[srcBmX1 - dstRoI.x1 * 2]);
+            }
+        }
         
         for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
             const PIX* const srcPixStart    = srcLineStart   + x * 2 * nComponents;
-            const char* const srcBmPixStart = srcBmLineStart + x * 2;
             PIX* const dstPixStart          = dstLineStart   + x * nComponents;
-            char* const dstBmPixStart       = dstBmLineStart + x;
 
             // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
             // Check that if are within srcBounds.
@@ -992,28 +1213,31 @@ Image::halveRoIForDepth(const RectI & roi,
             const int sum = sumW * sumH;
             assert(0 < sum && sum <= 4);
 
-            for (int k = 0; k < nComponents; ++k) {
-                ///a b
-                ///c d
+            if (x < simdX1 || x >= simdX2) {
+                for (int k = 0; k < nComponents; ++k) {
+                    ///a b
+                    ///c d
 
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + nComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize): 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + nComponents)  : 0;
+                    const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
+                    const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + nComponents) : 0;
+                    const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize): 0;
+                    const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + nComponents)  : 0;
                 
-                assert(sumW == 2 || (sumW == 1 && ((a == 0 && c == 0) || (b == 0 && d == 0))));
-                assert(sumH == 2 || (sumH == 1 && ((a == 0 && b == 0) || (c == 0 && d == 0))));
-                dstPixStart[k] = (a + b + c + d) / sum;
+                    assert(sumW == 2 || (sumW == 1 && ((a == 0 && c == 0) || (b == 0 && d == 0))));
+                    assert(sumH == 2 || (sumH == 1 && ((a == 0 && b == 0) || (c == 0 && d == 0))));
+                    dstPixStart[k] = (a + b + c + d) / sum;
+                }
             }
             
             if (copyBitMap) {
                 ///a b
                 ///c d
 
-                char a = (pickThisCol && pickThisRow) ? *(srcBmPixStart) : 0;
-                char b = (pickNextCol && pickThisRow) ? *(srcBmPixStart + 1) : 0;
-                char c = (pickThisCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize): 0;
-                char d = (pickNextCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize  + 1)  : 0;
+                const int bmCol = (x - dstRoI.x1) * 2;
+                char a = (pickThisCol && pickThisRow) ? srcBmThisRow[bmCol] : 0;
+                char b = (pickNextCol && pickThisRow) ? srcBmThisRow[bmCol + 1] : 0;
+                char c = (pickThisCol && pickNextRow) ? srcBmNextRow[bmCol] : 0;
+                char d = (pickNextCol && pickNextRow) ? srcBmNextRow[bmCol + 1] : 0;
 #if NATRON_ENABLE_TRIMAP
                 if (a == PIXEL_UNAVAILABLE) {
                     a = treatUnavailablePixelsAsRendered ? 1 : 0;
@@ -1032,10 +1256,15 @@ Image::halveRoIForDepth(const RectI & roi,
                 assert(sumH == 2 || (sumH == 1 && ((a == 0 && b == 0) || (c == 0 && d == 0))));
                 assert(a + b + c + d <= sum); // bitmaps are 0 or 1
                 // the following is an integer division, the result can be 0 or 1
-                dstBmPixStart[0] = (a + b + c + d) / sum;
-                assert(dstBmPixStart[0] == 0 || dstBmPixStart[0] == 1);
+                char & dstBm = dstBmRow[x - dstRoI.x1];
+                dstBm = (a + b + c + d) / sum;
+                assert(dstBm == 0 || dstBm == 1);
             }
         }
+        
+        if (copyBitMap) {
+            output->_bitmap.setRowStates(y, dstRoI.x1, dstRoI.x2, &dstBmRow.front());
+        }
     }
 
 } // halveRoIForDepth
@@ -1154,7 +1383,16 @@ Image::downscaleMipMap(const RectI & roi,
 //    roiCanonical.toPixelEnclosing(toLevel, par , &dstRoI);
     unsigned int downscaleLvls = toLevel - fromLevel;
 
-    assert(!copyBitMap || _bitmap.getBitmap());
+    assert(!copyBitMap || usesBitMap());
+    
+    if (_tiled) {
+        ///The mipmap levels are built from contiguous images, start from a copy of the roi
+        ImagePtr srcImg( new Natron::Image( getComponents(), getRoD(), roi, fromLevel, par, getBitDepth(), usesBitMap() ) );
+        srcImg->pasteFrom(*this, roi, usesBitMap());
+        srcImg->downscaleMipMap(roi, fromLevel, toLevel, copyBitMap, treatUnavailablePixelsAsRendered, output);
+        
+        return;
+    }
     
     RectI dstRoI  = roi.downscalePowerOfTwoSmallestEnclosing(downscaleLvls);
     
@@ -1183,15 +1421,18 @@ Image::checkForNaNs(const RectI& roi)
     unsigned int compsCount = getComponentsCount();
     
     for (int y = roi.y1; y < roi.y2; ++y) {
-        
-        float* pix = (float*)pixelAt(roi.x1, roi.y1);
-        float* const end = pix +  compsCount * roi.width();
-        
-        for (;pix < end; ++pix) {
-            assert(!boost::math::isnan(*pix) && !boost::math::isinf(*pix));
-            if (boost::math::isnan(*pix) || boost::math::isinf(*pix)) {
-                *pix = 1.;
+        for (int x = roi.x1; x < roi.x2;) {
+            int spanEnd = std::min( roi.x2, getContiguousRowEnd(x) );
+            float* pix = (float*)pixelAt(x, y);
+            float* const end = pix +  compsCount * (spanEnd - x);
+            
+            for (;pix < end; ++pix) {
+                assert(!boost::math::isnan(*pix) && !boost::math::isinf(*pix));
+                if (boost::math::isnan(*pix) || boost::math::isinf(*pix)) {
+                    *pix = 1.;
+                }
             }
+            x = spanEnd;
         }
     }
 
@@ -1233,6 +1474,7 @@ Image::upscaleMipMapForDepth(const RectI & roi,
     }
     int srcRowSize = getBounds().width() * components;
     int dstRowSize = output->getBounds().width() * components;
+    const int pixelSize = components * sizeof(PIX);
     const PIX *src = (const PIX*)pixelAt(srcRoi.x1, srcRoi.y1);
     PIX* dst = (PIX*)output->pixelAt(dstRoi.x1, dstRoi.y1);
     assert(src && dst);
@@ -1256,9 +1498,10 @@ Image::upscaleMipMapForDepth(const RectI & roi,
             xcount = scale + xo - xi * scale;
             //assert(0 < xcount && xcount <= scale);
             // replicate srcPix as many times as necessary
-            PIX * dstPix = dstPixFirst;
+            int copied = Natron::ImageSIMD::replicatePixel( (const unsigned char*)srcPix, pixelSize, (unsigned char*)dstPixFirst, xcount );
+            PIX * dstPix = dstPixFirst + copied * components;
             //assert((srcPix-(PIX*)pixelAt(srcRoi.x1, srcRoi.y1)) % components == 0);
-            for (int i = 0; i < xcount; ++i, dstPix += components) {
+            for (int i = copied; i < xcount; ++i, dstPix += components) {
                 assert( ( dstPix - (PIX*)output->pixelAt(dstRoi.x1, dstRoi.y1) ) % components == 0 );
                 for (int c = 0; c < components; ++c) {
                     dstPix[c] = srcPix[c];
@@ -1281,6 +1524,26 @@ Image::upscaleMipMap(const RectI & roi,
                      unsigned int toLevel,
                      Natron::Image* output) const
 {
+    if ( _tiled || output->isTiled() ) {
+        ///Upscale between contiguous copies of the images
+        RectD roiCanonical;
+        roi.toCanonical(fromLevel, _par, getRoD(), &roiCanonical);
+        RectI dstRoi;
+        roiCanonical.toPixelEnclosing(toLevel, _par, &dstRoi);
+        if ( !dstRoi.intersect(output->getBounds(), &dstRoi) ) {
+            return;
+        }
+        ImagePtr srcImg = makeContiguousView(roi);
+        ImagePtr dstImg = output->makeContiguousView(dstRoi);
+        if (!srcImg || !dstImg) {
+            return;
+        }
+        srcImg->upscaleMipMap(roi, fromLevel, toLevel, dstImg.get());
+        output->pasteFrom(*dstImg, dstRoi, false);
+        
+        return;
+    }
+    
     switch ( getBitDepth() ) {
     case eImageBitDepthByte:
         upscaleMipMapForDepth<unsigned char, 255>(roi, fromLevel, toLevel, output);
@@ -1729,15 +1992,17 @@ Image::copyBitmapRowPortion(int x1, int x2,int y, const Image& other)
 void
 Bitmap::copyRowPortion(int x1,int x2,int y,const Bitmap& other)
 {
-    const char* srcBitmap = other.getBitmapAt(x1, y);
-    char* dstBitmap = getBitmapAt(x1, y);
-    const char* end = dstBitmap + (x2 - x1);
-    while (dstBitmap < end) {
-        *dstBitmap = *srcBitmap == PIXEL_UNAVAILABLE ? 0 : *srcBitmap;
-        ++dstBitmap;
-        ++srcBitmap;
-    }
+    assert(y >= other._bounds.y1 && y < other._bounds.y2);
     
+    ///Pixels being rendered in the other bitmap are not rendered in this one
+    Row spans;
+    const Row & srcRow = other._rows[y - other._bounds.y1];
+    for (Row::const_iterator it = srcRow.begin(); it != srcRow.end(); ++it) {
+        if (it->state != PIXEL_UNAVAILABLE) {
+            appendSpan( &spans, Span(std::max(it->x1, x1), std::min(it->x2, x2), it->state) );
+        }
+    }
+    replaceSpans(y, x1, x2, spans);
 }
 
 void
@@ -1755,24 +2020,8 @@ Bitmap::copyBitmapPortion(const RectI& roi, const Bitmap& other)
     assert(roi.x1 >= _bounds.x1 && roi.x2 <= _bounds.x2 && roi.y1 >= _bounds.y1 && roi.y2 <= _bounds.y2);
     assert(roi.x1 >= other._bounds.x1 && roi.x2 <= other._bounds.x2 && roi.y1 >= other._bounds.y1 && roi.y2 <= other._bounds.y2);
     
-    int srcRowSize = other._bounds.width();
-    int dstRowSize = _bounds.width();
-    
-    const char* srcBitmap = other.getBitmapAt(roi.x1, roi.y1);
-    char* dstBitmap = getBitmapAt(roi.x1, roi.y1);
-    
-    for (int y = roi.y1; y < roi.y2; ++y,
-         srcBitmap += srcRowSize,
-         dstBitmap += dstRowSize) {
-        
-        const char* srcCur = srcBitmap;
-        const char* srcEnd = srcBitmap + roi.width();
-        char* dstCur = dstBitmap;
-        while (srcCur < srcEnd) {
-            *dstCur = *srcCur == PIXEL_UNAVAILABLE ? 0 : *srcCur;
-            ++srcCur;
-            ++dstCur;
-        }
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        copyRowPortion(roi.x1, roi.x2, y, other);
     }
 }
 
@@ -2178,6 +2427,23 @@ Image::convertToFormat(const RectI & renderWindow,
                        Natron::Image* dstImg) const
 {
     assert( getBounds() == dstImg->getBounds() );
+    
+    if ( _tiled || dstImg->isTiled() ) {
+        ///Convert between contiguous copies of the images
+        RectI roi;
+        if ( !renderWindow.intersect(_bounds, &roi) ) {
+            return;
+        }
+        ImagePtr srcView = makeContiguousView(roi);
+        ImagePtr dstView = dstImg->makeContiguousView(roi);
+        srcView->convertToFormat(roi, srcColorSpace, dstColorSpace, channelForAlpha, invert, false, requiresUnpremult, dstView.get());
+        dstImg->pasteFrom(*dstView, roi, false);
+        if (copyBitmap) {
+            dstImg->copyBitmapPortion(roi, *this);
+        }
+        
+        return;
+    }
 
     if ( dstImg->getComponents() == getComponents() ) {
         switch ( dstImg->getBitDepth() ) {
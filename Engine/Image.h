@@ -14,6 +14,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 
 #include "Global/GlobalDefines.h"
 
@@ -21,6 +22,8 @@ CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QHash>
 CLANG_DIAG_ON(deprecated)
 #include <QtCore/QReadWriteLock>
+#include <QtCore/QMutex>
+#include <QtCore/QAtomicPointer>
 
 #include "Engine/ImageKey.h"
 #include "Engine/ImageParams.h"
@@ -28,37 +31,58 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/Rect.h"
 #include "Engine/OutputSchedulerThread.h"
 
+///The width and height in pixels of the tiles of tiled images, see Image::isTiled()
+#define NATRON_IMAGE_TILE_SIZE 256
 
 namespace Natron {
 
     
+    /**
+     * @brief Keeps track of the pixels of an image that are rendered. Each row holds the sorted list of
+     * its spans of marked pixels (rendered, or being rendered with the trimap): pixels that do not belong to a span
+     * are not rendered. Queries then cost time proportional to the number of rows and spans instead of the number of pixels.
+     **/
     class Bitmap
     {
     public:
+        
+        ///A span of pixels [x1,x2) of a row sharing the same state, which is never 0
+        struct Span
+        {
+            int x1,x2;
+            char state;
+            
+            Span(int x1_,int x2_,char state_)
+                : x1(x1_)
+                , x2(x2_)
+                , state(state_)
+            {
+            }
+        };
+        
+        typedef std::vector<Span> Row;
+        
         Bitmap(const RectI & bounds)
             : _bounds(bounds)
-            , _map( bounds.area() )
+            , _rows( bounds.isNull() ? 0 : bounds.height() )
         {
             //Do not assert !rod.isNull() : An empty image can be created for entries that correspond to
             // "identities" images (i.e: images that are just a link to another image). See EffectInstance :
             // "!!!Note that if isIdentity is true it will allocate an empty image object with 0 bytes of data."
             //assert(!rod.isNull());
-            std::fill(_map.begin(), _map.end(), 0);
         }
 
         Bitmap()
             : _bounds()
-            , _map()
+            , _rows()
         {
         }
 
         void initialize(const RectI & bounds)
         {
-            assert(_map.size() == 0);
+            assert(_rows.size() == 0);
             _bounds = bounds;
-            _map.resize( _bounds.area() );
-
-            std::fill(_map.begin(), _map.end(), 0);
+            _rows.resize( bounds.isNull() ? 0 : bounds.height() );
         }
 
         ~Bitmap()
@@ -66,15 +90,21 @@ namespace Natron {
         }
 
         
-        void setTo1()
-        {
-            std::fill(_map.begin(),_map.end(),1);
-        }
+        void setTo1();
 
         const RectI & getBounds() const
         {
             return _bounds;
         }
+        
+        /**
+         * @brief Returns the memory taken by the rows. The spans are not accounted since there are a few
+         * per row and their count changes with each render.
+         **/
+        std::size_t getMemorySize() const
+        {
+            return _rows.size() * sizeof(Row);
+        }
 
 #if NATRON_ENABLE_TRIMAP
         void minimalNonMarkedRects_trimap(const RectI & roi,std::list<RectI>& ret,bool* isBeingRenderedElsewhere) const;
@@ -94,27 +124,40 @@ namespace Natron {
 #endif
         
         void clear(const RectI& roi);
-
-        const char* getBitmap() const
-        {
-            return &_map.front();
-        }
-
-        char* getBitmap()
-        {
-            return &_map.front();
-        }
-
-        const char* getBitmapAt(int x,int y) const;
-        char* getBitmapAt(int x,int y);
+        
+        /**
+         * @brief Writes in states the state of each pixel of the row y in [x1,x2): 0 if not rendered, 1 if rendered
+         * and 2 if being rendered. The portion must be contained in the bounds.
+         **/
+        void getRowStates(int y,int x1,int x2,char* states) const;
+        
+        /**
+         * @brief Sets the state of each pixel of the row y in [x1,x2) from states, see getRowStates()
+         **/
+        void setRowStates(int y,int x1,int x2,const char* states);
         
         void copyRowPortion(int x1,int x2,int y,const Bitmap& other);
         
         void copyBitmapPortion(const RectI& roi, const Bitmap& other);
         
     private:
+        
+        ///Replaces the spans of the row y in [x1,x2) by the given spans which must be sorted and contained in [x1,x2)
+        void replaceSpans(int y,int x1,int x2,const Row& spans);
+        
+        void setSpan(int y,int x1,int x2,char state);
+        
+        void minimalNonMarkedRects_internal(const RectI & roi,std::list<RectI>& ret) const;
+        
+        RectI minimalNonMarkedBbox_internal(const RectI & roi) const;
+        
+#if NATRON_ENABLE_TRIMAP
+        ///Returns true if a pixel of roi that is being rendered is not covered by the rectangles
+        bool hasPixelsBeingRenderedOutside(const RectI & roi,const std::list<RectI>& rects) const;
+#endif
+        
         RectI _bounds;
-        std::vector<char> _map;
+        std::vector<Row> _rows;
     };
 
     class Image
@@ -125,8 +168,7 @@ namespace Natron {
         Image(const ImageKey & key,
               const boost::shared_ptr<ImageParams> &  params,
               const Natron::CacheAPI* cache,
-              Natron::StorageModeEnum storage,
-              const std::string & path);
+              Natron::StorageModeEnum storage);
         
         
 
@@ -148,6 +190,7 @@ namespace Natron {
         
         virtual ~Image()
         {
+            deallocateTiles();
             deallocate();
         }
         
@@ -204,7 +247,7 @@ namespace Natron {
         };
         virtual size_t size() const OVERRIDE FINAL
         {
-            return dataSize() + _bitmap.getBounds().area();
+            return dataSize() + getTilesDataSize() + _bitmap.getMemorySize();
         }
 
 
@@ -252,25 +295,52 @@ namespace Natron {
 
         /**
      * @brief Access pixels. The pointer must be cast to the appropriate type afterwards.
+     * If the image is tiled, the non-const version allocates the tile containing the pixel if needed
+     * whereas the const version returns a pointer to black pixels if the tile is not allocated.
      **/
         unsigned char* pixelAt(int x,int y);
         const unsigned char* pixelAt(int x,int y) const;
 
         /**
      * @brief Same as getElementsCount(getComponents()) * getBounds().width()
+     * This is the offset between 2 rows only if the image is not tiled.
      **/
         unsigned int getRowElements() const;
-        const char* getBitmapAt(int x,
-                                int y) const
-        {
-            return this->_bitmap.getBitmapAt(x,y);
-        }
-
-        char* getBitmapAt(int x,
-                          int y)
+        
+        /**
+     * @brief Returns true if the pixels are stored in tiles of NATRON_IMAGE_TILE_SIZE x NATRON_IMAGE_TILE_SIZE pixels
+     * that are allocated the first time a pixel is written to them, instead of a single buffer covering the bounds.
+     * Only the pixels of the same row within a tile are contiguous in memory: use getContiguousRowEnd() to walk a row,
+     * getTileBounds() to hand a tile in place to code that expects a constant stride (e.g: plug-ins) and makeContiguousView()
+     * to copy a portion spanning several tiles.
+     **/
+        bool isTiled() const
         {
-            return this->_bitmap.getBitmapAt(x,y);
+            return _tiled;
         }
+        
+        /**
+     * @brief Returns the x coordinate (excluded) up to which the pixels of a row starting at x are contiguous in memory.
+     **/
+        int getContiguousRowEnd(int x) const;
+        
+        /**
+     * @brief Returns the bounds of the tile containing the pixel (x,y), or the bounds of the image if it is not tiled.
+     * The rows of pixels within these bounds have a stride of their width.
+     **/
+        RectI getTileBounds(int x, int y) const;
+        
+        /**
+     * @brief Returns an image that is not tiled holding a copy of the pixels of this image in roi, intersected with the bounds.
+     * The returned image has the same key and params as this image, except the bounds, but it does not belong to the cache
+     * and has no bitmap.
+     **/
+        boost::shared_ptr<Natron::Image> makeContiguousView(const RectI & roi) const;
+        
+        /**
+     * @brief Returns the number of tiles allocated so far, this is always 0 if the image is not tiled.
+     **/
+        std::size_t getAllocatedTilesCount() const;
 
         /**
      * @brief Returns a list of portions of image that are not yet rendered within the
@@ -462,8 +532,20 @@ namespace Natron {
         void copyBitmapPortion(const RectI& roi, const Image& other);
         
     private:
-
+        
+        void initializeTiles();
+        
+        void deallocateTiles();
+        
+        std::size_t getTilesDataSize() const;
         
+        /**
+     * @brief Returns the tile of the image containing the pixel (x,y) and the bounds of that tile.
+     * If the tile is not allocated yet it is allocated if allocate is true, otherwise NULL is returned.
+     * This does not lock: threads allocating the same tile concurrently race to publish it and the losers free theirs.
+     **/
+        unsigned char* getTile(int x, int y, bool allocate, RectI* tileBounds) const;
+
         /**
      * @brief Given the output buffer,the region of interest and the mip map level, this
      * function computes the mip map of this image in the given roi.
@@ -516,6 +598,14 @@ namespace Natron {
         RectI _bounds;
         double _par;
         bool _useBitmap;
+        
+        bool _tiled;
+        ///The tiles of a tiled image, by rows of tiles, NULL until allocated. The vector is sized once by initializeTiles(),
+        ///the tiles are then published lock-free by getTile()
+        mutable std::vector<QAtomicPointer<unsigned char> > _tiles;
+        int _tilesPerRow;
+        mutable QMutex _tilesDataSizeLock; //< protects _tilesDataSize
+        mutable std::size_t _tilesDataSize; //< the number of bytes allocated by the tiles
     };
 
     template <typename SRCPIX,typename DSTPIX>
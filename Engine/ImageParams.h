@@ -65,6 +65,7 @@ public:
         , _bitdepth(Natron::eImageBitDepthFloat)
         , _mipMapLevel(0)
         , _par(1.)
+        , _tiled(false)
     {
     }
 
@@ -78,6 +79,7 @@ public:
         , _bitdepth(other._bitdepth)
         , _mipMapLevel(other._mipMapLevel)
         , _par(other._par)
+        , _tiled(other._tiled)
     {
     }
 
@@ -99,6 +101,7 @@ public:
         , _bitdepth(bitdepth)
         , _mipMapLevel(mipMapLevel)
         , _par(par)
+        , _tiled(false)
     {
     }
 
@@ -160,13 +163,36 @@ public:
         _mipMapLevel = mmlvl;
     }
     
+    bool isTiled() const
+    {
+        return _tiled;
+    }
+    
+    /**
+     * @brief If true the image will allocate its pixels by tiles on demand (see Image::isTiled())
+     * instead of allocating a single buffer for its bounds. This is only honoured for images stored in RAM.
+     **/
+    void setTiled(bool tiled)
+    {
+        _tiled = tiled;
+        setElementsCount( tiled ? 0 : _bounds.area() * getElementsCountForComponents(_components) * getSizeOfForBitDepth(_bitdepth) );
+    }
+    
     template<class Archive>
     void serialize(Archive & ar, const unsigned int version);
 
     bool operator==(const ImageParams & other) const
     {
-        if (NonKeyParams::operator!=(other)) {
-            return false;
+        if (_tiled == other._tiled) {
+            if (NonKeyParams::operator!=(other)) {
+                return false;
+            }
+        } else {
+            ///The elements count of a tiled image is 0 since its tiles are allocated on demand: it holds the same
+            ///pixels as an image that is not tiled with the same bounds, components and bit depth
+            if ( getCost() != other.getCost() || _bounds != other._bounds ) {
+                return false;
+            }
         }
         if ( other._framesNeeded.size() != _framesNeeded.size() ) {
             return false;
@@ -212,6 +238,9 @@ private:
     Natron::ImageBitDepthEnum _bitdepth;
     unsigned int _mipMapLevel;
     double _par;
+    
+    ///Not serialized: images stored on disk are never tiled
+    bool _tiled;
 };
 }
 
@@ -0,0 +1,865 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ImageSIMD.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QtCore/QAtomicInt>
+
+///SSE2 is part of x86-64, on 32 bits x86 it is only used if the compiler targets it
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define NATRON_IMAGESIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+///AVX2 code is compiled for the functions that use it only, and called if the CPU supports it
+#if defined(NATRON_IMAGESIMD_SSE2) && \
+    ( defined(__clang__) || \
+      ( defined(__GNUC__) && ( __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) ) ) || \
+      ( defined(_MSC_VER) && _MSC_VER >= 1800 ) )
+#define NATRON_IMAGESIMD_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__( ( target("avx2") ) )
+#endif
+#endif
+
+using namespace Natron;
+
+namespace {
+
+///-1 until the CPU is queried. They are atomic because setInstructionSet() may be called while threads render:
+///the kernels only read the value, no other data is published with it so relaxed accesses are enough
+QAtomicInt supportedInstructionSet(-1);
+QAtomicInt currentInstructionSet(-1);
+
+SIMDInstructionSetEnum
+detectInstructionSet()
+{
+#if defined(NATRON_IMAGESIMD_AVX2)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        ///The OS must save the AVX registers (OSXSAVE and AVX bits, then XCR0)
+        bool osxsave = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+        if ( osxsave && ( (_xgetbv(0) & 6) == 6 ) ) {
+            __cpuidex(info, 7, 0);
+            if ( info[1] & (1 << 5) ) {
+                return eSIMDInstructionSetAVX2;
+            }
+        }
+    }
+#else
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") ) {
+        return eSIMDInstructionSetAVX2;
+    }
+#endif
+#endif
+#if defined(NATRON_IMAGESIMD_SSE2)
+    return eSIMDInstructionSetSSE2;
+#else
+    return eSIMDInstructionSetNone;
+#endif
+}
+
+#if defined(NATRON_IMAGESIMD_SSE2)
+
+///Packs the unsigned 32 bits integers of a and b, which must fit in 16 bits (_mm_packus_epi32 is SSE4.1)
+inline __m128i
+packUnsigned32To16(__m128i a,
+                   __m128i b)
+{
+    const __m128i bias32 = _mm_set1_epi32(32768);
+    const __m128i bias16 = _mm_set1_epi16(-32768);
+
+    return _mm_add_epi16( _mm_packs_epi32( _mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32) ), bias16 );
+}
+
+int
+halveRowSSE2(const float* s0,
+             const float* s1,
+             float* dst,
+             int nComponents,
+             int width)
+{
+    const __m128 four = _mm_set1_ps(4.f);
+    int x = 0;
+    if (nComponents == 4) {
+        for (; x < width; ++x, s0 += 8, s1 += 8, dst += 4) {
+            __m128 a = _mm_loadu_ps(s0);
+            __m128 b = _mm_loadu_ps(s0 + 4);
+            __m128 c = _mm_loadu_ps(s1);
+            __m128 d = _mm_loadu_ps(s1 + 4);
+            _mm_storeu_ps( dst, _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), four) );
+        }
+    } else if (nComponents == 1) {
+        for (; x + 4 <= width; x += 4, s0 += 8, s1 += 8, dst += 4) {
+            __m128 r0lo = _mm_loadu_ps(s0);
+            __m128 r0hi = _mm_loadu_ps(s0 + 4);
+            __m128 r1lo = _mm_loadu_ps(s1);
+            __m128 r1hi = _mm_loadu_ps(s1 + 4);
+            __m128 a = _mm_shuffle_ps( r0lo, r0hi, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 b = _mm_shuffle_ps( r0lo, r0hi, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m128 c = _mm_shuffle_ps( r1lo, r1hi, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 d = _mm_shuffle_ps( r1lo, r1hi, _MM_SHUFFLE(3, 1, 3, 1) );
+            _mm_storeu_ps( dst, _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), four) );
+        }
+    }
+
+    return x;
+}
+
+///Sums the 2 pixels of 4 components starting at s
+inline __m128i
+sumPixelPairSSE2(const unsigned short* s)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128( (const __m128i*)s );
+
+    return _mm_add_epi32( _mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero) );
+}
+
+///Sums the pairs of adjacent components of the 8 components starting at s
+inline __m128i
+sumComponentPairsSSE2(const unsigned short* s)
+{
+    const __m128i mask = _mm_set1_epi32(0xFFFF);
+    __m128i v = _mm_loadu_si128( (const __m128i*)s );
+
+    return _mm_add_epi32( _mm_and_si128(v, mask), _mm_srli_epi32(v, 16) );
+}
+
+int
+halveRowSSE2(const unsigned short* s0,
+             const unsigned short* s1,
+             unsigned short* dst,
+             int nComponents,
+             int width)
+{
+    int x = 0;
+    if (nComponents == 4) {
+        for (; x + 2 <= width; x += 2, s0 += 16, s1 += 16, dst += 8) {
+            __m128i d0 = _mm_srli_epi32(_mm_add_epi32( sumPixelPairSSE2(s0), sumPixelPairSSE2(s1) ), 2);
+            __m128i d1 = _mm_srli_epi32(_mm_add_epi32( sumPixelPairSSE2(s0 + 8), sumPixelPairSSE2(s1 + 8) ), 2);
+            _mm_storeu_si128( (__m128i*)dst, packUnsigned32To16(d0, d1) );
+        }
+    } else if (nComponents == 1) {
+        for (; x + 8 <= width; x += 8, s0 += 16, s1 += 16, dst += 8) {
+            __m128i d0 = _mm_srli_epi32(_mm_add_epi32( sumComponentPairsSSE2(s0), sumComponentPairsSSE2(s1) ), 2);
+            __m128i d1 = _mm_srli_epi32(_mm_add_epi32( sumComponentPairsSSE2(s0 + 8), sumComponentPairsSSE2(s1 + 8) ), 2);
+            _mm_storeu_si128( (__m128i*)dst, packUnsigned32To16(d0, d1) );
+        }
+    }
+
+    return x;
+}
+
+///Sums the pairs of pixels of 4 components of the 16 bytes starting at s: the result holds 2 pixels
+inline __m128i
+sumPixelPairsSSE2(const unsigned char* s)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128( (const __m128i*)s );
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+    return _mm_add_epi16( _mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi) );
+}
+
+///Sums the pairs of adjacent components of the 16 bytes starting at s
+inline __m128i
+sumComponentPairsSSE2(const unsigned char* s)
+{
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    __m128i v = _mm_loadu_si128( (const __m128i*)s );
+
+    return _mm_add_epi16( _mm_and_si128(v, mask), _mm_srli_epi16(v, 8) );
+}
+
+int
+halveRowSSE2(const unsigned char* s0,
+             const unsigned char* s1,
+             unsigned char* dst,
+             int nComponents,
+             int width)
+{
+    int x = 0;
+    if (nComponents == 4) {
+        for (; x + 4 <= width; x += 4, s0 += 32, s1 += 32, dst += 16) {
+            __m128i d01 = _mm_srli_epi16(_mm_add_epi16( sumPixelPairsSSE2(s0), sumPixelPairsSSE2(s1) ), 2);
+            __m128i d23 = _mm_srli_epi16(_mm_add_epi16( sumPixelPairsSSE2(s0 + 16), sumPixelPairsSSE2(s1 + 16) ), 2);
+            _mm_storeu_si128( (__m128i*)dst, _mm_packus_epi16(d01, d23) );
+        }
+    } else if (nComponents == 1) {
+        for (; x + 16 <= width; x += 16, s0 += 32, s1 += 32, dst += 16) {
+            __m128i d0 = _mm_srli_epi16(_mm_add_epi16( sumComponentPairsSSE2(s0), sumComponentPairsSSE2(s1) ), 2);
+            __m128i d1 = _mm_srli_epi16(_mm_add_epi16( sumComponentPairsSSE2(s0 + 16), sumComponentPairsSSE2(s1 + 16) ), 2);
+            _mm_storeu_si128( (__m128i*)dst, _mm_packus_epi16(d0, d1) );
+        }
+    }
+
+    return x;
+}
+
+///Returns a register filled with copies of the pixel, or false if the pixel size is not handled
+inline bool
+loadReplicatedPixel(const unsigned char* src,
+                    int pixelSize,
+                    __m128i* ret)
+{
+    switch (pixelSize) {
+    case 1:
+        *ret = _mm_set1_epi8( (char)src[0] );
+
+        return true;
+    case 2: {
+        short v;
+        std::memcpy( &v, src, sizeof(v) );
+        *ret = _mm_set1_epi16(v);
+
+        return true;
+    }
+    case 4: {
+        int v;
+        std::memcpy( &v, src, sizeof(v) );
+        *ret = _mm_set1_epi32(v);
+
+        return true;
+    }
+    case 8: {
+        __m128i v = _mm_loadl_epi64( (const __m128i*)src );
+        *ret = _mm_unpacklo_epi64(v, v);
+
+        return true;
+    }
+    case 16:
+        *ret = _mm_loadu_si128( (const __m128i*)src );
+
+        return true;
+    default:
+
+        return false;
+    }
+}
+
+int
+replicatePixelSSE2(const unsigned char* src,
+                   int pixelSize,
+                   unsigned char* dst,
+                   int count)
+{
+    __m128i pix;
+    if ( !loadReplicatedPixel(src, pixelSize, &pix) ) {
+        return 0;
+    }
+    int pixelsPerStore = 16 / pixelSize;
+    int x = 0;
+    for (; x + pixelsPerStore <= count; x += pixelsPerStore, dst += 16) {
+        _mm_storeu_si128( (__m128i*)dst, pix );
+    }
+
+    return x;
+}
+
+int
+deinterleaveRGBASSE2(const float* src,
+                     int rOffset,
+                     int gOffset,
+                     int bOffset,
+                     bool opaque,
+                     float* r,
+                     float* g,
+                     float* b,
+                     float* a,
+                     int count)
+{
+    const __m128 one = _mm_set1_ps(1.f);
+    int x = 0;
+    for (; x + 4 <= count; x += 4, src += 16) {
+        __m128 c[4] = { _mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), _mm_loadu_ps(src + 12) };
+        _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+        _mm_storeu_ps(r + x, c[rOffset]);
+        _mm_storeu_ps(g + x, c[gOffset]);
+        _mm_storeu_ps(b + x, c[bOffset]);
+        _mm_storeu_ps(a + x, opaque ? one : c[3]);
+    }
+
+    return x;
+}
+
+int
+interleaveRGBASSE2(const float* r,
+                   const float* g,
+                   const float* b,
+                   const float* a,
+                   float* dst,
+                   int count)
+{
+    int x = 0;
+    for (; x + 4 <= count; x += 4, dst += 16) {
+        __m128 c0 = _mm_loadu_ps(r + x);
+        __m128 c1 = _mm_loadu_ps(g + x);
+        __m128 c2 = _mm_loadu_ps(b + x);
+        __m128 c3 = _mm_loadu_ps(a + x);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        _mm_storeu_ps(dst, c0);
+        _mm_storeu_ps(dst + 4, c1);
+        _mm_storeu_ps(dst + 8, c2);
+        _mm_storeu_ps(dst + 12, c3);
+    }
+
+    return x;
+}
+
+int
+multiplyAddSSE2(float* values,
+                float gain,
+                float offset,
+                int count)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    const __m128 o = _mm_set1_ps(offset);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        _mm_storeu_ps( values + x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + x), g), o) );
+    }
+
+    return x;
+}
+
+int
+luminanceSSE2(float* r,
+              float* g,
+              float* b,
+              int count)
+{
+    const __m128 kr = _mm_set1_ps(0.299f);
+    const __m128 kg = _mm_set1_ps(0.587f);
+    const __m128 kb = _mm_set1_ps(0.114f);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m128 l = _mm_add_ps( _mm_add_ps( _mm_mul_ps(_mm_loadu_ps(r + x), kr), _mm_mul_ps(_mm_loadu_ps(g + x), kg) ),
+                               _mm_mul_ps(_mm_loadu_ps(b + x), kb) );
+        _mm_storeu_ps(r + x, l);
+        _mm_storeu_ps(g + x, l);
+        _mm_storeu_ps(b + x, l);
+    }
+
+    return x;
+}
+
+///Clamps to [0,1] and rounds v * 255 like Color::floatToInt<256>: NaNs become 0
+inline __m128i
+floatToByteSSE2(__m128 v)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 f255 = _mm_set1_ps(255.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    ///_mm_max_ps returns its second operand if the first one is a NaN
+    v = _mm_min_ps(_mm_max_ps(v, zero), one);
+
+    return _mm_cvttps_epi32( _mm_add_ps(_mm_mul_ps(v, f255), half) );
+}
+
+int
+floatToByteSSE2(const float* src,
+                unsigned char* dst,
+                int count)
+{
+    int x = 0;
+    for (; x + 16 <= count; x += 16, src += 16, dst += 16) {
+        __m128i i0 = floatToByteSSE2( _mm_loadu_ps(src) );
+        __m128i i1 = floatToByteSSE2( _mm_loadu_ps(src + 4) );
+        __m128i i2 = floatToByteSSE2( _mm_loadu_ps(src + 8) );
+        __m128i i3 = floatToByteSSE2( _mm_loadu_ps(src + 12) );
+        _mm_storeu_si128( (__m128i*)dst, _mm_packus_epi16( _mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i3) ) );
+    }
+
+    return x;
+}
+
+#endif // NATRON_IMAGESIMD_SSE2
+
+#if defined(NATRON_IMAGESIMD_AVX2)
+
+///The 256 bits pack and shuffle instructions work in each 128 bits lane: this puts back the
+///64 bits blocks 0,2,1,3 they produce in order
+#define NATRON_IMAGESIMD_UNINTERLEAVE_LANES _MM_SHUFFLE(3, 1, 2, 0)
+
+AVX2_FUNCTION int
+halveRowAVX2(const float* s0,
+             const float* s1,
+             float* dst,
+             int nComponents,
+             int width)
+{
+    const __m256 four = _mm256_set1_ps(4.f);
+    int x = 0;
+    if (nComponents == 4) {
+        for (; x + 2 <= width; x += 2, s0 += 16, s1 += 16, dst += 8) {
+            __m256 r0lo = _mm256_loadu_ps(s0);
+            __m256 r0hi = _mm256_loadu_ps(s0 + 8);
+            __m256 r1lo = _mm256_loadu_ps(s1);
+            __m256 r1hi = _mm256_loadu_ps(s1 + 8);
+            __m256 a = _mm256_permute2f128_ps(r0lo, r0hi, 0x20);
+            __m256 b = _mm256_permute2f128_ps(r0lo, r0hi, 0x31);
+            __m256 c = _mm256_permute2f128_ps(r1lo, r1hi, 0x20);
+            __m256 d = _mm256_permute2f128_ps(r1lo, r1hi, 0x31);
+            _mm256_storeu_ps( dst, _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a, b), c), d), four) );
+        }
+    } else if (nComponents == 1) {
+        for (; x + 8 <= width; x += 8, s0 += 16, s1 += 16, dst += 8) {
+            __m256 r0lo = _mm256_loadu_ps(s0);
+            __m256 r0hi = _mm256_loadu_ps(s0 + 8);
+            __m256 r1lo = _mm256_loadu_ps(s1);
+            __m256 r1hi = _mm256_loadu_ps(s1 + 8);
+            __m256 a = _mm256_shuffle_ps( r0lo, r0hi, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m256 b = _mm256_shuffle_ps( r0lo, r0hi, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m256 c = _mm256_shuffle_ps( r1lo, r1hi, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m256 d = _mm256_shuffle_ps( r1lo, r1hi, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m256 r = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(a, b), c), d), four);
+            r = _mm256_castpd_ps( _mm256_permute4x64_pd(_mm256_castps_pd(r), NATRON_IMAGESIMD_UNINTERLEAVE_LANES) );
+            _mm256_storeu_ps(dst, r);
+        }
+    }
+
+    return x;
+}
+
+AVX2_FUNCTION inline __m256i
+packUnsigned32To16AVX2(__m256i a,
+                       __m256i b)
+{
+    ///_mm256_packus_epi32 saturates to 16 bits like the SSE4.1 version, the values always fit
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), NATRON_IMAGESIMD_UNINTERLEAVE_LANES);
+}
+
+AVX2_FUNCTION int
+halveRowAVX2(const unsigned short* s0,
+             const unsigned short* s1,
+             unsigned short* dst,
+             int nComponents,
+             int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    int x = 0;
+    if (nComponents == 4) {
+        for (; x + 4 <= width; x += 4, s0 += 32, s1 += 32, dst += 16) {
+            __m256i sums[2];
+            for (int i = 0; i < 2; ++i) {
+                __m256i v0 = _mm256_loadu_si256( (const __m256i*)(s0 + i * 16) );
+                __m256i v1 = _mm256_loadu_si256( (const __m256i*)(s1 + i * 16) );
+                __m256i sum = _mm256_add_epi32( _mm256_unpacklo_epi16(v0, zero), _mm256_unpackhi_epi16(v0, zero) );
+                sum = _mm256_add_epi32( sum, _mm256_add_epi32( _mm256_unpacklo_epi16(v1, zero), _mm256_unpackhi_epi16(v1, zero) ) );
+                sums[i] = _mm256_srli_epi32(sum, 2);
+            }
+            _mm256_storeu_si256( (__m256i*)dst, packUnsigned32To16AVX2(sums[0], sums[1]) );
+        }
+    } else if (nComponents == 1) {
+        for (; x + 16 <= width; x += 16, s0 += 32, s1 += 32, dst += 16) {
+            __m256i sums[2];
+            for (int i = 0; i < 2; ++i) {
+                __m256i v0 = _mm256_loadu_si256( (const __m256i*)(s0 + i * 16) );
+                __m256i v1 = _mm256_loadu_si256( (const __m256i*)(s1 + i * 16) );
+                __m256i sum = _mm256_add_epi32( _mm256_and_si256(v0, mask), _mm256_srli_epi32(v0, 16) );
+                sum = _mm256_add_epi32( sum, _mm256_add_epi32( _mm256_and_si256(v1, mask), _mm256_srli_epi32(v1, 16) ) );
+                sums[i] = _mm256_srli_epi32(sum, 2);
+            }
+            _mm256_storeu_si256( (__m256i*)dst, packUnsigned32To16AVX2(sums[0], sums[1]) );
+        }
+    }
+
+    return x;
+}
+
+AVX2_FUNCTION int
+halveRowAVX2(const unsigned char* s0,
+             const unsigned char* s1,
+             unsigned char* dst,
+             int nComponents,
+             int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mask = _mm256_set1_epi16(0xFF);
+    int x = 0;
+    if (nComponents == 4) {
+        for (; x + 8 <= width; x += 8, s0 += 64, s1 += 64, dst += 32) {
+            __m256i sums[2];
+            for (int i = 0; i < 2; ++i) {
+                __m256i sum = zero;
+                const unsigned char* rows[2] = { s0 + i * 32, s1 + i * 32 };
+                for (int r = 0; r < 2; ++r) {
+                    __m256i v = _mm256_loadu_si256( (const __m256i*)rows[r] );
+                    __m256i lo = _mm256_unpacklo_epi8(v, zero);
+                    __m256i hi = _mm256_unpackhi_epi8(v, zero);
+                    sum = _mm256_add_epi16( sum, _mm256_add_epi16( _mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi) ) );
+                }
+                sums[i] = _mm256_srli_epi16(sum, 2);
+            }
+            __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), NATRON_IMAGESIMD_UNINTERLEAVE_LANES);
+            _mm256_storeu_si256( (__m256i*)dst, r );
+        }
+    } else if (nComponents == 1) {
+        for (; x + 32 <= width; x += 32, s0 += 64, s1 += 64, dst += 32) {
+            __m256i sums[2];
+            for (int i = 0; i < 2; ++i) {
+                __m256i v0 = _mm256_loadu_si256( (const __m256i*)(s0 + i * 32) );
+                __m256i v1 = _mm256_loadu_si256( (const __m256i*)(s1 + i * 32) );
+                __m256i sum = _mm256_add_epi16( _mm256_and_si256(v0, mask), _mm256_srli_epi16(v0, 8) );
+                sum = _mm256_add_epi16( sum, _mm256_add_epi16( _mm256_and_si256(v1, mask), _mm256_srli_epi16(v1, 8) ) );
+                sums[i] = _mm256_srli_epi16(sum, 2);
+            }
+            __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(sums[0], sums[1]), NATRON_IMAGESIMD_UNINTERLEAVE_LANES);
+            _mm256_storeu_si256( (__m256i*)dst, r );
+        }
+    }
+
+    return x;
+}
+
+AVX2_FUNCTION int
+replicatePixelAVX2(const unsigned char* src,
+                   int pixelSize,
+                   unsigned char* dst,
+                   int count)
+{
+    __m128i pix128;
+    if ( !loadReplicatedPixel(src, pixelSize, &pix128) ) {
+        return 0;
+    }
+    __m256i pix = _mm256_broadcastsi128_si256(pix128);
+    int pixelsPerStore = 32 / pixelSize;
+    int x = 0;
+    for (; x + pixelsPerStore <= count; x += pixelsPerStore, dst += 32) {
+        _mm256_storeu_si256( (__m256i*)dst, pix );
+    }
+
+    return x;
+}
+
+AVX2_FUNCTION int
+lookupByFloatHighBitsAVX2(const unsigned short* table,
+                          const float* src,
+                          unsigned short* dst,
+                          int count)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    const int* table32 = (const int*)table;
+    int x = 0;
+    for (; x + 16 <= count; x += 16, src += 16, dst += 16) {
+        ///the index is the high half of the float and the gather reads the entry and the next one
+        __m256i i0 = _mm256_srli_epi32(_mm256_castps_si256( _mm256_loadu_ps(src) ), 16);
+        __m256i i1 = _mm256_srli_epi32(_mm256_castps_si256( _mm256_loadu_ps(src + 8) ), 16);
+        __m256i v0 = _mm256_and_si256(_mm256_i32gather_epi32(table32, i0, 2), mask);
+        __m256i v1 = _mm256_and_si256(_mm256_i32gather_epi32(table32, i1, 2), mask);
+        _mm256_storeu_si256( (__m256i*)dst, packUnsigned32To16AVX2(v0, v1) );
+    }
+
+    return x;
+}
+
+AVX2_FUNCTION int
+lookupByByteAVX2(const float* table,
+                 const unsigned char* src,
+                 float* dst,
+                 int count)
+{
+    int x = 0;
+    for (; x + 8 <= count; x += 8, src += 8, dst += 8) {
+        __m256i i = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)src ) );
+        _mm256_storeu_ps( dst, _mm256_i32gather_ps(table, i, 4) );
+    }
+
+    return x;
+}
+
+#endif // NATRON_IMAGESIMD_AVX2
+
+template <typename PIX>
+int
+halveRowInternal(const PIX* srcRow0,
+                 const PIX* srcRow1,
+                 PIX* dst,
+                 int nComponents,
+                 int width)
+{
+    int done = 0;
+#if defined(NATRON_IMAGESIMD_AVX2)
+    if (ImageSIMD::getInstructionSet() >= eSIMDInstructionSetAVX2) {
+        done = halveRowAVX2(srcRow0, srcRow1, dst, nComponents, width);
+    }
+#endif
+#if defined(NATRON_IMAGESIMD_SSE2)
+    if (ImageSIMD::getInstructionSet() >= eSIMDInstructionSetSSE2) {
+        done += halveRowSSE2(srcRow0 + done * 2 * nComponents, srcRow1 + done * 2 * nComponents, dst + done * nComponents,
+                             nComponents, width - done);
+    }
+#else
+    (void)srcRow0;
+    (void)srcRow1;
+    (void)dst;
+    (void)nComponents;
+    (void)width;
+#endif
+
+    return done;
+}
+
+} // anon namespace
+
+SIMDInstructionSetEnum
+ImageSIMD::getSupportedInstructionSet()
+{
+    int set = supportedInstructionSet.fetchAndAddRelaxed(0);
+    if (set == -1) {
+        ///detectInstructionSet() returns the same value in all threads
+        set = (int)detectInstructionSet();
+        supportedInstructionSet.fetchAndStoreRelaxed(set);
+    }
+
+    return (SIMDInstructionSetEnum)set;
+}
+
+SIMDInstructionSetEnum
+ImageSIMD::getInstructionSet()
+{
+    int set = currentInstructionSet.fetchAndAddRelaxed(0);
+    if (set == -1) {
+        ///do not overwrite a set given to setInstructionSet() concurrently
+        set = (int)getSupportedInstructionSet();
+        if ( !currentInstructionSet.testAndSetRelaxed(-1, set) ) {
+            set = currentInstructionSet.fetchAndAddRelaxed(0);
+        }
+    }
+
+    return (SIMDInstructionSetEnum)set;
+}
+
+void
+ImageSIMD::setInstructionSet(SIMDInstructionSetEnum set)
+{
+    currentInstructionSet.fetchAndStoreRelaxed( std::min( (int)set, (int)getSupportedInstructionSet() ) );
+}
+
+int
+ImageSIMD::halveRow(const float* srcRow0,
+                    const float* srcRow1,
+                    float* dst,
+                    int nComponents,
+                    int width)
+{
+    return halveRowInternal(srcRow0, srcRow1, dst, nComponents, width);
+}
+
+int
+ImageSIMD::halveRow(const unsigned short* srcRow0,
+                    const unsigned short* srcRow1,
+                    unsigned short* dst,
+                    int nComponents,
+                    int width)
+{
+    return halveRowInternal(srcRow0, srcRow1, dst, nComponents, width);
+}
+
+int
+ImageSIMD::halveRow(const unsigned char* srcRow0,
+                    const unsigned char* srcRow1,
+                    unsigned char* dst,
+                    int nComponents,
+                    int width)
+{
+    return halveRowInternal(srcRow0, srcRow1, dst, nComponents, width);
+}
+
+int
+ImageSIMD::replicatePixel(const unsigned char* src,
+                          int pixelSize,
+                          unsigned char* dst,
+                          int count)
+{
+    int done = 0;
+#if defined(NATRON_IMAGESIMD_AVX2)
+    if (getInstructionSet() >= eSIMDInstructionSetAVX2) {
+        done = replicatePixelAVX2(src, pixelSize, dst, count);
+    }
+#endif
+#if defined(NATRON_IMAGESIMD_SSE2)
+    if (getInstructionSet() >= eSIMDInstructionSetSSE2) {
+        done += replicatePixelSSE2(src, pixelSize, dst + done * pixelSize, count - done);
+    }
+#else
+    (void)src;
+    (void)pixelSize;
+    (void)dst;
+    (void)count;
+#endif
+
+    return done;
+}
+
+int
+ImageSIMD::lookupByFloatHighBits(const unsigned short* table,
+                                 const float* src,
+                                 unsigned short* dst,
+                                 int count)
+{
+#if defined(NATRON_IMAGESIMD_AVX2)
+    if (getInstructionSet() >= eSIMDInstructionSetAVX2) {
+        return lookupByFloatHighBitsAVX2(table, src, dst, count);
+    }
+#else
+    (void)table;
+    (void)src;
+    (void)dst;
+    (void)count;
+#endif
+
+    return 0;
+}
+
+int
+ImageSIMD::lookupByByte(const float* table,
+                        const unsigned char* src,
+                        float* dst,
+                        int count)
+{
+#if defined(NATRON_IMAGESIMD_AVX2)
+    if (getInstructionSet() >= eSIMDInstructionSetAVX2) {
+        return lookupByByteAVX2(table, src, dst, count);
+    }
+#else
+    (void)table;
+    (void)src;
+    (void)dst;
+    (void)count;
+#endif
+
+    return 0;
+}
+
+int
+ImageSIMD::deinterleaveRGBA(const float* src,
+                            int rOffset,
+                            int gOffset,
+                            int bOffset,
+                            bool opaque,
+                            float* r,
+                            float* g,
+                            float* b,
+                            float* a,
+                            int count)
+{
+#if defined(NATRON_IMAGESIMD_SSE2)
+    if (getInstructionSet() >= eSIMDInstructionSetSSE2) {
+        return deinterleaveRGBASSE2(src, rOffset, gOffset, bOffset, opaque, r, g, b, a, count);
+    }
+#else
+    (void)src;
+    (void)rOffset;
+    (void)gOffset;
+    (void)bOffset;
+    (void)opaque;
+    (void)r;
+    (void)g;
+    (void)b;
+    (void)a;
+    (void)count;
+#endif
+
+    return 0;
+}
+
+int
+ImageSIMD::interleaveRGBA(const float* r,
+                          const float* g,
+                          const float* b,
+                          const float* a,
+                          float* dst,
+                          int count)
+{
+#if defined(NATRON_IMAGESIMD_SSE2)
+    if (getInstructionSet() >= eSIMDInstructionSetSSE2) {
+        return interleaveRGBASSE2(r, g, b, a, dst, count);
+    }
+#else
+    (void)r;
+    (void)g;
+    (void)b;
+    (void)a;
+    (void)dst;
+    (void)count;
+#endif
+
+    return 0;
+}
+
+int
+ImageSIMD::multiplyAdd(float* values,
+                       float gain,
+                       float offset,
+                       int count)
+{
+#if defined(NATRON_IMAGESIMD_SSE2)
+    if (getInstructionSet() >= eSIMDInstructionSetSSE2) {
+        return multiplyAddSSE2(values, gain, offset, count);
+    }
+#else
+    (void)values;
+    (void)gain;
+    (void)offset;
+    (void)count;
+#endif
+
+    return 0;
+}
+
+int
+ImageSIMD::luminance(float* r,
+                     float* g,
+                     float* b,
+                     int count)
+{
+#if defined(NATRON_IMAGESIMD_SSE2)
+    if (getInstructionSet() >= eSIMDInstructionSetSSE2) {
+        return luminanceSSE2(r, g, b, count);
+    }
+#else
+    (void)r;
+    (void)g;
+    (void)b;
+    (void)count;
+#endif
+
+    return 0;
+}
+
+int
+ImageSIMD::floatToByte(const float* src,
+                       unsigned char* dst,
+                       int count)
+{
+#if defined(NATRON_IMAGESIMD_SSE2)
+    if (getInstructionSet() >= eSIMDInstructionSetSSE2) {
+        return floatToByteSSE2(src, dst, count);
+    }
+#else
+    (void)src;
+    (void)dst;
+    (void)count;
+#endif
+
+    return 0;
+}
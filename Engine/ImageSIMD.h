@@ -0,0 +1,112 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_IMAGESIMD_H_
+#define NATRON_ENGINE_IMAGESIMD_H_
+
+#include "Global/Macros.h"
+#include "Global/Enums.h"
+
+/**
+ * @brief Vectorized kernels used by the mipmapping functions of Natron::Image and the look-ups of Natron::Color::Lut.
+ * They produce exactly the same results as the scalar code: the float kernels
+ * do the operations in the same order and the integer kernels are exact.
+ * Each kernel returns the number of pixels it processed, the caller handles the remaining ones.
+ **/
+namespace Natron {
+namespace ImageSIMD {
+
+/**
+ * @brief Returns the best instruction set both compiled in and supported by the CPU.
+ * It is detected once.
+ **/
+Natron::SIMDInstructionSetEnum getSupportedInstructionSet();
+
+/**
+ * @brief Returns the instruction set used by the kernels, which is getSupportedInstructionSet() unless
+ * it was restricted with setInstructionSet().
+ **/
+Natron::SIMDInstructionSetEnum getInstructionSet();
+
+/**
+ * @brief Restricts the instruction set used by the kernels, e.g: to compare them against the scalar code.
+ * It is clamped to getSupportedInstructionSet().
+ **/
+void setInstructionSet(Natron::SIMDInstructionSetEnum set);
+
+/**
+ * @brief Averages the 2x2 blocks of pixels of the rows srcRow0 and srcRow1 into dst:
+ * dst[x] = (srcRow0[2x] + srcRow0[2x+1] + srcRow1[2x] + srcRow1[2x+1]) / 4 for each component.
+ * Only 1 and 4 components images are vectorized.
+ * @returns The number of dst pixels written, at most width.
+ **/
+int halveRow(const float* srcRow0, const float* srcRow1, float* dst, int nComponents, int width);
+int halveRow(const unsigned short* srcRow0, const unsigned short* srcRow1, unsigned short* dst, int nComponents, int width);
+int halveRow(const unsigned char* srcRow0, const unsigned char* srcRow1, unsigned char* dst, int nComponents, int width);
+
+/**
+ * @brief Writes count copies of the pixel of pixelSize bytes pointed to by src in dst.
+ * Only pixels of 1, 2, 4, 8 or 16 bytes are vectorized.
+ * @returns The number of copies written, at most count.
+ **/
+int replicatePixel(const unsigned char* src, int pixelSize, unsigned char* dst, int count);
+
+/**
+ * @brief dst[i] = table[hipart(src[i])], where hipart() is the 16 high bits of the float, for a table of 0x10000 entries.
+ * The table must have one extra entry after them because the gathers read 32 bits.
+ * Only AVX2 is vectorized.
+ * @returns The number of values written, at most count.
+ **/
+int lookupByFloatHighBits(const unsigned short* table, const float* src, unsigned short* dst, int count);
+
+/**
+ * @brief dst[i] = table[src[i]] for a table of 256 floats.
+ * Only AVX2 is vectorized.
+ * @returns The number of values written, at most count.
+ **/
+int lookupByByte(const float* table, const unsigned char* src, float* dst, int count);
+
+/**
+ * @brief Splits count RGBA float pixels into the planes r, g, b and a. The planes r, g and b receive the
+ * channels of index rOffset, gOffset and bOffset (in [0,3]), a receives 1 if opaque is true.
+ * Only SSE2 is vectorized.
+ * @returns The number of pixels written, at most count.
+ **/
+int deinterleaveRGBA(const float* src, int rOffset, int gOffset, int bOffset, bool opaque,
+                     float* r, float* g, float* b, float* a, int count);
+
+/**
+ * @brief The reverse of deinterleaveRGBA: writes count RGBA float pixels from the 4 planes.
+ * Only SSE2 is vectorized.
+ * @returns The number of pixels written, at most count.
+ **/
+int interleaveRGBA(const float* r, const float* g, const float* b, const float* a, float* dst, int count);
+
+/**
+ * @brief values[i] = values[i] * gain + offset
+ * Only SSE2 is vectorized.
+ * @returns The number of values written, at most count.
+ **/
+int multiplyAdd(float* values, float gain, float offset, int count);
+
+/**
+ * @brief r[i] = g[i] = b[i] = 0.299f * r[i] + 0.587f * g[i] + 0.114f * b[i]
+ * Only SSE2 is vectorized.
+ * @returns The number of values written, at most count.
+ **/
+int luminance(float* r, float* g, float* b, int count);
+
+/**
+ * @brief dst[i] = Color::floatToInt<256>(src[i]), NaNs become 0.
+ * Only SSE2 is vectorized.
+ * @returns The number of values written, at most count.
+ **/
+int floatToByte(const float* src, unsigned char* dst, int count);
+
+} // namespace ImageSIMD
+} // namespace Natron
+
+#endif // NATRON_ENGINE_IMAGESIMD_H_
@@ -0,0 +1,279 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ImageStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifndef Q_MOC_RUN
+#include <boost/bind.hpp>
+#endif
+
+#include "Engine/Image.h"
+#include "Engine/TaskScheduler.h"
+
+using namespace Natron;
+
+namespace {
+
+///The statistics of a band of rows, merged by ImageStatistics::compute()
+struct PartialStatistics
+{
+    double min[ImageStatistics::eChannelCount];
+    double max[ImageStatistics::eChannelCount];
+    double sum[ImageStatistics::eChannelCount];
+    std::vector<float> histograms[ImageStatistics::eChannelCount];
+
+    explicit PartialStatistics(int binsCount = 0)
+    {
+        for (int c = 0; c < ImageStatistics::eChannelCount; ++c) {
+            min[c] = std::numeric_limits<double>::infinity();
+            max[c] = -std::numeric_limits<double>::infinity();
+            sum[c] = 0.;
+            histograms[c].resize(binsCount, 0.f);
+        }
+    }
+
+    void merge(const PartialStatistics & other)
+    {
+        for (int c = 0; c < ImageStatistics::eChannelCount; ++c) {
+            if (other.min[c] < min[c]) {
+                min[c] = other.min[c];
+            }
+            if (other.max[c] > max[c]) {
+                max[c] = other.max[c];
+            }
+            sum[c] += other.sum[c];
+            for (std::size_t i = 0; i < histograms[c].size(); ++i) {
+                histograms[c][i] += other.histograms[c][i];
+            }
+        }
+    }
+};
+
+template <typename PIX,int nComps>
+void
+computeRowsForComponents(const Natron::Image* image,
+                         const RectI & rect,
+                         double histogramMin,
+                         double histogramMax,
+                         int binsCount,
+                         PartialStatistics* stats)
+{
+    ///pixels of the tiles that were never written are black
+    static const PIX zero[4] = { 0, 0, 0, 0 };
+    const double binSize = binsCount > 0 ? (histogramMax - histogramMin) / binsCount : 0.;
+
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        for (int x = rect.x1; x < rect.x2;) {
+            const int spanEnd = std::min( rect.x2, image->getContiguousRowEnd(x) );
+            const PIX* pix = (const PIX*)image->pixelAt(x, y);
+            int step = nComps;
+            if (!pix) {
+                pix = zero;
+                step = 0;
+            }
+            for (; x < spanEnd; ++x, pix += step) {
+                double v[ImageStatistics::eChannelCount];
+                switch (nComps) {
+                case 4:
+                    v[0] = convertPixelDepth<PIX, float>(pix[0]);
+                    v[1] = convertPixelDepth<PIX, float>(pix[1]);
+                    v[2] = convertPixelDepth<PIX, float>(pix[2]);
+                    v[3] = convertPixelDepth<PIX, float>(pix[3]);
+                    break;
+                case 3:
+                    v[0] = convertPixelDepth<PIX, float>(pix[0]);
+                    v[1] = convertPixelDepth<PIX, float>(pix[1]);
+                    v[2] = convertPixelDepth<PIX, float>(pix[2]);
+                    v[3] = 1.;
+                    break;
+                case 1:
+                    v[0] = v[1] = v[2] = 0.;
+                    v[3] = convertPixelDepth<PIX, float>(pix[0]);
+                    break;
+                default:
+                    v[0] = v[1] = v[2] = v[3] = 0.;
+                    break;
+                }
+                v[4] = 0.299 * v[0] + 0.587 * v[1] + 0.114 * v[2];
+
+                for (int c = 0; c < ImageStatistics::eChannelCount; ++c) {
+                    if (v[c] < stats->min[c]) {
+                        stats->min[c] = v[c];
+                    }
+                    if (v[c] > stats->max[c]) {
+                        stats->max[c] = v[c];
+                    }
+                    stats->sum[c] += v[c];
+                }
+                if (binsCount > 0) {
+                    ///the histogram panel has always binned the values as floats
+                    for (int c = 0; c < ImageStatistics::eChannelCount; ++c) {
+                        float f = (float)v[c];
+                        if ( (histogramMin <= f) && (f < histogramMax) ) {
+                            int index = std::min( (int)( (f - histogramMin) / binSize ), binsCount - 1 );
+                            stats->histograms[c][index] += 1.f;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename PIX>
+void
+computeRowsForDepth(const Natron::Image* image,
+                    const RectI & rect,
+                    double histogramMin,
+                    double histogramMax,
+                    int binsCount,
+                    PartialStatistics* stats)
+{
+    switch ( image->getComponents() ) {
+    case Natron::eImageComponentRGBA:
+        computeRowsForComponents<PIX, 4>(image, rect, histogramMin, histogramMax, binsCount, stats);
+        break;
+    case Natron::eImageComponentRGB:
+        computeRowsForComponents<PIX, 3>(image, rect, histogramMin, histogramMax, binsCount, stats);
+        break;
+    case Natron::eImageComponentAlpha:
+        computeRowsForComponents<PIX, 1>(image, rect, histogramMin, histogramMax, binsCount, stats);
+        break;
+    default:
+        break;
+    }
+}
+
+PartialStatistics
+computeRows(const Natron::Image* image,
+            double histogramMin,
+            double histogramMax,
+            int binsCount,
+            const RectI & rect)
+{
+    PartialStatistics ret(binsCount);
+
+    switch ( image->getBitDepth() ) {
+    case Natron::eImageBitDepthByte:
+        computeRowsForDepth<unsigned char>(image, rect, histogramMin, histogramMax, binsCount, &ret);
+        break;
+    case Natron::eImageBitDepthShort:
+        computeRowsForDepth<unsigned short>(image, rect, histogramMin, histogramMax, binsCount, &ret);
+        break;
+    case Natron::eImageBitDepthFloat:
+        computeRowsForDepth<float>(image, rect, histogramMin, histogramMax, binsCount, &ret);
+        break;
+    case Natron::eImageBitDepthNone:
+        break;
+    }
+
+    return ret;
+}
+
+///A task of the TaskScheduler computing the statistics of the band i
+void
+computeBand(const Natron::Image* image,
+            double histogramMin,
+            double histogramMax,
+            int binsCount,
+            const std::vector<RectI>* splitRects,
+            std::vector<PartialStatistics>* results,
+            int i)
+{
+    (*results)[i] = computeRows(image, histogramMin, histogramMax, binsCount, (*splitRects)[i]);
+}
+} // anon namespace
+
+ImageStatistics::ImageStatistics()
+    : _image()
+      , _rect()
+      , _pixelsCount(0)
+      , _histogramMin(0.)
+      , _histogramMax(0.)
+      , _binsCount(0)
+{
+    for (int c = 0; c < eChannelCount; ++c) {
+        _min[c] = std::numeric_limits<double>::infinity();
+        _max[c] = -std::numeric_limits<double>::infinity();
+        _mean[c] = 0.;
+    }
+}
+
+void
+ImageStatistics::compute(const boost::shared_ptr<const Natron::Image> & image,
+                         const RectI & rect,
+                         double histogramMin,
+                         double histogramMax,
+                         int binsCount,
+                         bool multiThreaded)
+{
+    assert(image);
+    _image = image;
+    _histogramMin = histogramMin;
+    _histogramMax = histogramMax;
+    _binsCount = std::max(0, binsCount);
+    if ( !rect.intersect(image->getBounds(), &_rect) ) {
+        _rect.clear();
+    }
+    _pixelsCount = (int)_rect.area();
+
+    PartialStatistics stats(_binsCount);
+    int threadsCount = multiThreaded ? TaskScheduler::globalInstance()->getMaxThreadCount() + 1 : 1;
+    if ( (threadsCount <= 1) || (_rect.height() < 2) ) {
+        stats = computeRows(image.get(), _histogramMin, _histogramMax, _binsCount, _rect);
+    } else {
+        int rowsPerThread = std::ceil( (double)_rect.height() / threadsCount );
+        std::vector<RectI> splitRects;
+        for (int y = _rect.y1; y < _rect.y2; y += rowsPerThread) {
+            splitRects.push_back( RectI( _rect.x1, y, _rect.x2, std::min(y + rowsPerThread, _rect.y2) ) );
+        }
+        std::vector<PartialStatistics> results( splitRects.size() );
+        TaskScheduler::globalInstance()->parallelFor( (int)splitRects.size(),
+                                                      boost::bind(computeBand,
+                                                                  image.get(),
+                                                                  _histogramMin,
+                                                                  _histogramMax,
+                                                                  _binsCount,
+                                                                  &splitRects,
+                                                                  &results,
+                                                                  _1) );
+        for (std::vector<PartialStatistics>::const_iterator it = results.begin(); it != results.end(); ++it) {
+            stats.merge(*it);
+        }
+    }
+
+    for (int c = 0; c < eChannelCount; ++c) {
+        _min[c] = stats.min[c];
+        _max[c] = stats.max[c];
+        _mean[c] = _pixelsCount > 0 ? stats.sum[c] / _pixelsCount : 0.;
+        _histograms[c].swap(stats.histograms[c]);
+    }
+}
+
+bool
+ImageStatistics::isComputedFor(const boost::shared_ptr<const Natron::Image> & image,
+                               const RectI & rect) const
+{
+    RectI clipped;
+
+    if ( !image || !rect.intersect(image->getBounds(), &clipped) ) {
+        clipped.clear();
+    }
+
+    return _image.lock() == image && clipped == _rect;
+}
+
+bool
+ImageStatistics::hasHistograms(double histogramMin,
+                               double histogramMax,
+                               int binsCount) const
+{
+    return _binsCount > 0 && _binsCount == binsCount && _histogramMin == histogramMin && _histogramMax == histogramMax;
+}
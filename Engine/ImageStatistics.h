@@ -0,0 +1,117 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_IMAGESTATISTICS_H_
+#define NATRON_ENGINE_IMAGESTATISTICS_H_
+
+#include <vector>
+
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#endif
+
+#include "Global/Macros.h"
+#include "Engine/Rect.h"
+
+namespace Natron {
+class Image;
+
+/**
+ * @brief The statistics of a portion of an image: the minimum, maximum and mean of each channel
+ * and optionally their histograms, all computed in a single pass over the pixels split across threads.
+ * The viewer computes them for its auto-contrast and keeps the last ones, so that the histogram panel
+ * can use them instead of reading the same image again.
+ **/
+class ImageStatistics
+{
+public:
+
+    enum ChannelEnum
+    {
+        eChannelRed = 0,
+        eChannelGreen,
+        eChannelBlue,
+        eChannelAlpha,
+        eChannelLuminance,
+        eChannelCount
+    };
+
+    ImageStatistics();
+
+    /**
+     * @brief Computes the statistics of the pixels of image in rect, converted to float.
+     * If binsCount is greater than 0, a histogram of binsCount bins is computed for each channel,
+     * counting the values in [histogramMin, histogramMax[.
+     * The rows are split across the threads of the global TaskScheduler if multiThreaded is true.
+     * Channels that the image does not have are 0, except the alpha which is 1.
+     **/
+    void compute(const boost::shared_ptr<const Natron::Image> & image,
+                 const RectI & rect,
+                 double histogramMin,
+                 double histogramMax,
+                 int binsCount,
+                 bool multiThreaded);
+
+    /**
+     * @brief Returns true if these statistics were computed for the given portion of image.
+     **/
+    bool isComputedFor(const boost::shared_ptr<const Natron::Image> & image,const RectI & rect) const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Returns true if the histograms were computed with these parameters.
+     **/
+    bool hasHistograms(double histogramMin,double histogramMax,int binsCount) const WARN_UNUSED_RETURN;
+
+    const RectI & getRect() const WARN_UNUSED_RETURN
+    {
+        return _rect;
+    }
+
+    ///The number of pixels in the rectangle
+    int getPixelsCount() const WARN_UNUSED_RETURN
+    {
+        return _pixelsCount;
+    }
+
+    ///+infinity if the rectangle is empty
+    double getMin(ChannelEnum channel) const WARN_UNUSED_RETURN
+    {
+        return _min[channel];
+    }
+
+    ///-infinity if the rectangle is empty
+    double getMax(ChannelEnum channel) const WARN_UNUSED_RETURN
+    {
+        return _max[channel];
+    }
+
+    double getMean(ChannelEnum channel) const WARN_UNUSED_RETURN
+    {
+        return _mean[channel];
+    }
+
+    ///Empty if the histograms were not computed
+    const std::vector<float> & getHistogram(ChannelEnum channel) const WARN_UNUSED_RETURN
+    {
+        return _histograms[channel];
+    }
+
+private:
+
+    boost::weak_ptr<const Natron::Image> _image;
+    RectI _rect;
+    int _pixelsCount;
+    double _histogramMin, _histogramMax;
+    int _binsCount;
+    double _min[eChannelCount];
+    double _max[eChannelCount];
+    double _mean[eChannelCount];
+    std::vector<float> _histograms[eChannelCount];
+};
+} // namespace Natron
+
+#endif // NATRON_ENGINE_IMAGESTATISTICS_H_
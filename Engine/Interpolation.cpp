@@ -341,6 +341,31 @@ Natron::interpolate(double tcur,
                     double currentTime,
                     Natron::KeyframeTypeEnum interp,
                     Natron::KeyframeTypeEnum interpNext)
+{
+    // if the following is true, this makes the special case for eKeyframeTypeConstant at tnext useless, and we can always use a cubic - the strict "currentTime < tnext" is the key
+    assert( ( (interp == eKeyframeTypeNone) || (tcur <= currentTime) ) && ( (currentTime < tnext) || (interpNext == eKeyframeTypeNone) ) );
+
+    double tStart, duration, coeffs[4];
+    interpolationCoefficients(tcur, vcur, vcurDerivRight, vnextDerivLeft, tnext, vnext, interp, interpNext, &tStart, &duration, coeffs);
+
+    // cubicDerive: divide the result by (tnext-tcur)
+
+    // cubicIntegrate: multiply the result by (tnext-tcur)
+    return interpolationEval(tStart, duration, coeffs, currentTime);
+}
+
+void
+Natron::interpolationCoefficients(double tcur,
+                                  const double vcur,                     //start control point
+                                  const double vcurDerivRight,        //being the derivative dv/dt at tcur
+                                  const double vnextDerivLeft,        //being the derivative dv/dt at tnext
+                                  double tnext,
+                                  const double vnext,                      //end control point
+                                  Natron::KeyframeTypeEnum interp,
+                                  Natron::KeyframeTypeEnum interpNext,
+                                  double* tStart,
+                                  double* duration,
+                                  double coeffs[4])
 {
     double P0 = vcur;
     double P3 = vnext;
@@ -348,8 +373,6 @@ Natron::interpolate(double tcur,
     double P0pr = vcurDerivRight * (tnext - tcur); // normalize for x \in [0,1]
     double P3pl = vnextDerivLeft * (tnext - tcur); // normalize for x \in [0,1]
 
-    // if the following is true, this makes the special case for eKeyframeTypeConstant at tnext useless, and we can always use a cubic - the strict "currentTime < tnext" is the key
-    assert( ( (interp == eKeyframeTypeNone) || (tcur <= currentTime) ) && ( (currentTime < tnext) || (interpNext == eKeyframeTypeNone) ) );
     // after the last / before the first keyframe, derivatives are wrt currentTime (i.e. non-normalized)
     if (interp == eKeyframeTypeNone) {
         // virtual previous frame at t-1
@@ -367,16 +390,9 @@ Natron::interpolate(double tcur,
         P3 = P0 + P0pr;
         tnext = tcur + 1;
     }
-    double c0, c1, c2, c3;
-    hermiteToCubicCoeffs(P0, P0pr, P3pl, P3, &c0, &c1, &c2, &c3);
-
-    const double t = (currentTime - tcur) / (tnext - tcur);
-    double ret = cubicEval(c0, c1, c2, c3, t);
-
-    // cubicDerive: divide the result by (tnext-tcur)
-
-    // cubicIntegrate: multiply the result by (tnext-tcur)
-    return ret;
+    hermiteToCubicCoeffs(P0, P0pr, P3pl, P3, &coeffs[0], &coeffs[1], &coeffs[2], &coeffs[3]);
+    *tStart = tcur;
+    *duration = tnext - tcur;
 }
 
 /// derive at currentTime. The derivative is with respect to currentTime
@@ -30,6 +30,35 @@ double interpolate(double tcur, const double vcur, //start control point
                    KeyframeTypeEnum interp,
                    KeyframeTypeEnum interpNext) WARN_UNUSED_RETURN;
 
+/**
+ * @brief Returns the cubic used by interpolate() for the same keyframes: the value at currentTime is
+ * coeffs[0] + coeffs[1] * x + coeffs[2] * x^2 + coeffs[3] * x^3 with x = (currentTime - *tStart) / *duration.
+ * The coefficients do not depend on currentTime, so they can be computed once for all the times between the keyframes.
+ **/
+void interpolationCoefficients(double tcur, const double vcur, //start control point
+                               const double vcurDerivRight, //being the derivative dv/dt at tcur
+                               const double vnextDerivLeft, //being the derivative dv/dt at tnext
+                               double tnext, const double vnext, //end control point
+                               KeyframeTypeEnum interp,
+                               KeyframeTypeEnum interpNext,
+                               double* tStart,
+                               double* duration,
+                               double coeffs[4]);
+
+/// evaluate at currentTime the cubic returned by interpolationCoefficients()
+inline double
+interpolationEval(double tStart,
+                  double duration,
+                  const double coeffs[4],
+                  double currentTime)
+{
+    const double t = (currentTime - tStart) / duration;
+    const double t2 = t * t;
+    const double t3 = t2 * t;
+
+    return coeffs[0] + coeffs[1] * t + coeffs[2] * t2 + coeffs[3] * t3;
+}
+
 /// derive at currentTime. The derivative is with respect to currentTime
 double derive(double tcur, const double vcur, //start control point
               const double vcurDerivRight, //being the derivative dv/dt at tcur
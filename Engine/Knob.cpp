@@ -1656,6 +1656,13 @@ KnobHelper::getCurrentTime() const
     return holder && holder->getApp() ? holder->getCurrentTime() : 0;
 }
 
+const KnobsSnapshot*
+KnobHelper::getRenderKnobsSnapshot() const
+{
+    KnobHolder* holder = getHolder();
+    return holder ? holder->getRenderKnobsSnapshot() : NULL;
+}
+
 /***************************KNOB HOLDER******************************************/
 
 struct KnobHolder::KnobHolderPrivate
@@ -2178,6 +2185,12 @@ KnobHolder::getCurrentTime() const
     return getApp()->getTimeLine()->currentFrame();
 }
 
+const KnobsSnapshot*
+KnobHolder::getRenderKnobsSnapshot() const
+{
+    return NULL;
+}
+
 void
 KnobHolder::discardAppPointer()
 {
@@ -27,6 +27,7 @@
 class Curve;
 class KeyFrame;
 class KnobHolder;
+class KnobsSnapshot;
 class AppInstance;
 class KnobSerialization;
 class StringAnimationManager;
@@ -976,6 +977,11 @@ public:
     virtual SequenceTime getCurrentTime() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual std::string getDimensionName(int dimension) const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual void setDimensionName(int dim,const std::string & name) OVERRIDE FINAL;
+
+protected:
+
+    ///The snapshot of the frame being rendered by the holder in the calling thread, if any, @see KnobHolder::getRenderKnobsSnapshot()
+    const KnobsSnapshot* getRenderKnobsSnapshot() const WARN_UNUSED_RETURN;
     
 private:
 
@@ -1631,6 +1637,13 @@ public:
      **/
     virtual SequenceTime getCurrentTime() const;
 
+    /**
+     * @brief Returns the values of the knobs taken when the rendering of the current frame started in the calling
+     * thread, or NULL if the knobs must be read live, which is the default.
+     * @see KnobsSnapshot
+     **/
+    virtual const KnobsSnapshot* getRenderKnobsSnapshot() const WARN_UNUSED_RETURN;
+
 protected:
 
 
@@ -27,6 +27,7 @@
 #include "Engine/TimeLine.h"
 #include "Engine/EffectInstance.h"
 #include "Engine/KnobTypes.h"
+#include "Engine/KnobsSnapshot.h"
 
 
 ///template specializations
@@ -292,6 +293,12 @@ template<>
 std::string
 Knob<std::string>::getValue(int dimension,bool /*clampToMinMax*/) const
 {
+    const KnobsSnapshot* snapshot = getRenderKnobsSnapshot();
+    std::string snapshotValue;
+    if ( snapshot && snapshot->getValue(this, dimension, getCurrentTime(), &snapshotValue) ) {
+        return snapshotValue;
+    }
+
     if ( isAnimated(dimension) ) {
         SequenceTime time;
         if ( !getHolder() || !getHolder()->getApp() ) {
@@ -330,6 +337,13 @@ template <typename T>
 T
 Knob<T>::getValue(int dimension,bool clamp) const
 {
+    ///During a render the values are read from the snapshot taken when the frame started, which holds clamped values
+    const KnobsSnapshot* snapshot = clamp ? getRenderKnobsSnapshot() : NULL;
+    double snapshotValue;
+    if ( snapshot && snapshot->getValue(this, dimension, getCurrentTime(), &snapshotValue) ) {
+        return (T)snapshotValue;
+    }
+
     if ( isAnimated(dimension) ) {
         return getValueAtTime(getCurrentTime(), dimension,clamp);
     }
@@ -370,6 +384,12 @@ Knob<std::string>::getValueAtTime(double time,
         throw std::invalid_argument("Knob::getValueAtTime(): Dimension out of range");
     }
 
+    const KnobsSnapshot* snapshot = byPassMaster ? NULL : getRenderKnobsSnapshot();
+    std::string snapshotValue;
+    if ( snapshot && snapshot->getValue(this, dimension, time, &snapshotValue) ) {
+        return snapshotValue;
+    }
+
 
     ///if the knob is slaved to another knob, returns the other knob value
     std::pair<int,boost::shared_ptr<KnobI> > master = getMaster(dimension);
@@ -392,9 +412,10 @@ Knob<std::string>::getValueAtTime(double time,
     assert( ret.empty() );
 
     boost::shared_ptr<Curve> curve  = getCurve(dimension,byPassMaster);
-    if (curve && curve->getKeyFramesCount() > 0) {
+    double curveValue;
+    if ( curve && curve->getValueAtIfAnimated(time, true, &curveValue) ) {
         assert(isStringAnimated);
-        isStringAnimated->stringFromInterpolatedValue(curve->getValueAt(time), &ret);
+        isStringAnimated->stringFromInterpolatedValue(curveValue, &ret);
 
         return ret;
     } else {
@@ -424,6 +445,12 @@ Knob<T>::getValueAtTime(double time,
         throw std::invalid_argument("Knob::getValueAtTime(): Dimension out of range");
     }
 
+    const KnobsSnapshot* snapshot = clamp && !byPassMaster ? getRenderKnobsSnapshot() : NULL;
+    double snapshotValue;
+    if ( snapshot && snapshot->getValue(this, dimension, time, &snapshotValue) ) {
+        return (T)snapshotValue;
+    }
+
 
     ///if the knob is slaved to another knob, returns the other knob value
     std::pair<int,boost::shared_ptr<KnobI> > master = getMaster(dimension);
@@ -441,9 +468,10 @@ Knob<T>::getValueAtTime(double time,
         }
     }
     boost::shared_ptr<Curve> curve  = getCurve(dimension,byPassMaster);
-    if (curve && curve->getKeyFramesCount() > 0) {
+    double curveValue;
+    if ( curve && curve->getValueAtIfAnimated(time, clamp, &curveValue) ) {
         //getValueAt already clamps to the range for us
-        return (T)curve->getValueAt(time,clamp);
+        return (T)curveValue;
     } else {
         /*if the knob as no keys at this dimension, return the value
            at the requested dimension.*/
@@ -13,6 +13,7 @@
 #include "KnobSerialization.h"
 
 #include <QDebug>
+#include <QCoreApplication>
 
 #include "Engine/Knob.h"
 #include "Engine/Curve.h"
@@ -74,6 +75,14 @@ boost::shared_ptr<KnobI> KnobSerialization::createKnob(const std::string & typeN
     }
     if (ret) {
         ret->populate();
+
+        ///The binary projects are decoded in the thread pool (see ProjectBinarySerialization.h): the knobs that are
+        ///QObjects must belong to the main thread, as the knobs of the nodes do, before their signals are connected
+        QObject* isQObject = dynamic_cast<QObject*>( ret.get() );
+        QCoreApplication* app = QCoreApplication::instance();
+        if ( isQObject && app && ( isQObject->thread() != app->thread() ) ) {
+            isQObject->moveToThread( app->thread() );
+        }
     }
 
     return ret;
@@ -0,0 +1,205 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "KnobsSnapshot.h"
+
+#include <cassert>
+#include <functional>
+
+#include "Engine/Knob.h"
+
+namespace {
+template <typename T>
+void
+addKnobValues(double time,
+              const KnobI* knob,
+              const Knob<T>* typedKnob,
+              const std::vector<bool> & timeInvariant,
+              KnobsSnapshot* snapshot)
+{
+    std::vector<double> values( timeInvariant.size() );
+
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = (double)typedKnob->getValueAtTime(time, (int)i);
+    }
+    snapshot->addValues(knob, values, timeInvariant);
+}
+}
+
+KnobsSnapshot::KnobsSnapshot(double time)
+    : _time(time)
+      , _entries()
+      , _values()
+      , _valuesTimeInvariant()
+      , _strings()
+      , _stringsTimeInvariant()
+{
+}
+
+boost::shared_ptr<KnobsSnapshot>
+KnobsSnapshot::create(double time,
+                      const std::vector< boost::shared_ptr<KnobI> > & knobs)
+{
+    boost::shared_ptr<KnobsSnapshot> ret( new KnobsSnapshot(time) );
+
+    for (std::vector< boost::shared_ptr<KnobI> >::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
+        const KnobI* knob = it->get();
+        const Knob<int>* isInt = dynamic_cast<const Knob<int>*>(knob);
+        const Knob<bool>* isBool = dynamic_cast<const Knob<bool>*>(knob);
+        const Knob<double>* isDouble = dynamic_cast<const Knob<double>*>(knob);
+        const Knob<std::string>* isString = dynamic_cast<const Knob<std::string>*>(knob);
+        if (!isInt && !isBool && !isDouble && !isString) {
+            continue;
+        }
+
+        ///A dimension which is neither animated nor slaved has the same value at any time: it can also be read from the
+        ///snapshot when the effect asks for it at another time than the frame's, e.g to render a temporal effect
+        std::vector<bool> timeInvariant( knob->getDimension() );
+        for (std::size_t i = 0; i < timeInvariant.size(); ++i) {
+            timeInvariant[i] = !knob->isAnimated( (int)i ) && !knob->getMaster( (int)i ).second;
+        }
+
+        if (isInt) {
+            addKnobValues(time, knob, isInt, timeInvariant, ret.get());
+        } else if (isBool) {
+            addKnobValues(time, knob, isBool, timeInvariant, ret.get());
+        } else if (isDouble) {
+            addKnobValues(time, knob, isDouble, timeInvariant, ret.get());
+        } else {
+            std::vector<std::string> values( timeInvariant.size() );
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                values[i] = isString->getValueAtTime(time, (int)i);
+            }
+            ret->addValues(knob, values, timeInvariant);
+        }
+    }
+
+    return ret;
+}
+
+double
+KnobsSnapshot::getTime() const
+{
+    return _time;
+}
+
+int
+KnobsSnapshot::getKnobsCount() const
+{
+    return (int)_entries.size();
+}
+
+void
+KnobsSnapshot::addValues(const KnobI* knob,
+                         const std::vector<double> & values,
+                         const std::vector<bool> & timeInvariant)
+{
+    assert( values.size() == timeInvariant.size() );
+    insertEntry(knob, (int)_values.size(), (int)values.size(), false);
+    _values.insert( _values.end(), values.begin(), values.end() );
+    _valuesTimeInvariant.insert( _valuesTimeInvariant.end(), timeInvariant.begin(), timeInvariant.end() );
+}
+
+void
+KnobsSnapshot::addValues(const KnobI* knob,
+                         const std::vector<std::string> & values,
+                         const std::vector<bool> & timeInvariant)
+{
+    assert( values.size() == timeInvariant.size() );
+    insertEntry(knob, (int)_strings.size(), (int)values.size(), true);
+    _strings.insert( _strings.end(), values.begin(), values.end() );
+    _stringsTimeInvariant.insert( _stringsTimeInvariant.end(), timeInvariant.begin(), timeInvariant.end() );
+}
+
+void
+KnobsSnapshot::insertEntry(const KnobI* knob,
+                           int offset,
+                           int dimensions,
+                           bool isString)
+{
+    std::vector<Entry>::iterator it = _entries.begin();
+
+    ///std::less gives a total order on pointers, unlike operator<
+    while ( it != _entries.end() && std::less<const KnobI*>()(it->knob, knob) ) {
+        ++it;
+    }
+    assert(it == _entries.end() || it->knob != knob);
+
+    Entry e;
+    e.knob = knob;
+    e.offset = offset;
+    e.dimensions = dimensions;
+    e.isString = isString;
+    _entries.insert(it, e);
+}
+
+const KnobsSnapshot::Entry*
+KnobsSnapshot::findEntry(const KnobI* knob,
+                         bool isString,
+                         int dimension,
+                         double time) const
+{
+    std::less<const KnobI*> less;
+    std::size_t first = 0;
+    std::size_t last = _entries.size();
+
+    while (first < last) {
+        std::size_t middle = first + (last - first) / 2;
+        if ( less(_entries[middle].knob, knob) ) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    if ( (first == _entries.size()) || (_entries[first].knob != knob) ) {
+        return NULL;
+    }
+
+    const Entry & e = _entries[first];
+    if ( (e.isString != isString) || (dimension < 0) || (dimension >= e.dimensions) ) {
+        return NULL;
+    }
+    if (time != _time) {
+        const std::vector<bool> & timeInvariant = isString ? _stringsTimeInvariant : _valuesTimeInvariant;
+        if (!timeInvariant[e.offset + dimension]) {
+            return NULL;
+        }
+    }
+
+    return &e;
+}
+
+bool
+KnobsSnapshot::getValue(const KnobI* knob,
+                        int dimension,
+                        double time,
+                        double* value) const
+{
+    const Entry* e = findEntry(knob, false, dimension, time);
+
+    if (!e) {
+        return false;
+    }
+    *value = _values[e->offset + dimension];
+
+    return true;
+}
+
+bool
+KnobsSnapshot::getValue(const KnobI* knob,
+                        int dimension,
+                        double time,
+                        std::string* value) const
+{
+    const Entry* e = findEntry(knob, true, dimension, time);
+
+    if (!e) {
+        return false;
+    }
+    *value = _strings[e->offset + dimension];
+
+    return true;
+}
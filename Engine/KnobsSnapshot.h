@@ -0,0 +1,90 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_KNOBSSNAPSHOT_H_
+#define NATRON_ENGINE_KNOBSSNAPSHOT_H_
+
+#include <string>
+#include <vector>
+
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include "Global/Macros.h"
+
+///The snapshots of the knobs of an effect kept for the frames being rendered, see EffectInstance::setParallelRenderArgs().
+///Several frames of the same effect can be rendered concurrently during playback.
+#define NATRON_KNOBS_SNAPSHOTS_CACHE_SIZE 8
+
+class KnobI;
+
+/**
+ * @brief The values of the knobs of an effect at the time of a frame, taken once when the rendering of the frame starts.
+ * The getters of the knobs read them from the snapshot for the rest of the render (see KnobHolder::getRenderKnobsSnapshot())
+ * instead of taking the locks of the knob, of its master and of its curves and interpolating the curves every time
+ * a plug-in asks for a parameter value, which it may do for every tile or every row it renders.
+ *
+ * A snapshot is never modified once built and may be shared by all the threads rendering the same frame of the effect.
+ * It is tied to the hash of the node, so that any change of the parameters leads to a new snapshot.
+ **/
+class KnobsSnapshot
+{
+public:
+
+    explicit KnobsSnapshot(double time);
+
+    /**
+     * @brief Takes the values of the int, bool, double and string knobs of knobs at the time of the snapshot.
+     * The other knobs are left out: their getters always read the live values.
+     **/
+    static boost::shared_ptr<KnobsSnapshot> create(double time, const std::vector< boost::shared_ptr<KnobI> > & knobs) WARN_UNUSED_RETURN;
+
+    double getTime() const WARN_UNUSED_RETURN;
+
+    int getKnobsCount() const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Adds the values of all the dimensions of knob. If timeInvariant[i] is true, dimension i has the same value
+     * at any time, i.e it is neither animated nor slaved. The knobs can be added in any order but only once.
+     **/
+    void addValues(const KnobI* knob,const std::vector<double> & values,const std::vector<bool> & timeInvariant);
+
+    void addValues(const KnobI* knob,const std::vector<std::string> & values,const std::vector<bool> & timeInvariant);
+
+    /**
+     * @brief Returns true and sets value to the value of the given dimension of knob at the given time if it is in the
+     * snapshot: time must be the time of the snapshot, unless the dimension is time invariant.
+     **/
+    bool getValue(const KnobI* knob,int dimension,double time,double* value) const WARN_UNUSED_RETURN;
+
+    bool getValue(const KnobI* knob,int dimension,double time,std::string* value) const WARN_UNUSED_RETURN;
+
+private:
+
+    struct Entry
+    {
+        const KnobI* knob;
+        int offset; //< of the first dimension in _values or _strings
+        int dimensions;
+        bool isString;
+    };
+
+    // PRIVATE - should not lock
+    const Entry* findEntry(const KnobI* knob,bool isString,int dimension,double time) const WARN_UNUSED_RETURN;
+
+    // PRIVATE - should not lock
+    void insertEntry(const KnobI* knob,int offset,int dimensions,bool isString);
+
+    double _time;
+    std::vector<Entry> _entries; //< sorted by knob
+    std::vector<double> _values;
+    std::vector<bool> _valuesTimeInvariant; //< same size as _values
+    std::vector<std::string> _strings;
+    std::vector<bool> _stringsTimeInvariant; //< same size as _strings
+};
+
+#endif // NATRON_ENGINE_KNOBSSNAPSHOT_H_
@@ -92,6 +92,8 @@ CLANG_DIAG_ON(unknown-pragmas)
 
 ///WARNING: Cached element must have a use_count() method that returns
 ///the current reference counting of the object. Typically a shared_ptr.
+///The pointed object must also have a testAndClearAccessed() method, see
+///AbstractCacheEntry.
 
 
 template <typename K,typename V,template<typename ...> class MAP>
@@ -126,6 +128,13 @@ public:
         return it;
     }
 
+    // Find the value for k without updating the access record: this does not
+    // modify the container and can be called concurrently by several readers.
+    typename key_to_value_type::iterator find(const key_type & k)
+    {
+        return _key_to_value.find(k);
+    }
+
     void erase(typename key_to_value_type::iterator it)
     {
         _key_tracker.erase(it->second.second);
@@ -172,31 +181,100 @@ public:
         _key_tracker.clear();
     }
 
-    // Purge the least-recently-used element in the cache
+    // Purge the least-recently-used element in the cache.
+    // Records whose values were marked accessed since they were last visited
+    // are given a second chance (CLOCK): their access bit is cleared and they
+    // are moved to the back of the list.
     std::pair<key_type,V> evict()
     {
-        // Assert method is never called when cache is empty
-        assert( !_key_tracker.empty() );
-        // Identify least recently used key
-        const typename key_to_value_type::iterator it  = _key_to_value.find( _key_tracker.front() );
+        std::size_t nToVisit = _key_tracker.size() * 2;
+        typename key_tracker_type::iterator kit = _key_tracker.begin();
+        while ( kit != _key_tracker.end() && nToVisit > 0 ) {
+            --nToVisit;
+            const typename key_to_value_type::iterator it  = _key_to_value.find(*kit);
+            if ( wasAccessed(it->second.first) ) {
+                typename key_tracker_type::iterator next = kit;
+                ++next;
+                _key_tracker.splice(_key_tracker.end(),_key_tracker,kit);
+                kit = next;
+                continue;
+            }
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end();
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    std::pair<key_type,V> ret = std::make_pair(it->first,*it2);
+                    if (it->second.first.size() == 1) {
+                        // Erase both elements to completely purge record
+                        _key_to_value.erase(it);
+                        _key_tracker.erase(kit);
+                    } else {
+                        it->second.first.erase(it2);
+                    }
+
+                    return ret;
+                }
+            }
+            ++kit;
+        }
+
+        return std::make_pair( key_type(),V() );
+    }
+
+    // Collects up to maxCount values that could be evicted (i.e: that are not referenced
+    // anywhere else), least-recently-used first, without removing them from the cache.
+    // The access records are updated with the same second chance as evict().
+    void getEvictionCandidates(std::size_t maxCount,
+                               std::list<std::pair<key_type,V> >* candidates)
+    {
+        std::size_t nToVisit = _key_tracker.size() * 2;
+        std::size_t nFound = 0;
+        typename key_tracker_type::iterator kit = _key_tracker.begin();
+        while ( kit != _key_tracker.end() && nToVisit > 0 && nFound < maxCount ) {
+            --nToVisit;
+            const typename key_to_value_type::iterator it  = _key_to_value.find(*kit);
+            if ( wasAccessed(it->second.first) ) {
+                typename key_tracker_type::iterator next = kit;
+                ++next;
+                _key_tracker.splice(_key_tracker.end(),_key_tracker,kit);
+                kit = next;
+                continue;
+            }
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end() && nFound < maxCount;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    candidates->push_back( std::make_pair(it->first,*it2) );
+                    ++nFound;
+                }
+            }
+            ++kit;
+        }
+    }
+
+    // Removes the value v from the record of k, returns false if it could not be found
+    bool remove(const key_type & k,
+                const V & v)
+    {
+        typename key_to_value_type::iterator it = _key_to_value.find(k);
+        if ( it == _key_to_value.end() ) {
+            return false;
+        }
         for (typename std::list<V>::iterator it2 = it->second.first.begin();
              it2 != it->second.first.end();
              ++it2) {
-            if ( (*it2).use_count() == 1 ) {
-                std::pair<key_type,V> ret = std::make_pair(it->first,*it2);
+            if (*it2 == v) {
                 if (it->second.first.size() == 1) {
-                    // Erase both elements to completely purge record
-                    _key_to_value.erase(it);
-                    _key_tracker.pop_front();
+                    erase(it);
                 } else {
                     it->second.first.erase(it2);
                 }
 
-                return ret;
+                return true;
             }
         }
 
-        return std::make_pair( key_type(),V() );
+        return false;
     }
 
     unsigned int size()
@@ -205,6 +283,19 @@ public:
     }
 
 private:
+
+    // Clears the access bit of all values of a record, returns true if any was set
+    static bool wasAccessed(std::list<V> & values)
+    {
+        bool ret = false;
+        for (typename std::list<V>::iterator it = values.begin(); it != values.end(); ++it) {
+            if ( (*it)->testAndClearAccessed() ) {
+                ret = true;
+            }
+        }
+        return ret;
+    }
+
     // Key access history
     key_tracker_type _key_tracker;
 
@@ -244,6 +335,13 @@ public:
         return it;
     }
 
+    // Find the value for k without updating the access record: this does not
+    // modify the container and can be called concurrently by several readers.
+    typename container_type::left_iterator find(const key_type & k)
+    {
+        return _container.left.find(k);
+    }
+
     void erase(typename container_type::left_iterator it)
     {
         _container.left.erase(it);
@@ -288,10 +386,23 @@ public:
         _container.clear();
     }
 
+    // Purge the least-recently-used element in the cache.
+    // Records whose values were marked accessed since they were last visited
+    // are given a second chance (CLOCK): their access bit is cleared and they
+    // are moved to the most-recently-used end of the list.
     std::pair<key_type,V> evict()
     {
+        std::size_t nToVisit = _container.size() * 2;
         typename container_type::right_iterator it = _container.right.begin();
-        while ( it != _container.right.end() ) {
+        while ( it != _container.right.end() && nToVisit > 0 ) {
+            --nToVisit;
+            if ( wasAccessed(it->first) ) {
+                typename container_type::right_iterator next = it;
+                ++next;
+                _container.right.relocate(_container.right.end(),it);
+                it = next;
+                continue;
+            }
             for (typename std::list<V>::iterator it2 = it->first.begin();
                  it2 != it->first.end();
                  ++it2) {
@@ -312,12 +423,80 @@ public:
         return std::make_pair( key_type(),V() );
     }
 
+    // Collects up to maxCount values that could be evicted (i.e: that are not referenced
+    // anywhere else), least-recently-used first, without removing them from the cache.
+    // The access records are updated with the same second chance as evict().
+    void getEvictionCandidates(std::size_t maxCount,
+                               std::list<std::pair<key_type,V> >* candidates)
+    {
+        std::size_t nToVisit = _container.size() * 2;
+        std::size_t nFound = 0;
+        typename container_type::right_iterator it = _container.right.begin();
+        while ( it != _container.right.end() && nToVisit > 0 && nFound < maxCount ) {
+            --nToVisit;
+            if ( wasAccessed(it->first) ) {
+                typename container_type::right_iterator next = it;
+                ++next;
+                _container.right.relocate(_container.right.end(),it);
+                it = next;
+                continue;
+            }
+            for (typename std::list<V>::iterator it2 = it->first.begin();
+                 it2 != it->first.end() && nFound < maxCount;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    candidates->push_back( std::make_pair(it->second,*it2) );
+                    ++nFound;
+                }
+            }
+            ++it;
+        }
+    }
+
+    // Removes the value v from the record of k, returns false if it could not be found
+    bool remove(const key_type & k,
+                const V & v)
+    {
+        typename container_type::left_iterator it = _container.left.find(k);
+        if ( it == _container.left.end() ) {
+            return false;
+        }
+        for (typename std::list<V>::iterator it2 = it->second.begin();
+             it2 != it->second.end();
+             ++it2) {
+            if (*it2 == v) {
+                if (it->second.size() == 1) {
+                    _container.left.erase(it);
+                } else {
+                    it->second.erase(it2);
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     unsigned int size()
     {
         return _container.size();
     }
 
 private:
+
+    // Clears the access bit of all values of a record, returns true if any was set
+    static bool wasAccessed(std::list<V> & values)
+    {
+        bool ret = false;
+        for (typename std::list<V>::iterator it = values.begin(); it != values.end(); ++it) {
+            if ( (*it)->testAndClearAccessed() ) {
+                ret = true;
+            }
+        }
+        return ret;
+    }
+
     container_type _container;
 };
 
@@ -360,6 +539,13 @@ public:
         return it;
     }
 
+    // Find the value for k without updating the access record: this does not
+    // modify the container and can be called concurrently by several readers.
+    typename key_to_value_type::iterator find(const key_type & k)
+    {
+        return _key_to_value.find(k);
+    }
+
     void erase(typename key_to_value_type::iterator it)
     {
         _key_tracker.erase(it->second.second);
@@ -406,31 +592,100 @@ public:
         _key_tracker.clear();
     }
 
-    // Purge the least-recently-used element in the cache
+    // Purge the least-recently-used element in the cache.
+    // Records whose values were marked accessed since they were last visited
+    // are given a second chance (CLOCK): their access bit is cleared and they
+    // are moved to the back of the list.
     std::pair<key_type,V> evict()
     {
-        // Assert method is never called when cache is empty
-        assert( !_key_tracker.empty() );
-        // Identify least recently used key
-        const typename key_to_value_type::iterator it  = _key_to_value.find( _key_tracker.front() );
+        std::size_t nToVisit = _key_tracker.size() * 2;
+        typename key_tracker_type::iterator kit = _key_tracker.begin();
+        while ( kit != _key_tracker.end() && nToVisit > 0 ) {
+            --nToVisit;
+            const typename key_to_value_type::iterator it  = _key_to_value.find(*kit);
+            if ( wasAccessed(it->second.first) ) {
+                typename key_tracker_type::iterator next = kit;
+                ++next;
+                _key_tracker.splice(_key_tracker.end(),_key_tracker,kit);
+                kit = next;
+                continue;
+            }
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end();
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    std::pair<key_type,V> ret = std::make_pair(it->first,*it2);
+                    if (it->second.first.size() == 1) {
+                        // Erase both elements to completely purge record
+                        _key_to_value.erase(it);
+                        _key_tracker.erase(kit);
+                    } else {
+                        it->second.first.erase(it2);
+                    }
+
+                    return ret;
+                }
+            }
+            ++kit;
+        }
+
+        return std::make_pair( key_type(),V() );
+    }
+
+    // Collects up to maxCount values that could be evicted (i.e: that are not referenced
+    // anywhere else), least-recently-used first, without removing them from the cache.
+    // The access records are updated with the same second chance as evict().
+    void getEvictionCandidates(std::size_t maxCount,
+                               std::list<std::pair<key_type,V> >* candidates)
+    {
+        std::size_t nToVisit = _key_tracker.size() * 2;
+        std::size_t nFound = 0;
+        typename key_tracker_type::iterator kit = _key_tracker.begin();
+        while ( kit != _key_tracker.end() && nToVisit > 0 && nFound < maxCount ) {
+            --nToVisit;
+            const typename key_to_value_type::iterator it  = _key_to_value.find(*kit);
+            if ( wasAccessed(it->second.first) ) {
+                typename key_tracker_type::iterator next = kit;
+                ++next;
+                _key_tracker.splice(_key_tracker.end(),_key_tracker,kit);
+                kit = next;
+                continue;
+            }
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end() && nFound < maxCount;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    candidates->push_back( std::make_pair(it->first,*it2) );
+                    ++nFound;
+                }
+            }
+            ++kit;
+        }
+    }
+
+    // Removes the value v from the record of k, returns false if it could not be found
+    bool remove(const key_type & k,
+                const V & v)
+    {
+        typename key_to_value_type::iterator it = _key_to_value.find(k);
+        if ( it == _key_to_value.end() ) {
+            return false;
+        }
         for (typename std::list<V>::iterator it2 = it->second.first.begin();
              it2 != it->second.first.end();
              ++it2) {
-            if ( (*it2).use_count() == 1 ) {
-                std::pair<key_type,V> ret = std::make_pair(it->first,*it2);
+            if (*it2 == v) {
                 if (it->second.first.size() == 1) {
-                    // Erase both elements to completely purge record
-                    _key_to_value.erase(it);
-                    _key_tracker.pop_front();
+                    erase(it);
                 } else {
                     it->second.first.erase(it2);
                 }
 
-                return ret;
+                return true;
             }
         }
 
-        return std::make_pair( key_type(),V() );
+        return false;
     }
 
     unsigned int size()
@@ -439,6 +694,19 @@ public:
     }
 
 private:
+
+    // Clears the access bit of all values of a record, returns true if any was set
+    static bool wasAccessed(std::list<V> & values)
+    {
+        bool ret = false;
+        for (typename std::list<V>::iterator it = values.begin(); it != values.end(); ++it) {
+            if ( (*it)->testAndClearAccessed() ) {
+                ret = true;
+            }
+        }
+        return ret;
+    }
+
     // Key access history
     key_tracker_type _key_tracker;
 
@@ -474,6 +742,13 @@ public:
         return it;
     }
 
+    // Find the value for k without updating the access record: this does not
+    // modify the container and can be called concurrently by several readers.
+    typename container_type::left_iterator find(const key_type & k)
+    {
+        return _container.left.find(k);
+    }
+
     void erase(typename container_type::left_iterator it)
     {
         _container.left.erase(it);
@@ -518,10 +793,23 @@ public:
         _container.clear();
     }
 
+    // Purge the least-recently-used element in the cache.
+    // Records whose values were marked accessed since they were last visited
+    // are given a second chance (CLOCK): their access bit is cleared and they
+    // are moved to the most-recently-used end of the list.
     std::pair<key_type,V> evict()
     {
+        std::size_t nToVisit = _container.size() * 2;
         typename container_type::right_iterator it = _container.right.begin();
-        while ( it != _container.right.end() ) {
+        while ( it != _container.right.end() && nToVisit > 0 ) {
+            --nToVisit;
+            if ( wasAccessed(it->first) ) {
+                typename container_type::right_iterator next = it;
+                ++next;
+                _container.right.relocate(_container.right.end(),it);
+                it = next;
+                continue;
+            }
             for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end(); ++it2) {
                 if (it2->use_count() == 1) {
                     std::pair<key_type,V> ret = std::make_pair(it->second,*it2);
@@ -540,12 +828,80 @@ public:
         return std::make_pair( key_type(),V() );
     }
 
+    // Collects up to maxCount values that could be evicted (i.e: that are not referenced
+    // anywhere else), least-recently-used first, without removing them from the cache.
+    // The access records are updated with the same second chance as evict().
+    void getEvictionCandidates(std::size_t maxCount,
+                               std::list<std::pair<key_type,V> >* candidates)
+    {
+        std::size_t nToVisit = _container.size() * 2;
+        std::size_t nFound = 0;
+        typename container_type::right_iterator it = _container.right.begin();
+        while ( it != _container.right.end() && nToVisit > 0 && nFound < maxCount ) {
+            --nToVisit;
+            if ( wasAccessed(it->first) ) {
+                typename container_type::right_iterator next = it;
+                ++next;
+                _container.right.relocate(_container.right.end(),it);
+                it = next;
+                continue;
+            }
+            for (typename std::list<V>::iterator it2 = it->first.begin();
+                 it2 != it->first.end() && nFound < maxCount;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    candidates->push_back( std::make_pair(it->second,*it2) );
+                    ++nFound;
+                }
+            }
+            ++it;
+        }
+    }
+
+    // Removes the value v from the record of k, returns false if it could not be found
+    bool remove(const key_type & k,
+                const V & v)
+    {
+        typename container_type::left_iterator it = _container.left.find(k);
+        if ( it == _container.left.end() ) {
+            return false;
+        }
+        for (typename std::list<V>::iterator it2 = it->second.begin();
+             it2 != it->second.end();
+             ++it2) {
+            if (*it2 == v) {
+                if (it->second.size() == 1) {
+                    _container.left.erase(it);
+                } else {
+                    it->second.erase(it2);
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     unsigned int size()
     {
         return _container.size();
     }
 
 private:
+
+    // Clears the access bit of all values of a record, returns true if any was set
+    static bool wasAccessed(std::list<V> & values)
+    {
+        bool ret = false;
+        for (typename std::list<V>::iterator it = values.begin(); it != values.end(); ++it) {
+            if ( (*it)->testAndClearAccessed() ) {
+                ret = true;
+            }
+        }
+        return ret;
+    }
+
     container_type _container;
 };
 
@@ -576,6 +932,13 @@ public:
         return it;
     }
 
+    // Find the value for k without updating the access record: this does not
+    // modify the container and can be called concurrently by several readers.
+    typename container_type::left_iterator find(const key_type & k)
+    {
+        return _container.left.find(k);
+    }
+
     void erase(typename container_type::left_iterator it)
     {
         _container.left.erase(it);
@@ -621,10 +984,23 @@ public:
         _container.clear();
     }
 
+    // Purge the least-recently-used element in the cache.
+    // Records whose values were marked accessed since they were last visited
+    // are given a second chance (CLOCK): their access bit is cleared and they
+    // are moved to the most-recently-used end of the list.
     std::pair<key_type,V> evict()
     {
+        std::size_t nToVisit = _container.size() * 2;
         typename container_type::right_iterator it = _container.right.begin();
-        while ( it != _container.right.end() ) {
+        while ( it != _container.right.end() && nToVisit > 0 ) {
+            --nToVisit;
+            if ( wasAccessed(it->first) ) {
+                typename container_type::right_iterator next = it;
+                ++next;
+                _container.right.relocate(_container.right.end(),it);
+                it = next;
+                continue;
+            }
             for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end(); ++it2) {
                 if ( (*it2).use_count() == 1 ) {
                     std::pair<key_type,V> ret = std::make_pair(it->second,*it2);
@@ -643,12 +1019,80 @@ public:
         return std::make_pair( key_type(),V() );
     }
 
+    // Collects up to maxCount values that could be evicted (i.e: that are not referenced
+    // anywhere else), least-recently-used first, without removing them from the cache.
+    // The access records are updated with the same second chance as evict().
+    void getEvictionCandidates(std::size_t maxCount,
+                               std::list<std::pair<key_type,V> >* candidates)
+    {
+        std::size_t nToVisit = _container.size() * 2;
+        std::size_t nFound = 0;
+        typename container_type::right_iterator it = _container.right.begin();
+        while ( it != _container.right.end() && nToVisit > 0 && nFound < maxCount ) {
+            --nToVisit;
+            if ( wasAccessed(it->first) ) {
+                typename container_type::right_iterator next = it;
+                ++next;
+                _container.right.relocate(_container.right.end(),it);
+                it = next;
+                continue;
+            }
+            for (typename std::list<V>::iterator it2 = it->first.begin();
+                 it2 != it->first.end() && nFound < maxCount;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    candidates->push_back( std::make_pair(it->second,*it2) );
+                    ++nFound;
+                }
+            }
+            ++it;
+        }
+    }
+
+    // Removes the value v from the record of k, returns false if it could not be found
+    bool remove(const key_type & k,
+                const V & v)
+    {
+        typename container_type::left_iterator it = _container.left.find(k);
+        if ( it == _container.left.end() ) {
+            return false;
+        }
+        for (typename std::list<V>::iterator it2 = it->second.begin();
+             it2 != it->second.end();
+             ++it2) {
+            if (*it2 == v) {
+                if (it->second.size() == 1) {
+                    _container.left.erase(it);
+                } else {
+                    it->second.erase(it2);
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     unsigned int size()
     {
         return _container.size();
     }
 
 private:
+
+    // Clears the access bit of all values of a record, returns true if any was set
+    static bool wasAccessed(std::list<V> & values)
+    {
+        bool ret = false;
+        for (typename std::list<V>::iterator it = values.begin(); it != values.end(); ++it) {
+            if ( (*it)->testAndClearAccessed() ) {
+                ret = true;
+            }
+        }
+        return ret;
+    }
+
     container_type _container;
 };
 
@@ -11,8 +11,11 @@
 
 #include "Lut.h"
 
+#include <algorithm>
 #include <cstring> // for memcpy
+#include <vector>
 
+#include "Engine/ImageSIMD.h"
 #include "Engine/Rect.h"
 
 namespace Natron {
@@ -269,6 +272,58 @@ Lut::toColorSpaceUint16FromLinearFloatFast(float v) const
     return (v8u_prev << 8) + v8u_prev + (v - v32f_prev) * ( ( (v8u_next - v8u_prev) << 8 ) + (v8u_next + v8u_prev) ) / (v32f_next - v32f_prev) + 0.5;
 }
 
+void
+Lut::toColorSpaceUint8FromLinearFloatFast(const float* from,
+                                          unsigned char* to,
+                                          int count) const
+{
+    assert(init_);
+    ///convert by chunks so that the intermediate values stay on the stack
+    unsigned short buf[256];
+    for (int i = 0; i < count; i += 256) {
+        int n = std::min(256, count - i);
+        toColorSpaceUint8xxFromLinearFloatFast(from + i, buf, n);
+        for (int j = 0; j < n; ++j) {
+            to[i + j] = Color::uint8xxToChar(buf[j]);
+        }
+    }
+}
+
+void
+Lut::toColorSpaceUint8xxFromLinearFloatFast(const float* from,
+                                            unsigned short* to,
+                                            int count) const
+{
+    assert(init_);
+    int done = ImageSIMD::lookupByFloatHighBits(toFunc_hipart_to_uint8xx, from, to, count);
+    for (int i = done; i < count; ++i) {
+        to[i] = toFunc_hipart_to_uint8xx[hipart(from[i])];
+    }
+}
+
+void
+Lut::fromColorSpaceUint8ToLinearFloatFast(const unsigned char* from,
+                                          float* to,
+                                          int count) const
+{
+    assert(init_);
+    int done = ImageSIMD::lookupByByte(fromFunc_uint8_to_float, from, to, count);
+    for (int i = done; i < count; ++i) {
+        to[i] = fromFunc_uint8_to_float[from[i]];
+    }
+}
+
+void
+Lut::fromColorSpaceUint16ToLinearFloatFast(const unsigned short* from,
+                                           float* to,
+                                           int count) const
+{
+    assert(init_);
+    for (int i = 0; i < count; ++i) {
+        to[i] = fromColorSpaceUint16ToLinearFloatFast(from[i]);
+    }
+}
+
 float
 Lut::fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const
 {
@@ -423,8 +478,16 @@ Lut::to_byte_packed(unsigned char* to,
 
     validate();
 
+    const int width = rect.x2 - rect.x1;
+    ///the rows are premultiplied and looked-up at once, the error diffusion only reads the looked-up values
+    std::vector<float> premultRow;
+    if (inputHasAlpha && premult) {
+        premultRow.resize(width * inPackingSize);
+    }
+    std::vector<unsigned short> rowValues(width * inPackingSize);
+
     for (int y = rect.y1; y < rect.y2; ++y) {
-        int start = rand() % (rect.x2 - rect.x1) + rect.x1;
+        int start = ditherStartColumn(y, width) + rect.x1;
         unsigned error_r, error_g, error_b;
         error_r = error_g = error_b = 0x80;
         int srcY = y;
@@ -436,19 +499,33 @@ Lut::to_byte_packed(unsigned char* to,
         int dstY = dstBounds.y2 - y - 1;
         const float *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
         unsigned char *dst_pixels = to + (dstY * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
+
+        const float* rowStart = src_pixels + rect.x1 * inPackingSize;
+        if (inputHasAlpha && premult) {
+            for (int i = 0; i < width * inPackingSize; i += inPackingSize) {
+                float a = rowStart[i + inAOffset];
+                for (int c = 0; c < inPackingSize; ++c) {
+                    premultRow[i + c] = rowStart[i + c] * a;
+                }
+            }
+            rowStart = &premultRow.front();
+        }
+        toColorSpaceUint8xxFromLinearFloatFast(rowStart, &rowValues.front(), width * inPackingSize);
+        const unsigned short* values = &rowValues.front() - rect.x1 * inPackingSize;
+
         /* go fowards from starting point to end of line: */
         for (int x = start; x < rect.x2; ++x) {
             int inCol = x * inPackingSize;
             int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
-            error_r = (error_r & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inROffset] * a)];
-            error_g = (error_g & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inGOffset] * a)];
-            error_b = (error_b & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inBOffset] * a)];
+            error_r = (error_r & 0xff) + values[inCol + inROffset];
+            error_g = (error_g & 0xff) + values[inCol + inGOffset];
+            error_b = (error_b & 0xff) + values[inCol + inBOffset];
             assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
             dst_pixels[outCol + outROffset] = (unsigned char)(error_r >> 8);
             dst_pixels[outCol + outGOffset] = (unsigned char)(error_g >> 8);
             dst_pixels[outCol + outBOffset] = (unsigned char)(error_b >> 8);
             if (outputHasAlpha) {
+                float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
                 dst_pixels[outCol + outAOffset] = floatToInt<256>(a);
             }
         }
@@ -457,15 +534,15 @@ Lut::to_byte_packed(unsigned char* to,
         for (int x = start - 1; x >= rect.x1; --x) {
             int inCol = x * inPackingSize;
             int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
-            error_r = (error_r & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inROffset] * a)];
-            error_g = (error_g & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inGOffset] * a)];
-            error_b = (error_b & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inBOffset] * a)];
+            error_r = (error_r & 0xff) + values[inCol + inROffset];
+            error_g = (error_g & 0xff) + values[inCol + inGOffset];
+            error_b = (error_b & 0xff) + values[inCol + inBOffset];
             assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
             dst_pixels[outCol + outROffset] = (unsigned char)(error_r >> 8);
             dst_pixels[outCol + outGOffset] = (unsigned char)(error_g >> 8);
             dst_pixels[outCol + outBOffset] = (unsigned char)(error_b >> 8);
             if (outputHasAlpha) {
+                float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
                 dst_pixels[outCol + outAOffset] = floatToInt<256>(a);
             }
         }
@@ -550,7 +627,9 @@ Lut::from_byte_planar(float* to,
                       int outDelta) const
 {
     validate();
-    if (!alpha) {
+    if ( !alpha && (inDelta == 1) && (outDelta == 1) ) {
+        fromColorSpaceUint8ToLinearFloatFast(from, to, W);
+    } else if (!alpha) {
         for (int f = 0,t = 0; f < W; f += inDelta, t += outDelta) {
             to[f] = fromFunc_uint8_to_float[(int)from[f]];
         }
@@ -627,6 +706,15 @@ Lut::from_byte_packed(float* to,
     outPackingSize = outputHasAlpha ? 4 : 3;
 
     validate();
+
+    ///without premultiplication the rows are looked-up at once
+    const bool lookupRows = !(inputHasAlpha && premult);
+    const int width = rect.x2 - rect.x1;
+    std::vector<float> rowValues;
+    if (lookupRows) {
+        rowValues.resize(width * inPackingSize);
+    }
+
     for (int y = rect.y1; y < rect.y2; ++y) {
         int srcY = y;
         if (invertY) {
@@ -635,6 +723,11 @@ Lut::from_byte_packed(float* to,
 
         const unsigned char *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
         float *dst_pixels = to + (y * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
+        const float* values = 0;
+        if (lookupRows) {
+            fromColorSpaceUint8ToLinearFloatFast(src_pixels + rect.x1 * inPackingSize, &rowValues.front(), width * inPackingSize);
+            values = &rowValues.front() - rect.x1 * inPackingSize;
+        }
         for (int x = rect.x1; x < rect.x2; ++x) {
             int inCol = x * inPackingSize;
             int outCol = x * outPackingSize;
@@ -654,14 +747,9 @@ Lut::from_byte_packed(float* to,
                     dst_pixels[outCol + outAOffset] = a;
                 }
             } else {
-                int r8 = 0, g8 = 0, b8 = 0;
-                r8 = src_pixels[inCol + inROffset];
-                g8 = src_pixels[inCol + inGOffset];
-                b8 = src_pixels[inCol + inBOffset];
-                assert(r8 >= 0 && r8 < 256 && g8 >= 0 && g8 < 256 && b8 >= 0 && b8 < 256);
-                dst_pixels[outCol + outROffset] = fromFunc_uint8_to_float[r8];
-                dst_pixels[outCol + outGOffset] = fromFunc_uint8_to_float[g8];
-                dst_pixels[outCol + outBOffset] = fromFunc_uint8_to_float[b8];
+                dst_pixels[outCol + outROffset] = values[inCol + inROffset];
+                dst_pixels[outCol + outGOffset] = values[inCol + inGOffset];
+                dst_pixels[outCol + outBOffset] = values[inCol + inBOffset];
                 if (outputHasAlpha) {
                     float a = Color::intToFloat<256>(src_pixels[inCol + inAOffset]);
                     dst_pixels[outCol + outAOffset] = a;
@@ -49,6 +49,7 @@
 #include "Global/Macros.h"
 CLANG_DIAG_OFF(deprecated)
 #include <QMutex>
+#include <QAtomicInt>
 CLANG_DIAG_ON(deprecated)
 
 
@@ -142,10 +143,10 @@ class Lut
 
     /// the fast lookup tables are mutable, because they are automatically initialized post-construction,
     /// and never change afterwards
-    mutable unsigned short toFunc_hipart_to_uint8xx[0x10000];         /// contains  2^16 = 65536 values between 0-255
+    mutable unsigned short toFunc_hipart_to_uint8xx[0x10000 + 1];         /// contains  2^16 = 65536 values between 0-255, plus one for the 32 bits gathers
     mutable float fromFunc_uint8_to_float[256];         /// values between 0-1.f
-    mutable bool init_;         ///< false if the tables are not yet initialized
-    mutable QMutex _lock;         ///< protects init_
+    mutable QAtomicInt init_;         ///< 0 if the tables are not yet initialized, read without the lock
+    mutable QMutex _lock;         ///< serializes fillTables()
 
     friend class LutManager;
     ///private constructor, used by LutManager
@@ -155,9 +156,10 @@ class Lut
         : _name(name)
           , _fromFunc(fromFunc)
           , _toFunc(toFunc)
-          , init_(false)
+          , init_(0)
           , _lock()
     {
+        toFunc_hipart_to_uint8xx[0x10000] = 0;
     }
 
     ///init luts
@@ -186,15 +188,20 @@ public:
     }
 
     //Called by all public members
+    //Once the tables are filled this does not lock: they never change afterwards
     void validate() const
     {
+        ///Acquire pairs with the release below, so that the tables are seen fully filled
+        if ( init_.testAndSetAcquire(1, 1) ) {
+            return;
+        }
         QMutexLocker g(&_lock);
 
-        if (init_) {
+        if ( (int)init_ ) {
             return;
         }
         fillTables();
-        init_ = true;
+        init_.fetchAndStoreRelease(1);
     }
 
     const std::string & getName() const
@@ -235,6 +242,16 @@ public:
      */
     float fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const;
 
+    /**
+     * @brief Same as the functions above for count contiguous values, e.g: a row of an image.
+     * They give the same results but use vectorized table look-ups when the CPU supports it.
+     * validate() must have been called before: they do not lock and can be called from any thread.
+     **/
+    void toColorSpaceUint8FromLinearFloatFast(const float* from, unsigned char* to, int count) const;
+    void toColorSpaceUint8xxFromLinearFloatFast(const float* from, unsigned short* to, int count) const;
+    void fromColorSpaceUint8ToLinearFloatFast(const unsigned char* from, float* to, int count) const;
+    void fromColorSpaceUint16ToLinearFloatFast(const unsigned short* from, float* to, int count) const;
+
 
     /////@TODO the following functions expects a float input buffer, one could extend it to cover all bitdepths.
 
@@ -498,6 +515,17 @@ to_func_srgb(float v)
     }
 }
 
+/// The error diffusion of a row starts at a pseudo-random column derived from the row index,
+/// so that the result does not depend on the thread doing the conversion (rand() is not reentrant)
+inline int
+ditherStartColumn(int y,
+                  int width)
+{
+    unsigned int h = (unsigned int)y * 2654435761U;
+
+    return (int)( (h >> 16) % (unsigned int)width );
+}
+
 /// convert RGB to HSV
 /// In Nuke's viewer, sRGB values are used (apply to_func_srgb to linear
 /// RGB values before calling this fuunction)
@@ -27,6 +27,7 @@
 #endif
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 
 #include "Global/Macros.h"
 
@@ -338,6 +339,66 @@ MemoryFile::flush()
 #endif
 }
 
+static size_t
+getPageSize()
+{
+#if defined(__NATRON_UNIX__)
+    static const size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+#elif defined(__NATRON_WIN32__)
+    static size_t pageSize = 0;
+    if (pageSize == 0) {
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        pageSize = info.dwPageSize;
+    }
+#endif
+
+    return pageSize;
+}
+
+bool
+MemoryFile::flush(size_t offset,
+                  size_t length)
+{
+    if ( !_imp->data || (offset >= _imp->size) ) {
+        return true;
+    }
+    length = std::min(length, _imp->size - offset);
+    size_t pageSize = getPageSize();
+    size_t begin = offset - (offset % pageSize);
+    length += offset - begin;
+#if defined(__NATRON_UNIX__)
+
+    return ::msync(_imp->data + begin, length, MS_SYNC) == 0;
+#elif defined(__NATRON_WIN32__)
+
+    return ::FlushViewOfFile(_imp->data + begin, length) != 0;
+#endif
+}
+
+void
+MemoryFile::discard(size_t offset,
+                    size_t length)
+{
+    if ( !_imp->data || (offset >= _imp->size) ) {
+        return;
+    }
+    length = std::min(length, _imp->size - offset);
+    size_t pageSize = getPageSize();
+    size_t begin = ( (offset + pageSize - 1) / pageSize ) * pageSize;
+    size_t end = ( (offset + length) / pageSize ) * pageSize;
+    if (end <= begin) {
+        return;
+    }
+#if defined(__NATRON_UNIX__)
+    ///The mapping is shared: dropping the pages does not lose any data, they are read back from the file on the next access
+    ::madvise(_imp->data + begin, end - begin, MADV_DONTNEED);
+#elif defined(__NATRON_WIN32__)
+    ///Unlocking pages that are not locked removes them from the working set of the process
+    ::VirtualUnlock(_imp->data + begin, end - begin);
+#endif
+}
+
 MemoryFile::~MemoryFile()
 {
     if (_imp->data) {
@@ -120,6 +120,19 @@ public:
      **/
     bool flush();
 
+    /**
+     * @brief Same as flush() but only for the given range of the file. The range is extended to the
+     * enclosing memory pages.
+     **/
+    bool flush(size_t offset,size_t length);
+
+    /**
+     * @brief Releases the memory pages of the given range without modifying the file: the data
+     * will be read again from the file when accessed. The range must have been flushed before.
+     * Only the pages entirely contained in the range are released.
+     **/
+    void discard(size_t offset,size_t length);
+
     /**
      * @brief Returns the filepath of the backing file.
      **/
@@ -23,6 +23,7 @@
 #include <ofxNatron.h>
 
 #include "Engine/Hash64.h"
+#include "Engine/HashPropagation.h"
 #include "Engine/Format.h"
 #include "Engine/ViewerInstance.h"
 #include "Engine/OfxHost.h"
@@ -494,68 +495,89 @@ Node::getHashValue() const
     return _imp->hash.value();
 }
 
-void
-Node::computeHash()
+bool
+Node::recomputeOwnHash()
 {
-    ///Always called in the main thread
-    assert( QThread::currentThread() == qApp->thread() );
     if (!_imp->inputsInitialized) {
         qDebug() << "Node::computeHash(): inputs not initialized";
     }
     
+    ///copy the inputs so that the hash can be computed from any thread
+    InputsV inputs;
     {
-        QWriteLocker l(&_imp->knobsAgeMutex);
-        
-        ///reset the hash value
-        _imp->hash.reset();
-        
-        ///append the effect's own age
-        _imp->hash.append(_imp->knobsAge);
+        QMutexLocker l(&_imp->inputsMutex);
+        inputs = _imp->inputs;
+    }
+    
+    ///compute the new hash before taking the lock: the hash of the inputs is read with their own lock
+    Hash64 hash;
+    U64 knobsAge;
+    {
+        QReadLocker l(&_imp->knobsAgeMutex);
+        knobsAge = _imp->knobsAge;
+    }
+    
+    ///append the effect's own age
+    hash.append(knobsAge);
+    
+    ///append all inputs hash
+    {
+        ViewerInstance* isViewer = dynamic_cast<ViewerInstance*>(_imp->liveInstance);
         
-        ///append all inputs hash
-        {
-            ViewerInstance* isViewer = dynamic_cast<ViewerInstance*>(_imp->liveInstance);
+        if (isViewer) {
+            int activeInput[2];
+            isViewer->getActiveInputs(activeInput[0], activeInput[1]);
             
-            if (isViewer) {
-                int activeInput[2];
-                isViewer->getActiveInputs(activeInput[0], activeInput[1]);
-                
-                for (int i = 0; i < 2; ++i) {
-                    if ( (activeInput[i] >= 0) && _imp->inputs[activeInput[i]] ) {
-                        _imp->hash.append( _imp->inputs[activeInput[i]]->getHashValue() );
-                    }
+            for (int i = 0; i < 2; ++i) {
+                if ( (activeInput[i] >= 0) && inputs[activeInput[i]] ) {
+                    hash.append( inputs[activeInput[i]]->getHashValue() );
                 }
-            } else {
-                for (U32 i = 0; i < _imp->inputs.size(); ++i) {
-                    if (_imp->inputs[i]) {
-                        ///Add the index of the input to its hash.
-                        ///Explanation: if we didn't add this, just switching inputs would produce a similar
-                        ///hash.
-                        _imp->hash.append(_imp->inputs[i]->getHashValue() + i);
-                    }
+            }
+        } else {
+            for (U32 i = 0; i < inputs.size(); ++i) {
+                if (inputs[i]) {
+                    ///Add the index of the input to its hash.
+                    ///Explanation: if we didn't add this, just switching inputs would produce a similar
+                    ///hash.
+                    hash.append(inputs[i]->getHashValue() + i);
                 }
             }
         }
-        
-        ///Also append the effect's label to distinguish 2 instances with the same parameters
-        ::Hash64_appendQString( &_imp->hash, QString( getName().c_str() ) );
-        
-        
-        ///Also append the project's creation time in the hash because 2 projects openend concurrently
-        ///could reproduce the same (especially simple graphs like Viewer-Reader)
-        qint64 creationTime =  getApp()->getProject()->getProjectCreationTime();
-        _imp->hash.append(creationTime);
-        
-        _imp->hash.computeHash();
     }
     
-    ///call it on all the outputs
-    for (std::list<Node*>::iterator it = _imp->outputs.begin(); it != _imp->outputs.end(); ++it) {
-        assert(*it);
-        (*it)->computeHash();
+    ///Also append the effect's label to distinguish 2 instances with the same parameters
+    ::Hash64_appendQString( &hash, QString( getName_mt_safe().c_str() ) );
+    
+    
+    ///Also append the project's creation time in the hash because 2 projects openend concurrently
+    ///could reproduce the same (especially simple graphs like Viewer-Reader)
+    qint64 creationTime =  getApp()->getProject()->getProjectCreationTime();
+    hash.append(creationTime);
+    
+    hash.computeHash();
+    
+    QWriteLocker l(&_imp->knobsAgeMutex);
+    bool changed = hash.value() != _imp->hash.value();
+    _imp->hash = hash;
+    
+    return changed;
+} // recomputeOwnHash
+
+///Only one hash update runs at a time, so that 2 threads cannot hash the same nodes in different orders
+static QMutex hashUpdateMutex;
+
+void
+Node::computeHash()
+{
+    std::list<Node*> changed;
+    {
+        QMutexLocker l(&hashUpdateMutex);
+        HashPropagation::updateDownstreamHashes(this, &changed);
     }
-    _imp->liveInstance->onNodeHashChanged(getHashValue());
     
+    for (std::list<Node*>::iterator it = changed.begin(); it != changed.end(); ++it) {
+        (*it)->_imp->liveInstance->onNodeHashChanged( (*it)->getHashValue() );
+    }
 } // computeHash
 
 void
@@ -2701,6 +2723,7 @@ Node::registerPluginMemory(size_t nBytes)
         QMutexLocker l(&_imp->memoryUsedMutex);
         _imp->pluginInstanceMemoryUsed += nBytes;
     }
+    appPTR->notifyRenderMemoryAllocated(nBytes);
     emit pluginMemoryUsageChanged(nBytes);
 }
 
@@ -2711,6 +2734,7 @@ Node::unregisterPluginMemory(size_t nBytes)
         QMutexLocker l(&_imp->memoryUsedMutex);
         _imp->pluginInstanceMemoryUsed -= nBytes;
     }
+    appPTR->notifyRenderMemoryFreed(nBytes);
     emit pluginMemoryUsageChanged(-nBytes);
 }
 
@@ -863,11 +863,19 @@ protected:
     bool checkIfConnectingInputIsOk(Natron::Node* input) const;
 
     /**
-     * @brief Recompute the hash value of this node and notify all the clone effects that the values they store in their
-     * knobs is dirty and that they should refresh it by cloning the live instance.
+     * @brief Recompute the hash value of this node and of the nodes downstream and notify all the clone effects that
+     * the values they store in their knobs is dirty and that they should refresh it by cloning the live instance.
+     * Each node downstream is visited once, in topological order, and only if the hash of one of its inputs changed.
+     * MT-safe.
      **/
     void computeHash();
 
+    /**
+     * @brief Recompute the hash value of this node only, from the current hash of its inputs.
+     * Returns true if it changed. You should call computeHash() instead, @see HashPropagation.
+     **/
+    bool recomputeOwnHash();
+
 private:
     
     std::string makeInfoForInput(int inputNumber) const;
@@ -735,7 +735,7 @@ OfxImage::OfxImage(boost::shared_ptr<Natron::Image> internalImage,
    
     
     // data ptr
-    const RectI & bounds = internalImage->getBounds();
+    RectI bounds = internalImage->getBounds();
     
     ///Do not activate this assert! The render window passed to renderRoI can be bigger than the actual RoD of the effect
     ///in which case it is just clipped to the RoD.
@@ -743,8 +743,30 @@ OfxImage::OfxImage(boost::shared_ptr<Natron::Image> internalImage,
     RectI pluginsSeenBounds;
     renderWindow.intersect(bounds, &pluginsSeenBounds);
     
+    ///Plug-ins expect rows of pixels with a constant stride: a window within a single tile of a tiled image
+    ///is handed out in place with the stride of the tile. Only an input window spanning several tiles is copied,
+    ///the output window always lies within a tile (see EffectInstance::tiledRenderingFunctor)
+    if ( internalImage->isTiled() ) {
+        RectI tileBounds = internalImage->getTileBounds( pluginsSeenBounds.left(), pluginsSeenBounds.bottom() );
+        if ( tileBounds.contains(pluginsSeenBounds) ) {
+            bounds = tileBounds;
+        } else {
+            assert( !clip.isOutput() );
+            internalImage = internalImage->makeContiguousView(pluginsSeenBounds);
+            _floatImage = internalImage;
+            bounds = internalImage->getBounds();
+        }
+    }
+    
     const RectD & rod = internalImage->getRoD(); // Not the OFX RoD!!! Natron::Image::getRoD() is in *CANONICAL* coordinates
-    unsigned char* ptr = internalImage->pixelAt( pluginsSeenBounds.left(), pluginsSeenBounds.bottom() );
+    unsigned char* ptr;
+    if ( clip.isOutput() ) {
+        ptr = internalImage->pixelAt( pluginsSeenBounds.left(), pluginsSeenBounds.bottom() );
+    } else {
+        ///Inputs are only read: do not allocate the tiles that were not rendered
+        const Natron::Image* inputImage = internalImage.get();
+        ptr = const_cast<unsigned char*>( inputImage->pixelAt( pluginsSeenBounds.left(), pluginsSeenBounds.bottom() ) );
+    }
     setPointerProperty( kOfxImagePropData, ptr);
     
     ///We set the render window that was given to the render thread instead of the actual bounds of the image
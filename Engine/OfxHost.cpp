@@ -26,7 +26,6 @@ CLANG_DIAG_ON(deprecated-register)
 #ifdef OFX_SUPPORTS_MULTITHREAD
 #include <QtCore/QThread>
 #include <QtCore/QThreadStorage>
-#include <QtConcurrentMap>
 #include <boost/bind.hpp>
 #endif
 
@@ -58,6 +57,7 @@ CLANG_DIAG_ON(deprecated-register)
 #include "Engine/KnobTypes.h"
 #include "Engine/Plugin.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/Settings.h"
 #include "Engine/Node.h"
 
@@ -666,8 +666,8 @@ Natron::OfxHost::setThreadAsActionCaller(bool actionCaller)
 
 namespace {
     
-///Using QtConcurrent doesn't work with The Foundry Furnace plug-ins because they expect fresh threads
-///to be created. As QtConcurrent's thread-pool recycles thread, it seems to make Furnace crash.
+///Using a thread-pool doesn't work with The Foundry Furnace plug-ins because they expect fresh threads
+///to be created. As the TaskScheduler recycles threads, it seems to make Furnace crash.
 ///We think this is because Furnace must keep an internal thread-local state that becomes then dirty
 ///if we re-use the same thread.
 
@@ -696,6 +696,17 @@ threadFunctionWrapper(OfxThreadFunctionV1 func,
     return ret;
 }
 
+///A task of the TaskScheduler calling func for the thread index i
+static void
+threadTask(OfxThreadFunctionV1 func,
+           unsigned int threadMax,
+           void *customArg,
+           std::vector<OfxStatus>* status,
+           int i)
+{
+    (*status)[i] = threadFunctionWrapper(func, i, threadMax, customArg);
+}
+
     
 
     
@@ -789,19 +800,12 @@ Natron::OfxHost::multiThread(OfxThreadFunctionV1 func,
     
     if (useThreadPool) {
         
-        std::vector<unsigned int> threadIndexes(nThreads);
-        for (unsigned int i = 0; i < nThreads; ++i) {
-            threadIndexes[i] = i;
-        }
-        
-        /// DON'T set the maximum thread count, this is a global application setting, and see the documentation excerpt above
-        //QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
-        QFuture<OfxStatus> future = QtConcurrent::mapped( threadIndexes, boost::bind(::threadFunctionWrapper,func, _1, nThreads, customArg) );
-        future.waitForFinished();
-        ///DON'T reset back to the original value the maximum thread count
-        //QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+        ///the calling thread runs some of the threads functions too: a plug-in calling multiThread from a
+        ///thread of the scheduler cannot wait for the other threads to be free
+        std::vector<OfxStatus> status(nThreads, kOfxStatOK);
+        Natron::TaskScheduler::globalInstance()->parallelFor( nThreads, boost::bind(::threadTask, func, nThreads, customArg, &status, _1) );
         
-        for (QFuture<OfxStatus>::const_iterator it = future.begin(); it != future.end(); ++it) {
+        for (std::vector<OfxStatus>::const_iterator it = status.begin(); it != status.end(); ++it) {
             OfxStatus stat = *it;
             if (stat != kOfxStatOK) {
                 return stat;
@@ -874,21 +878,6 @@ Natron::OfxHost::multiThreadNumCPUS(unsigned int *nCPUs) const
     if (nThreadsToRender == -1) {
         *nCPUs = 1;
     } else {
-        // activeThreadCount may be negative (for example if releaseThread() is called)
-        int activeThreadsCount = QThreadPool::globalInstance()->activeThreadCount();
-        
-        // Add the number of threads already running by the multiThreadSuite + parallel renders
-        activeThreadsCount += appPTR->getNRunningThreads();
-        
-        // Clamp to 0
-        activeThreadsCount = std::max( 0, activeThreadsCount);
-        
-        assert(activeThreadsCount >= 0);
-        
-        // better than QThread::idealThreadCount();, because it can be set by a global preference:
-        int maxThreadsCount = QThreadPool::globalInstance()->maxThreadCount();
-        assert(maxThreadsCount >= 0);
-        
         if (nThreadsPerEffect == 0) {
             ///Simple heuristic: limit 1 effect to start at most 8 threads because otherwise it might spend too much
             ///time scheduling than just processing
@@ -902,9 +891,32 @@ Natron::OfxHost::multiThreadNumCPUS(unsigned int *nCPUs) const
                 nThreadsPerEffect = 4;
             }
         }
-        ///+1 because the current thread is going to wait during the multiThread call so we're better off
-        ///not counting it.
-        *nCPUs = std::max(1,std::min(maxThreadsCount - activeThreadsCount + 1, nThreadsPerEffect));
+        
+        if ( appPTR->getUseThreadPool() ) {
+            ///The threads are tasks of the TaskScheduler: they don't need free threads because the thread calling
+            ///multiThread runs them too, +1 for this thread.
+            int maxThreadsCount = Natron::TaskScheduler::globalInstance()->getMaxThreadCount() + 1;
+            *nCPUs = std::max( 1, std::min(maxThreadsCount, nThreadsPerEffect) );
+        } else {
+            // activeThreadCount may be negative (for example if releaseThread() is called)
+            int activeThreadsCount = QThreadPool::globalInstance()->activeThreadCount();
+            
+            // Add the number of threads already running by the multiThreadSuite + parallel renders
+            activeThreadsCount += appPTR->getNRunningThreads();
+            
+            // Clamp to 0
+            activeThreadsCount = std::max( 0, activeThreadsCount);
+            
+            assert(activeThreadsCount >= 0);
+            
+            // better than QThread::idealThreadCount();, because it can be set by a global preference:
+            int maxThreadsCount = QThreadPool::globalInstance()->maxThreadCount();
+            assert(maxThreadsCount >= 0);
+            
+            ///+1 because the current thread is going to wait during the multiThread call so we're better off
+            ///not counting it.
+            *nCPUs = std::max(1,std::min(maxThreadsCount - activeThreadsCount + 1, nThreadsPerEffect));
+        }
     }
 
     return kOfxStatOK;
@@ -35,6 +35,7 @@
 #include "Engine/Node.h"
 #include "Engine/OpenGLViewerI.h"
 #include "Engine/Project.h"
+#include "Engine/RenderMemoryCounter.h"
 #include "Engine/Settings.h"
 #include "Engine/Timer.h"
 #include "Engine/TimeLine.h"
@@ -43,6 +44,9 @@
 
 #define NATRON_FPS_REFRESH_RATE_SECONDS 1.5
 
+///Weight of the last frame in the moving average of the memory needed by a frame, when it needed less than the average
+#define NATRON_FRAME_MEMORY_ESTIMATE_DECAY 0.25
+
 
 using namespace Natron;
 
@@ -196,6 +200,12 @@ struct OutputSchedulerThreadPrivate
     
     ///Render threads wait in this condition and the scheduler wake them when it needs to render some frames
     QWaitCondition framesToRenderNotEmptyCond;
+    
+    ///Admission control: the memory needed by a frame is estimated from the peak memory held by the previous frames
+    ///so that no more frames are rendered in parallel than what fits in AppManager::getRenderMemoryBudget()
+    double frameMemoryEstimate; //< 0 until a frame was rendered
+    int reportedParallelRenders; //< the last number of parallel renders reported, 0 if none was
+    mutable QMutex frameMemoryMutex; //< protects the 2 above
 
     
     Natron::OutputEffectInstance* outputEffect; //< The effect used as output device
@@ -239,6 +249,9 @@ struct OutputSchedulerThreadPrivate
     , framesToRender()
     , lastFramePushedIndex(0)
     , framesToRenderNotEmptyCond()
+    , frameMemoryEstimate(0.)
+    , reportedParallelRenders(0)
+    , frameMemoryMutex()
     , outputEffect(effect)
     , engine(engine)
     {
@@ -309,6 +322,49 @@ struct OutputSchedulerThreadPrivate
     }
     
 
+    /**
+     * @brief Called once a render thread rendered a frame, with the peak of the memory its RenderMemoryCounter saw.
+     * The estimate follows increases right away and decreases slowly so that it is close to the largest frames.
+     **/
+    void updateFrameMemoryEstimate(std::size_t framePeakMemory)
+    {
+        QMutexLocker l(&frameMemoryMutex);
+        double frameMemory = (double)framePeakMemory;
+        if (frameMemory >= frameMemoryEstimate) {
+            frameMemoryEstimate = frameMemory;
+        } else {
+            frameMemoryEstimate += (frameMemory - frameMemoryEstimate) * NATRON_FRAME_MEMORY_ESTIMATE_DECAY;
+        }
+    }
+    
+    void resetParallelRendersReport()
+    {
+        QMutexLocker l(&frameMemoryMutex);
+        reportedParallelRenders = 0;
+    }
+    
+    int getMaxParallelRendersInMemoryBudget() const
+    {
+        QMutexLocker l(&frameMemoryMutex);
+        return OutputSchedulerThread::getMaxParallelRendersInMemoryBudget(appPTR->getRenderMemoryBudget(), frameMemoryEstimate);
+    }
+    
+    /**
+     * @brief Returns the number of render threads that were not asked to quit
+     **/
+    int getNRenderThreadsNotQuitting() const
+    {
+        ///Private shouldn't lock
+        assert( !renderThreadsMutex.tryLock() );
+        int ret = 0;
+        for (RenderThreads::const_iterator it = renderThreads.begin() ; it!=renderThreads.end();++it) {
+            if ( !it->thread->mustQuit() ) {
+                ++ret;
+            }
+        }
+        return ret;
+    }
+    
     int getNBufferedFrames() const {
         QMutexLocker l(&bufMutex);
         return buf.size();
@@ -741,6 +797,9 @@ OutputSchedulerThread::startRender()
     
     aboutToStartRender();
     
+    ///Report the number of parallel renders chosen for this render, the estimate of the memory of a frame is kept
+    _imp->resetParallelRendersReport();
+    
     ///Flag that we're now doing work
     {
         QMutexLocker l(&_imp->workingMutex);
@@ -1122,7 +1181,21 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads)
         optimalNThreads = userSettingParallelThreads;
     }
     optimalNThreads = std::max(1,optimalNThreads);
-
+    
+    ///Do not render more frames in parallel than what fits in memory, otherwise the cache keeps evicting the images
+    ///of the frames being rendered and the system swaps
+    int memoryBoundNThreads = _imp->getMaxParallelRendersInMemoryBudget();
+    bool limitedByMemory = memoryBoundNThreads < optimalNThreads;
+    if (limitedByMemory) {
+        optimalNThreads = memoryBoundNThreads;
+    }
+    reportParallelRendersCount(optimalNThreads, limitedByMemory);
+    
+    int parallelRendersNotQuitting;
+    {
+        QMutexLocker l(&_imp->renderThreadsMutex);
+        parallelRendersNotQuitting = _imp->getNRenderThreadsNotQuitting();
+    }
 
     if (runningThreads < optimalNThreads && currentParallelRenders < optimalNThreads) {
      
@@ -1133,6 +1206,12 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads)
         _imp->appendRunnable(createRunnable());
         *newNThreads = currentParallelRenders +  1;
         
+    } else if (limitedByMemory && parallelRendersNotQuitting > optimalNThreads) {
+        ////////
+        ///Stop the threads exceeding the memory budget right away, they will quit once their current frame is rendered
+        stopRenderThreads(parallelRendersNotQuitting - optimalNThreads);
+        *newNThreads = optimalNThreads;
+        
     } else if (runningThreads > optimalNThreads && currentParallelRenders > optimalNThreads) {
         ////////
         ///Stop 1 thread
@@ -1146,6 +1225,62 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads)
     }
 }
 
+void
+OutputSchedulerThread::reportParallelRendersCount(int nThreads,
+                                                  bool limitedByMemory)
+{
+    double frameMemory;
+    {
+        QMutexLocker l(&_imp->frameMemoryMutex);
+        ///Only report changes due to the memory budget
+        if ( (_imp->reportedParallelRenders == nThreads) || (!limitedByMemory && _imp->reportedParallelRenders == 0) ) {
+            return;
+        }
+        _imp->reportedParallelRenders = nThreads;
+        frameMemory = _imp->frameMemoryEstimate;
+    }
+    _imp->engine->s_parallelRendersChanged(nThreads, frameMemory);
+    if ( appPTR->isBackground() ) {
+        QString longMessage = QObject::tr("%1 frame(s) rendered in parallel, a frame needs about %2 of the %3 available to the renders")
+                              .arg(nThreads)
+                              .arg( printAsRAM( (U64)frameMemory ) )
+                              .arg( printAsRAM( appPTR->getRenderMemoryBudget() ) );
+        QString shortMessage = QString::number(nThreads) + ' ' + QString::number( (qulonglong)frameMemory );
+        appPTR->writeToOutputPipe(kParallelRendersChangedStringLong + longMessage,kParallelRendersChangedStringShort + shortMessage);
+    }
+}
+
+double
+OutputSchedulerThread::getEstimatedFrameMemory() const
+{
+    QMutexLocker l(&_imp->frameMemoryMutex);
+    return _imp->frameMemoryEstimate;
+}
+
+int
+OutputSchedulerThread::getMaxParallelRendersInMemoryBudget() const
+{
+    return _imp->getMaxParallelRendersInMemoryBudget();
+}
+
+int
+OutputSchedulerThread::getMaxParallelRendersInMemoryBudget(std::size_t budget,
+                                                           double frameMemory)
+{
+    if (frameMemory <= 0.) {
+        return INT_MAX;
+    }
+    double nFrames = (double)budget / frameMemory;
+    
+    return nFrames >= INT_MAX ? INT_MAX : std::max(1,(int)nFrames);
+}
+
+void
+OutputSchedulerThread::notifyFrameMemoryUsed(std::size_t framePeakMemory)
+{
+    _imp->updateFrameMemoryEstimate(framePeakMemory);
+}
+
 void
 OutputSchedulerThread::notifyFrameRendered(int frame,
                                            Natron::SchedulingPolicyEnum policy)
@@ -1631,7 +1766,13 @@ RenderThreadTask::run()
             break;
         }
         
-        renderFrame(time);
+        ///Count the memory held by this frame, including what the threads rendering its tiles allocate
+        boost::shared_ptr<RenderMemoryCounter> memoryCounter(new RenderMemoryCounter);
+        {
+            RenderMemoryCounterSetter counterSetter(memoryCounter);
+            renderFrame(time);
+        }
+        _imp->scheduler->notifyFrameMemoryUsed( memoryCounter->getPeakMemory() );
         
         if ( mustQuit() ) {
             break;
@@ -222,6 +222,21 @@ public:
      **/
     int getNActiveRenderThreads() const;
     
+    /**
+     * @brief Returns the memory a frame is expected to need, estimated from the peak memory held by the previous frames,
+     * or 0 if no frame was rendered yet.
+     **/
+    double getEstimatedFrameMemory() const;
+    
+    /**
+     * @brief Returns how many frames can be rendered in parallel without exceeding AppManager::getRenderMemoryBudget(),
+     * INT_MAX if the memory of a frame is not known yet.
+     **/
+    int getMaxParallelRendersInMemoryBudget() const;
+    
+    ///Returns how many frames needing frameMemory bytes each fit in budget bytes, at least 1, INT_MAX if frameMemory is 0
+    static int getMaxParallelRendersInMemoryBudget(std::size_t budget,double frameMemory);
+    
     /**
      * @brief Called by render-threads to pick some work to do or to get asleep if theres nothing to do
      **/
@@ -401,11 +416,23 @@ private:
     void pushAllFrameRange();
     
     /**
-     * @brief Starts/stops more threads according to CPU activity and user preferences 
+     * @brief Starts/stops more threads according to CPU activity, user preferences and the memory needed by the frames:
+     * no more frames are rendered in parallel than what fits in the memory budget.
      * @param optimalNThreads[out] Will be set to the new number of threads
      **/
     void adjustNumberOfThreads(int* newNThreads);
     
+    /**
+     * @brief Called by the render threads once they rendered a frame, with the peak of the memory the frame held
+     **/
+    void notifyFrameMemoryUsed(std::size_t framePeakMemory);
+    
+    /**
+     * @brief Reports the number of frames rendered in parallel when the memory budget changes it: on the standard output
+     * in background mode, in the debug output otherwise.
+     **/
+    void reportParallelRendersCount(int nThreads,bool limitedByMemory);
+    
     /**
      * @brief Make nThreadsToStop quit running. If 0 then all threads will be destroyed.
      **/
@@ -657,6 +684,12 @@ signals:
      * This will not be emitted after calling renderCurrentFrame
      **/
     void renderFinished(int retCode);
+    
+    /**
+     * @brief Emitted when the number of frames rendered in parallel changes because of the memory budget of the renders.
+     * frameMemory is the estimated memory in bytes needed to render a frame.
+     **/
+    void parallelRendersChanged(int parallelRenders,double frameMemory);
 
     /**
     * @brief Emitted when gui is frozen and rendering is finished to update all knobs
@@ -679,6 +712,7 @@ private:
     void s_fpsChanged(double actual,double desired) { emit fpsChanged(actual, desired); }
     void s_frameRendered(int time) { emit frameRendered(time); }
     void s_renderFinished(int retCode) { emit renderFinished(retCode); }
+    void s_parallelRendersChanged(int parallelRenders,double frameMemory) { emit parallelRendersChanged(parallelRenders, frameMemory); }
     void s_refreshAllKnobs() { emit refreshAllKnobs(); }
     boost::scoped_ptr<RenderEnginePrivate> _imp;
 };
@@ -19,6 +19,7 @@
 #include <QMutex>
 #include <QDir>
 #include <QDebug>
+#include <QStringList>
 
 #include "Engine/AppInstance.h"
 #include "Engine/AppManager.h"
@@ -126,6 +127,12 @@ ProcessHandler::onDataWrittenToSocket()
     } else if ( str.startsWith(kProgressChangedStringShort) ) {
         str = str.remove(kProgressChangedStringShort);
         emit frameProgress( str.toInt() );
+    } else if ( str.startsWith(kParallelRendersChangedStringShort) ) {
+        str = str.remove(kParallelRendersChangedStringShort);
+        QStringList values = str.split(' ');
+        if (values.size() == 2) {
+            emit parallelRendersChanged( values[0].toInt(), values[1].toDouble() );
+        }
     } else if ( str.startsWith(kBgProcessServerCreatedShort) ) {
         str = str.remove(kBgProcessServerCreatedShort);
         ///the bg process wants us to create the pipe for its input
@@ -161,6 +161,9 @@ signals:
 
     void frameProgress(int);
 
+    ///The number of frames rendered in parallel and the estimated memory of a frame in bytes
+    void parallelRendersChanged(int,double);
+
     void processCanceled();
 
     /**
@@ -11,6 +11,7 @@
 #include "Project.h"
 
 #include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <cstdlib> // strtoul
 #include <cerrno> // errno
@@ -33,6 +34,8 @@
 #include <QHostInfo>
 #include <QFileInfo>
 
+#include <boost/scoped_ptr.hpp>
+
 
 #include "Engine/AppManager.h"
 #include "Engine/AppInstance.h"
@@ -42,6 +45,7 @@
 #include "Engine/Node.h"
 #include "Engine/ViewerInstance.h"
 #include "Engine/ProjectSerialization.h"
+#include "Engine/ProjectBinarySerialization.h"
 #include "Engine/Settings.h"
 #include "Engine/KnobFile.h"
 #include "Engine/StandardPaths.h"
@@ -192,10 +196,11 @@ Project::loadProjectInternal(const QString & path,
     }
     
     bool ret = false;
+    bool isBinary = Natron::isBinaryProjectFile( filePath.toStdString() );
     std::ifstream ifile;
     try {
         ifile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        ifile.open(filePath.toStdString().c_str(),std::ifstream::in);
+        ifile.open(filePath.toStdString().c_str(),isBinary ? std::ifstream::in | std::ifstream::binary : std::ifstream::in);
     } catch (const std::ifstream::failure & e) {
         throw std::runtime_error( std::string("Exception occured when opening file ") + filePath.toStdString() + ": " + e.what() );
     }
@@ -205,7 +210,8 @@ Project::loadProjectInternal(const QString & path,
         getApp()->startProgress(this, loadMessage, false);
     }
     
-    if (NATRON_VERSION_MAJOR == 1 && NATRON_VERSION_MINOR == 0 && NATRON_VERSION_REVISION == 0) {
+    ///Binary projects were introduced long after these release candidates
+    if (!isBinary && NATRON_VERSION_MAJOR == 1 && NATRON_VERSION_MINOR == 0 && NATRON_VERSION_REVISION == 0) {
         
         ///Try to determine if the project was made during Natron v1.0.0 - RC2 or RC3 to detect a bug we introduced at that time
         ///in the BezierCP class serialisation
@@ -233,21 +239,34 @@ Project::loadProjectInternal(const QString & path,
             QMutexLocker k(&_imp->isLoadingProjectMutex);
             _imp->isLoadingProjectInternal = true;
         }
-        boost::archive::xml_iarchive iArchive(ifile);
+        ///Decode the project: the nodes of a binary project are decoded in parallel, then both formats are loaded alike.
+        ///The GUI is stored as XML in both formats, in its own block of a binary project: it is small compared to the nodes.
         bool bgProject;
-        iArchive >> boost::serialization::make_nvp("Background_project", bgProject);
         ProjectSerialization projectSerializationObj( getApp() );
-        iArchive >> boost::serialization::make_nvp("Project", projectSerializationObj);
-        
+        std::istringstream guiStream;
+        boost::scoped_ptr<boost::archive::xml_iarchive> xmlArchive; //< the archive holding the GUI, if any
+        if (isBinary) {
+            std::string projectGuiXml;
+            Natron::readBinaryProject(ifile, getApp(), &bgProject, &projectSerializationObj, &projectGuiXml);
+            if ( !bgProject && !projectGuiXml.empty() ) {
+                guiStream.str(projectGuiXml);
+                xmlArchive.reset( new boost::archive::xml_iarchive(guiStream) );
+            }
+        } else {
+            xmlArchive.reset( new boost::archive::xml_iarchive(ifile) );
+            *xmlArchive >> boost::serialization::make_nvp("Background_project", bgProject);
+            *xmlArchive >> boost::serialization::make_nvp("Project", projectSerializationObj);
+        }
+
         ret = load(projectSerializationObj,name,path,isAutoSave,realFilePath);
-        
+
         {
             QMutexLocker k(&_imp->isLoadingProjectMutex);
             _imp->isLoadingProjectInternal = false;
         }
-        
-        if (!bgProject) {
-            getApp()->loadProjectGui(iArchive);
+
+        if (!bgProject && xmlArchive) {
+            getApp()->loadProjectGui(*xmlArchive);
         }
     } catch (const boost::archive::archive_exception & e) {
         ifile.close();
@@ -375,9 +394,7 @@ Project::saveProjectInternal(const QString & path,
     QString timeStr = time.toString();
     Hash64 timeHash;
 
-    for (int i = 0; i < timeStr.size(); ++i) {
-        timeHash.append<unsigned short>( timeStr.at(i).unicode() );
-    }
+    Hash64_appendQString(&timeHash, timeStr);
     timeHash.computeHash();
     QString timeHashStr = QString::number( timeHash.value() );
     QString actualFileName = name;
@@ -431,10 +448,12 @@ Project::saveProjectInternal(const QString & path,
     tmpFilename.append( QDir::separator() );
     tmpFilename.append( QString::number( time.toMSecsSinceEpoch() ) );
 
+    ///Auto-saves are only read back by this installation: use the faster binary format for them
+    bool isBinary = autoSave || appPTR->getCurrentSettings()->isSaveProjectsAsBinaryEnabled();
     std::ofstream ofile;
     try {
         ofile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        ofile.open(tmpFilename.toStdString().c_str(),std::ofstream::out);
+        ofile.open(tmpFilename.toStdString().c_str(),isBinary ? std::ofstream::out | std::ofstream::binary : std::ofstream::out);
     } catch (const std::ofstream::failure & e) {
         throw std::runtime_error( std::string("Exception occured when opening file ") + tmpFilename.toStdString() + ": " + e.what() );
     }
@@ -459,14 +478,29 @@ Project::saveProjectInternal(const QString & path,
     }
     
     try {
-        boost::archive::xml_oarchive oArchive(ofile);
         bool bgProject = appPTR->isBackground();
-        oArchive << boost::serialization::make_nvp("Background_project",bgProject);
-        ProjectSerialization projectSerializationObj( getApp() );
-        save(&projectSerializationObj);
-        oArchive << boost::serialization::make_nvp("Project",projectSerializationObj);
-        if (!bgProject) {
-            getApp()->saveProjectGui(oArchive);
+        if (isBinary) {
+            ProjectSerialization projectSerializationObj( getApp() );
+            save(&projectSerializationObj);
+            std::string projectGuiXml;
+            if (!bgProject) {
+                std::ostringstream guiStream;
+                {
+                    boost::archive::xml_oarchive guiArchive(guiStream);
+                    getApp()->saveProjectGui(guiArchive);
+                }
+                projectGuiXml = guiStream.str();
+            }
+            Natron::writeBinaryProject(ofile, bgProject, projectSerializationObj, projectGuiXml);
+        } else {
+            boost::archive::xml_oarchive oArchive(ofile);
+            oArchive << boost::serialization::make_nvp("Background_project",bgProject);
+            ProjectSerialization projectSerializationObj( getApp() );
+            save(&projectSerializationObj);
+            oArchive << boost::serialization::make_nvp("Project",projectSerializationObj);
+            if (!bgProject) {
+                getApp()->saveProjectGui(oArchive);
+            }
         }
     } catch (...) {
         ofile.close();
@@ -0,0 +1,234 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ProjectBinarySerialization.h"
+
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <sstream>
+#include <stdexcept>
+
+#include <QtConcurrentRun>
+#include <QFuture>
+
+#ifndef Q_MOC_RUN
+#include <boost/archive/basic_archive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/NodeSerialization.h"
+#include "Engine/ProjectSerialization.h"
+
+namespace {
+///The result of the decoding of the block of a node, run by the thread pool: QtConcurrent::run doesn't forward exceptions
+struct DecodedNode
+{
+    boost::shared_ptr<NodeSerialization> serialization;
+    std::string error;
+};
+
+DecodedNode
+decodeNode(AppInstance* app,
+           const std::string & block)
+{
+    DecodedNode ret;
+
+    try {
+        std::istringstream stream(block);
+        boost::archive::binary_iarchive archive(stream);
+        boost::shared_ptr<NodeSerialization> serialization( new NodeSerialization(app) );
+        archive >> boost::serialization::make_nvp("item", *serialization);
+        ret.serialization = serialization;
+    } catch (const std::exception & e) {
+        ret.error = e.what();
+    } catch (...) {
+        ret.error = "unknown error";
+    }
+
+    return ret;
+}
+
+void
+writeBlock(std::ostream & stream,
+           const std::string & block)
+{
+    U64 size = block.size();
+
+    stream.write( reinterpret_cast<const char*>(&size), sizeof(size) );
+    stream.write( block.data(), block.size() );
+}
+
+///remaining is the number of bytes left in the stream, so that a corrupted size doesn't allocate the whole memory
+void
+readBlock(std::istream & stream,
+          U64* remaining,
+          std::string* block)
+{
+    U64 size;
+
+    if ( (*remaining < sizeof(size)) || !stream.read( reinterpret_cast<char*>(&size), sizeof(size) ) ) {
+        throw std::runtime_error("Unexpected end of the project file");
+    }
+    *remaining -= sizeof(size);
+    if (size > *remaining) {
+        throw std::runtime_error("The project file is corrupted");
+    }
+    block->resize(size);
+    if ( (size > 0) && !stream.read(&(*block)[0], size) ) {
+        throw std::runtime_error("Unexpected end of the project file");
+    }
+    *remaining -= size;
+}
+}
+
+bool
+Natron::isBinaryProjectFile(const std::string & filePath)
+{
+    std::ifstream file(filePath.c_str(), std::ifstream::in | std::ifstream::binary);
+    char magic[NATRON_PROJECT_BINARY_MAGIC_SIZE];
+
+    if ( !file.read(magic, NATRON_PROJECT_BINARY_MAGIC_SIZE) ) {
+        return false;
+    }
+
+    return std::memcmp(magic, NATRON_PROJECT_BINARY_MAGIC, NATRON_PROJECT_BINARY_MAGIC_SIZE) == 0;
+}
+
+void
+Natron::writeBinaryProject(std::ostream & stream,
+                           bool bgProject,
+                           const ProjectSerialization & project,
+                           const std::string & projectGuiXml)
+{
+    stream.write(NATRON_PROJECT_BINARY_MAGIC, NATRON_PROJECT_BINARY_MAGIC_SIZE);
+    U32 version = NATRON_PROJECT_BINARY_FORMAT_VERSION;
+    stream.write( reinterpret_cast<const char*>(&version), sizeof(version) );
+    U32 archiveVersion = static_cast<U32>( boost::archive::BOOST_ARCHIVE_VERSION() );
+    stream.write( reinterpret_cast<const char*>(&archiveVersion), sizeof(archiveVersion) );
+
+    const std::list<NodeSerialization> & nodes = project.getNodesSerialization();
+    {
+        std::ostringstream header;
+        {
+            boost::archive::binary_oarchive archive(header);
+            int nodesCount = (int)nodes.size();
+            ///The fields of the project are not saved through the serialization of the class: store its version as well
+            unsigned int projectVersion = PROJECT_SERIALIZATION_VERSION;
+            archive << boost::serialization::make_nvp("Background_project", bgProject);
+            archive << boost::serialization::make_nvp("ProjectVersion", projectVersion);
+            archive << boost::serialization::make_nvp("NodesCount", nodesCount);
+            project.saveWithoutNodes(archive);
+        }
+        writeBlock( stream, header.str() );
+    }
+
+    for (std::list<NodeSerialization>::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+        std::ostringstream node;
+        {
+            boost::archive::binary_oarchive archive(node);
+            archive << boost::serialization::make_nvp("item", *it);
+        }
+        writeBlock( stream, node.str() );
+    }
+
+    writeBlock(stream, projectGuiXml);
+    stream.flush();
+    if ( !stream.good() ) {
+        throw std::runtime_error("Failed to write the project file");
+    }
+}
+
+void
+Natron::readBinaryProject(std::istream & stream,
+                          AppInstance* app,
+                          bool* bgProject,
+                          ProjectSerialization* project,
+                          std::string* projectGuiXml)
+{
+    std::istream::pos_type start = stream.tellg();
+    stream.seekg(0, std::istream::end);
+    U64 remaining = (U64)(stream.tellg() - start);
+    stream.seekg(start);
+
+    char magic[NATRON_PROJECT_BINARY_MAGIC_SIZE];
+    U32 version;
+    if ( (remaining < sizeof(magic) + sizeof(version)) || !stream.read(magic, sizeof(magic)) ||
+         std::memcmp(magic, NATRON_PROJECT_BINARY_MAGIC, sizeof(magic)) != 0 ) {
+        throw std::runtime_error("Not a binary project file");
+    }
+    if ( !stream.read( reinterpret_cast<char*>(&version), sizeof(version) ) ) {
+        throw std::runtime_error("Unexpected end of the project file");
+    }
+    remaining -= sizeof(magic) + sizeof(version);
+    if (version > NATRON_PROJECT_BINARY_FORMAT_VERSION) {
+        throw std::invalid_argument("The project you're trying to load was saved by a more recent "
+                                    "version of Natron, which makes it unreadable");
+    }
+    if (version >= NATRON_PROJECT_BINARY_FORMAT_VERSION_ARCHIVE_VERSION) {
+        U32 archiveVersion;
+        if ( (remaining < sizeof(archiveVersion)) || !stream.read( reinterpret_cast<char*>(&archiveVersion), sizeof(archiveVersion) ) ) {
+            throw std::runtime_error("Unexpected end of the project file");
+        }
+        remaining -= sizeof(archiveVersion);
+        U32 currentArchiveVersion = static_cast<U32>( boost::archive::BOOST_ARCHIVE_VERSION() );
+        if (archiveVersion != currentArchiveVersion) {
+            std::ostringstream message;
+            message << "The project you're trying to load was saved in the binary format by a Natron built against "
+                    << "another version of the boost serialization library (archive version " << archiveVersion
+                    << ", this version of Natron reads version " << currentArchiveVersion << "), which makes it "
+                    << "unreadable. Save it as XML with the version of Natron that wrote it to load it here";
+            throw std::invalid_argument( message.str() );
+        }
+    }
+
+    std::string block;
+    int nodesCount;
+    readBlock(stream, &remaining, &block);
+    {
+        std::istringstream header(block);
+        boost::archive::binary_iarchive archive(header);
+        unsigned int projectVersion;
+        archive >> boost::serialization::make_nvp("Background_project", *bgProject);
+        archive >> boost::serialization::make_nvp("ProjectVersion", projectVersion);
+        if (projectVersion > PROJECT_SERIALIZATION_VERSION) {
+            throw std::invalid_argument("The project you're trying to load was saved by a more recent "
+                                        "version of Natron, which makes it unreadable");
+        }
+        archive >> boost::serialization::make_nvp("NodesCount", nodesCount);
+        project->loadWithoutNodes(archive, projectVersion);
+    }
+
+    ///Decode the nodes in the thread pool while the next ones are read
+    std::list< QFuture<DecodedNode> > decodedNodes;
+    try {
+        for (int i = 0; i < nodesCount; ++i) {
+            readBlock(stream, &remaining, &block);
+            decodedNodes.push_back( QtConcurrent::run(decodeNode, app, block) );
+        }
+        readBlock(stream, &remaining, projectGuiXml);
+    } catch (...) {
+        for (std::list< QFuture<DecodedNode> >::iterator it = decodedNodes.begin(); it != decodedNodes.end(); ++it) {
+            it->waitForFinished();
+        }
+        throw;
+    }
+
+    std::string error;
+    for (std::list< QFuture<DecodedNode> >::iterator it = decodedNodes.begin(); it != decodedNodes.end(); ++it) {
+        DecodedNode node = it->result();
+        if (node.serialization) {
+            project->addNodeSerialization(*node.serialization);
+        } else if ( error.empty() ) {
+            error = node.error;
+        }
+    }
+    if ( !error.empty() ) {
+        throw std::runtime_error(error);
+    }
+}
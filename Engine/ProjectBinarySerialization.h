@@ -0,0 +1,65 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_PROJECTBINARYSERIALIZATION_H_
+#define NATRON_ENGINE_PROJECTBINARYSERIALIZATION_H_
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "Global/Macros.h"
+
+///The first bytes of a binary project file. An XML project starts with the XML declaration instead.
+#define NATRON_PROJECT_BINARY_MAGIC "NatronBP"
+#define NATRON_PROJECT_BINARY_MAGIC_SIZE 8
+
+///Version 2 stores the version of the boost archive library after the format version
+#define NATRON_PROJECT_BINARY_FORMAT_VERSION 2
+#define NATRON_PROJECT_BINARY_FORMAT_VERSION_ARCHIVE_VERSION 2
+
+class AppInstance;
+class ProjectSerialization;
+
+/*
+ * The binary project format. It is faster to write and read than the XML format, but it is only readable
+ * by a Natron built for the same kind of platform (word size and endianness), as for the boost binary archives
+ * of the caches. The auto-saves always use it. The XML format remains the portable one, used to exchange projects.
+ *
+ * The boost binary archives are not guaranteed to be readable by another version of the boost serialization library
+ * either: the version of the library that wrote the file is stored in it and the file is rejected by a Natron built
+ * against another one, instead of failing in the middle of the archives. Save the project as XML to move it across.
+ *
+ * The file holds, after the magic, the format version and the version of the boost archive library:
+ * - a block with the version of ProjectSerialization, the settings of the project and the number of nodes,
+ * - a block per node, each holding a boost binary archive of its NodeSerialization,
+ * - a block holding the XML archive of the GUI of the project, empty for a project saved in background mode.
+ * Each block is preceded by its size in bytes. The nodes are read from the file in sequence and decoded in
+ * parallel as they arrive: their archives are independent.
+ */
+namespace Natron {
+///Returns true if the file at filePath starts with NATRON_PROJECT_BINARY_MAGIC
+bool isBinaryProjectFile(const std::string & filePath) WARN_UNUSED_RETURN;
+
+///Throws an exception if the stream fails
+void writeBinaryProject(std::ostream & stream,
+                        bool bgProject,
+                        const ProjectSerialization & project,
+                        const std::string & projectGuiXml);
+
+/**
+ * @brief Reads a project written by writeBinaryProject into project, which must be empty. Throws an exception
+ * if the file is not a binary project, was written by a more recent version of the format or against another
+ * version of the boost archive library, or is corrupted.
+ **/
+void readBinaryProject(std::istream & stream,
+                       AppInstance* app,
+                       bool* bgProject,
+                       ProjectSerialization* project,
+                       std::string* projectGuiXml);
+} // namespace Natron
+
+#endif // NATRON_ENGINE_PROJECTBINARYSERIALIZATION_H_
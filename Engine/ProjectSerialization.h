@@ -104,6 +104,58 @@ public:
         return _creationDate;
     }
 
+    ///Used by the binary project format, which reads the nodes apart from the rest of the project
+    void addNodeSerialization(const NodeSerialization & node)
+    {
+        _serializedNodes.push_back(node);
+    }
+
+    /**
+     * @brief The fields of save() and load() but the version of Natron and the nodes. The binary project format
+     * (see ProjectBinarySerialization.h) stores each node in its own archive so that they can be read in parallel,
+     * and the other fields with these functions. version is the version of the class the archive was written with.
+     **/
+    template<class Archive>
+    void saveWithoutNodes(Archive & ar) const
+    {
+        int knobsCount = _projectKnobs.size();
+        ar & boost::serialization::make_nvp("ProjectKnobsCount",knobsCount);
+        for (std::list< boost::shared_ptr<KnobSerialization> >::const_iterator it = _projectKnobs.begin();
+             it != _projectKnobs.end();
+             ++it) {
+            ar & boost::serialization::make_nvp( "item",*(*it) );
+        }
+        ar & boost::serialization::make_nvp("AdditionalFormats", _additionalFormats);
+        ar & boost::serialization::make_nvp("Timeline_current_time", _timelineCurrent);
+        ar & boost::serialization::make_nvp("Timeline_left_bound", _timelineLeft);
+        ar & boost::serialization::make_nvp("Timeline_right_bound", _timelineRight);
+        ar & boost::serialization::make_nvp("CreationDate", _creationDate);
+    }
+
+    template<class Archive>
+    void loadWithoutNodes(Archive & ar,
+                          const unsigned int version)
+    {
+        int knobsCount;
+        ar & boost::serialization::make_nvp("ProjectKnobsCount",knobsCount);
+        
+        for (int i = 0; i < knobsCount; ++i) {
+            boost::shared_ptr<KnobSerialization> ks(new KnobSerialization);
+            ar & boost::serialization::make_nvp("item",*ks);
+            _projectKnobs.push_back(ks);
+        }
+
+        ar & boost::serialization::make_nvp("AdditionalFormats", _additionalFormats);
+        ar & boost::serialization::make_nvp("Timeline_current_time", _timelineCurrent);
+        ar & boost::serialization::make_nvp("Timeline_left_bound", _timelineLeft);
+        ar & boost::serialization::make_nvp("Timeline_right_bound", _timelineRight);
+        if (version < PROJECT_SERIALIZATION_REMOVES_NODE_COUNTERS) {
+            std::map<std::string,int> _nodeCounters;
+            ar & boost::serialization::make_nvp("NodeCounters", _nodeCounters);
+        }
+        ar & boost::serialization::make_nvp("CreationDate", _creationDate);
+    }
+
 
     friend class boost::serialization::access;
     template<class Archive>
@@ -134,18 +186,7 @@ public:
              ++it) {
             ar & boost::serialization::make_nvp("item",*it);
         }
-        int knobsCount = _projectKnobs.size();
-        ar & boost::serialization::make_nvp("ProjectKnobsCount",knobsCount);
-        for (std::list< boost::shared_ptr<KnobSerialization> >::const_iterator it = _projectKnobs.begin();
-             it != _projectKnobs.end();
-             ++it) {
-            ar & boost::serialization::make_nvp( "item",*(*it) );
-        }
-        ar & boost::serialization::make_nvp("AdditionalFormats", _additionalFormats);
-        ar & boost::serialization::make_nvp("Timeline_current_time", _timelineCurrent);
-        ar & boost::serialization::make_nvp("Timeline_left_bound", _timelineLeft);
-        ar & boost::serialization::make_nvp("Timeline_right_bound", _timelineRight);
-        ar & boost::serialization::make_nvp("CreationDate", _creationDate);
+        saveWithoutNodes(ar);
     }
 
     template<class Archive>
@@ -165,25 +206,7 @@ public:
             ar & boost::serialization::make_nvp("item",ns);
             _serializedNodes.push_back(ns);
         }
-
-        int knobsCount;
-        ar & boost::serialization::make_nvp("ProjectKnobsCount",knobsCount);
-        
-        for (int i = 0; i < knobsCount; ++i) {
-            boost::shared_ptr<KnobSerialization> ks(new KnobSerialization);
-            ar & boost::serialization::make_nvp("item",*ks);
-            _projectKnobs.push_back(ks);
-        }
-
-        ar & boost::serialization::make_nvp("AdditionalFormats", _additionalFormats);
-        ar & boost::serialization::make_nvp("Timeline_current_time", _timelineCurrent);
-        ar & boost::serialization::make_nvp("Timeline_left_bound", _timelineLeft);
-        ar & boost::serialization::make_nvp("Timeline_right_bound", _timelineRight);
-        if (version < PROJECT_SERIALIZATION_REMOVES_NODE_COUNTERS) {
-            std::map<std::string,int> _nodeCounters;
-            ar & boost::serialization::make_nvp("NodeCounters", _nodeCounters);
-        }
-        ar & boost::serialization::make_nvp("CreationDate", _creationDate);
+        loadWithoutNodes(ar, version);
     }
 
     BOOST_SERIALIZATION_SPLIT_MEMBER()
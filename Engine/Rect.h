@@ -471,6 +471,36 @@ public:
         return ret;
     }
 
+    /**
+     * @brief Splits rect in tiles of at most tilePixelsCount pixels, to be dispatched dynamically to the render threads.
+     * The tiles are bands of full scan-lines, unless a single scan-line is bigger than tilePixelsCount, in which case
+     * the scan-lines are cut in chunks of tilePixelsCount pixels.
+     **/
+    static std::vector<RectI> splitRectIntoTiles(const RectI & rect,
+                                                 int tilePixelsCount)
+    {
+        std::vector<RectI> ret;
+
+        if ( rect.isNull() ) {
+            return ret;
+        }
+        assert(tilePixelsCount > 0);
+        if ( tilePixelsCount >= rect.width() ) {
+            int scanLinesCount = tilePixelsCount / rect.width();
+            for (int y = rect.bottom(); y < rect.top(); y += scanLinesCount) {
+                ret.push_back( RectI( rect.left(),y,rect.right(),std::min(y + scanLinesCount,rect.top()) ) );
+            }
+        } else {
+            for (int y = rect.bottom(); y < rect.top(); ++y) {
+                for (int x = rect.left(); x < rect.right(); x += tilePixelsCount) {
+                    ret.push_back( RectI( x,y,std::min(x + tilePixelsCount,rect.right()),y + 1 ) );
+                }
+            }
+        }
+
+        return ret;
+    }
+
     static RectI fromOfxRectI(const OfxRectI & r)
     {
         RectI ret(r.x1,r.y1,r.x2,r.y2);
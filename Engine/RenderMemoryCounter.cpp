@@ -0,0 +1,62 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "RenderMemoryCounter.h"
+
+#include "Engine/AppManager.h"
+
+RenderMemoryCounter::RenderMemoryCounter()
+    : _lock()
+      , _current(0)
+      , _peak(0)
+{
+}
+
+void
+RenderMemoryCounter::notifyAllocated(std::size_t nBytes)
+{
+    QMutexLocker l(&_lock);
+
+    _current += (qint64)nBytes;
+    if (_current > _peak) {
+        _peak = _current;
+    }
+}
+
+void
+RenderMemoryCounter::notifyFreed(std::size_t nBytes)
+{
+    QMutexLocker l(&_lock);
+
+    _current -= (qint64)nBytes;
+}
+
+std::size_t
+RenderMemoryCounter::getCurrentMemory() const
+{
+    QMutexLocker l(&_lock);
+
+    return _current > 0 ? (std::size_t)_current : 0;
+}
+
+std::size_t
+RenderMemoryCounter::getPeakMemory() const
+{
+    QMutexLocker l(&_lock);
+
+    return (std::size_t)_peak;
+}
+
+RenderMemoryCounterSetter::RenderMemoryCounterSetter(const boost::shared_ptr<RenderMemoryCounter> & counter)
+    : _previous( appPTR->getThreadRenderMemoryCounter() )
+{
+    appPTR->setThreadRenderMemoryCounter(counter);
+}
+
+RenderMemoryCounterSetter::~RenderMemoryCounterSetter()
+{
+    appPTR->setThreadRenderMemoryCounter(_previous);
+}
@@ -0,0 +1,69 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_RENDERMEMORYCOUNTER_H_
+#define NATRON_ENGINE_RENDERMEMORYCOUNTER_H_
+
+#include <cstddef>
+
+#include <QtCore/QMutex>
+
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include "Global/Macros.h"
+
+/**
+ * @brief Counts the memory allocated and freed by the threads rendering a frame: the images and the viewer textures
+ * allocated in the RAM by the caches, including the tiles of tiled images allocated on demand, and the memory registered
+ * by the plug-ins. The peak of what the frame held is the memory it needs, which the scheduler uses to decide how many
+ * frames it can render in parallel (see OutputSchedulerThread::getMaxParallelRendersInMemoryBudget()).
+ *
+ * The counter of a thread is set with RenderMemoryCounterSetter and notified by AppManager::notifyRenderMemoryAllocated()
+ * and AppManager::notifyRenderMemoryFreed(). Entries evicted from the caches are freed by the deleter thread of the cache
+ * and are not accounted to the frame whose allocation evicted them.
+ * This is MT-safe: the tiles of a frame are rendered by several threads sharing the counter.
+ **/
+class RenderMemoryCounter
+{
+public:
+
+    RenderMemoryCounter();
+
+    void notifyAllocated(std::size_t nBytes);
+
+    void notifyFreed(std::size_t nBytes);
+
+    ///The memory held now, 0 if the frame freed more than it allocated
+    std::size_t getCurrentMemory() const WARN_UNUSED_RETURN;
+
+    ///The maximum of the memory held since the counter was created
+    std::size_t getPeakMemory() const WARN_UNUSED_RETURN;
+
+private:
+
+    mutable QMutex _lock;
+    qint64 _current; //< may go below 0 when the frame frees memory allocated before it started
+    qint64 _peak;
+};
+
+/**
+ * @brief Makes counter the counter of the current thread while the object lives, then restores the previous one.
+ * counter may be NULL so that the memory allocated by the thread isn't accounted.
+ **/
+class RenderMemoryCounterSetter
+{
+    boost::shared_ptr<RenderMemoryCounter> _previous;
+
+public:
+
+    explicit RenderMemoryCounterSetter(const boost::shared_ptr<RenderMemoryCounter> & counter);
+
+    ~RenderMemoryCounterSetter();
+};
+
+#endif // NATRON_ENGINE_RENDERMEMORYCOUNTER_H_
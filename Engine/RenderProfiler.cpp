@@ -0,0 +1,243 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "RenderProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EffectInstance.h"
+#include "Engine/Timer.h"
+
+using namespace Natron;
+
+///The spans are spread in buckets by thread so that the render threads rarely wait for each other
+#define NATRON_RENDER_PROFILER_BUCKETS_COUNT 32
+
+namespace {
+struct Span
+{
+    std::string nodeName;
+    const char* category;
+    const char* name;
+    int frame;
+    const QThread* thread;
+    double startTime;
+    double duration;
+};
+
+struct SpansBucket
+{
+    QMutex mutex;
+    std::vector<Span> spans;
+};
+
+bool
+compareSpansStartTime(const Span & lhs,
+                      const Span & rhs)
+{
+    return lhs.startTime < rhs.startTime;
+}
+
+void
+writeJSONString(std::ostream & stream,
+                const std::string & str)
+{
+    stream << '"';
+    for (std::size_t i = 0; i < str.size(); ++i) {
+        unsigned char c = str[i];
+        if ( (c == '"') || (c == '\\') ) {
+            stream << '\\' << c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::sprintf(escaped, "\\u%04x", c);
+            stream << escaped;
+        } else {
+            stream << c;
+        }
+    }
+    stream << '"';
+}
+
+///The clock of the spans, never reset so that it can be read without locking
+TimeLapse gClock;
+QAtomicInt gRecording(0);
+QMutex gStateMutex; //< protects gStartTime and gTraceFilePath
+double gStartTime = 0.;
+std::string gTraceFilePath;
+SpansBucket gBuckets[NATRON_RENDER_PROFILER_BUCKETS_COUNT];
+
+SpansBucket &
+getCurrentThreadBucket()
+{
+    std::size_t thread = (std::size_t)QThread::currentThread();
+
+    ///the low bits of the address are the same for every thread object
+    return gBuckets[(thread >> 6) % NATRON_RENDER_PROFILER_BUCKETS_COUNT];
+}
+}
+
+void
+RenderProfiler::start(const std::string & traceFilePath)
+{
+    QMutexLocker l(&gStateMutex);
+
+    for (int i = 0; i < NATRON_RENDER_PROFILER_BUCKETS_COUNT; ++i) {
+        QMutexLocker bucketLocker(&gBuckets[i].mutex);
+        gBuckets[i].spans.clear();
+    }
+    gTraceFilePath = traceFilePath;
+    gStartTime = gClock.getTimeSinceCreation();
+    gRecording.fetchAndStoreOrdered(1);
+}
+
+bool
+RenderProfiler::stop()
+{
+    if ( !gRecording.fetchAndStoreOrdered(0) ) {
+        return true;
+    }
+    std::string traceFilePath = getTraceFilePath();
+    if ( traceFilePath.empty() ) {
+        return true;
+    }
+    std::ofstream file( traceFilePath.c_str() );
+    if ( !file.good() ) {
+        return false;
+    }
+    writeChromeTrace(file);
+
+    return file.good();
+}
+
+bool
+RenderProfiler::isRecording()
+{
+    return (int)gRecording != 0;
+}
+
+std::string
+RenderProfiler::getTraceFilePath()
+{
+    QMutexLocker l(&gStateMutex);
+
+    return gTraceFilePath;
+}
+
+std::string
+RenderProfiler::getDefaultTraceFilePath()
+{
+    std::stringstream ss;
+
+    ss << NATRON_APPLICATION_NAME << "_profile" << QCoreApplication::applicationPid() << ".json";
+
+    return ss.str();
+}
+
+double
+RenderProfiler::getCurrentTime()
+{
+    return gClock.getTimeSinceCreation();
+}
+
+void
+RenderProfiler::addSpan(const std::string & nodeName,
+                        const char* category,
+                        const char* name,
+                        int frame,
+                        double startTime,
+                        double duration)
+{
+    if ( !isRecording() ) {
+        return;
+    }
+    Span span;
+    span.nodeName = nodeName;
+    span.category = category;
+    span.name = name;
+    span.frame = frame;
+    span.thread = QThread::currentThread();
+    span.startTime = startTime;
+    span.duration = duration;
+
+    SpansBucket & bucket = getCurrentThreadBucket();
+    QMutexLocker l(&bucket.mutex);
+    bucket.spans.push_back(span);
+}
+
+int
+RenderProfiler::getSpansCount()
+{
+    int count = 0;
+
+    for (int i = 0; i < NATRON_RENDER_PROFILER_BUCKETS_COUNT; ++i) {
+        QMutexLocker l(&gBuckets[i].mutex);
+        count += (int)gBuckets[i].spans.size();
+    }
+
+    return count;
+}
+
+void
+RenderProfiler::writeChromeTrace(std::ostream & stream)
+{
+    double startTime;
+    {
+        QMutexLocker l(&gStateMutex);
+        startTime = gStartTime;
+    }
+
+    std::vector<Span> spans;
+    for (int i = 0; i < NATRON_RENDER_PROFILER_BUCKETS_COUNT; ++i) {
+        QMutexLocker l(&gBuckets[i].mutex);
+        spans.insert( spans.end(), gBuckets[i].spans.begin(), gBuckets[i].spans.end() );
+    }
+    std::stable_sort(spans.begin(), spans.end(), compareSpansStartTime);
+
+    ///the thread objects may have been deleted, only their addresses are used
+    std::map<const QThread*, int> threadIndexes;
+    stream << "{\"traceEvents\":[";
+    bool first = true;
+    for (std::vector<Span>::const_iterator it = spans.begin(); it != spans.end(); ++it) {
+        ///spans which started before the recording belong to a previous trace
+        if (it->startTime < startTime) {
+            continue;
+        }
+        std::map<const QThread*, int>::iterator found = threadIndexes.find(it->thread);
+        if ( found == threadIndexes.end() ) {
+            found = threadIndexes.insert( std::make_pair( it->thread, (int)threadIndexes.size() + 1 ) ).first;
+        }
+        std::string label = it->nodeName.empty() ? std::string(it->name) : it->nodeName + ' ' + it->name;
+        stream << (first ? "\n" : ",\n") << "{\"name\":";
+        writeJSONString(stream, label);
+        stream << ",\"cat\":\"" << it->category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << found->second
+               << ",\"ts\":" << (U64)( (it->startTime - startTime) * 1000000. ) << ",\"dur\":" << (U64)(it->duration * 1000000.)
+               << ",\"args\":{\"node\":";
+        writeJSONString(stream, it->nodeName);
+        stream << ",\"frame\":" << it->frame << "}}";
+        first = false;
+    }
+    stream << "\n]}" << std::endl;
+}
+
+RenderProfilerSpan::~RenderProfilerSpan()
+{
+    if (!_recording) {
+        return;
+    }
+    double duration = RenderProfiler::getCurrentTime() - _startTime;
+    RenderProfiler::addSpan(_effect ? _effect->getName_mt_safe() : std::string(), _category, _name, _frame, _startTime, duration);
+}
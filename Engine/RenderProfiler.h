@@ -0,0 +1,118 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_RENDERPROFILER_H_
+#define NATRON_ENGINE_RENDERPROFILER_H_
+
+#include <ostream>
+#include <string>
+
+#include "Global/Macros.h"
+
+///The categories of the spans, the "cat" field of the trace events
+#define kRenderProfilerCategoryRender "render"
+#define kRenderProfilerCategoryAction "action"
+#define kRenderProfilerCategoryCache "cache"
+#define kRenderProfilerCategoryLock "lock"
+
+namespace Natron {
+class EffectInstance;
+
+/**
+ * @brief Records where the time of the renders goes: the spans of time spent by each node in its actions, in the cache and
+ * waiting on locks, for each frame and each thread. They are exported in the Chrome trace format, which can be opened in
+ * chrome://tracing or https://ui.perfetto.dev to find the nodes that make a frame slow.
+ *
+ * Recording is started by the "Profile renders" preference or by the --profile option of the command line.
+ * When not recording, a span costs a single atomic read.
+ **/
+class RenderProfiler
+{
+public:
+
+    /**
+     * @brief Discards what was recorded so far and starts recording. The trace is written to traceFilePath by stop(),
+     * unless it is empty.
+     **/
+    static void start(const std::string & traceFilePath);
+
+    /**
+     * @brief Stops recording and writes the trace to the file given to start().
+     * Returns false if the file could not be written.
+     **/
+    static bool stop();
+
+    static bool isRecording() WARN_UNUSED_RETURN;
+
+    static std::string getTraceFilePath() WARN_UNUSED_RETURN;
+
+    ///The trace file used when none is given, in the current directory
+    static std::string getDefaultTraceFilePath() WARN_UNUSED_RETURN;
+
+    ///The time in seconds since start() was called, the time of the spans
+    static double getCurrentTime() WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Records a span of the current thread. category and name must be string literals: they are not copied.
+     * Does nothing when not recording.
+     **/
+    static void addSpan(const std::string & nodeName,
+                        const char* category,
+                        const char* name,
+                        int frame,
+                        double startTime,
+                        double duration);
+
+    static int getSpansCount() WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Writes the spans recorded so far as a JSON object with a "traceEvents" array of complete ("X") events.
+     * The threads are numbered in the order they recorded their first span.
+     **/
+    static void writeChromeTrace(std::ostream & stream);
+};
+
+/**
+ * @brief Records the time between its construction and its destruction as a span of the node of effect, which may be NULL.
+ * The name of the node is only fetched when recording.
+ **/
+class RenderProfilerSpan
+{
+public:
+
+    RenderProfilerSpan(const Natron::EffectInstance* effect,
+                       const char* category,
+                       const char* name,
+                       int frame)
+        : _effect(effect)
+          , _category(category)
+          , _name(name)
+          , _frame(frame)
+          , _recording( RenderProfiler::isRecording() )
+          , _startTime(_recording ? RenderProfiler::getCurrentTime() : 0.)
+    {
+    }
+
+    ~RenderProfilerSpan();
+
+    ///Renames the span once its outcome is known, e.g a cache hit or a miss. name must be a string literal.
+    void setName(const char* name)
+    {
+        _name = name;
+    }
+
+private:
+
+    const Natron::EffectInstance* _effect;
+    const char* _category;
+    const char* _name;
+    int _frame;
+    bool _recording;
+    double _startTime;
+};
+} // namespace Natron
+
+#endif // NATRON_ENGINE_RENDERPROFILER_H_
@@ -12,6 +12,8 @@
 #include "RotoContext.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <sstream>
 
 #include <boost/bind.hpp>
@@ -28,6 +30,7 @@
 #include "Engine/Hash64.h"
 #include "Engine/Settings.h"
 #include "Engine/Format.h"
+#include "Engine/RotoRasterizer.h"
 #include "Engine/RotoSerialization.h"
 #include "Engine/Transform.h"
 
@@ -35,6 +38,17 @@ using namespace Natron;
 
 ////////////////////////////////////ControlPoint////////////////////////////////////
 
+///The evaluations of the Bezier holding the point are no longer valid
+static void
+incrementHolderPointsAge(const BezierCPPrivate & imp)
+{
+    boost::shared_ptr<Bezier> holder = imp.holder.lock();
+
+    if (holder) {
+        holder->incrementPointsAge();
+    }
+}
+
 BezierCP::BezierCP()
     : _imp( new BezierCPPrivate(boost::shared_ptr<Bezier>()) )
 {
@@ -72,10 +86,8 @@ BezierCP::getPositionAtTime(int time,
         *y = k.getValue();
         ret = true;
     } else {
-        try {
-            *x = _imp->curveX->getValueAt(time);
-            *y = _imp->curveY->getValueAt(time);
-        } catch (const std::exception & e) {
+        if ( !_imp->curveX->getValueAtIfAnimated(time, true, x) ||
+             !_imp->curveY->getValueAtIfAnimated(time, true, y) ) {
             QMutexLocker l(&_imp->staticPositionMutex);
             *x = _imp->x;
             *y = _imp->y;
@@ -124,6 +136,7 @@ BezierCP::setPositionAtTime(int time,
         k.setInterpolation(Natron::eKeyframeTypeLinear);
         _imp->curveY->addKeyFrame(k);
     }
+    incrementHolderPointsAge(*_imp);
 }
 
 void
@@ -135,6 +148,8 @@ BezierCP::setStaticPosition(double x,
     QMutexLocker l(&_imp->staticPositionMutex);
     _imp->x = x;
     _imp->y = y;
+    l.unlock();
+    incrementHolderPointsAge(*_imp);
 }
 
 void
@@ -146,6 +161,8 @@ BezierCP::setLeftBezierStaticPosition(double x,
     QMutexLocker l(&_imp->staticPositionMutex);
     _imp->leftX = x;
     _imp->leftY = y;
+    l.unlock();
+    incrementHolderPointsAge(*_imp);
 }
 
 void
@@ -157,6 +174,8 @@ BezierCP::setRightBezierStaticPosition(double x,
     QMutexLocker l(&_imp->staticPositionMutex);
     _imp->rightX = x;
     _imp->rightY = y;
+    l.unlock();
+    incrementHolderPointsAge(*_imp);
 }
 
 bool
@@ -176,10 +195,8 @@ BezierCP::getLeftBezierPointAtTime(int time,
         *y = k.getValue();
         ret =  true;
     } else {
-        try {
-            *x = _imp->curveLeftBezierX->getValueAt(time);
-            *y = _imp->curveLeftBezierY->getValueAt(time);
-        } catch (const std::exception & e) {
+        if ( !_imp->curveLeftBezierX->getValueAtIfAnimated(time, true, x) ||
+             !_imp->curveLeftBezierY->getValueAtIfAnimated(time, true, y) ) {
             QMutexLocker l(&_imp->staticPositionMutex);
             *x = _imp->leftX;
             *y = _imp->leftY;
@@ -226,10 +243,8 @@ BezierCP::getRightBezierPointAtTime(int time,
         *y = k.getValue();
         ret = true;
     } else {
-        try {
-            *x = _imp->curveRightBezierX->getValueAt(time);
-            *y = _imp->curveRightBezierY->getValueAt(time);
-        } catch (const std::exception & e) {
+        if ( !_imp->curveRightBezierX->getValueAtIfAnimated(time, true, x) ||
+             !_imp->curveRightBezierY->getValueAtIfAnimated(time, true, y) ) {
             QMutexLocker l(&_imp->staticPositionMutex);
             *x = _imp->rightX;
             *y = _imp->rightY;
@@ -278,6 +293,7 @@ BezierCP::setLeftBezierPointAtTime(int time,
         k.setInterpolation(Natron::eKeyframeTypeLinear);
         _imp->curveLeftBezierY->addKeyFrame(k);
     }
+    incrementHolderPointsAge(*_imp);
 }
 
 void
@@ -298,6 +314,7 @@ BezierCP::setRightBezierPointAtTime(int time,
         k.setInterpolation(Natron::eKeyframeTypeLinear);
         _imp->curveRightBezierY->addKeyFrame(k);
     }
+    incrementHolderPointsAge(*_imp);
 }
 
 void
@@ -326,6 +343,7 @@ BezierCP::removeKeyframe(int time)
         _imp->curveRightBezierY->removeKeyFrameWithTime(time);
     } catch (...) {
     }
+    incrementHolderPointsAge(*_imp);
 }
 
 bool
@@ -673,6 +691,7 @@ BezierCP::clone(const BezierCP & other)
         _imp->masterTrack = other._imp->masterTrack;
         _imp->offsetTime = other._imp->offsetTime;
     }
+    incrementHolderPointsAge(*_imp);
 }
 
 bool
@@ -714,6 +733,8 @@ BezierCP::slaveTo(SequenceTime offsetTime,
     QWriteLocker l(&_imp->masterMutex);
     _imp->masterTrack = track;
     _imp->offsetTime = offsetTime;
+    l.unlock();
+    incrementHolderPointsAge(*_imp);
 }
 
 void
@@ -723,6 +744,8 @@ BezierCP::unslave()
     assert(_imp->masterTrack);
     QWriteLocker l(&_imp->masterMutex);
     _imp->masterTrack.reset();
+    l.unlock();
+    incrementHolderPointsAge(*_imp);
 }
 
 boost::shared_ptr<Double_Knob>
@@ -1936,6 +1959,7 @@ Bezier::clone(const RotoItem* other)
         }
         _imp->finished = otherBezier->_imp->finished;
     }
+    incrementPointsAge();
     RotoDrawableItem::clone(other);
     emit cloned();
 }
@@ -2005,6 +2029,7 @@ Bezier::addControlPoint(double x,
         }
         _imp->featherPoints.insert(_imp->featherPoints.end(),fp);
     }
+    incrementPointsAge();
     emit controlPointAdded();
     return p;
 }
@@ -2136,6 +2161,7 @@ Bezier::addControlPointAfterIndex(int index,
             _imp->points.push_front(p);
             _imp->featherPoints.push_front(fp);
         }
+        incrementPointsAge();
         
         
         ///If auto-keying is enabled, set a new keyframe
@@ -2233,8 +2259,11 @@ Bezier::setCurveFinished(bool finished)
 {
     ///only called on the main-thread
     assert( QThread::currentThread() == qApp->thread() );
-    QMutexLocker l(&itemMutex);
-    _imp->finished = finished;
+    {
+        QMutexLocker l(&itemMutex);
+        _imp->finished = finished;
+    }
+    incrementPointsAge();
 }
 
 bool
@@ -2271,6 +2300,7 @@ Bezier::removeControlPointByIndex(int index)
         std::advance(itF, index);
         _imp->featherPoints.erase(itF);
     }
+    incrementPointsAge();
     emit controlPointRemoved();
 }
 
@@ -2998,6 +3028,29 @@ Bezier::getKeyframesCount() const
     }
 }
 
+static void
+setEmptyBBox(RectD* bbox)
+{
+    bbox->x1 = std::numeric_limits<double>::infinity();
+    bbox->x2 = -std::numeric_limits<double>::infinity();
+    bbox->y1 = std::numeric_limits<double>::infinity();
+    bbox->y2 = -std::numeric_limits<double>::infinity();
+}
+
+static void
+appendPolygon(const BezierPolygon & polygon,
+              std::list< Natron::Point >* points,
+              RectD* bbox)
+{
+    points->insert( points->end(), polygon.points.begin(), polygon.points.end() );
+    if (bbox) {
+        bbox->x1 = std::min(bbox->x1, polygon.bbox.x1);
+        bbox->x2 = std::max(bbox->x2, polygon.bbox.x2);
+        bbox->y1 = std::min(bbox->y1, polygon.bbox.y1);
+        bbox->y2 = std::max(bbox->y2, polygon.bbox.y2);
+    }
+}
+
 void
 Bezier::evaluateAtTime_DeCasteljau(int time,
                                    unsigned int mipMapLevel,
@@ -3005,21 +3058,55 @@ Bezier::evaluateAtTime_DeCasteljau(int time,
                                    std::list< Natron::Point >* points,
                                    RectD* bbox) const
 {
-    QMutexLocker l(&itemMutex);
-    BezierCPs::const_iterator next = _imp->points.begin();
+    U64 age;
+    {
+        QMutexLocker k(&_imp->evaluationsMutex);
+        BezierEvaluations::const_iterator found = _imp->evaluations.find( std::make_pair(time, mipMapLevel) );
+        if ( found != _imp->evaluations.end() ) {
+            std::map<int, BezierPolygon>::const_iterator polygon = found->second.polygons.find(nbPointsPerSegment);
+            if ( polygon != found->second.polygons.end() ) {
+                appendPolygon(polygon->second, points, bbox);
+                ++_imp->evaluationsCacheHits;
 
-    if ( _imp->points.empty() ) {
-        return;
+                return;
+            }
+        }
+        age = _imp->pointsAge;
     }
-    ++next;
-    for (BezierCPs::const_iterator it = _imp->points.begin(); it != _imp->points.end(); ++it,++next) {
-        if ( next == _imp->points.end() ) {
-            if (!_imp->finished) {
-                break;
+
+    BezierPolygon polygon;
+    setEmptyBBox(&polygon.bbox);
+    bool cacheable;
+    {
+        QMutexLocker l(&itemMutex);
+        BezierCPs::const_iterator next = _imp->points.begin();
+
+        if ( _imp->points.empty() ) {
+            return;
+        }
+        ++next;
+        for (BezierCPs::const_iterator it = _imp->points.begin(); it != _imp->points.end(); ++it,++next) {
+            if ( next == _imp->points.end() ) {
+                if (!_imp->finished) {
+                    break;
+                }
+                next = _imp->points.begin();
             }
-            next = _imp->points.begin();
+            bezierSegmentEval(*(*it),*(*next), time,mipMapLevel, nbPointsPerSegment, &polygon.points,&polygon.bbox);
+        }
+        ///points slaved to a track move without any change of the Bezier
+        cacheable = !_imp->hasSlavedPoints();
+    }
+    appendPolygon(polygon, points, bbox);
+
+    if (cacheable) {
+        QMutexLocker k(&_imp->evaluationsMutex);
+        ///the evaluation is discarded if the points changed meanwhile
+        if (_imp->pointsAge == age) {
+            BezierPolygon & cached = _imp->getEvaluationForInsertion(time, mipMapLevel)->polygons[nbPointsPerSegment];
+            cached.points.swap(polygon.points);
+            cached.bbox = polygon.bbox;
         }
-        bezierSegmentEval(*(*it),*(*next), time,mipMapLevel, nbPointsPerSegment, points,bbox);
     }
 }
 
@@ -3031,55 +3118,108 @@ Bezier::evaluateFeatherPointsAtTime_DeCasteljau(int time,
                                                 std::list< Natron::Point >* points, ///< output
                                                 RectD* bbox) const ///< output
 {
-    QMutexLocker l(&itemMutex);
+    U64 age = 0;
+    if (evaluateIfEqual) {
+        QMutexLocker k(&_imp->evaluationsMutex);
+        BezierEvaluations::const_iterator found = _imp->evaluations.find( std::make_pair(time, mipMapLevel) );
+        if ( found != _imp->evaluations.end() ) {
+            std::map<int, BezierPolygon>::const_iterator polygon = found->second.featherPolygons.find(nbPointsPerSegment);
+            if ( polygon != found->second.featherPolygons.end() ) {
+                appendPolygon(polygon->second, points, bbox);
+                ++_imp->evaluationsCacheHits;
 
-    if ( _imp->points.empty() ) {
-        return;
+                return;
+            }
+        }
+        age = _imp->pointsAge;
     }
-    BezierCPs::const_iterator itCp = _imp->points.begin();
-    BezierCPs::const_iterator next = _imp->featherPoints.begin();
-    ++next;
-    BezierCPs::const_iterator nextCp = itCp;
-    ++nextCp;
-    for (BezierCPs::const_iterator it = _imp->featherPoints.begin(); it != _imp->featherPoints.end(); ++it,++itCp,++next,++nextCp) {
-        if ( next == _imp->featherPoints.end() ) {
-            next = _imp->featherPoints.begin();
+
+    BezierPolygon polygon;
+    setEmptyBBox(&polygon.bbox);
+    bool cacheable;
+    {
+        QMutexLocker l(&itemMutex);
+
+        if ( _imp->points.empty() ) {
+            return;
         }
-        if ( nextCp == _imp->points.end() ) {
-            if (!_imp->finished) {
-                break;
+        BezierCPs::const_iterator itCp = _imp->points.begin();
+        BezierCPs::const_iterator next = _imp->featherPoints.begin();
+        ++next;
+        BezierCPs::const_iterator nextCp = itCp;
+        ++nextCp;
+        for (BezierCPs::const_iterator it = _imp->featherPoints.begin(); it != _imp->featherPoints.end(); ++it,++itCp,++next,++nextCp) {
+            if ( next == _imp->featherPoints.end() ) {
+                next = _imp->featherPoints.begin();
             }
-            nextCp = _imp->points.begin();
-        }
-        if ( !evaluateIfEqual && bezierSegmenEqual(time, **itCp, **nextCp, **it, **next) ) {
-            continue;
+            if ( nextCp == _imp->points.end() ) {
+                if (!_imp->finished) {
+                    break;
+                }
+                nextCp = _imp->points.begin();
+            }
+            if ( !evaluateIfEqual && bezierSegmenEqual(time, **itCp, **nextCp, **it, **next) ) {
+                continue;
+            }
+
+            bezierSegmentEval(*(*it),*(*next), time, mipMapLevel, nbPointsPerSegment, &polygon.points, &polygon.bbox);
         }
+        cacheable = evaluateIfEqual && !_imp->hasSlavedPoints();
+    }
+    appendPolygon(polygon, points, bbox);
 
-        bezierSegmentEval(*(*it),*(*next), time, mipMapLevel, nbPointsPerSegment, points, bbox);
+    if (cacheable) {
+        QMutexLocker k(&_imp->evaluationsMutex);
+        if (_imp->pointsAge == age) {
+            BezierPolygon & cached = _imp->getEvaluationForInsertion(time, mipMapLevel)->featherPolygons[nbPointsPerSegment];
+            cached.points.swap(polygon.points);
+            cached.bbox = polygon.bbox;
+        }
     }
 }
 
 RectD
 Bezier::getBoundingBox(int time) const
 {
-    std::list<Point> pts;
     RectD bbox; // a very empty bbox
+    bool found = false;
+    U64 age;
+    {
+        QMutexLocker k(&_imp->evaluationsMutex);
+        BezierEvaluations::const_iterator it = _imp->evaluations.find( std::make_pair(time, 0U) );
+        if ( ( it != _imp->evaluations.end() ) && it->second.hasBoundingBox ) {
+            bbox = it->second.boundingBox;
+            found = true;
+            ++_imp->evaluationsCacheHits;
+        }
+        age = _imp->pointsAge;
+    }
 
-    bbox.x1 = std::numeric_limits<double>::infinity();
-    bbox.x2 = -std::numeric_limits<double>::infinity();
-    bbox.y1 = std::numeric_limits<double>::infinity();
-    bbox.y2 = -std::numeric_limits<double>::infinity();
-
-    QMutexLocker l(&itemMutex);
-    bezierSegmentListBboxUpdate(_imp->points, _imp->finished, time, 0, &bbox);
+    if (!found) {
+        setEmptyBBox(&bbox);
+        bool cacheable;
+        {
+            QMutexLocker l(&itemMutex);
+            bezierSegmentListBboxUpdate(_imp->points, _imp->finished, time, 0, &bbox);
 #pragma message WARN("TODO: use featherPointsAtDistance")
-    // BUG https://github.com/MrKepzie/Natron/issues/145 : the feather Bezier must be moved by featherdistance before RoD computation!
-    bezierSegmentListBboxUpdate(_imp->featherPoints, _imp->finished, time, 0, &bbox);
-    
+            // BUG https://github.com/MrKepzie/Natron/issues/145 : the feather Bezier must be moved by featherdistance before RoD computation!
+            bezierSegmentListBboxUpdate(_imp->featherPoints, _imp->finished, time, 0, &bbox);
+            cacheable = !_imp->hasSlavedPoints();
+        }
+        if (cacheable) {
+            QMutexLocker k(&_imp->evaluationsMutex);
+            if (_imp->pointsAge == age) {
+                BezierEvaluation* evaluation = _imp->getEvaluationForInsertion(time, 0);
+                evaluation->hasBoundingBox = true;
+                evaluation->boundingBox = bbox;
+            }
+        }
+    }
     
     // EDIT: Partial fix, just pad the BBOX by the feather distance. This might not be accurate but gives at least something
     // enclosing the real bbox and close enough
-    double featherDistance = getFeatherDistance(time);
+    // The feather distance may be negative when the feather goes inward, the bbox must not shrink
+    double featherDistance = std::abs( getFeatherDistance(time) );
     bbox.x1 -= featherDistance;
     bbox.x2 += featherDistance;
     bbox.y1 -= featherDistance;
@@ -3087,6 +3227,23 @@ Bezier::getBoundingBox(int time) const
     return bbox;
 }
 
+void
+Bezier::incrementPointsAge()
+{
+    QMutexLocker k(&_imp->evaluationsMutex);
+
+    ++_imp->pointsAge;
+    _imp->evaluations.clear();
+}
+
+U64
+Bezier::getEvaluationsCacheHits() const
+{
+    QMutexLocker k(&_imp->evaluationsMutex);
+
+    return _imp->evaluationsCacheHits;
+}
+
 const std::list< boost::shared_ptr<BezierCP> > &
 Bezier::getControlPoints() const
 {
@@ -3481,6 +3638,7 @@ Bezier::load(const RotoItemSerialization & obj)
             _imp->featherPoints.push_back(fp);
         }
     }
+    incrementPointsAge();
     RotoDrawableItem::load(obj);
 }
 
@@ -5046,6 +5204,7 @@ RotoContext::renderMask(bool useCache,
     RectI clippedRoI;
     roi.intersect(pixelRod, &clippedRoI);
 
+#ifdef NATRON_ROTO_CAIRO_RENDERER
     cairo_format_t cairoImgFormat;
     switch (components) {
     case Natron::eImageComponentAlpha:
@@ -5095,6 +5254,26 @@ RotoContext::renderMask(bool useCache,
     cairo_destroy(cr);
     ////Free the buffer used by Cairo
     cairo_surface_destroy(cairoImg);
+#else
+    ///The key of the image changes with the shapes: only render the part of the RoI that is not rendered yet
+    std::list<RectI> rectsToRender;
+    if ( image->usesBitMap() ) {
+        image->getRestToRender(clippedRoI, rectsToRender);
+    } else {
+        rectsToRender.push_back(clippedRoI);
+    }
+    if ( !rectsToRender.empty() ) {
+        RectI renderWindow = rectsToRender.front();
+        for (std::list<RectI>::iterator it = rectsToRender.begin(); it != rectsToRender.end(); ++it) {
+            renderWindow.merge(*it);
+        }
+        RotoRasterizer rasterizer;
+        _imp->makeRasterizerShapes(splines, mipmapLevel, time, renderWindow, &rasterizer);
+        for (std::list<RectI>::iterator it = rectsToRender.begin(); it != rectsToRender.end(); ++it) {
+            rasterizer.render(*it, image.get());
+        }
+    }
+#endif
 
 
     ////////////////////////////////////
@@ -5397,6 +5576,84 @@ RotoContextPrivate::renderInternal(cairo_t* cr,
     cairo_surface_flush(cairoImg);
 } // renderInternal
 
+void
+RotoContextPrivate::makeRasterizerShapes(const std::list< boost::shared_ptr<Bezier> > & splines,
+                                         unsigned int mipmapLevel,
+                                         int time,
+                                         const RectI & roi,
+                                         Natron::RotoRasterizer* rasterizer)
+{
+    for (std::list<boost::shared_ptr<Bezier> >::const_iterator it2 = splines.begin(); it2 != splines.end(); ++it2) {
+        ///render the bezier only if finished (closed) and activated
+        if ( !(*it2)->isCurveFinished() || !(*it2)->isActivated(time) || ( (*it2)->getControlPointsCount() <= 1 ) ) {
+            continue;
+        }
+
+        RotoRasterizerShape shape;
+        shape.featherFallOff = (*it2)->getFeatherFallOff(time);
+        shape.opacity = (*it2)->getOpacity(time);
+#ifdef NATRON_ROTO_INVERTIBLE
+        shape.inverted = (*it2)->getInverted(time);
+#endif
+        shape.compositingOperator = (*it2)->getCompositingOperator(time);
+
+        ///A shape which cannot change the pixels outside of its bounding box is not evaluated if they are all outside of the roi
+        if ( !shape.inverted && RotoRasterizer::isOperatorBounded(shape.compositingOperator) ) {
+            RectI pixelBBox;
+            (*it2)->getBoundingBox(time).toPixelEnclosing(mipmapLevel, 1., &pixelBBox);
+            if ( !pixelBBox.intersects(roi) ) {
+                continue;
+            }
+        }
+        (*it2)->getColor(time, shape.color);
+
+        double featherDist = (*it2)->getFeatherDistance(time);
+        ///Adjust the feather distance so it takes the mipmap level into account
+        if (mipmapLevel != 0) {
+            featherDist /= (1 << mipmapLevel);
+        }
+
+        std::list<Point> featherPolygon;
+        std::list<Point> bezierPolygon;
+        (*it2)->evaluateFeatherPointsAtTime_DeCasteljau(time, mipmapLevel, 50, true, &featherPolygon, NULL);
+        (*it2)->evaluateAtTime_DeCasteljau(time, mipmapLevel, 50, &bezierPolygon, NULL);
+        if (bezierPolygon.size() < 3) {
+            continue;
+        }
+        shape.polygon.assign( bezierPolygon.begin(), bezierPolygon.end() );
+
+        ///The feather contour is the feather polygon moved by the feather distance along its normals, outwards
+        ///for a positive distance. Unlike renderInternal, the outside is given by the orientation of the polygon,
+        ///computed once from its signed area, rather than by a pointInPolygon test for each point.
+        if ( featherPolygon.size() == bezierPolygon.size() ) {
+            std::vector<Point> fps( featherPolygon.begin(), featherPolygon.end() );
+            std::size_t pointsCount = fps.size();
+            double area = 0.;
+            for (std::size_t i = 0; i < pointsCount; ++i) {
+                const Point & p0 = fps[i];
+                const Point & p1 = fps[(i + 1) % pointsCount];
+                area += p0.x * p1.y - p1.x * p0.y;
+            }
+            ///(-dy, dx) points inside a counter-clockwise polygon
+            double normalFactor = ( (area > 0.) == (featherDist > 0.) ) ? -std::abs(featherDist) : std::abs(featherDist);
+            shape.featherContour.resize(pointsCount);
+            for (std::size_t i = 0; i < pointsCount; ++i) {
+                const Point & prev = fps[(i + pointsCount - 1) % pointsCount];
+                const Point & cur = fps[i];
+                const Point & next = fps[(i + 1) % pointsCount];
+                double norm = sqrt( (next.x - prev.x) * (next.x - prev.x) + (next.y - prev.y) * (next.y - prev.y) );
+                Point & p = shape.featherContour[i];
+                p = cur;
+                if (norm != 0) {
+                    p.x -= ( (next.y - prev.y) / norm ) * normalFactor;
+                    p.y += ( (next.x - prev.x) / norm ) * normalFactor;
+                }
+            }
+        }
+        rasterizer->addShape(shape);
+    } // foreach(splines)
+} // makeRasterizerShapes
+
 void
 RotoContextPrivate::renderInternalShape(int time,
                                         unsigned int mipmapLevel,
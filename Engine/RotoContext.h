@@ -669,6 +669,8 @@ public:
     /**
      * @brief Evaluates the spline at the given time and returns the list of all the points on the curve.
      * @param nbPointsPerSegment controls how many points are used to draw one Bezier segment
+     * The points are appended to points and bbox is grown to enclose the Bezier segments. The result is cached until
+     * the points change, see incrementPointsAge().
      **/
     void evaluateAtTime_DeCasteljau(int time,
                                     unsigned int mipMapLevel,
@@ -678,7 +680,7 @@ public:
 
     /**
      * @brief Evaluates the bezier formed by the feather points. Segments which are equal to the control points of the bezier
-     * will not be drawn.
+     * will not be drawn, unless evaluateIfEqual is true: the result is then cached like for evaluateAtTime_DeCasteljau().
      **/
     void evaluateFeatherPointsAtTime_DeCasteljau(int time,
                                                  unsigned int mipMapLevel,
@@ -688,11 +690,20 @@ public:
                                                  RectD* bbox) const;
 
     /**
-     * @brief Returns the bounding box of the bezier. The last value computed by evaluateAtTime_DeCasteljau will be returned,
-     * otherwise if it has never been called, evaluateAtTime_DeCasteljau will be called to compute the bounding box.
+     * @brief Returns the bounding box of the bezier and its feather points, padded by the feather distance. It is cached
+     * along with the evaluated curves.
      **/
     RectD getBoundingBox(int time) const;
 
+    /**
+     * @brief Forgets the curves evaluated so far. Must be called after any change of the control points or the feather points,
+     * the setters of BezierCP do it.
+     **/
+    void incrementPointsAge();
+
+    ///Returns how many evaluations and bounding boxes were read from the cache of evaluated curves so far
+    U64 getEvaluationsCacheHits() const;
+
     /**
      * @brief Returns a const ref to the control points of the bezier curve. This can only ever be called on the main thread.
      **/
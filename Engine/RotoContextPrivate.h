@@ -11,6 +11,7 @@
 #ifndef ROTOCONTEXTPRIVATE_H
 #define ROTOCONTEXTPRIVATE_H
 
+#include <cstdlib>
 #include <list>
 #include <map>
 #include <string>
@@ -36,6 +37,16 @@
 
 #include "Global/GlobalDefines.h"
 
+///Define to render the masks with cairo (RotoContextPrivate::renderInternal) instead of Natron::RotoRasterizer
+//#define NATRON_ROTO_CAIRO_RENDERER
+
+///The number of (time, mipmap level) pairs for which a Bezier keeps its evaluated curves, see BezierPrivate::evaluations
+#define NATRON_BEZIER_EVALUATIONS_CACHE_SIZE 32
+
+namespace Natron {
+class RotoRasterizer;
+}
+
 #define ROTO_DEFAULT_OPACITY 1.
 #define ROTO_DEFAULT_FEATHER 1.5
 #define ROTO_DEFAULT_FEATHERFALLOFF 1.
@@ -138,6 +149,32 @@ struct BezierCPPrivate
 class BezierCP;
 typedef std::list< boost::shared_ptr<BezierCP> > BezierCPs;
 
+struct BezierPolygon
+{
+    std::list<Natron::Point> points;
+    RectD bbox; //< the bounding box of the Bezier segments the points were evaluated on
+};
+
+/**
+ * @brief The curves of a Bezier evaluated at a given time and mipmap level.
+ **/
+struct BezierEvaluation
+{
+    std::map<int, BezierPolygon> polygons; //< evaluateAtTime_DeCasteljau(), by number of points per segment
+    std::map<int, BezierPolygon> featherPolygons; //< evaluateFeatherPointsAtTime_DeCasteljau() with evaluateIfEqual, by number of points per segment
+    bool hasBoundingBox;
+    RectD boundingBox; //< getBoundingBox() before the padding by the feather distance
+
+    BezierEvaluation()
+        : polygons()
+          , featherPolygons()
+          , hasBoundingBox(false)
+          , boundingBox()
+    {
+    }
+};
+
+typedef std::map<std::pair<int, unsigned int>, BezierEvaluation> BezierEvaluations;
 
 struct BezierPrivate
 {
@@ -150,6 +187,13 @@ struct BezierPrivate
     double featherPointsAtDistanceVal; //< the distance value used to compute featherPointsAtDistance. if == 0., use featherPoints. if Bezier::getFeatherDistance() returns a different value, featherPointsAtDistance must be updated.
     bool finished; //< when finished is true, the last point of the list is connected to the first point of the list.
 
+    ///The curves evaluated by time and mipmap level, shared by the RoD, the render and the overlay.
+    ///They are cleared by Bezier::incrementPointsAge() whenever the points change.
+    mutable QMutex evaluationsMutex; //< protects pointsAge, evaluations and evaluationsCacheHits, never locked before the itemMutex
+    U64 pointsAge;
+    BezierEvaluations evaluations;
+    mutable U64 evaluationsCacheHits; //< the evaluations answered from evaluations
+
     BezierPrivate()
         : points()
           , featherPoints()
@@ -157,9 +201,55 @@ struct BezierPrivate
           , featherPointsAtDistance()
           , featherPointsAtDistanceVal(0.)
           , finished(false)
+          , evaluationsMutex()
+          , pointsAge(0)
+          , evaluations()
+          , evaluationsCacheHits(0)
     {
     }
 
+    bool hasSlavedPoints() const
+    {
+        // PRIVATE - should not lock
+
+        for (BezierCPs::const_iterator it = points.begin(); it != points.end(); ++it) {
+            if ( (*it)->isSlaved() ) {
+                return true;
+            }
+        }
+        for (BezierCPs::const_iterator it = featherPoints.begin(); it != featherPoints.end(); ++it) {
+            if ( (*it)->isSlaved() ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    BezierEvaluation* getEvaluationForInsertion(int time,
+                                                unsigned int mipMapLevel)
+    {
+        // PRIVATE - should not lock, evaluationsMutex must be locked by the caller
+
+        std::pair<int, unsigned int> key(time,mipMapLevel);
+        BezierEvaluations::iterator found = evaluations.find(key);
+        if ( found != evaluations.end() ) {
+            return &found->second;
+        }
+        if (evaluations.size() >= NATRON_BEZIER_EVALUATIONS_CACHE_SIZE) {
+            ///forget the evaluation which is the farthest in time from the new one
+            BezierEvaluations::iterator farthest = evaluations.begin();
+            for (BezierEvaluations::iterator it = evaluations.begin(); it != evaluations.end(); ++it) {
+                if ( std::abs(it->first.first - time) > std::abs(farthest->first.first - time) ) {
+                    farthest = it;
+                }
+            }
+            evaluations.erase(farthest);
+        }
+
+        return &evaluations[key];
+    }
+
     bool hasKeyframeAtTime(int time) const
     {
         // PRIVATE - should not lock
@@ -675,6 +765,14 @@ struct RotoContextPrivate
     void renderInternalShape(int time,unsigned int mipmapLevel,cairo_t* cr,const BezierCPs & cps);
 
     void applyAndDestroyMask(cairo_t* cr,cairo_pattern_t* mesh);
+
+    /**
+     * @brief Adds to the rasterizer the polygons and feather contours of the splines that must be rendered,
+     * this is the equivalent of renderInternal for the rasterizer. Splines which cannot change the pixels of roi
+     * (in pixel coordinates at mipmapLevel) are skipped.
+     **/
+    void makeRasterizerShapes(const std::list< boost::shared_ptr<Bezier> > & splines,unsigned int mipmapLevel,int time,
+                              const RectI & roi,Natron::RotoRasterizer* rasterizer);
 };
 
 
@@ -0,0 +1,865 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "RotoRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifndef Q_MOC_RUN
+#include <boost/bind.hpp>
+#endif
+
+#include <cairo/cairo.h>
+
+#include "Engine/Image.h"
+#include "Engine/TaskScheduler.h"
+
+///Number of intervals of the table giving the alpha of the feather from the distance across it
+#define NATRON_ROTO_RASTERIZER_FALLOFF_LUT_SIZE 1024
+
+using namespace Natron;
+
+namespace {
+///An edge of a polygon, with y0 < y1. It crosses the scanlines y0 <= y < y1.
+struct Edge
+{
+    double y0;
+    double y1;
+    double x0; //< x at y0
+    double dxdy;
+    int winding;
+};
+
+bool
+compareEdgesY0(const Edge & lhs,
+               const Edge & rhs)
+{
+    return lhs.y0 < rhs.y0;
+}
+
+struct Crossing
+{
+    double x;
+    int winding;
+
+    Crossing(double x,
+             int winding)
+        : x(x)
+          , winding(winding)
+    {
+    }
+
+    bool operator<(const Crossing & other) const
+    {
+        return x < other.x;
+    }
+};
+
+/**
+ * @brief A quadrilateral of the feather: a and b are on the polygon, c and d on the feather contour, facing b and a.
+ * Its points are a + u * e + v * f + u * v * g with u and v in [0,1], v being the distance across the feather.
+ **/
+struct FeatherPatch
+{
+    Natron::Point corners[4]; //< a, b, c, d
+    Natron::Point a;
+    Natron::Point e; //< b - a
+    Natron::Point f; //< d - a
+    Natron::Point g; //< a - b + c - d
+    double crossEF;
+    double crossGF;
+    RectI bbox; //< pixels whose center may be in the patch
+};
+
+inline double
+cross(double x0,
+      double y0,
+      double x1,
+      double y1)
+{
+    return x0 * y1 - y0 * x1;
+}
+
+/**
+ * @brief Returns in v the distance across the patch of (x,y), between 0 on the polygon and 1 on the feather contour.
+ * Returns false if (x,y) is not in the patch.
+ **/
+bool
+getFeatherDistance(const FeatherPatch & p,
+                   double x,
+                   double y,
+                   double* v)
+{
+    const double eps = 1e-9;
+    double hx = x - p.a.x;
+    double hy = y - p.a.y;
+    ///inverting the bilinear interpolation gives p.crossGF * v^2 + k1 * v + k0 = 0
+    double k0 = cross(hx, hy, p.e.x, p.e.y);
+    double k1 = p.crossEF + cross(hx, hy, p.g.x, p.g.y);
+    double k2 = p.crossGF;
+    double discriminant = k1 * k1 - 4. * k0 * k2;
+
+    if (discriminant < 0.) {
+        return false;
+    }
+    ///numerically stable roots, k2 is close to 0 when the patch is a parallelogram
+    double q = -0.5 * ( k1 + (k1 >= 0. ? std::sqrt(discriminant) : -std::sqrt(discriminant)) );
+    double roots[2];
+    int rootsCount = 0;
+    if (k2 != 0.) {
+        roots[rootsCount++] = q / k2;
+    }
+    if (q != 0.) {
+        roots[rootsCount++] = k0 / q;
+    }
+    for (int i = 0; i < rootsCount; ++i) {
+        double r = roots[i];
+        if ( (r < -eps) || (r > 1. + eps) ) {
+            continue;
+        }
+        double dx = p.e.x + p.g.x * r;
+        double dy = p.e.y + p.g.y * r;
+        double u;
+        if ( std::abs(dx) >= std::abs(dy) ) {
+            if (dx == 0.) {
+                continue;
+            }
+            u = (hx - p.f.x * r) / dx;
+        } else {
+            u = (hy - p.f.y * r) / dy;
+        }
+        if ( (u >= -eps) && (u <= 1. + eps) ) {
+            *v = std::max( 0., std::min(r, 1.) );
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief The sides of the cairo mesh patches formerly used for the feather were cubic Bezier curves from the polygon to
+ * the feather contour, with control points at c1 and c2 of the distance for the given fall-off. The alpha was linear
+ * along the curve parameter t, and squared because the mesh was both the source and the mask.
+ * Returns the alpha factor of the feather at each distance across it, to render the same feather.
+ **/
+void
+makeFallOffLut(double fallOff,
+               std::vector<float>* lut)
+{
+    double f2 = fallOff * fallOff;
+    double c1 = 1. / (2. * f2 + 1.);
+    double c2 = 2. / (f2 + 2.);
+
+    lut->resize(NATRON_ROTO_RASTERIZER_FALLOFF_LUT_SIZE + 1);
+    for (int i = 0; i <= NATRON_ROTO_RASTERIZER_FALLOFF_LUT_SIZE; ++i) {
+        double distance = (double)i / NATRON_ROTO_RASTERIZER_FALLOFF_LUT_SIZE;
+        ///the curve is monotonic: bisect its parameter
+        double lo = 0.;
+        double hi = 1.;
+        for (int k = 0; k < 30; ++k) {
+            double t = (lo + hi) / 2.;
+            double s = 1. - t;
+            double b = 3. * t * s * s * c1 + 3. * t * t * s * c2 + t * t * t;
+            if (b < distance) {
+                lo = t;
+            } else {
+                hi = t;
+            }
+        }
+        double alpha = 1. - (lo + hi) / 2.;
+        (*lut)[i] = (float)(alpha * alpha);
+    }
+}
+
+inline float
+multiplyBlend(float s,
+              float d)
+{
+    return s * d;
+}
+
+inline float
+screenBlend(float s,
+            float d)
+{
+    return s + d - s * d;
+}
+
+inline float
+hardLightBlend(float s,
+               float d)
+{
+    return s <= 0.5f ? multiplyBlend(2.f * s, d) : screenBlend(2.f * s - 1.f, d);
+}
+
+inline float
+colorDodgeBlend(float s,
+                float d)
+{
+    if (d <= 0.f) {
+        return 0.f;
+    }
+    if (s >= 1.f) {
+        return 1.f;
+    }
+
+    return std::min(1.f, d / (1.f - s) );
+}
+
+inline float
+colorBurnBlend(float s,
+               float d)
+{
+    if (d >= 1.f) {
+        return 1.f;
+    }
+    if (s <= 0.f) {
+        return 0.f;
+    }
+
+    return 1.f - std::min(1.f, (1.f - d) / s);
+}
+
+inline float
+softLightBlend(float s,
+               float d)
+{
+    if (s <= 0.5f) {
+        return d - (1.f - 2.f * s) * d * (1.f - d);
+    }
+    float dd = d <= 0.25f ? ( (16.f * d - 12.f) * d + 4.f ) * d : std::sqrt(d);
+
+    return d + (2.f * s - 1.f) * (dd - d);
+}
+
+inline float
+separableBlend(int op,
+               float s,
+               float d)
+{
+    switch (op) {
+    case CAIRO_OPERATOR_MULTIPLY:
+
+        return multiplyBlend(s, d);
+    case CAIRO_OPERATOR_SCREEN:
+
+        return screenBlend(s, d);
+    case CAIRO_OPERATOR_OVERLAY:
+
+        return hardLightBlend(d, s);
+    case CAIRO_OPERATOR_DARKEN:
+
+        return std::min(s, d);
+    case CAIRO_OPERATOR_LIGHTEN:
+
+        return std::max(s, d);
+    case CAIRO_OPERATOR_COLOR_DODGE:
+
+        return colorDodgeBlend(s, d);
+    case CAIRO_OPERATOR_COLOR_BURN:
+
+        return colorBurnBlend(s, d);
+    case CAIRO_OPERATOR_HARD_LIGHT:
+
+        return hardLightBlend(s, d);
+    case CAIRO_OPERATOR_SOFT_LIGHT:
+
+        return softLightBlend(s, d);
+    case CAIRO_OPERATOR_DIFFERENCE:
+
+        return std::abs(s - d);
+    case CAIRO_OPERATOR_EXCLUSION:
+
+        return s + d - 2.f * s * d;
+    default:
+
+        return s;
+    }
+}
+
+///The non-separable blend modes, as defined in the PDF specification (and implemented by pixman)
+inline float
+getLuminosity(const float c[3])
+{
+    return 0.3f * c[0] + 0.59f * c[1] + 0.11f * c[2];
+}
+
+inline float
+getSaturation(const float c[3])
+{
+    return std::max( c[0], std::max(c[1], c[2]) ) - std::min( c[0], std::min(c[1], c[2]) );
+}
+
+void
+setLuminosity(float c[3],
+              float l)
+{
+    float d = l - getLuminosity(c);
+
+    for (int i = 0; i < 3; ++i) {
+        c[i] += d;
+    }
+    l = getLuminosity(c);
+    float n = std::min( c[0], std::min(c[1], c[2]) );
+    float x = std::max( c[0], std::max(c[1], c[2]) );
+    for (int i = 0; i < 3; ++i) {
+        if ( (n < 0.f) && (l != n) ) {
+            c[i] = l + (c[i] - l) * l / (l - n);
+        }
+        if ( (x > 1.f) && (x != l) ) {
+            c[i] = l + (c[i] - l) * (1.f - l) / (x - l);
+        }
+    }
+}
+
+void
+setSaturation(float c[3],
+              float s)
+{
+    int iMax = 0;
+    int iMin = 0;
+
+    for (int i = 1; i < 3; ++i) {
+        if (c[i] > c[iMax]) {
+            iMax = i;
+        }
+        if (c[i] < c[iMin]) {
+            iMin = i;
+        }
+    }
+    if (iMax == iMin) {
+        c[0] = c[1] = c[2] = 0.f;
+
+        return;
+    }
+    int iMid = 3 - iMax - iMin;
+    c[iMid] = (c[iMid] - c[iMin]) * s / (c[iMax] - c[iMin]);
+    c[iMax] = s;
+    c[iMin] = 0.f;
+}
+
+void
+nonSeparableBlend(int op,
+                  const float s[3],
+                  const float d[3],
+                  float ret[3])
+{
+    switch (op) {
+    case CAIRO_OPERATOR_HSL_HUE:
+        std::copy(s, s + 3, ret);
+        setSaturation( ret, getSaturation(d) );
+        setLuminosity( ret, getLuminosity(d) );
+        break;
+    case CAIRO_OPERATOR_HSL_SATURATION:
+        std::copy(d, d + 3, ret);
+        setSaturation( ret, getSaturation(s) );
+        setLuminosity( ret, getLuminosity(d) );
+        break;
+    case CAIRO_OPERATOR_HSL_COLOR:
+        std::copy(s, s + 3, ret);
+        setLuminosity( ret, getLuminosity(d) );
+        break;
+    default:
+        std::copy(d, d + 3, ret);
+        setLuminosity( ret, getLuminosity(s) );
+        break;
+    }
+}
+
+/**
+ * @brief Composites a shape of the given color and opacity, covering the pixel by coverage, on the premultiplied
+ * RGBA pixel dst. As with cairo, the source is multiplied by the coverage except for the clear and source operators
+ * which interpolate the destination towards their result.
+ **/
+void
+compositePixel(int op,
+               const float color[3],
+               float opacity,
+               float coverage,
+               float* dst)
+{
+    if (op == CAIRO_OPERATOR_CLEAR) {
+        for (int i = 0; i < 4; ++i) {
+            dst[i] *= 1.f - coverage;
+        }
+
+        return;
+    } else if (op == CAIRO_OPERATOR_SOURCE) {
+        for (int i = 0; i < 3; ++i) {
+            dst[i] += (color[i] * opacity - dst[i]) * coverage;
+        }
+        dst[3] += (opacity - dst[3]) * coverage;
+
+        return;
+    }
+
+    float sa = opacity * coverage;
+    float da = dst[3];
+    float fa, fb;
+    switch (op) {
+    case CAIRO_OPERATOR_OVER:
+        fa = 1.f; fb = 1.f - sa;
+        break;
+    case CAIRO_OPERATOR_IN:
+        fa = da; fb = 0.f;
+        break;
+    case CAIRO_OPERATOR_OUT:
+        fa = 1.f - da; fb = 0.f;
+        break;
+    case CAIRO_OPERATOR_ATOP:
+        fa = da; fb = 1.f - sa;
+        break;
+    case CAIRO_OPERATOR_DEST:
+
+        return;
+    case CAIRO_OPERATOR_DEST_OVER:
+        fa = 1.f - da; fb = 1.f;
+        break;
+    case CAIRO_OPERATOR_DEST_IN:
+        fa = 0.f; fb = sa;
+        break;
+    case CAIRO_OPERATOR_DEST_OUT:
+        fa = 0.f; fb = 1.f - sa;
+        break;
+    case CAIRO_OPERATOR_DEST_ATOP:
+        fa = 1.f - da; fb = sa;
+        break;
+    case CAIRO_OPERATOR_XOR:
+        fa = 1.f - da; fb = 1.f - sa;
+        break;
+    case CAIRO_OPERATOR_ADD:
+        fa = 1.f; fb = 1.f;
+        break;
+    case CAIRO_OPERATOR_SATURATE:
+        fa = sa > 0.f ? std::min(1.f, (1.f - da) / sa) : 1.f; fb = 1.f;
+        break;
+    default: {
+        ///blend modes: the source and the destination are mixed where they overlap
+        if (sa <= 0.f) {
+            return;
+        }
+        float d[3];
+        for (int i = 0; i < 3; ++i) {
+            d[i] = da > 0.f ? dst[i] / da : 0.f;
+        }
+        float b[3];
+        if (op >= CAIRO_OPERATOR_HSL_HUE) {
+            nonSeparableBlend(op, color, d, b);
+        } else {
+            for (int i = 0; i < 3; ++i) {
+                b[i] = separableBlend(op, color[i], d[i]);
+            }
+        }
+        for (int i = 0; i < 3; ++i) {
+            dst[i] = (1.f - da) * color[i] * sa + (1.f - sa) * dst[i] + sa * da * b[i];
+        }
+        dst[3] = sa + da - sa * da;
+
+        return;
+    }
+    }
+    for (int i = 0; i < 3; ++i) {
+        dst[i] = std::min(color[i] * sa * fa + dst[i] * fb, 1.f);
+    }
+    dst[3] = std::min(sa * fa + da * fb, 1.f);
+} // compositePixel
+
+template <typename PIX,int maxValue>
+PIX
+convertValue(float v)
+{
+    return PIX(std::max( 0.f, std::min(v, 1.f) ) * maxValue + 0.5f);
+}
+
+template <>
+float
+convertValue<float, 1>(float v)
+{
+    return v;
+}
+
+template <typename PIX,int maxValue>
+void
+writeTile(const RectI & tile,
+          const float* rgba,
+          Natron::Image* image)
+{
+    int comps = (int)image->getComponentsCount();
+
+    for (int y = tile.y1; y < tile.y2; ++y) {
+        const float* srcPix = rgba + (y - tile.y1) * tile.width() * 4;
+        ///the pixels of a row are contiguous only within a tile of a tiled image
+        for (int x = tile.x1; x < tile.x2; ) {
+            int spanEnd = std::min(image->getContiguousRowEnd(x), tile.x2);
+            PIX* dstPix = (PIX*)image->pixelAt(x, y);
+            assert(dstPix);
+            for (; x < spanEnd; ++x, srcPix += 4, dstPix += comps) {
+                if (comps == 1) {
+                    dstPix[0] = convertValue<PIX, maxValue>(srcPix[3]);
+                } else {
+                    dstPix[0] = convertValue<PIX, maxValue>(srcPix[0]);
+                    dstPix[1] = convertValue<PIX, maxValue>(srcPix[1]);
+                    dstPix[2] = convertValue<PIX, maxValue>(srcPix[2]);
+                    if (comps == 4) {
+                        dstPix[3] = convertValue<PIX, maxValue>(srcPix[3]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void
+addSpan(float* row,
+        int width,
+        double xa,
+        double xb,
+        float weight)
+{
+    xa = std::max(xa, 0.);
+    xb = std::min(xb, (double)width);
+    if (xb <= xa) {
+        return;
+    }
+    int ia = (int)xa;
+    int ib = (int)xb;
+    if (ia == ib) {
+        row[ia] += (float)(xb - xa) * weight;
+
+        return;
+    }
+    row[ia] += (float)(ia + 1 - xa) * weight;
+    for (int i = ia + 1; i < ib; ++i) {
+        row[i] += weight;
+    }
+    if (ib < width) {
+        row[ib] += (float)(xb - ib) * weight;
+    }
+}
+
+struct ShapeData
+{
+    RotoRasterizerShape shape;
+    std::vector<Edge> edges; //< sorted by y0
+    std::vector<FeatherPatch> patches;
+    std::vector<float> fallOffLut;
+    RectI bbox; //< pixels touched by the polygon or the feather
+    float color[3];
+};
+} // anon namespace
+
+struct Natron::RotoRasterizerPrivate
+{
+    std::vector<ShapeData> shapes;
+
+    void rasterizeFill(const ShapeData & s,
+                       const RectI & area,
+                       float* coverage) const;
+
+    void rasterizeFeather(const ShapeData & s,
+                          const RectI & area,
+                          float* feather) const;
+};
+
+RotoRasterizer::RotoRasterizer()
+    : _imp( new RotoRasterizerPrivate() )
+{
+}
+
+RotoRasterizer::~RotoRasterizer()
+{
+}
+
+void
+RotoRasterizer::addShape(const RotoRasterizerShape & shape)
+{
+    if (shape.polygon.size() < 3) {
+        return;
+    }
+    assert( shape.featherContour.empty() || shape.featherContour.size() == shape.polygon.size() );
+
+    _imp->shapes.push_back( ShapeData() );
+    ShapeData & s = _imp->shapes.back();
+    s.shape = shape;
+    for (int i = 0; i < 3; ++i) {
+        s.color[i] = (float)shape.color[i];
+    }
+
+    double xMin = std::numeric_limits<double>::infinity();
+    double yMin = xMin;
+    double xMax = -xMin;
+    double yMax = -xMin;
+    std::size_t pointsCount = shape.polygon.size();
+    for (std::size_t i = 0; i < pointsCount; ++i) {
+        const Natron::Point & p0 = shape.polygon[i == 0 ? pointsCount - 1 : i - 1];
+        const Natron::Point & p1 = shape.polygon[i];
+        xMin = std::min(xMin, p1.x);
+        xMax = std::max(xMax, p1.x);
+        yMin = std::min(yMin, p1.y);
+        yMax = std::max(yMax, p1.y);
+        if (p0.y == p1.y) {
+            continue;
+        }
+        Edge e;
+        if (p0.y < p1.y) {
+            e.y0 = p0.y; e.y1 = p1.y; e.x0 = p0.x; e.winding = 1;
+        } else {
+            e.y0 = p1.y; e.y1 = p0.y; e.x0 = p1.x; e.winding = -1;
+        }
+        e.dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+        s.edges.push_back(e);
+    }
+    std::sort(s.edges.begin(), s.edges.end(), compareEdgesY0);
+
+    if ( !shape.featherContour.empty() ) {
+        makeFallOffLut(shape.featherFallOff, &s.fallOffLut);
+        for (std::size_t i = 0; i < pointsCount; ++i) {
+            std::size_t prev = i == 0 ? pointsCount - 1 : i - 1;
+            const Natron::Point & a = shape.polygon[prev];
+            const Natron::Point & b = shape.polygon[i];
+            const Natron::Point & c = shape.featherContour[i];
+            const Natron::Point & d = shape.featherContour[prev];
+            FeatherPatch p;
+            p.corners[0] = a;
+            p.corners[1] = b;
+            p.corners[2] = c;
+            p.corners[3] = d;
+            p.a = a;
+            p.e.x = b.x - a.x; p.e.y = b.y - a.y;
+            p.f.x = d.x - a.x; p.f.y = d.y - a.y;
+            p.g.x = a.x - b.x + c.x - d.x; p.g.y = a.y - b.y + c.y - d.y;
+            p.crossEF = cross(p.e.x, p.e.y, p.f.x, p.f.y);
+            p.crossGF = cross(p.g.x, p.g.y, p.f.x, p.f.y);
+            ///skip the patches of a null feather
+            if ( (std::abs(p.crossEF) < 1e-9) && ( std::abs( cross(c.x - b.x, c.y - b.y, d.x - c.x, d.y - c.y) ) < 1e-9 ) ) {
+                continue;
+            }
+            double px1 = std::min( std::min(a.x, b.x), std::min(c.x, d.x) );
+            double px2 = std::max( std::max(a.x, b.x), std::max(c.x, d.x) );
+            double py1 = std::min( std::min(a.y, b.y), std::min(c.y, d.y) );
+            double py2 = std::max( std::max(a.y, b.y), std::max(c.y, d.y) );
+            xMin = std::min(xMin, px1);
+            xMax = std::max(xMax, px2);
+            yMin = std::min(yMin, py1);
+            yMax = std::max(yMax, py2);
+            p.bbox.set( (int)std::ceil(px1 - 0.5), (int)std::ceil(py1 - 0.5),
+                        (int)std::floor(px2 - 0.5) + 1, (int)std::floor(py2 - 0.5) + 1 );
+            s.patches.push_back(p);
+        }
+    }
+    s.bbox.set( (int)std::floor(xMin), (int)std::floor(yMin), (int)std::ceil(xMax) + 1, (int)std::ceil(yMax) + 1 );
+} // addShape
+
+int
+RotoRasterizer::getShapesCount() const
+{
+    return (int)_imp->shapes.size();
+}
+
+bool
+RotoRasterizer::isOperatorBounded(int compositingOperator)
+{
+    switch (compositingOperator) {
+    case CAIRO_OPERATOR_IN:
+    case CAIRO_OPERATOR_OUT:
+    case CAIRO_OPERATOR_DEST_IN:
+    case CAIRO_OPERATOR_DEST_ATOP:
+
+        return false;
+    default:
+
+        return true;
+    }
+}
+
+void
+RotoRasterizerPrivate::rasterizeFill(const ShapeData & s,
+                                     const RectI & area,
+                                     float* coverage) const
+{
+    const int width = area.width();
+    const float weight = 1.f / NATRON_ROTO_RASTERIZER_SUBSCANLINES;
+    std::vector<const Edge*> active;
+    std::vector<Crossing> crossings;
+    std::size_t nextEdge = 0;
+
+    for (int y = area.y1; y < area.y2; ++y) {
+        float* row = coverage + (y - area.y1) * width;
+        for (int sub = 0; sub < NATRON_ROTO_RASTERIZER_SUBSCANLINES; ++sub) {
+            double scanY = y + (sub + 0.5) / NATRON_ROTO_RASTERIZER_SUBSCANLINES;
+            while ( nextEdge < s.edges.size() && s.edges[nextEdge].y0 <= scanY ) {
+                if (s.edges[nextEdge].y1 > scanY) {
+                    active.push_back(&s.edges[nextEdge]);
+                }
+                ++nextEdge;
+            }
+            crossings.clear();
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < active.size(); ++i) {
+                const Edge* e = active[i];
+                if (e->y1 <= scanY) {
+                    continue;
+                }
+                active[kept++] = e;
+                crossings.push_back( Crossing(e->x0 + (scanY - e->y0) * e->dxdy, e->winding) );
+            }
+            active.resize(kept);
+            std::sort( crossings.begin(), crossings.end() );
+
+            ///non-zero winding rule
+            int winding = 0;
+            double spanStart = 0.;
+            for (std::size_t i = 0; i < crossings.size(); ++i) {
+                int previousWinding = winding;
+                winding += crossings[i].winding;
+                if ( (previousWinding == 0) && (winding != 0) ) {
+                    spanStart = crossings[i].x;
+                } else if ( (previousWinding != 0) && (winding == 0) ) {
+                    addSpan(row, width, spanStart - area.x1, crossings[i].x - area.x1, weight);
+                }
+            }
+        }
+    }
+} // rasterizeFill
+
+void
+RotoRasterizerPrivate::rasterizeFeather(const ShapeData & s,
+                                        const RectI & area,
+                                        float* feather) const
+{
+    const int width = area.width();
+
+    for (std::vector<FeatherPatch>::const_iterator it = s.patches.begin(); it != s.patches.end(); ++it) {
+        RectI patchArea;
+        if ( !it->bbox.intersect(area, &patchArea) ) {
+            continue;
+        }
+        for (int y = patchArea.y1; y < patchArea.y2; ++y) {
+            ///the patches are thin and slanted: only test the pixels between the sides crossing this row
+            double centerY = y + 0.5;
+            double xMin = std::numeric_limits<double>::infinity();
+            double xMax = -xMin;
+            for (int i = 0; i < 4; ++i) {
+                const Natron::Point & p0 = it->corners[i];
+                const Natron::Point & p1 = it->corners[(i + 1) % 4];
+                if ( ( (p0.y <= centerY) && (p1.y >= centerY) ) || ( (p1.y <= centerY) && (p0.y >= centerY) ) ) {
+                    double x = p0.y == p1.y ? p0.x : p0.x + (centerY - p0.y) * (p1.x - p0.x) / (p1.y - p0.y);
+                    xMin = std::min( xMin, std::min(x, p0.y == p1.y ? p1.x : x) );
+                    xMax = std::max( xMax, std::max(x, p0.y == p1.y ? p1.x : x) );
+                }
+            }
+            if (xMax < xMin) {
+                continue;
+            }
+            int x1 = std::max( patchArea.x1, (int)std::ceil(xMin - 0.5) );
+            int x2 = std::min( patchArea.x2, (int)std::floor(xMax - 0.5) + 1 );
+            float* row = feather + (y - area.y1) * width - area.x1;
+            for (int x = x1; x < x2; ++x) {
+                double v;
+                if ( getFeatherDistance(*it, x + 0.5, y + 0.5, &v) ) {
+                    ///patches overlap in the concave parts of the contour
+                    float alpha = s.fallOffLut[(int)(v * NATRON_ROTO_RASTERIZER_FALLOFF_LUT_SIZE + 0.5)];
+                    row[x] = std::max(row[x], alpha);
+                }
+            }
+        }
+    }
+}
+
+void
+RotoRasterizer::renderTile(const RectI & tile,
+                           float* rgba) const
+{
+    std::fill(rgba, rgba + tile.area() * 4, 0.f);
+
+    std::vector<float> coverage;
+    std::vector<float> feather;
+    for (std::vector<ShapeData>::const_iterator it = _imp->shapes.begin(); it != _imp->shapes.end(); ++it) {
+        const RotoRasterizerShape & shape = it->shape;
+        ///An inverted shape covers the pixels outside of it, and some operators clear the destination outside
+        ///of the source: these are composited on the whole tile
+        RectI area;
+        bool intersects = it->bbox.intersect(tile, &area);
+        bool bounded = !shape.inverted && isOperatorBounded(shape.compositingOperator);
+        if (!bounded) {
+            area = tile;
+        } else if (!intersects) {
+            continue;
+        }
+
+        coverage.assign(area.area(), 0.f);
+        feather.assign(area.area(), 0.f);
+        if (intersects) {
+            _imp->rasterizeFill(*it, area, &coverage.front());
+            _imp->rasterizeFeather(*it, area, &feather.front());
+        }
+
+        float opacity = (float)shape.opacity;
+        const float* coveragePix = &coverage.front();
+        const float* featherPix = &feather.front();
+        for (int y = area.y1; y < area.y2; ++y) {
+            float* dstPix = rgba + ( (y - tile.y1) * tile.width() + (area.x1 - tile.x1) ) * 4;
+            for (int x = area.x1; x < area.x2; ++x, ++coveragePix, ++featherPix, dstPix += 4) {
+                ///the alpha of the feather is that of the fill on the polygon: take the max of the two so that
+                ///the anti-aliased edges of the fill do not show under the feather
+                float c = std::max(std::min(*coveragePix, 1.f), *featherPix);
+                if (shape.inverted) {
+                    c = 1.f - c;
+                } else if ( bounded && (c <= 0.f) ) {
+                    continue;
+                }
+                compositePixel(shape.compositingOperator, it->color, opacity, c, dstPix);
+            }
+        }
+    }
+} // renderTile
+
+void
+RotoRasterizer::renderImageTile(const std::vector<RectI>* tiles,
+                                Natron::Image* image,
+                                int tileIndex) const
+{
+    const RectI & tile = (*tiles)[tileIndex];
+    std::vector<float> rgba(tile.area() * 4);
+
+    renderTile(tile, &rgba.front());
+    switch ( image->getBitDepth() ) {
+    case Natron::eImageBitDepthFloat:
+        writeTile<float, 1>(tile, &rgba.front(), image);
+        break;
+    case Natron::eImageBitDepthByte:
+        writeTile<unsigned char, 255>(tile, &rgba.front(), image);
+        break;
+    case Natron::eImageBitDepthShort:
+        writeTile<unsigned short, 65535>(tile, &rgba.front(), image);
+        break;
+    case Natron::eImageBitDepthNone:
+        assert(false);
+        break;
+    }
+}
+
+void
+RotoRasterizer::render(const RectI & roi,
+                       Natron::Image* image) const
+{
+    RectI clippedRoI;
+
+    if ( !roi.intersect(image->getBounds(), &clippedRoI) ) {
+        return;
+    }
+    std::vector<RectI> tiles = RectI::splitRectIntoTiles(clippedRoI, NATRON_ROTO_RASTERIZER_TILE_SIZE);
+    Natron::TaskScheduler::globalInstance()->parallelFor( (int)tiles.size(),
+                                                          boost::bind(&RotoRasterizer::renderImageTile,
+                                                                      this,
+                                                                      &tiles,
+                                                                      image,
+                                                                      _1) );
+}
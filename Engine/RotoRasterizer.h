@@ -0,0 +1,112 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_ROTORASTERIZER_H_
+#define NATRON_ENGINE_ROTORASTERIZER_H_
+
+#include <vector>
+
+#ifndef Q_MOC_RUN
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/Macros.h"
+#include "Global/GlobalDefines.h"
+#include "Engine/Rect.h"
+
+///The RoI is cut in tiles of this many pixels, rendered in parallel. A tile of premultiplied RGBA floats takes 256 KiB
+///at this size.
+#define NATRON_ROTO_RASTERIZER_TILE_SIZE 16384
+
+///Each row of pixels is sampled by this many scanlines to compute the coverage of the edges of the shapes
+#define NATRON_ROTO_RASTERIZER_SUBSCANLINES 4
+
+namespace Natron {
+class Image;
+
+/**
+ * @brief A shape given to the RotoRasterizer, in pixel coordinates of the mipmap level being rendered.
+ **/
+struct RotoRasterizerShape
+{
+    ///The polygon of the Bezier, filled with the non-zero winding rule
+    std::vector<Natron::Point> polygon;
+
+    ///Same size as polygon: the feather is made of the quadrilaterals between 2 consecutive points of polygon and
+    ///the 2 matching points of featherContour. Empty if the shape has no feather.
+    std::vector<Natron::Point> featherContour;
+    double color[3];
+    double opacity;
+    double featherFallOff;
+
+    ///A cairo_operator_t, see getCompositingOperators()
+    int compositingOperator;
+    bool inverted;
+
+    RotoRasterizerShape()
+        : polygon()
+          , featherContour()
+          , opacity(1.)
+          , featherFallOff(1.)
+          , compositingOperator(2) // CAIRO_OPERATOR_OVER
+          , inverted(false)
+    {
+        color[0] = color[1] = color[2] = 1.;
+    }
+};
+
+struct RotoRasterizerPrivate;
+
+/**
+ * @brief Renders the masks of the Roto node without cairo: the shapes are rasterized by scanlines directly in the
+ * output image, on tiles of the region of interest rendered in parallel by the TaskScheduler.
+ *
+ * The fill of a shape has an anti-aliased coverage. The alpha in its feather decreases from the opacity on the polygon
+ * to 0 on the feather contour, with the same profile as the cairo mesh patches formerly used for a given fall-off.
+ * The shapes are composited in order, starting from a transparent image, with the operators of cairo.
+ **/
+class RotoRasterizer
+{
+public:
+
+    RotoRasterizer();
+
+    ~RotoRasterizer();
+
+    void addShape(const RotoRasterizerShape & shape);
+
+    int getShapesCount() const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Returns true if the operator leaves the destination unchanged where the source is transparent: a shape
+     * composited with it, unless inverted, does not change the pixels outside of its bounding box.
+     **/
+    static bool isOperatorBounded(int compositingOperator) WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Renders the shapes in the roi of image, which must be allocated. Only the pixels of the roi are written.
+     **/
+    void render(const RectI & roi,
+                Natron::Image* image) const;
+
+    /**
+     * @brief Renders the shapes in tile, in the calling thread, into rgba which holds tile.width() * tile.height()
+     * premultiplied RGBA pixels, row by row from the bottom.
+     **/
+    void renderTile(const RectI & tile,
+                    float* rgba) const;
+
+private:
+
+    void renderImageTile(const std::vector<RectI>* tiles,
+                         Natron::Image* image,
+                         int tileIndex) const;
+
+    boost::scoped_ptr<RotoRasterizerPrivate> _imp;
+};
+} // namespace Natron
+
+#endif // NATRON_ENGINE_ROTORASTERIZER_H_
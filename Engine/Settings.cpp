@@ -27,7 +27,9 @@
 #include "Engine/Plugin.h"
 #include "Engine/Node.h"
 #include "Engine/ViewerInstance.h"
+#include "Engine/RenderProfiler.h"
 #include "Engine/StandardPaths.h"
+#include "Engine/TaskScheduler.h"
 #include "SequenceParsing.h"
 
 #define NATRON_CUSTOM_OCIO_CONFIG_NAME "Custom config"
@@ -134,6 +136,15 @@ Settings::initializeKnobs()
                                    " wait until it is done to actually auto-save.");
     _generalTab->addKnob(_autoSaveDelay);
 
+    _saveProjectsAsBinary = Natron::createKnob<Bool_Knob>(this, "Save projects in binary format");
+    _saveProjectsAsBinary->setName("saveProjectsAsBinary");
+    _saveProjectsAsBinary->setAnimationEnabled(false);
+    _saveProjectsAsBinary->setHintToolTip("When checked, projects are saved in a binary format which is much faster to save and load "
+                                          "than XML, but which can only be opened by " NATRON_APPLICATION_NAME " on the same kind "
+                                          "of operating system and architecture. Uncheck it to save projects in XML, e.g. to "
+                                          "exchange them. Both formats can always be opened and auto-saves are always binary.");
+    _generalTab->addKnob(_saveProjectsAsBinary);
+
 
     _linearPickers = Natron::createKnob<Bool_Knob>(this, "Linear color pickers");
     _linearPickers->setName("linearPickers");
@@ -195,6 +206,36 @@ Settings::initializeKnobs()
     _nThreadsPerEffect->disableSlider();
     _generalTab->addKnob(_nThreadsPerEffect);
 
+    _hostSMPTileSize = Natron::createKnob<Int_Knob>(this, "Pixels per tile of the host multi-threading (0=\"guess\")");
+    _hostSMPTileSize->setName("hostSMPTileSize");
+    _hostSMPTileSize->setAnimationEnabled(false);
+    _hostSMPTileSize->setHintToolTip("When an effect lets " NATRON_APPLICATION_NAME " split its rendering across threads, the image "
+                                     "is cut in many tiles of at most this number of pixels, and each thread picks the next tile "
+                                     "as soon as it is done with the previous one. Small tiles balance the work better between the threads, "
+                                     "big tiles have less overhead. Images that are not bigger than a tile are rendered by a single thread. "
+                                     "By default (0) the tiles are sized so that a tile of the output and of one input fit in the "
+                                     "processor cache.");
+    _hostSMPTileSize->setMinimum(0);
+    _hostSMPTileSize->disableSlider();
+    _generalTab->addKnob(_hostSMPTileSize);
+
+    _profileRenders = Natron::createKnob<Bool_Knob>(this, "Profile renders");
+    _profileRenders->setName("profileRenders");
+    _profileRenders->setAnimationEnabled(false);
+    _profileRenders->setHintToolTip("When checked, the time spent by each node in its actions, in the cache and waiting for locks "
+                                    "is recorded for every frame and every thread. The recording is written to the profile file "
+                                    "when this is unchecked or when " NATRON_APPLICATION_NAME " quits. It can be opened in the "
+                                    "chrome://tracing page of Google Chrome to find which nodes make a render slow. "
+                                    "Recording slows down the renders slightly.");
+    _generalTab->addKnob(_profileRenders);
+
+    _profileRendersFile = Natron::createKnob<OutputFile_Knob>(this, "Profile file (empty = default)");
+    _profileRendersFile->setName("profileRendersFile");
+    _profileRendersFile->setAnimationEnabled(false);
+    _profileRendersFile->setHintToolTip("The JSON file where the renders profile is written. By default it is written to "
+                                        NATRON_APPLICATION_NAME "_profile<process id>.json in the current directory.");
+    _generalTab->addKnob(_profileRendersFile);
+
     _renderInSeparateProcess = Natron::createKnob<Bool_Knob>(this, "Render in a separate process");
     _renderInSeparateProcess->setName("renderNewProcess");
     _renderInSeparateProcess->setAnimationEnabled(false);
@@ -680,6 +721,32 @@ Settings::initializeKnobs()
     _maxDiskCacheNodeGB->setMaximum(100);
     _maxDiskCacheNodeGB->setHintToolTip("The maximum size that may be used by the DiskCache node on disk (in GiB)");
     _cachingTab->addKnob(_maxDiskCacheNodeGB);
+    
+    std::vector<std::string> evictionPolicies;
+    std::vector<std::string> helpStringsEvictionPolicies;
+    evictionPolicies.push_back("LRU");
+    helpStringsEvictionPolicies.push_back("The least recently used images are removed first.");
+    evictionPolicies.push_back("ARC");
+    helpStringsEvictionPolicies.push_back("Adaptive replacement: images that were viewed several times are kept in favor "
+                                          "of images that were used only once. This works best when going back and forth "
+                                          "in the timeline.");
+    evictionPolicies.push_back("Cost-aware");
+    helpStringsEvictionPolicies.push_back("Among the least recently used images, the ones that are the fastest to render "
+                                          "again relatively to their size are removed first.");
+    
+    _nodeCacheEvictionPolicy = Natron::createKnob<Choice_Knob>(this, "Node cache eviction policy");
+    _nodeCacheEvictionPolicy->setName("nodeCacheEvictionPolicy");
+    _nodeCacheEvictionPolicy->setAnimationEnabled(false);
+    _nodeCacheEvictionPolicy->populateChoices(evictionPolicies,helpStringsEvictionPolicies);
+    _nodeCacheEvictionPolicy->setHintToolTip("How the node cache selects which images to remove from memory when it is full.");
+    _cachingTab->addKnob(_nodeCacheEvictionPolicy);
+    
+    _viewerCacheEvictionPolicy = Natron::createKnob<Choice_Knob>(this, "Playback cache eviction policy");
+    _viewerCacheEvictionPolicy->setName("viewerCacheEvictionPolicy");
+    _viewerCacheEvictionPolicy->setAnimationEnabled(false);
+    _viewerCacheEvictionPolicy->populateChoices(evictionPolicies,helpStringsEvictionPolicies);
+    _viewerCacheEvictionPolicy->setHintToolTip("How the playback cache selects which textures to remove from memory when it is full.");
+    _cachingTab->addKnob(_viewerCacheEvictionPolicy);
 
 
     _diskCachePath = Natron::createKnob<Path_Knob>(this, "Disk cache path (empty = default)");
@@ -696,6 +763,26 @@ Settings::initializeKnobs()
     _diskCachePath->setHintToolTip(diskCacheTt + defaultLocation.toStdString());
     _cachingTab->addKnob(_diskCachePath);
     
+    _sharedDiskCache = Natron::createKnob<Bool_Knob>(this, "Share the disk cache between processes");
+    _sharedDiskCache->setName("sharedDiskCache");
+    _sharedDiskCache->setAnimationEnabled(false);
+    _sharedDiskCache->setHintToolTip("WARNING: Changing this parameter requires a restart of the application. \n"
+                                     "When checked, the images written to the disk portion of the caches by a process are "
+                                     "also available to the other processes of the same machine using the same disk cache path "
+                                     "which have this parameter checked, "
+                                     "e.g: several " NATRON_APPLICATION_NAME " background renders of different frame ranges "
+                                     "of the same project do not compute the images that do not change over time again.");
+    _cachingTab->addKnob(_sharedDiskCache);
+    
+    _tiledNodeCacheImages = Natron::createKnob<Bool_Knob>(this, "Allocate node cache images by tiles");
+    _tiledNodeCacheImages->setName("tiledNodeCacheImages");
+    _tiledNodeCacheImages->setAnimationEnabled(false);
+    _tiledNodeCacheImages->setHintToolTip("When checked, the images kept in RAM by the node cache are split in tiles of "
+                                          "256x256 pixels which are only allocated once something is rendered in them. "
+                                          "The memory used by an image then depends on the area that was rendered "
+                                          "(e.g: the portion of the image visible in the viewer) instead of its region of definition.");
+    _cachingTab->addKnob(_tiledNodeCacheImages);
+    
     ///readers & writers settings are created in a postponed manner because we don't know
     ///their dimension yet. See populateReaderPluginsAndFormats & populateWriterPluginsAndFormats
 
@@ -780,6 +867,7 @@ Settings::setDefaultValues()
     _checkForUpdates->setDefaultValue(false);
     _notifyOnFileChange->setDefaultValue(true);
     _autoSaveDelay->setDefaultValue(5, 0);
+    _saveProjectsAsBinary->setDefaultValue(false);
     _maxUndoRedoNodeGraph->setDefaultValue(20, 0);
     _linearPickers->setDefaultValue(true,0);
     _snapNodesToConnections->setDefaultValue(true);
@@ -789,6 +877,8 @@ Settings::setDefaultValues()
     _numberOfParallelRenders->setDefaultValue(0,0);
     _useThreadPool->setDefaultValue(true);
     _nThreadsPerEffect->setDefaultValue(0);
+    _hostSMPTileSize->setDefaultValue(0);
+    _profileRenders->setDefaultValue(false);
     _renderInSeparateProcess->setDefaultValue(false,0);
     _autoPreviewEnabledForNewProjects->setDefaultValue(true,0);
     _firstReadSetProjectFormat->setDefaultValue(true);
@@ -823,6 +913,10 @@ Settings::setDefaultValues()
     _unreachableRAMPercent->setDefaultValue(5);
     _maxViewerDiskCacheGB->setDefaultValue(5,0);
     _maxDiskCacheNodeGB->setDefaultValue(10,0);
+    _nodeCacheEvictionPolicy->setDefaultValue(0,0);
+    _viewerCacheEvictionPolicy->setDefaultValue(0,0);
+    _sharedDiskCache->setDefaultValue(false);
+    _tiledNodeCacheImages->setDefaultValue(false);
     setCachingLabels();
     _autoTurbo->setDefaultValue(false);
     _defaultNodeColor->setDefaultValue(0.7,0);
@@ -1034,6 +1128,10 @@ Settings::restoreSettings()
     bool useTP = _useThreadPool->getValue();
     appPTR->setUseThreadPool(useTP);
 
+    ///the --profile option of the command line already started the profiler
+    if ( _profileRenders->getValue() && !Natron::RenderProfiler::isRecording() ) {
+        Natron::RenderProfiler::start( getRenderProfileFilePath() );
+    }
     
     _restoringSettings = false;
 } // restoreSettings
@@ -1141,6 +1239,14 @@ Settings::onKnobValueChanged(KnobI* k,
         if (!_restoringSettings) {
             appPTR->setApplicationsCachesMaximumDiskSpace(getMaximumDiskCacheNodeSize());
         }
+    } else if ( k == _nodeCacheEvictionPolicy.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setNodeCacheEvictionPolicy( getNodeCacheEvictionPolicy() );
+        }
+    } else if ( k == _viewerCacheEvictionPolicy.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setViewerCacheEvictionPolicy( getViewerCacheEvictionPolicy() );
+        }
     } else if ( k == _maxRAMPercent.get() ) {
         if (!_restoringSettings) {
             appPTR->setApplicationsCachesMaximumMemoryPercent( getRamMaximumPercent() );
@@ -1158,14 +1264,26 @@ Settings::onKnobValueChanged(KnobI* k,
         appPTR->setNThreadsToRender(nbThreads);
         if (nbThreads == -1) {
             QThreadPool::globalInstance()->setMaxThreadCount(1);
+            Natron::TaskScheduler::globalInstance()->setMaxThreadCount(0);
             appPTR->abortAnyProcessing();
         } else if (nbThreads == 0) {
             QThreadPool::globalInstance()->setMaxThreadCount( QThread::idealThreadCount() );
+            Natron::TaskScheduler::globalInstance()->setMaxThreadCount( QThread::idealThreadCount() );
         } else {
             QThreadPool::globalInstance()->setMaxThreadCount(nbThreads);
+            Natron::TaskScheduler::globalInstance()->setMaxThreadCount(nbThreads);
         }
     } else if ( k == _nThreadsPerEffect.get() ) {
         appPTR->setNThreadsPerEffect( getNumberOfThreadsPerEffect() );
+    } else if ( k == _profileRenders.get() ) {
+        if (!_restoringSettings) {
+            if ( _profileRenders->getValue() ) {
+                Natron::RenderProfiler::start( getRenderProfileFilePath() );
+            } else if ( !Natron::RenderProfiler::stop() ) {
+                Natron::errorDialog( QObject::tr("Profile renders").toStdString(),
+                                     QObject::tr("Could not write the renders profile to ").toStdString() + getRenderProfileFilePath() );
+            }
+        }
     } else if ( k == _ocioConfigKnob.get() ) {
         if ( _ocioConfigKnob->getActiveEntryText_mt_safe() == std::string(NATRON_CUSTOM_OCIO_CONFIG_NAME) ) {
             _customOcioConfigFile->setAllDimensionsEnabled(true);
@@ -1264,6 +1382,30 @@ Settings::getMaximumDiskCacheNodeSize() const
     return (U64)( _maxDiskCacheNodeGB->getValue() ) * std::pow(1024.,3.);
 }
 
+Natron::CacheEvictionPolicyEnum
+Settings::getNodeCacheEvictionPolicy() const
+{
+    return (Natron::CacheEvictionPolicyEnum)_nodeCacheEvictionPolicy->getValue();
+}
+
+Natron::CacheEvictionPolicyEnum
+Settings::getViewerCacheEvictionPolicy() const
+{
+    return (Natron::CacheEvictionPolicyEnum)_viewerCacheEvictionPolicy->getValue();
+}
+
+bool
+Settings::isDiskCacheSharedBetweenProcesses() const
+{
+    return _sharedDiskCache->getValue();
+}
+
+bool
+Settings::areNodeCacheImagesTiled() const
+{
+    return _tiledNodeCacheImages->getValue();
+}
+
 double
 Settings::getUnreachableRamPercent() const
 {
@@ -1282,6 +1424,20 @@ Settings::getNumberOfThreadsPerEffect() const
     return _nThreadsPerEffect->getValue();
 }
 
+int
+Settings::getHostSMPTileSize() const
+{
+    return _hostSMPTileSize->getValue();
+}
+
+std::string
+Settings::getRenderProfileFilePath() const
+{
+    std::string filePath = _profileRendersFile->getValue();
+
+    return filePath.empty() ? Natron::RenderProfiler::getDefaultTraceFilePath() : filePath;
+}
+
 int
 Settings::getNumberOfThreads() const
 {
@@ -1755,6 +1911,18 @@ Settings::getAutoSaveDelayMS() const
     return _autoSaveDelay->getValue() * 1000;
 }
 
+bool
+Settings::isSaveProjectsAsBinaryEnabled() const
+{
+    return _saveProjectsAsBinary->getValue();
+}
+
+void
+Settings::setSaveProjectsAsBinary(bool binary)
+{
+    _saveProjectsAsBinary->setValue(binary, 0);
+}
+
 bool
 Settings::isSnapToNodeEnabled() const
 {
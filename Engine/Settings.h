@@ -31,6 +31,7 @@ class Plugin;
 }
 
 class File_Knob;
+class OutputFile_Knob;
 class Page_Knob;
 class Double_Knob;
 class Int_Knob;
@@ -71,6 +72,14 @@ public:
     U64 getMaximumViewerDiskCacheSize() const;
     
     U64 getMaximumDiskCacheNodeSize() const;
+    
+    Natron::CacheEvictionPolicyEnum getNodeCacheEvictionPolicy() const;
+    
+    Natron::CacheEvictionPolicyEnum getViewerCacheEvictionPolicy() const;
+
+    bool isDiskCacheSharedBetweenProcesses() const;
+    
+    bool areNodeCacheImagesTiled() const;
 
     double getUnreachableRamPercent() const;
 
@@ -84,6 +93,10 @@ public:
     
     int getNumberOfThreadsPerEffect() const;
     
+    int getHostSMPTileSize() const;
+    
+    std::string getRenderProfileFilePath() const;
+    
     bool useGlobalThreadPool() const;
     
     void setUseGlobalThreadPool(bool use) ;
@@ -131,6 +144,11 @@ public:
 
     int getAutoSaveDelayMS() const;
 
+    ///Auto-saves are always binary, @see ProjectBinarySerialization.h
+    bool isSaveProjectsAsBinaryEnabled() const;
+
+    void setSaveProjectsAsBinary(bool binary);
+
     bool isSnapToNodeEnabled() const;
 
     bool isCheckForUpdatesEnabled() const;
@@ -243,11 +261,15 @@ private:
     boost::shared_ptr<Bool_Knob> _checkForUpdates;
     boost::shared_ptr<Bool_Knob> _notifyOnFileChange;
     boost::shared_ptr<Int_Knob> _autoSaveDelay;
+    boost::shared_ptr<Bool_Knob> _saveProjectsAsBinary;
     boost::shared_ptr<Bool_Knob> _linearPickers;
     boost::shared_ptr<Int_Knob> _numberOfThreads;
     boost::shared_ptr<Int_Knob> _numberOfParallelRenders;
     boost::shared_ptr<Bool_Knob> _useThreadPool;
     boost::shared_ptr<Int_Knob> _nThreadsPerEffect;
+    boost::shared_ptr<Int_Knob> _hostSMPTileSize;
+    boost::shared_ptr<Bool_Knob> _profileRenders;
+    boost::shared_ptr<OutputFile_Knob> _profileRendersFile;
     boost::shared_ptr<Bool_Knob> _renderInSeparateProcess;
     boost::shared_ptr<Bool_Knob> _autoPreviewEnabledForNewProjects;
     boost::shared_ptr<Bool_Knob> _firstReadSetProjectFormat;
@@ -287,7 +309,11 @@ private:
     ///The total disk space allowed for all Natron's caches
     boost::shared_ptr<Int_Knob> _maxViewerDiskCacheGB;
     boost::shared_ptr<Int_Knob> _maxDiskCacheNodeGB;
+    boost::shared_ptr<Choice_Knob> _nodeCacheEvictionPolicy;
+    boost::shared_ptr<Choice_Knob> _viewerCacheEvictionPolicy;
     boost::shared_ptr<Path_Knob> _diskCachePath;
+    boost::shared_ptr<Bool_Knob> _sharedDiskCache;
+    boost::shared_ptr<Bool_Knob> _tiledNodeCacheImages;
     
     boost::shared_ptr<Page_Knob> _viewersTab;
     boost::shared_ptr<Choice_Knob> _texturesMode;
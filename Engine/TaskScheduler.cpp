@@ -0,0 +1,370 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#ifndef Q_MOC_RUN
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+
+using namespace Natron;
+
+namespace {
+
+///The tasks of a call to parallelFor(), claimed one at a time by the threads running them
+struct TaskGroup
+{
+    boost::function<void (int)> func;
+    int count;
+    QAtomicInt next; //< the index of the next task to claim, may go past count
+    QAtomicInt remaining; //< the number of tasks not finished
+    QMutex mutex; //< protects error and failed, and is used to wait for remaining to reach 0
+    QWaitCondition finished;
+    bool failed;
+    std::string error;
+
+    TaskGroup(const boost::function<void (int)> & func,
+              int count)
+        : func(func)
+          , count(count)
+          , next(0)
+          , remaining(count)
+          , mutex()
+          , finished()
+          , failed(false)
+          , error()
+    {
+    }
+
+    bool hasTasksToClaim() const
+    {
+        return (int)next < count;
+    }
+
+    ///Runs tasks until all of them are claimed, returns the number of tasks run
+    int runTasks();
+};
+
+typedef boost::shared_ptr<TaskGroup> TaskGroupPtr;
+
+///The loops started by a thread, the oldest at the front. Only the owner pushes and removes, thieves read.
+struct TaskDeque
+{
+    QMutex mutex;
+    std::deque<TaskGroupPtr> groups;
+
+    void push(const TaskGroupPtr & group)
+    {
+        QMutexLocker l(&mutex);
+
+        groups.push_back(group);
+    }
+
+    void remove(const TaskGroupPtr & group)
+    {
+        QMutexLocker l(&mutex);
+        std::deque<TaskGroupPtr>::iterator found = std::find(groups.begin(), groups.end(), group);
+
+        if ( found != groups.end() ) {
+            groups.erase(found);
+        }
+    }
+
+    ///Returns the oldest loop which still has tasks to claim
+    TaskGroupPtr steal()
+    {
+        QMutexLocker l(&mutex);
+
+        for (std::deque<TaskGroupPtr>::iterator it = groups.begin(); it != groups.end(); ++it) {
+            if ( (*it)->hasTasksToClaim() ) {
+                return *it;
+            }
+        }
+
+        return TaskGroupPtr();
+    }
+};
+
+class WorkerThread;
+}
+
+struct Natron::TaskSchedulerPrivate
+{
+    QReadWriteLock workersLock; //< protects workers
+    std::vector<WorkerThread*> workers;
+    TaskDeque externalDeque; //< the loops started by the threads that are not workers of this scheduler
+    QMutex sleepMutex; //< protects maxThreadCount, workAvailableCount and stopRequested
+    QWaitCondition workAvailable;
+    int maxThreadCount;
+    U64 workAvailableCount; //< incremented every time a loop starts, so that a worker never misses it
+    bool stopRequested;
+
+    TaskSchedulerPrivate()
+        : workersLock()
+          , workers()
+          , externalDeque()
+          , sleepMutex()
+          , workAvailable()
+          , maxThreadCount(0)
+          , workAvailableCount(0)
+          , stopRequested(false)
+    {
+    }
+
+    ///Returns the deque of the current thread
+    TaskDeque* getCurrentThreadDeque();
+
+    ///Steals a loop from the deques of the other threads, starting after thief
+    TaskGroupPtr stealGroup(int thiefIndex);
+
+    void notifyWorkAvailable()
+    {
+        QMutexLocker l(&sleepMutex);
+
+        ++workAvailableCount;
+        workAvailable.wakeAll();
+    }
+
+    void workerLoop(int index);
+};
+
+namespace {
+class WorkerThread
+    : public QThread
+{
+public:
+
+    WorkerThread(TaskSchedulerPrivate* scheduler,
+                 int index)
+        : QThread()
+          , scheduler(scheduler)
+          , index(index)
+          , deque()
+    {
+    }
+
+    TaskSchedulerPrivate* scheduler;
+    int index;
+    TaskDeque deque;
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        scheduler->workerLoop(index);
+    }
+};
+
+int
+TaskGroup::runTasks()
+{
+    int tasksCount = 0;
+
+    for (;;) {
+        int i = next.fetchAndAddOrdered(1);
+        if (i >= count) {
+            return tasksCount;
+        }
+        try {
+            func(i);
+        } catch (const std::exception & e) {
+            QMutexLocker l(&mutex);
+            if (!failed) {
+                failed = true;
+                error = e.what();
+            }
+        } catch (...) {
+            QMutexLocker l(&mutex);
+            if (!failed) {
+                failed = true;
+                error = "Unknown exception in a task";
+            }
+        }
+        ++tasksCount;
+        if ( !remaining.deref() ) {
+            QMutexLocker l(&mutex);
+            finished.wakeAll();
+        }
+    }
+}
+}
+
+TaskDeque*
+TaskSchedulerPrivate::getCurrentThreadDeque()
+{
+    WorkerThread* worker = dynamic_cast<WorkerThread*>( QThread::currentThread() );
+
+    if ( worker && (worker->scheduler == this) ) {
+        return &worker->deque;
+    }
+
+    return &externalDeque;
+}
+
+TaskGroupPtr
+TaskSchedulerPrivate::stealGroup(int thiefIndex)
+{
+    ///the loops of the threads that are not workers are usually the top-level ones
+    TaskGroupPtr group = externalDeque.steal();
+
+    if (group) {
+        return group;
+    }
+
+    QReadLocker l(&workersLock);
+    int workersCount = (int)workers.size();
+    for (int i = 1; i < workersCount; ++i) {
+        group = workers[(thiefIndex + i) % workersCount]->deque.steal();
+        if (group) {
+            return group;
+        }
+    }
+
+    return TaskGroupPtr();
+}
+
+void
+TaskSchedulerPrivate::workerLoop(int index)
+{
+    for (;;) {
+        U64 lastWorkAvailableCount;
+        {
+            QMutexLocker l(&sleepMutex);
+            ///the workers over the maximum sleep until they are allowed to run again
+            while ( !stopRequested && (index >= maxThreadCount) ) {
+                workAvailable.wait(&sleepMutex);
+            }
+            if (stopRequested) {
+                return;
+            }
+            lastWorkAvailableCount = workAvailableCount;
+        }
+
+        TaskGroupPtr group = stealGroup(index);
+        if (group) {
+            group->runTasks();
+            continue;
+        }
+
+        QMutexLocker l(&sleepMutex);
+        if ( !stopRequested && (workAvailableCount == lastWorkAvailableCount) ) {
+            workAvailable.wait(&sleepMutex);
+        }
+    }
+}
+
+TaskScheduler::TaskScheduler(int threadsCount)
+    : _imp( new TaskSchedulerPrivate )
+{
+    setMaxThreadCount(threadsCount);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        QMutexLocker l(&_imp->sleepMutex);
+        _imp->stopRequested = true;
+        _imp->workAvailable.wakeAll();
+    }
+    ///the workers may be stealing, don't keep the lock while they finish
+    std::vector<WorkerThread*> workers;
+    {
+        QWriteLocker l(&_imp->workersLock);
+        workers.swap(_imp->workers);
+    }
+    for (std::size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->wait();
+        delete workers[i];
+    }
+}
+
+static QMutex gGlobalInstanceMutex;
+static boost::scoped_ptr<TaskScheduler> gGlobalInstance;
+
+TaskScheduler*
+TaskScheduler::globalInstance()
+{
+    QMutexLocker l(&gGlobalInstanceMutex);
+
+    if (!gGlobalInstance) {
+        gGlobalInstance.reset( new TaskScheduler( std::max(0, QThread::idealThreadCount() ) ) );
+    }
+
+    return gGlobalInstance.get();
+}
+
+void
+TaskScheduler::setMaxThreadCount(int threadsCount)
+{
+    assert(threadsCount >= 0);
+    {
+        QWriteLocker l(&_imp->workersLock);
+        while ( (int)_imp->workers.size() < threadsCount ) {
+            WorkerThread* worker = new WorkerThread(_imp.get(), (int)_imp->workers.size());
+            _imp->workers.push_back(worker);
+            worker->start();
+        }
+    }
+    QMutexLocker l(&_imp->sleepMutex);
+    _imp->maxThreadCount = threadsCount;
+    _imp->workAvailable.wakeAll();
+}
+
+int
+TaskScheduler::getMaxThreadCount() const
+{
+    QMutexLocker l(&_imp->sleepMutex);
+
+    return _imp->maxThreadCount;
+}
+
+void
+TaskScheduler::parallelFor(int count,
+                           const boost::function<void (int)> & func)
+{
+    if ( (count <= 1) || (getMaxThreadCount() == 0) ) {
+        for (int i = 0; i < count; ++i) {
+            func(i);
+        }
+
+        return;
+    }
+
+    TaskGroupPtr group( new TaskGroup(func, count) );
+    TaskDeque* deque = _imp->getCurrentThreadDeque();
+    deque->push(group);
+    _imp->notifyWorkAvailable();
+
+    ///run the tasks instead of waiting for a worker to be free
+    group->runTasks();
+    deque->remove(group);
+
+    ///the remaining tasks are running in other threads
+    {
+        QMutexLocker l(&group->mutex);
+        while ( (int)group->remaining > 0 ) {
+            group->finished.wait(&group->mutex);
+        }
+    }
+
+    if (group->failed) {
+        throw std::runtime_error(group->error);
+    }
+}
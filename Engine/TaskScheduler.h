@@ -0,0 +1,73 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_TASKSCHEDULER_H_
+#define NATRON_ENGINE_TASKSCHEDULER_H_
+
+#ifndef Q_MOC_RUN
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/Macros.h"
+
+namespace Natron {
+struct TaskSchedulerPrivate;
+
+/**
+ * @brief A pool of worker threads running the tasks of parallel loops, used by the renders to split their work
+ * (tiles of an effect, threads of the OpenFX multi-thread suite, rows of the viewer).
+ *
+ * Unlike QtConcurrent::mapped on the global thread pool, the thread calling parallelFor() never blocks while the
+ * tasks it spawned are pending: it runs them itself, while the idle workers steal the others. Nested loops therefore
+ * cannot deadlock and do not need to fall back to a single thread when all the threads of the pool are busy.
+ *
+ * Each worker has a deque of the loops it started, and the threads that are not workers share another one.
+ * An idle worker steals the oldest loop of these deques that still has tasks, which is usually the one with the
+ * biggest tasks. A thread waiting for its own loop only runs the tasks of that loop: running any other task could
+ * try to take a lock that the waiting thread holds, or overwrite its thread-local render arguments.
+ **/
+class TaskScheduler
+{
+public:
+
+    /**
+     * @brief Creates a scheduler with threadsCount worker threads, which may be 0: the loops then run in the
+     * thread calling parallelFor().
+     **/
+    explicit TaskScheduler(int threadsCount);
+
+    ~TaskScheduler();
+
+    /**
+     * @brief The scheduler used by the renders, with as many workers as QThread::idealThreadCount()
+     * until the number of threads is changed in the settings.
+     **/
+    static TaskScheduler* globalInstance();
+
+    /**
+     * @brief Changes the number of workers running tasks, the threads are started if needed.
+     * With 0 workers, the loops run in the thread calling parallelFor().
+     **/
+    void setMaxThreadCount(int threadsCount);
+
+    int getMaxThreadCount() const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Calls func(i) for every i in [0, count[ and returns when all the calls returned. The calls are
+     * made concurrently by the calling thread and the workers, in any order.
+     * If calls throw an exception, the other calls are still made and a std::runtime_error with the message of the
+     * first exception is thrown once they are all done.
+     **/
+    void parallelFor(int count, const boost::function<void (int)> & func);
+
+private:
+
+    boost::scoped_ptr<TaskSchedulerPrivate> _imp;
+};
+} // namespace Natron
+
+#endif // NATRON_ENGINE_TASKSCHEDULER_H_
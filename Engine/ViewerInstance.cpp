@@ -16,7 +16,6 @@
 
 CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QtGlobal>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt<<(
 #include <QtCore/QFutureWatcher>
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
@@ -39,7 +38,11 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/Project.h"
 #include "Engine/OpenGLViewerI.h"
 #include "Engine/Image.h"
+#include "Engine/ImageStatistics.h"
 #include "Engine/OutputSchedulerThread.h"
+#include "Engine/TaskScheduler.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewerTexture.h"
 
 #ifndef M_LN2
 #define M_LN2       0.693147180559945309417232121458176568  /* loge(2)        */
@@ -58,28 +61,19 @@ static void scaleToTexture32bits(std::pair<int,int> yRange,
                                  const RenderViewerArgs & args,
                                  ViewerInstance* viewer,
                                  float *output);
-static std::pair<double, double>
-findAutoContrastVminVmax(boost::shared_ptr<const Natron::Image> inputImage,
-                         ViewerInstance::DisplayChannels channels,
-                         const RectI & rect);
+static void getAutoContrastVminVmax(const Natron::ImageStatistics & statistics,
+                                    ViewerInstance::DisplayChannels channels,
+                                    double* vmin,
+                                    double* vmax);
 static void renderFunctor(std::pair<int,int> yRange,
                           const RenderViewerArgs & args,
                           ViewerInstance* viewer,
                           void *buffer);
-
-/**
- *@brief Actually converting to ARGB... but it is called BGRA by
-   the texture format GL_UNSIGNED_INT_8_8_8_8_REV
- **/
-static unsigned int toBGRA(unsigned char r, unsigned char g, unsigned char b, unsigned char a) WARN_UNUSED_RETURN;
-unsigned int
-toBGRA(unsigned char r,
-       unsigned char g,
-       unsigned char b,
-       unsigned char a)
-{
-    return (a << 24) | (r << 16) | (g << 8) | b;
-}
+static void renderRowsTask(const std::vector<std::pair<int,int> >* splitRows,
+                           const RenderViewerArgs & args,
+                           ViewerInstance* viewer,
+                           void *buffer,
+                           int i);
 
 const Natron::Color::Lut*
 ViewerInstance::lutFromColorspace(Natron::ViewerColorSpaceEnum cs)
@@ -215,6 +209,9 @@ ViewerInstance::clearLastRenderedImage()
     if (_imp->uiContext) {
         _imp->uiContext->clearLastRenderedImage();
     }
+    QMutexLocker l(&_imp->statisticsMutex);
+    _imp->lastStatistics[0].reset();
+    _imp->lastStatistics[1].reset();
 }
 
 void
@@ -652,6 +649,9 @@ ViewerInstance::renderViewer_internal(int view,
     ///Notify the gui we're rendering.
     ViewerRenderingStarted_RAII renderingNotifier(this);
     
+    ///Record how long it takes to produce the texture, this is used by the cost-aware cache eviction policy
+    TimeLapse renderTimer;
+    
     ///Don't allow different threads to write the texture entry
     FrameEntryLocker entryLocker(_imp.get());
     
@@ -751,6 +751,11 @@ ViewerInstance::renderViewer_internal(int view,
                                                                                          components,
                                                                                          imageDepth) );
             
+            ///The texture is filled by whole rows of pixels: the rows of a tiled image are only contiguous within a tile
+            if ( inArgs.params->image && inArgs.params->image->isTiled() ) {
+                inArgs.params->image = inArgs.params->image->makeContiguousView(roi);
+            }
+            
             if (!inArgs.params->image) {
                 if (inArgs.params->cachedFrame) {
                     inArgs.params->cachedFrame->setAborted(true);
@@ -793,12 +798,45 @@ ViewerInstance::renderViewer_internal(int view,
     ViewerColorSpaceEnum srcColorSpace = getApp()->getDefaultColorSpaceForBitDepth( inArgs.params->image->getBitDepth() );
     
     
-    if (singleThreaded) {
+    ///the task scheduler never needs free threads: this thread renders rows too while it waits
+    bool runInCurrentThread = singleThreaded || Natron::TaskScheduler::globalInstance()->getMaxThreadCount() == 0;
+    
+    ///Compute the statistics needed by the auto-contrast and the histogram panel, if any, in a single pass over the image
+    bool histogramFullImage;
+    double histogramMin, histogramMax;
+    int histogramBinsCount;
+    {
+        QMutexLocker l(&_imp->statisticsMutex);
+        histogramFullImage = _imp->histogramFullImage;
+        histogramMin = _imp->histogramMin;
+        histogramMax = _imp->histogramMax;
+        histogramBinsCount = _imp->histogramBinsCount;
+    }
+    if (autoContrast || histogramBinsCount > 0) {
+        const boost::shared_ptr<Natron::Image> & image = inArgs.params->image;
+        boost::shared_ptr<Natron::ImageStatistics> histogramStatistics;
+        if (histogramBinsCount > 0) {
+            ///this is the portion of the image the histogram panel uses
+            RectI histogramRect = image->getBounds();
+            if (!histogramFullImage) {
+                histogramRect = _imp->uiContext->getImageRectangleDisplayed(histogramRect, image->getPixelAspectRatio(), image->getMipMapLevel());
+            }
+            histogramStatistics.reset(new Natron::ImageStatistics);
+            histogramStatistics->compute(image, histogramRect, histogramMin, histogramMax, histogramBinsCount, !runInCurrentThread);
+        }
+        
+        boost::shared_ptr<Natron::ImageStatistics> contrastStatistics;
         if (autoContrast) {
+            ///the auto-contrast only needs another pass if the histogram is not computed on the portion displayed
+            if ( histogramStatistics && histogramStatistics->isComputedFor(image, roi) ) {
+                contrastStatistics = histogramStatistics;
+            } else {
+                contrastStatistics.reset(new Natron::ImageStatistics);
+                contrastStatistics->compute(image, roi, 0., 0., 0, !runInCurrentThread);
+            }
+            
             double vmin, vmax;
-            std::pair<double,double> vMinMax = findAutoContrastVminVmax(inArgs.params->image, channels, roi);
-            vmin = vMinMax.first;
-            vmax = vMinMax.second;
+            getAutoContrastVminVmax(*contrastStatistics, channels, &vmin, &vmax);
             
             ///if vmax - vmin is greater than 1 the gain will be really small and we won't see
             ///anything in the image
@@ -809,17 +847,22 @@ ViewerInstance::renderViewer_internal(int view,
             inArgs.params->offset = -vmin / ( vmax - vmin);
         }
         
-        const RenderViewerArgs args( inArgs.params->image,
-                                    inArgs.params->textureRect,
-                                    channels,
-                                    inArgs.params->srcPremult,
-                                    1,
-                                    inArgs.key->getBitDepth(),
-                                    inArgs.params->gain,
-                                    inArgs.params->offset,
-                                    lutFromColorspace(srcColorSpace),
-                                    lutFromColorspace(inArgs.params->lut) );
-        
+        QMutexLocker l(&_imp->statisticsMutex);
+        _imp->lastStatistics[inArgs.params->textureIndex] = histogramStatistics ? histogramStatistics : contrastStatistics;
+    }
+    
+    const RenderViewerArgs args( inArgs.params->image,
+                                inArgs.params->textureRect,
+                                channels,
+                                inArgs.params->srcPremult,
+                                1,
+                                inArgs.key->getBitDepth(),
+                                inArgs.params->gain,
+                                inArgs.params->offset,
+                                lutFromColorspace(srcColorSpace),
+                                lutFromColorspace(inArgs.params->lut) );
+    
+    if (runInCurrentThread) {
         renderFunctor(std::make_pair(roi.y1,roi.y2),
                       args,
                       this,
@@ -828,94 +871,28 @@ ViewerInstance::renderViewer_internal(int view,
         
         int rowsPerThread = std::ceil( (double)(roi.x2 - roi.x1) / appPTR->getHardwareIdealThreadCount() );
         // group of group of rows where first is image coordinate, second is texture coordinate
-        QList< std::pair<int, int> > splitRows;
-        
-        bool runInCurrentThread = QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount();
-        
-        if (!runInCurrentThread) {
-            int k = roi.y1;
-            while (k < roi.y2) {
-                int top = k + rowsPerThread;
-                int realTop = top > roi.y2 ? roi.y2 : top;
-                splitRows.push_back( std::make_pair(k,realTop) );
-                k += rowsPerThread;
-            }
-        }
-        
-        ///if autoContrast is enabled, find out the vmin/vmax before rendering and mapping against new values
-        if (autoContrast) {
-            rowsPerThread = std::ceil( (double)( roi.width() ) / (double)appPTR->getHardwareIdealThreadCount() );
-            
-            std::vector<RectI> splitRects;
-            
-            double vmin = std::numeric_limits<double>::infinity();
-            double vmax = -std::numeric_limits<double>::infinity();
-            
-            if (!runInCurrentThread) {
-                int k = roi.y1;
-                while (k < roi.y2) {
-                    int top = k + rowsPerThread;
-                    int realTop = top > roi.top() ? roi.top() : top;
-                    splitRects.push_back( RectI(roi.left(), k, roi.right(), realTop) );
-                    k += rowsPerThread;
-                }
-                
-                
-                QFuture<std::pair<double,double> > future = QtConcurrent::mapped( splitRects,
-                                                                                 boost::bind(findAutoContrastVminVmax,
-                                                                                             inArgs.params->image,
-                                                                                             channels,
-                                                                                             _1) );
-                future.waitForFinished();
-                
-                std::pair<double,double> vMinMax;
-                foreach ( vMinMax, future.results() ) {
-                    if (vMinMax.first < vmin) {
-                        vmin = vMinMax.first;
-                    }
-                    if (vMinMax.second > vmax) {
-                        vmax = vMinMax.second;
-                    }
-                }
-            } else { //!runInCurrentThread
-                std::pair<double,double> vMinMax = findAutoContrastVminVmax(inArgs.params->image, channels, roi);
-                vmin = vMinMax.first;
-                vmax = vMinMax.second;
-            }
-            
-            if (vmax == vmin) {
-                vmin = vmax - 1.;
-            }
-            
-            inArgs.params->gain = 1 / (vmax - vmin);
-            inArgs.params->offset =  -vmin / (vmax - vmin);
-        }
-        
-        const RenderViewerArgs args(inArgs.params->image,
-                                    inArgs.params->textureRect,
-                                    channels,
-                                    inArgs.params->srcPremult,
-                                    1,
-                                    inArgs.key->getBitDepth(),
-                                    inArgs.params->gain,
-                                    inArgs.params->offset,
-                                    lutFromColorspace(srcColorSpace),
-                                    lutFromColorspace(inArgs.params->lut));
-        if (runInCurrentThread) {
-            renderFunctor(std::make_pair(inArgs.params->textureRect.y1,inArgs.params->textureRect.y2),
-                          args, this, inArgs.params->ramBuffer);
-        } else {
-            QtConcurrent::map( splitRows,
-                              boost::bind(&renderFunctor,
-                                          _1,
-                                          args,
-                                          this,
-                                          inArgs.params->ramBuffer) ).waitForFinished();
+        std::vector< std::pair<int, int> > splitRows;
+        int k = roi.y1;
+        while (k < roi.y2) {
+            int top = k + rowsPerThread;
+            int realTop = top > roi.y2 ? roi.y2 : top;
+            splitRows.push_back( std::make_pair(k,realTop) );
+            k += rowsPerThread;
         }
         
-        
+        Natron::TaskScheduler::globalInstance()->parallelFor( (int)splitRows.size(),
+                                                              boost::bind(&renderRowsTask,
+                                                                          &splitRows,
+                                                                          args,
+                                                                          this,
+                                                                          inArgs.params->ramBuffer,
+                                                                          _1) );
     }
     abortCheck(inArgs.activeInputToRender);
+    
+    if (inArgs.params->cachedFrame) {
+        inArgs.params->cachedFrame->addComputeTime( renderTimer.getTimeSinceCreation() );
+    }
 
     return eStatusOK;
 } // renderViewer_internal
@@ -927,6 +904,16 @@ ViewerInstance::updateViewer(boost::shared_ptr<UpdateViewerParams> & frame)
     _imp->updateViewer(boost::dynamic_pointer_cast<UpdateViewerParams>(frame));
 }
 
+void
+renderRowsTask(const std::vector<std::pair<int,int> >* splitRows,
+               const RenderViewerArgs & args,
+               ViewerInstance* viewer,
+               void *buffer,
+               int i)
+{
+    renderFunctor( (*splitRows)[i], args, viewer, buffer );
+}
+
 void
 renderFunctor(std::pair<int,int> yRange,
               const RenderViewerArgs & args,
@@ -944,104 +931,127 @@ renderFunctor(std::pair<int,int> yRange,
     }
 }
 
-template <int nComps>
-std::pair<double, double>
-findAutoContrastVminVmax_internal(boost::shared_ptr<const Natron::Image> inputImage,
-                         ViewerInstance::DisplayChannels channels,
-                         const RectI & rect)
+void
+getAutoContrastVminVmax(const Natron::ImageStatistics & statistics,
+                        ViewerInstance::DisplayChannels channels,
+                        double* vmin,
+                        double* vmax)
+{
+    switch (channels) {
+    case ViewerInstance::RGB:
+        *vmin = std::min( std::min( statistics.getMin(ImageStatistics::eChannelRed), statistics.getMin(ImageStatistics::eChannelGreen) ),
+                          statistics.getMin(ImageStatistics::eChannelBlue) );
+        *vmax = std::max( std::max( statistics.getMax(ImageStatistics::eChannelRed), statistics.getMax(ImageStatistics::eChannelGreen) ),
+                          statistics.getMax(ImageStatistics::eChannelBlue) );
+        break;
+    case ViewerInstance::LUMINANCE:
+        *vmin = statistics.getMin(ImageStatistics::eChannelLuminance);
+        *vmax = statistics.getMax(ImageStatistics::eChannelLuminance);
+        break;
+    case ViewerInstance::R:
+        *vmin = statistics.getMin(ImageStatistics::eChannelRed);
+        *vmax = statistics.getMax(ImageStatistics::eChannelRed);
+        break;
+    case ViewerInstance::G:
+        *vmin = statistics.getMin(ImageStatistics::eChannelGreen);
+        *vmax = statistics.getMax(ImageStatistics::eChannelGreen);
+        break;
+    case ViewerInstance::B:
+        *vmin = statistics.getMin(ImageStatistics::eChannelBlue);
+        *vmax = statistics.getMax(ImageStatistics::eChannelBlue);
+        break;
+    case ViewerInstance::A:
+        *vmin = statistics.getMin(ImageStatistics::eChannelAlpha);
+        *vmax = statistics.getMax(ImageStatistics::eChannelAlpha);
+        break;
+    default:
+        *vmin = 0.;
+        *vmax = 0.;
+        break;
+    }
+} // getAutoContrastVminVmax
+
+/**
+ * @brief Reads the pixels of the texture row from the scan-line src_pixels of the input image (which may be NULL)
+ * into the linear float planes of row.
+ **/
+template <typename PIX,int maxValue,int nComps,bool opaque,int rOffset,int gOffset,int bOffset>
+void
+readTextureRow(const PIX* src_pixels,
+               const RenderViewerArgs & args,
+               ViewerTexture::Row* row)
 {
-    double localVmin = std::numeric_limits<double>::infinity();
-    double localVmax = -std::numeric_limits<double>::infinity();
-    
-    for (int y = rect.bottom(); y < rect.top(); ++y) {
-        const float* src_pixels = (const float*)inputImage->pixelAt(rect.left(),y);
-        ///we fill the scan-line with all the pixels of the input image
-        for (int x = rect.left(); x < rect.right(); ++x) {
-            
-            double r,g,b,a;
-            switch (nComps) {
-                case 4:
-                    r = src_pixels[0];
-                    g = src_pixels[1];
-                    b = src_pixels[2];
-                    a = src_pixels[3];
-                    break;
-                case 3:
-                    r = src_pixels[0];
-                    g = src_pixels[1];
-                    b = src_pixels[2];
-                    a = 1.;
-                    break;
-                case 1:
-                    a = src_pixels[0];
-                    r = g = b = 0.;
-                    break;
-                default:
-                    r = g = b = 0.;
-            }
-            
-            double mini, maxi;
-            switch (channels) {
-                case ViewerInstance::RGB:
-                    mini = std::min(std::min(r,g),b);
-                    maxi = std::max(std::max(r,g),b);
-                    break;
-                case ViewerInstance::LUMINANCE:
-                    mini = r = 0.299 * r + 0.587 * g + 0.114 * b;
-                    maxi = mini;
-                    break;
-                case ViewerInstance::R:
-                    mini = r;
-                    maxi = mini;
-                    break;
-                case ViewerInstance::G:
-                    mini = g;
-                    maxi = mini;
-                    break;
-                case ViewerInstance::B:
-                    mini = b;
-                    maxi = mini;
-                    break;
-                case ViewerInstance::A:
-                    mini = a;
-                    maxi = mini;
-                    break;
-                default:
-                    mini = 0.;
-                    maxi = 0.;
-                    break;
-            }
-            if (mini < localVmin) {
-                localVmin = mini;
-            }
-            if (maxi > localVmax) {
-                localVmax = maxi;
+    if (!src_pixels) {
+        row->clear();
+
+        return;
+    }
+
+    const int step = args.closestPowerOf2;
+    if (sizeof(PIX) == sizeof(float)) {
+        ViewerTexture::readFloatRow( (const float*)src_pixels, nComps, step, rOffset, gOffset, bOffset, opaque, row );
+        if (args.srcColorSpace) {
+            for (int x = 0; x < row->count; ++x) {
+                row->r[x] = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(row->r[x]);
+                row->g[x] = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(row->g[x]);
+                row->b[x] = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(row->b[x]);
             }
-            
-            src_pixels += nComps;
         }
-    }
-    
-    return std::make_pair(localVmin, localVmax);
-}
 
+        return;
+    }
 
-std::pair<double, double>
-findAutoContrastVminVmax(boost::shared_ptr<const Natron::Image> inputImage,
-                         ViewerInstance::DisplayChannels channels,
-                         const RectI & rect)
-{
-    switch (inputImage->getComponents()) {
-        case Natron::eImageComponentRGBA:
-            return findAutoContrastVminVmax_internal<4>(inputImage, channels, rect);
-        case Natron::eImageComponentRGB:
-            return findAutoContrastVminVmax_internal<3>(inputImage, channels, rect);
-        case Natron::eImageComponentAlpha:
-            return findAutoContrastVminVmax_internal<1>(inputImage, channels, rect);
+    for (int x = 0; x < row->count; ++x) {
+        const PIX* pix = src_pixels + x * step * nComps;
+        PIX r,g,b;
+        float a = 1.f;
+        switch (nComps) {
+        case 4:
+            r = pix[rOffset];
+            g = pix[gOffset];
+            b = pix[bOffset];
+            if (!opaque) {
+                a = convertPixelDepth<PIX, float>(pix[3]);
+            }
+            break;
+        case 3:
+            r = rOffset < nComps ? pix[rOffset] : 0;
+            g = gOffset < nComps ? pix[gOffset] : 0;
+            b = bOffset < nComps ? pix[bOffset] : 0;
+            break;
+        case 1:
+            r = g = b = *pix;
+            break;
         default:
-            return std::make_pair(0,1);
+            assert(false);
+            r = g = b = 0;
+            break;
+        }
+        if (!args.srcColorSpace) {
+            row->r[x] = convertPixelDepth<PIX, float>(r);
+            row->g[x] = convertPixelDepth<PIX, float>(g);
+            row->b[x] = convertPixelDepth<PIX, float>(b);
+        } else if (sizeof(PIX) == sizeof(unsigned char)) {
+            row->r[x] = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
+            row->g[x] = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
+            row->b[x] = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)b );
+        } else {
+            row->r[x] = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
+            row->g[x] = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
+            row->b[x] = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)b );
+        }
+        row->a[x] = a;
     }
-} // findAutoContrastVminVmax
+} // readTextureRow
+
+///The number of pixels of a row of the texture
+static int
+getTextureRowSize(const RenderViewerArgs & args)
+{
+    int srcWidth = args.texRect.x2 - args.texRect.x1;
+
+    return std::max(0, std::min( args.texRect.w, (srcWidth + args.closestPowerOf2 - 1) / args.closestPowerOf2 ) );
+}
 
 template <typename PIX,int maxValue,int nComps,bool opaque,int rOffset,int gOffset,int bOffset>
 void
@@ -1050,134 +1060,24 @@ scaleToTexture8bits_internal(const std::pair<int,int> & yRange,
                              ViewerInstance* /*viewer*/,
                              U32* output)
 {
-    size_t pixelSize = sizeof(PIX);
-    
     const bool luminance = (args.channels == ViewerInstance::LUMINANCE);
     
     ///offset the output buffer at the starting point
     output += ( (yRange.first - args.texRect.y1) / args.closestPowerOf2 ) * args.texRect.w;
 
+    ViewerTexture::Row row;
+    row.resize( getTextureRowSize(args) );
+
     ///iterating over the scan-lines of the input image
     int dstY = 0;
     for (int y = yRange.first; y < yRange.second; y += args.closestPowerOf2) {
-        
-        int start = (int)( rand() % std::max( ( (args.texRect.x2 - args.texRect.x1) / args.closestPowerOf2 ),1 ) );
         const PIX* src_pixels = (const PIX*)args.inputImage->pixelAt(args.texRect.x1, y);
         U32* dst_pixels = output + dstY * args.texRect.w;
-        
-        /* go fowards from starting point to end of line: */
-        for (int backward = 0; backward < 2; ++backward) {
-            int dstIndex = backward ? start - 1 : start;
-            int srcIndex = dstIndex * args.closestPowerOf2; //< offset from src_pixels
-            assert( backward == 1 || ( srcIndex >= 0 && srcIndex < (args.texRect.x2 - args.texRect.x1) ) );
-
-            unsigned error_r = 0x80;
-            unsigned error_g = 0x80;
-            unsigned error_b = 0x80;
-
-            while (dstIndex < args.texRect.w && dstIndex >= 0) {
-                if ( srcIndex >= ( args.texRect.x2 - args.texRect.x1) ) {
-                    break;
-                } else {
-                    double r,g,b;
-                    int a;
-                    switch (nComps) {
-                        case 4:
-                            r = (src_pixels ? src_pixels[srcIndex * nComps + rOffset] : 0.);
-                            g = (src_pixels ? src_pixels[srcIndex * nComps + gOffset] : 0.);
-                            b = (src_pixels ? src_pixels[srcIndex * nComps + bOffset] : 0.);
-                            if (opaque) {
-                                a = 255;
-                            } else {
-                                a = (src_pixels ? Color::floatToInt<256>(src_pixels[srcIndex * nComps + 3]) : 0);
-                            }
-                            break;
-                        case 3:
-                            r = (src_pixels && rOffset < nComps) ? src_pixels[srcIndex * nComps + rOffset] : 0.;
-                            g = (src_pixels && gOffset < nComps) ? src_pixels[srcIndex * nComps + gOffset] : 0.;
-                            b = (src_pixels && bOffset < nComps) ? src_pixels[srcIndex * nComps + bOffset] : 0.;
-                            a = (src_pixels ? 255 : 0);
-                            break;
-                        case 1:
-                            r = src_pixels ? src_pixels[srcIndex] : 0.;
-                            g = b = r;
-                            a = src_pixels ? 255 : 0;
-                            break;
-                        default:
-                            assert(false);
-                            break;
-                    }
-                    
-                    
-                    switch ( pixelSize ) {
-                    case sizeof(unsigned char): //byte
-                        if (args.srcColorSpace) {
-                            r = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
-                            g = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
-                            b = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)b );
-                        } else {
-                            r = (double)convertPixelDepth<unsigned char, float>( (unsigned char)r );
-                            g = (double)convertPixelDepth<unsigned char, float>( (unsigned char)g );
-                            b = (double)convertPixelDepth<unsigned char, float>( (unsigned char)b );
-                        }
-                        break;
-                    case sizeof(unsigned short): //short
-                        if (args.srcColorSpace) {
-                            r = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
-                            g = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
-                            b = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)b );
-                        } else {
-                            r = (double)convertPixelDepth<unsigned short, float>( (unsigned char)r );
-                            g = (double)convertPixelDepth<unsigned short, float>( (unsigned char)g );
-                            b = (double)convertPixelDepth<unsigned short, float>( (unsigned char)b );
-                        }
-                        break;
-                    case sizeof(float): //float
-                        if (args.srcColorSpace) {
-                            r = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(r);
-                            g = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(g);
-                            b = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(b);
-                        }
-                        break;
-                    default:
-                        break;
-                    }
-
-                    r =  r * args.gain + args.offset;
-                    g =  g * args.gain + args.offset;
-                    b =  b * args.gain + args.offset;
-
-                    if (luminance) {
-                        r = 0.299 * r + 0.587 * g + 0.114 * b;
-                        g = r;
-                        b = r;
-                    }
-
-                    if (!args.colorSpace) {
-                        dst_pixels[dstIndex] = toBGRA(Color::floatToInt<256>(r),
-                                                      Color::floatToInt<256>(g),
-                                                      Color::floatToInt<256>(b),
-                                                      a);
-                    } else {
-                        error_r = (error_r & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(r);
-                        error_g = (error_g & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(g);
-                        error_b = (error_b & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(b);
-                        assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
-                        dst_pixels[dstIndex] = toBGRA( (U8)(error_r >> 8),
-                                                       (U8)(error_g >> 8),
-                                                       (U8)(error_b >> 8),
-                                                       a );
-                    }
-                }
-                if (backward) {
-                    --dstIndex;
-                    srcIndex -= args.closestPowerOf2;
-                } else {
-                    ++dstIndex;
-                    srcIndex += args.closestPowerOf2;
-                }
-            }
-        }
+
+        readTextureRow<PIX, maxValue, nComps, opaque, rOffset, gOffset, bOffset>(src_pixels, args, &row);
+        ViewerTexture::applyGainOffset(args.gain, args.offset, luminance, &row);
+        ///the dithering depends on the row only, so that the texture does not flicker from one render to the next
+        ViewerTexture::writeRow8bits(args.colorSpace, y, &row, dst_pixels);
         ++dstY;
     }
 } // scaleToTexture8bits_internal
@@ -1286,7 +1186,6 @@ scaleToTexture32bitsInternal(const std::pair<int,int> & yRange,
                              ViewerInstance* viewer,
                              float *output)
 {
-    size_t pixelSize = sizeof(PIX);
     const bool luminance = (args.channels == ViewerInstance::LUMINANCE);
 
     ///the width of the output buffer multiplied by the channels count
@@ -1295,6 +1194,9 @@ scaleToTexture32bitsInternal(const std::pair<int,int> & yRange,
     ///offset the output buffer at the starting point
     output += ( (yRange.first - args.texRect.y1) / args.closestPowerOf2 ) * dst_width;
 
+    ViewerTexture::Row row;
+    row.resize( getTextureRowSize(args) );
+
     ///iterating over the scan-lines of the input image
     int dstY = 0;
     for (int y = yRange.first; y < yRange.second; y += args.closestPowerOf2) {
@@ -1303,88 +1205,13 @@ scaleToTexture32bitsInternal(const std::pair<int,int> & yRange,
             return;
         }
         
-        const float* src_pixels = (const float*)args.inputImage->pixelAt(args.texRect.x1, y);
+        const PIX* src_pixels = (const PIX*)args.inputImage->pixelAt(args.texRect.x1, y);
         float* dst_pixels = output + dstY * dst_width;
 
-        ///we fill the scan-line with all the pixels of the input image
-        for (int x = args.texRect.x1; x < args.texRect.x2; x += args.closestPowerOf2) {
-            double r,g,b,a;
-            
-            switch (nComps) {
-                case 4:
-                    r = (double)(src_pixels[rOffset]);
-                    g = (double)src_pixels[gOffset];
-                    b = (double)src_pixels[bOffset];
-                    if (opaque) {
-                        a = 1.;
-                    } else {
-                        a = (nComps < 4) ? 1. : src_pixels[3];
-                    }
-                    break;
-                case 3:
-                    r = (double)(src_pixels[rOffset]);
-                    g = (double)src_pixels[gOffset];
-                    b = (double)src_pixels[bOffset];
-                    a = 1.;
-                    break;
-                case 1:
-                    a = (nComps < 4) ? 1. : *src_pixels;
-                    r = g = b = a;
-                    a = 1.;
-                    break;
-                default:
-                    assert(false);
-                    r = g = b = a = 0.;
-                    break;
-            }
-            
-            switch ( pixelSize ) {
-            case sizeof(unsigned char):
-                if (args.srcColorSpace) {
-                    r = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
-                    g = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
-                    b = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)b );
-                } else {
-                    r = (double)convertPixelDepth<unsigned char, float>( (unsigned char)r );
-                    g = (double)convertPixelDepth<unsigned char, float>( (unsigned char)g );
-                    b = (double)convertPixelDepth<unsigned char, float>( (unsigned char)b );
-                }
-                break;
-            case sizeof(unsigned short):
-                if (args.srcColorSpace) {
-                    r = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
-                    g = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
-                    b = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)b );
-                } else {
-                    r = (double)convertPixelDepth<unsigned short, float>( (unsigned char)r );
-                    g = (double)convertPixelDepth<unsigned short, float>( (unsigned char)g );
-                    b = (double)convertPixelDepth<unsigned short, float>( (unsigned char)b );
-                }
-                break;
-            case sizeof(float):
-                if (args.srcColorSpace) {
-                    r = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(r);
-                    g = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(g);
-                    b = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(b);
-                }
-                break;
-            default:
-                break;
-            }
-
-
-            if (luminance) {
-                r = 0.299 * r + 0.587 * g + 0.114 * b;
-                g = r;
-                b = r;
-            }
-            *dst_pixels++ = r;
-            *dst_pixels++ = g;
-            *dst_pixels++ = b;
-            *dst_pixels++ = a;
-
-            src_pixels += args.closestPowerOf2 * 4;
-        }
+        ///the gain and offset are applied by the shader
+        readTextureRow<PIX, maxValue, nComps, opaque, rOffset, gOffset, bOffset>(src_pixels, args, &row);
+        ViewerTexture::applyGainOffset(1., 0., luminance, &row);
+        ViewerTexture::writeRow32bits(row, dst_pixels);
         ++dstY;
     }
 } // scaleToTexture32bitsInternal
@@ -1644,6 +1471,31 @@ ViewerInstance::isAutoContrastEnabled() const
     return _imp->viewerParamsAutoContrast;
 }
 
+void
+ViewerInstance::setHistogramParameters(bool fullImage,
+                                       double vmin,
+                                       double vmax,
+                                       int binsCount)
+{
+    // MT-safe
+    QMutexLocker l(&_imp->statisticsMutex);
+
+    _imp->histogramFullImage = fullImage;
+    _imp->histogramMin = vmin;
+    _imp->histogramMax = vmax;
+    _imp->histogramBinsCount = binsCount;
+}
+
+boost::shared_ptr<const Natron::ImageStatistics>
+ViewerInstance::getLastStatistics(int textureIndex) const
+{
+    // MT-safe
+    assert(textureIndex == 0 || textureIndex == 1);
+    QMutexLocker l(&_imp->statisticsMutex);
+
+    return _imp->lastStatistics[textureIndex];
+}
+
 void
 ViewerInstance::onColorSpaceChanged(Natron::ViewerColorSpaceEnum colorspace)
 {
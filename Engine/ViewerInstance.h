@@ -21,6 +21,7 @@
 #define NATRON_VIEWER_ID NATRON_ORGANIZATION_DOMAIN_TOPLEVEL "." NATRON_ORGANIZATION_DOMAIN_SUB ".built-in.Viewer"
 namespace Natron {
 class Image;
+class ImageStatistics;
 class FrameEntry;
 namespace Color {
 class Lut;
@@ -142,6 +143,20 @@ public:
 
     void onAutoContrastChanged(bool autoContrast,bool refresh);
 
+    /**
+     * @brief Asks the viewer to compute the histograms of the images it renders, with binsCount bins
+     * over [vmin, vmax[, along with the statistics used by the auto-contrast.
+     * They are computed over the whole image if fullImage is true, otherwise over the portion displayed.
+     * A binsCount of 0 stops computing them. MT-safe.
+     **/
+    void setHistogramParameters(bool fullImage,double vmin,double vmax,int binsCount);
+
+    /**
+     * @brief Returns the statistics computed for the last image rendered on the given texture, or NULL
+     * if neither the auto-contrast nor the histograms needed them. MT-safe.
+     **/
+    boost::shared_ptr<const Natron::ImageStatistics> getLastStatistics(int textureIndex) const WARN_UNUSED_RETURN;
+
     /**
      * @brief Returns the current view, MT-safe
      **/
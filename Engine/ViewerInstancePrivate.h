@@ -145,6 +145,12 @@ public:
           , lastRenderedHashMutex()
           , lastRenderedHash(0)
           , lastRenderedHashValid(false)
+          , statisticsMutex()
+          , histogramFullImage(false)
+          , histogramMin(0.)
+          , histogramMax(0.)
+          , histogramBinsCount(0)
+          , lastStatistics()
     {
 
         activeInputs[0] = -1;
@@ -248,6 +254,12 @@ public:
     QMutex lastRenderedHashMutex;
     U64 lastRenderedHash;
     bool lastRenderedHashValid;
+
+    mutable QMutex statisticsMutex; //< protects the histogram parameters and lastStatistics
+    bool histogramFullImage;
+    double histogramMin, histogramMax;
+    int histogramBinsCount; //< 0 when no histogram is requested
+    boost::shared_ptr<const Natron::ImageStatistics> lastStatistics[2];
     
     mutable QMutex textureBeingRenderedMutex;
     QWaitCondition textureBeingRenderedCond;
@@ -0,0 +1,212 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ViewerTexture.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Engine/ImageSIMD.h"
+#include "Engine/Lut.h"
+
+using namespace Natron;
+
+namespace {
+
+/**
+ *@brief Actually converting to ARGB... but it is called BGRA by
+   the texture format GL_UNSIGNED_INT_8_8_8_8_REV
+ **/
+inline U32
+toBGRA(unsigned char r,
+       unsigned char g,
+       unsigned char b,
+       unsigned char a)
+{
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+void
+quantize(const float* src,
+         unsigned char* dst,
+         int count)
+{
+    for (int i = ImageSIMD::floatToByte(src, dst, count); i < count; ++i) {
+        dst[i] = Color::floatToInt<256>(src[i]);
+    }
+}
+
+} // anon namespace
+
+void
+ViewerTexture::Row::resize(int pixelsCount)
+{
+    count = pixelsCount;
+    r.resize(count);
+    g.resize(count);
+    b.resize(count);
+    a.resize(count);
+    r8xx.resize(count);
+    g8xx.resize(count);
+    b8xx.resize(count);
+    r8.resize(count);
+    g8.resize(count);
+    b8.resize(count);
+    a8.resize(count);
+}
+
+void
+ViewerTexture::Row::clear()
+{
+    std::fill(r.begin(), r.end(), 0.f);
+    std::fill(g.begin(), g.end(), 0.f);
+    std::fill(b.begin(), b.end(), 0.f);
+    std::fill(a.begin(), a.end(), 0.f);
+}
+
+void
+ViewerTexture::readFloatRow(const float* src,
+                            int nComps,
+                            int step,
+                            int rOffset,
+                            int gOffset,
+                            int bOffset,
+                            bool opaque,
+                            Row* row)
+{
+    assert(nComps == 1 || nComps == 3 || nComps == 4);
+    if (row->count == 0) {
+        return;
+    }
+    int x = 0;
+    if ( (nComps == 4) && (step == 1) ) {
+        x = ImageSIMD::deinterleaveRGBA(src, rOffset, gOffset, bOffset, opaque,
+                                        &row->r.front(), &row->g.front(), &row->b.front(), &row->a.front(), row->count);
+    }
+    for (const float* pix = src + x * step * nComps; x < row->count; ++x, pix += step * nComps) {
+        switch (nComps) {
+        case 4:
+            row->r[x] = pix[rOffset];
+            row->g[x] = pix[gOffset];
+            row->b[x] = pix[bOffset];
+            row->a[x] = opaque ? 1.f : pix[3];
+            break;
+        case 3:
+            row->r[x] = rOffset < 3 ? pix[rOffset] : 0.f;
+            row->g[x] = gOffset < 3 ? pix[gOffset] : 0.f;
+            row->b[x] = bOffset < 3 ? pix[bOffset] : 0.f;
+            row->a[x] = 1.f;
+            break;
+        case 1:
+            row->r[x] = row->g[x] = row->b[x] = *pix;
+            row->a[x] = 1.f;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void
+ViewerTexture::applyGainOffset(double gain,
+                               double offset,
+                               bool luminance,
+                               Row* row)
+{
+    const int count = row->count;
+    if ( (count == 0) || ( (gain == 1.) && (offset == 0.) && !luminance ) ) {
+        return;
+    }
+    if ( (gain != 1.) || (offset != 0.) ) {
+        float* planes[3] = { &row->r.front(), &row->g.front(), &row->b.front() };
+        for (int c = 0; c < 3; ++c) {
+            float* v = planes[c];
+            for (int i = ImageSIMD::multiplyAdd(v, (float)gain, (float)offset, count); i < count; ++i) {
+                v[i] = v[i] * (float)gain + (float)offset;
+            }
+        }
+    }
+    if (luminance) {
+        float* r = &row->r.front();
+        float* g = &row->g.front();
+        float* b = &row->b.front();
+        for (int i = ImageSIMD::luminance(r, g, b, count); i < count; ++i) {
+            r[i] = g[i] = b[i] = 0.299f * r[i] + 0.587f * g[i] + 0.114f * b[i];
+        }
+    }
+}
+
+void
+ViewerTexture::writeRow8bits(const Color::Lut* colorSpace,
+                             int ditherSeed,
+                             Row* row,
+                             U32* dst)
+{
+    const int count = row->count;
+    if (count == 0) {
+        return;
+    }
+    quantize(&row->a.front(), &row->a8.front(), count);
+    const unsigned char* a = &row->a8.front();
+
+    if (!colorSpace) {
+        quantize(&row->r.front(), &row->r8.front(), count);
+        quantize(&row->g.front(), &row->g8.front(), count);
+        quantize(&row->b.front(), &row->b8.front(), count);
+        const unsigned char* r = &row->r8.front();
+        const unsigned char* g = &row->g8.front();
+        const unsigned char* b = &row->b8.front();
+        for (int x = 0; x < count; ++x) {
+            dst[x] = toBGRA(r[x], g[x], b[x], a[x]);
+        }
+
+        return;
+    }
+
+    colorSpace->toColorSpaceUint8xxFromLinearFloatFast(&row->r.front(), &row->r8xx.front(), count);
+    colorSpace->toColorSpaceUint8xxFromLinearFloatFast(&row->g.front(), &row->g8xx.front(), count);
+    colorSpace->toColorSpaceUint8xxFromLinearFloatFast(&row->b.front(), &row->b8xx.front(), count);
+    const unsigned short* r = &row->r8xx.front();
+    const unsigned short* g = &row->g8xx.front();
+    const unsigned short* b = &row->b8xx.front();
+
+    const int start = Color::ditherStartColumn(ditherSeed, count);
+    /* go fowards from starting point to end of line, then backwards from starting point to start of line: */
+    for (int backward = 0; backward < 2; ++backward) {
+        unsigned error_r = 0x80;
+        unsigned error_g = 0x80;
+        unsigned error_b = 0x80;
+        const int end = backward ? -1 : count;
+        const int dir = backward ? -1 : 1;
+        for (int x = backward ? start - 1 : start; x != end; x += dir) {
+            error_r = (error_r & 0xff) + r[x];
+            error_g = (error_g & 0xff) + g[x];
+            error_b = (error_b & 0xff) + b[x];
+            assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
+            dst[x] = toBGRA( (U8)(error_r >> 8), (U8)(error_g >> 8), (U8)(error_b >> 8), a[x] );
+        }
+    }
+}
+
+void
+ViewerTexture::writeRow32bits(const Row & row,
+                              float* dst)
+{
+    if (row.count == 0) {
+        return;
+    }
+    const float* r = &row.r.front();
+    const float* g = &row.g.front();
+    const float* b = &row.b.front();
+    const float* a = &row.a.front();
+    int x = ImageSIMD::interleaveRGBA(r, g, b, a, dst, row.count);
+    for (dst += x * 4; x < row.count; ++x) {
+        *dst++ = r[x];
+        *dst++ = g[x];
+        *dst++ = b[x];
+        *dst++ = a[x];
+    }
+}
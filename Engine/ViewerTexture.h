@@ -0,0 +1,79 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef NATRON_ENGINE_VIEWERTEXTURE_H_
+#define NATRON_ENGINE_VIEWERTEXTURE_H_
+
+#include <vector>
+
+#include "Global/Macros.h"
+#include "Global/GlobalDefines.h"
+
+namespace Natron {
+namespace Color {
+class Lut;
+}
+
+/**
+ * @brief Row kernels used by the ViewerInstance to convert its input image to the texture buffers.
+ * A row is first read into float planes, then processed and written to the texture a whole row at a time,
+ * which lets each step use the vectorized kernels of ImageSIMD.
+ **/
+namespace ViewerTexture {
+
+/**
+ * @brief One row of the texture as linear float planes, before it is written to the texture buffer.
+ * Each rendering thread uses its own.
+ **/
+struct Row
+{
+    int count; ///< the number of pixels of the row
+    std::vector<float> r, g, b, a;
+    std::vector<unsigned short> r8xx, g8xx, b8xx;
+    std::vector<unsigned char> r8, g8, b8, a8;
+
+    Row()
+        : count(0)
+    {
+    }
+
+    void resize(int pixelsCount);
+
+    ///Sets all the planes to 0, this is what is displayed where there is no image
+    void clear();
+};
+
+/**
+ * @brief Reads row->count pixels of a float image row in the planes of row, one every step pixels.
+ * rOffset, gOffset and bOffset are the indices of the channels displayed as red, green and blue.
+ * Channels that the image does not have read as 0, images with 1 component are read as grey.
+ * The alpha plane is 1 unless the image has 4 components and opaque is false.
+ **/
+void readFloatRow(const float* src, int nComps, int step, int rOffset, int gOffset, int bOffset, bool opaque, Row* row);
+
+/**
+ * @brief Applies the gain and offset of the viewer to the r, g and b planes, then converts
+ * them to luminance if needed.
+ **/
+void applyGainOffset(double gain, double offset, bool luminance, Row* row);
+
+/**
+ * @brief Writes the row to a 8 bits BGRA texture row.
+ * If colorSpace is not NULL, the values are converted with an error diffusion
+ * that starts at a column derived from ditherSeed, e.g: the row index, so that the result does not
+ * depend on the thread doing the conversion. colorSpace must have been validated.
+ **/
+void writeRow8bits(const Natron::Color::Lut* colorSpace, int ditherSeed, Row* row, U32* dst);
+
+/**
+ * @brief Writes the row to a 32 bits float RGBA texture row.
+ **/
+void writeRow32bits(const Row & row, float* dst);
+
+} // namespace ViewerTexture
+} // namespace Natron
+
+#endif // NATRON_ENGINE_VIEWERTEXTURE_H_
@@ -337,7 +337,31 @@ enum SchedulingPolicyEnum
     eSchedulingPolicyFFA = 0, ///frames will be rendered concurrently without ordering (free for all)
     eSchedulingPolicyOrdered ///frames will be rendered in order
 };
-    
+
+enum CacheEvictionPolicyEnum
+{
+    eCacheEvictionPolicyLRU = 0, ///the least recently used entry is evicted first
+    eCacheEvictionPolicyARC, ///adaptive replacement: balances recently and frequently used entries
+    eCacheEvictionPolicyCostAware ///entries that are cheap to recompute relative to their size are evicted first
+};
+
+enum CacheEvictionReasonEnum
+{
+    eCacheEvictionReasonMemoryFull = 0, ///evicted from the memory portion to make room, entries that have a backing file move to the disk portion
+    eCacheEvictionReasonDiskFull, ///evicted from the disk portion to make room
+    eCacheEvictionReasonRemoved, ///removed on purpose, e.g the render of the image was aborted
+    eCacheEvictionReasonInvalidated, ///the node that produced the entry changed
+    eCacheEvictionReasonCleared, ///the cache was cleared
+    eCacheEvictionReasonCount
+};
+
+enum SIMDInstructionSetEnum
+{
+    eSIMDInstructionSetNone = 0, ///scalar code only
+    eSIMDInstructionSetSSE2,
+    eSIMDInstructionSetAVX2
+};
+
 }
 Q_DECLARE_METATYPE(Natron::StandardButtons)
 
@@ -62,6 +62,10 @@ typedef OfxRangeD RangeD;
 #define kProgressChangedStringLong "Progress changed: "
 #define kProgressChangedStringShort "-p"
 
+///followed by the number of frames rendered in parallel and the estimated memory of a frame in bytes, separated by a space
+#define kParallelRendersChangedStringLong "Parallel renders changed: "
+#define kParallelRendersChangedStringShort "-c"
+
 #define kRenderingFinishedStringLong "Rendering finished"
 #define kRenderingFinishedStringShort "-e"
 
@@ -145,6 +145,10 @@ NATRON_VERSION_REVISION)
 //In this context, the reader of the bitmap should then wait for the pixel to be available.
 #define NATRON_ENABLE_TRIMAP 1
 
+//The cache size the tiles of the host multi-threading are sized for when the tile size is automatic in the settings:
+//a tile of the output image and a tile of an input image of the same format fit in it. This is the L2 cache of most processors.
+#define NATRON_HOST_SMP_CACHE_SIZE (256 * 1024)
+
 // compiler_warning.h
 #define STRINGISE_IMPL(x) # x
 #define STRINGISE(x) STRINGISE_IMPL(x)
@@ -11,6 +11,7 @@
 
 #include "CurveWidget.h"
 
+#include <algorithm>
 #include <cmath>
 #include <QMenu>
 CLANG_DIAG_OFF(unused-private-field)
@@ -286,12 +287,17 @@ CurveGui::drawCurve(int curveIndex,
         return;
     }
     
+    ///the vertices which are not keyframes are evaluated all at once afterwards
+    std::vector<double> samples;
+    std::vector<std::size_t> samplesVertices;
     std::pair<KeyFrame,bool> isX1AKey;
     while ( x1 < (w - 1) ) {
         double x,y;
         if (!isX1AKey.second) {
             x = _curveWidget->toZoomCoordinates(x1,0).x();
-            y = evaluate(x);
+            y = 0.;
+            samples.push_back(x);
+            samplesVertices.push_back( vertices.size() + 1 );
         } else {
             x = isX1AKey.first.getTime();
             y = isX1AKey.first.getValue();
@@ -304,9 +310,15 @@ CurveGui::drawCurve(int curveIndex,
     //also add the last point
     {
         double x = _curveWidget->toZoomCoordinates(x1,0).x();
-        double y = evaluate(x);
+        samples.push_back(x);
+        samplesVertices.push_back( vertices.size() + 1 );
         vertices.push_back( (float)x );
-        vertices.push_back( (float)y );
+        vertices.push_back( 0.f );
+    }
+    std::vector<double> samplesValues;
+    evaluate(samples, &samplesValues);
+    for (std::size_t i = 0; i < samplesVertices.size(); ++i) {
+        vertices[samplesVertices[i]] = (float)samplesValues[i];
     }
     
     QPointF btmLeft = _curveWidget->toZoomCoordinates(0,_curveWidget->height() - 1);
@@ -471,6 +483,23 @@ CurveGui::evaluate(double x) const
     }
 }
 
+void
+CurveGui::evaluate(const std::vector<double> & xs,
+                   std::vector<double>* ys) const
+{
+    // always running in the main thread
+    assert( qApp && qApp->thread() == QThread::currentThread() );
+    ys->resize( xs.size() );
+    if ( xs.empty() ) {
+        return;
+    }
+    try {
+        _internalCurve->getValuesAt(&xs.front(), (int)xs.size(), false, &ys->front());
+    } catch (...) {
+        std::fill(ys->begin(), ys->end(), 0.);
+    }
+}
+
 void
 CurveGui::setVisible(bool visible)
 {
@@ -618,6 +647,16 @@ BezierCPCurveGui::evaluate(double x) const
     }
 }
 
+void
+BezierCPCurveGui::evaluate(const std::vector<double> & xs,
+                           std::vector<double>* ys) const
+{
+    ys->resize( xs.size() );
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        (*ys)[i] = evaluate(xs[i]);
+    }
+}
+
 std::pair<double,double>
 BezierCPCurveGui::getCurveYRange() const
 {
@@ -13,6 +13,7 @@
 #define CURVE_WIDGET_H
 
 #include <set>
+#include <vector>
 
 #include "Global/GLIncludes.h" //!<must be included before QGlWidget because of gl.h and glew.h
 #include "Global/Macros.h"
@@ -120,6 +121,11 @@ public:
      * The coordinates are those of the curve, not of the widget.
      **/
     virtual double evaluate(double x) const;
+
+    /**
+     * @brief Same as evaluate() for all the x in xs, which should be increasing: the values are fetched from the curve at once.
+     **/
+    virtual void evaluate(const std::vector<double> & xs,std::vector<double>* ys) const;
     
     boost::shared_ptr<Curve>  getInternalCurve() const
     {
@@ -221,6 +227,7 @@ public:
     boost::shared_ptr<Bezier> getBezier() const ;
     
     virtual double evaluate(double x) const;
+    virtual void evaluate(const std::vector<double> & xs,std::vector<double>* ys) const;
     virtual std::pair<double,double> getCurveYRange() const;
 
     virtual bool areKeyFramesTimeClampedToIntegers() const { return true; }
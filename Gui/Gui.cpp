@@ -3854,6 +3854,7 @@ Gui::onWriterRenderStarted(const QString & sequenceName,
 
     QObject::connect( dialog,SIGNAL( canceled() ),engine,SLOT( abortRendering_Blocking() ) );
     QObject::connect( engine,SIGNAL( frameRendered(int) ),dialog,SLOT( onFrameRendered(int) ) );
+    QObject::connect( engine,SIGNAL( parallelRendersChanged(int,double) ),dialog,SLOT( onParallelRendersChanged(int,double) ) );
     QObject::connect( engine,SIGNAL( renderFinished(int) ),dialog,SLOT( onVideoEngineStopped(int) ) );
     dialog->show();
 }
@@ -22,10 +22,12 @@ CLANG_DIAG_ON(unused-private-field)
 #include <QMenu>
 #include <QToolButton>
 #include <QActionGroup>
+#include <QPointer>
 
 #include "Engine/Image.h"
 #include "Engine/ViewerInstance.h"
 #include "Engine/HistogramCPU.h"
+#include "Engine/ImageStatistics.h"
 #include "Engine/Node.h"
 
 #include "Gui/ticks.h"
@@ -101,12 +103,25 @@ struct HistogramPrivate
           , vmin(0)
           , vmax(0)
           , binsCount(0)
+          , histogramParametersViewer()
 #endif
          , sizeH()
     {
     }
 
-    boost::shared_ptr<Natron::Image> getHistogramImage(RectI* imagePortion) const;
+    /**
+     * @brief Returns the image of the viewer selected in the histogram, as well as the portion of it to use, the viewer
+     * and the index of its texture.
+     **/
+    boost::shared_ptr<Natron::Image> getHistogramImage(RectI* imagePortion,ViewerInstance** viewer,int* textureIndex) const;
+
+#ifndef NATRON_HISTOGRAM_USING_OPENGL
+    /**
+     * @brief Asks viewer to compute the histograms of its next frames. The viewer that was asked before, if another one,
+     * stops computing them. If viewer is NULL, no viewer computes them anymore.
+     **/
+    void setViewerHistogramParameters(ViewerInstance* viewer,double vmin,double vmax,int binsCount);
+#endif
 
 
     void showMenu(const QPoint & globalPos);
@@ -234,6 +249,7 @@ struct HistogramPrivate
     unsigned int pixelsCount;
     double vmin,vmax; //< the x range of the histogram
     unsigned int binsCount;
+    QPointer<ViewerInstance> histogramParametersViewer; //< the viewer computing the histograms, see setViewerHistogramParameters()
 #endif // !NATRON_HISTOGRAM_USING_OPENGL
     
     QSize sizeH;
@@ -396,10 +412,32 @@ Histogram::~Histogram()
     glDeleteBuffers(1,&_imp->vboID);
     glDeleteBuffers(1,&_imp->vboHistogramRendering);
 
+#else
+    ///The viewer would otherwise keep computing histograms for nobody
+    _imp->setViewerHistogramParameters(0, 0., 0., 0);
 #endif
 }
 
-boost::shared_ptr<Natron::Image> HistogramPrivate::getHistogramImage(RectI* imagePortion) const
+#ifndef NATRON_HISTOGRAM_USING_OPENGL
+void
+HistogramPrivate::setViewerHistogramParameters(ViewerInstance* viewer,
+                                               double vmin,
+                                               double vmax,
+                                               int binsCount)
+{
+    if ( histogramParametersViewer && (histogramParametersViewer != viewer) ) {
+        histogramParametersViewer->setHistogramParameters(false, 0., 0., 0);
+    }
+    histogramParametersViewer = viewer;
+    if (viewer) {
+        viewer->setHistogramParameters(fullImage->isChecked(), vmin, vmax, binsCount);
+    }
+}
+#endif
+
+boost::shared_ptr<Natron::Image> HistogramPrivate::getHistogramImage(RectI* imagePortion,
+                                                                     ViewerInstance** viewer,
+                                                                     int* textureIndex) const
 {
     // always running in the main thread
     assert( qApp && qApp->thread() == QThread::currentThread() );
@@ -413,10 +451,11 @@ boost::shared_ptr<Natron::Image> HistogramPrivate::getHistogramImage(RectI* imag
         viewerName = selectedHistAction->text().toStdString();
     }
 
-    int textureIndex = 0;
+    *viewer = 0;
+    *textureIndex = 0;
     QAction* selectedInputAction = viewerCurrentInputGroup->checkedAction();
     if (selectedInputAction) {
-        textureIndex = selectedInputAction->data().toInt();
+        *textureIndex = selectedInputAction->data().toInt();
     } 
     if (index == 0) {
         //no viewer selected
@@ -428,7 +467,8 @@ boost::shared_ptr<Natron::Image> HistogramPrivate::getHistogramImage(RectI* imag
         ViewerTab* lastSelectedViewer = gui->getLastSelectedViewer();
         boost::shared_ptr<Natron::Image> ret;
         if (lastSelectedViewer) {
-            ret = lastSelectedViewer->getViewer()->getLastRenderedImage(textureIndex);
+            *viewer = lastSelectedViewer->getInternalNode();
+            ret = lastSelectedViewer->getViewer()->getLastRenderedImage(*textureIndex);
         }
         if (ret) {
             if (!useImageRoD) {
@@ -446,7 +486,8 @@ boost::shared_ptr<Natron::Image> HistogramPrivate::getHistogramImage(RectI* imag
         const std::list<ViewerTab*> & viewerTabs = gui->getViewersList();
         for (std::list<ViewerTab*>::const_iterator it = viewerTabs.begin(); it != viewerTabs.end(); ++it) {
             if ( (*it)->getInternalNode()->getName() == viewerName ) {
-                ret = (*it)->getViewer()->getLastRenderedImage(textureIndex);
+                *viewer = (*it)->getInternalNode();
+                ret = (*it)->getViewer()->getLastRenderedImage(*textureIndex);
                 if (ret) {
                     if (!useImageRoD) {
                         *imagePortion = (*it)->getViewer()->getImageRectangleDisplayed(ret->getBounds(), ret->getPixelAspectRatio(), ret->getMipMapLevel());
@@ -1379,6 +1420,11 @@ Histogram::computeHistogramAndRefresh(bool forceEvenIfNotVisible)
     assert( qApp && qApp->thread() == QThread::currentThread() );
 
     if (!isVisible() && !forceEvenIfNotVisible) {
+#ifndef NATRON_HISTOGRAM_USING_OPENGL
+        ///don't let the viewer compute histograms that are not displayed
+        _imp->setViewerHistogramParameters(0, 0., 0., 0);
+#endif
+
         return;
     }
 
@@ -1390,9 +1436,18 @@ Histogram::computeHistogramAndRefresh(bool forceEvenIfNotVisible)
 #ifndef NATRON_HISTOGRAM_USING_OPENGL
 
     RectI rect;
-    boost::shared_ptr<Natron::Image> image = _imp->getHistogramImage(&rect);
+    ViewerInstance* viewer;
+    int textureIndex;
+    boost::shared_ptr<Natron::Image> image = _imp->getHistogramImage(&rect, &viewer, &textureIndex);
+    ///Ask the viewer to compute the histograms of the next frames along with its statistics, and use those
+    ///of the current frame if they match. The viewer selected before stops computing them.
+    _imp->setViewerHistogramParameters( viewer, vmin, vmax, HistogramCPU::getStatisticsBinsCount( width() ) );
     if (image) {
-        _imp->histogramThread.computeHistogram(_imp->mode, image, rect, width(),vmin,vmax,_imp->filterSize);
+        boost::shared_ptr<const Natron::ImageStatistics> statistics;
+        if (viewer) {
+            statistics = viewer->getLastStatistics(textureIndex);
+        }
+        _imp->histogramThread.computeHistogram(_imp->mode, image, rect, width(),vmin,vmax,_imp->filterSize,statistics);
     }
 
 #endif
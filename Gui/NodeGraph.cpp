@@ -11,6 +11,7 @@
 #include "NodeGraph.h"
 
 #include <cstdlib>
+#include <algorithm>
 #include <set>
 #include <map>
 #include <vector>
@@ -64,6 +65,7 @@ CLANG_DIAG_ON(uninitialized)
 #include "Engine/Node.h"
 #include "Engine/NoOp.h"
 #include "Engine/OutputSchedulerThread.h"
+#include "Engine/CacheStatistics.h"
 
 #include "Gui/TabWidget.h"
 #include "Gui/Edge.h"
@@ -2673,11 +2675,119 @@ QDirModelPrivate_size(quint64 bytes)
     return QFileSystemModel::tr("%1 byte(s)").arg( QLocale().toString(bytes) );
 }
 
+namespace {
+struct NodeCacheUsage
+{
+    U64 bytes;
+    std::string name;
+    const Natron::CacheCounters* counters;
+};
+
+bool
+compareNodeCacheUsage(const NodeCacheUsage & lhs,
+                      const NodeCacheUsage & rhs)
+{
+    return lhs.bytes > rhs.bytes;
+}
+
+struct NodeLoadBalance
+{
+    double balance;
+    int rendersCount;
+    std::string name;
+};
+
+bool
+compareNodeLoadBalance(const NodeLoadBalance & lhs,
+                       const NodeLoadBalance & rhs)
+{
+    return lhs.balance < rhs.balance;
+}
+}
+
 void
 NodeGraph::updateCacheSizeText()
 {
-    _imp->_cacheSizeText->setPlainText( tr("Memory cache size: %1")
-                                        .arg( QDirModelPrivate_size( appPTR->getCachesTotalMemorySize() ) ) );
+    if ( !_imp->_cacheSizeText->isVisible() ) {
+        return;
+    }
+
+    ///The entries of the images are identified by the hash of the node that rendered them
+    std::map<U64,std::string> nodeNames;
+    std::vector<NodeLoadBalance> loadBalances;
+    {
+        QMutexLocker l(&_imp->_nodesMutex);
+        for (std::list<boost::shared_ptr<NodeGui> >::iterator it = _imp->_nodes.begin(); it != _imp->_nodes.end(); ++it) {
+            boost::shared_ptr<Natron::Node> node = (*it)->getNode();
+            if (node) {
+                nodeNames[node->getHashValue()] = node->getName_mt_safe();
+                Natron::EffectInstance* effect = node->getLiveInstance();
+                if ( effect && (effect->getHostSMPRendersCount() > 0) ) {
+                    NodeLoadBalance nodeBalance;
+                    nodeBalance.balance = effect->getHostSMPLoadBalance();
+                    nodeBalance.rendersCount = effect->getHostSMPRendersCount();
+                    nodeBalance.name = node->getName_mt_safe();
+                    loadBalances.push_back(nodeBalance);
+                }
+            }
+        }
+    }
+
+    QString text = tr("Memory cache size: %1").arg( QDirModelPrivate_size( appPTR->getCachesTotalMemorySize() ) );
+    std::list<Natron::CacheStatistics> stats;
+    appPTR->getCachesStatistics(&stats);
+    for (std::list<Natron::CacheStatistics>::iterator it = stats.begin(); it != stats.end(); ++it) {
+        const Natron::CacheCounters & total = it->total;
+        text.append('\n');
+        text.append( tr("%1: %2% hits out of %3 look-ups, %4 in RAM, %5 on disk, average lifetime %6 s")
+                     .arg( it->cacheName.c_str() )
+                     .arg(total.getHitRatio() * 100.,0,'f',1)
+                     .arg(total.getLookupsCount())
+                     .arg( QDirModelPrivate_size(total.memoryBytes) )
+                     .arg( QDirModelPrivate_size(total.diskBytes) )
+                     .arg(total.getAverageLifetime(),0,'f',1) );
+        if (total.getEvictionsCount() > 0) {
+            text.append( tr("\n    Evictions:") );
+            for (int i = 0; i < Natron::eCacheEvictionReasonCount; ++i) {
+                text.append( QString(i == 0 ? " %1 %2" : ", %1 %2").arg(total.evictions[i])
+                             .arg( Natron::getCacheEvictionReasonName( (Natron::CacheEvictionReasonEnum)i ) ) );
+            }
+        }
+
+        ///The nodes of this graph which use the most of the cache
+        std::vector<NodeCacheUsage> nodes;
+        for (Natron::CacheStatistics::NodesCounters::const_iterator it2 = it->nodes.begin(); it2 != it->nodes.end(); ++it2) {
+            std::map<U64,std::string>::iterator found = nodeNames.find(it2->first);
+            if ( found != nodeNames.end() ) {
+                NodeCacheUsage usage;
+                usage.bytes = it2->second.memoryBytes + it2->second.diskBytes;
+                usage.name = found->second;
+                usage.counters = &it2->second;
+                nodes.push_back(usage);
+            }
+        }
+        std::sort(nodes.begin(), nodes.end(), compareNodeCacheUsage);
+        for (std::size_t i = 0; i < nodes.size() && i < 3; ++i) {
+            text.append( tr("\n    %1: %2, %3% hits out of %4 look-ups")
+                         .arg( nodes[i].name.c_str() )
+                         .arg( QDirModelPrivate_size(nodes[i].bytes) )
+                         .arg(nodes[i].counters->getHitRatio() * 100.,0,'f',1)
+                         .arg(nodes[i].counters->getLookupsCount()) );
+        }
+    }
+    
+    ///The nodes whose renders split in tiles kept the threads the least busy
+    if ( !loadBalances.empty() ) {
+        std::sort(loadBalances.begin(), loadBalances.end(), compareNodeLoadBalance);
+        text.append( tr("\nMulti-threaded renders load balance:") );
+        for (std::size_t i = 0; i < loadBalances.size() && i < 3; ++i) {
+            text.append( tr("\n    %1: %2% over %3 render(s)")
+                         .arg( loadBalances[i].name.c_str() )
+                         .arg(loadBalances[i].balance * 100.,0,'f',1)
+                         .arg(loadBalances[i].rendersCount) );
+        }
+    }
+    _imp->_cacheSizeText->setPlainText(text);
 }
 
 QRectF
@@ -2705,6 +2815,7 @@ NodeGraph::toggleCacheInfo()
         _imp->_cacheSizeText->hide();
     } else {
         _imp->_cacheSizeText->show();
+        updateCacheSizeText();
     }
 }
 
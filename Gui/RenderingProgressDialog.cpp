@@ -26,6 +26,7 @@ CLANG_DIAG_OFF(uninitialized)
 CLANG_DIAG_ON(deprecated)
 CLANG_DIAG_ON(uninitialized)
 
+#include "Global/MemoryInfo.h"
 #include "Engine/ProcessHandler.h"
 
 #include "Gui/Button.h"
@@ -38,6 +39,7 @@ struct RenderingProgressDialogPrivate
     QVBoxLayout* _mainLayout;
     QLabel* _totalLabel;
     QProgressBar* _totalProgress;
+    QLabel* _parallelRendersLabel;
     QFrame* _separator;
     QLabel* _perFrameLabel;
     QProgressBar* _perFrameProgress;
@@ -58,6 +60,7 @@ struct RenderingProgressDialogPrivate
           , _mainLayout(0)
           , _totalLabel(0)
           , _totalProgress(0)
+          , _parallelRendersLabel(0)
           , _separator(0)
           , _perFrameLabel(0)
           , _perFrameProgress(0)
@@ -103,6 +106,16 @@ RenderingProgressDialog::onCurrentFrameProgress(int progress)
     _imp->_perFrameProgress->setValue(progress);
 }
 
+void
+RenderingProgressDialog::onParallelRendersChanged(int parallelRenders,
+                                                  double frameMemory)
+{
+    _imp->_parallelRendersLabel->setText( tr("Rendering %1 frame(s) in parallel, about %2 per frame")
+                                          .arg(parallelRenders)
+                                          .arg( printAsRAM( (U64)frameMemory ) ) );
+    _imp->_parallelRendersLabel->show();
+}
+
 void
 RenderingProgressDialog::onProcessCanceled()
 {
@@ -199,6 +212,11 @@ RenderingProgressDialog::RenderingProgressDialog(Gui* gui,
 
     _imp->_mainLayout->addWidget(_imp->_totalProgress);
 
+    ///Only shown when the memory budget of the renders limits the number of frames rendered in parallel
+    _imp->_parallelRendersLabel = new QLabel(this);
+    _imp->_parallelRendersLabel->hide();
+    _imp->_mainLayout->addWidget(_imp->_parallelRendersLabel);
+
     _imp->_separator = new QFrame(this);
     _imp->_separator->setFrameShadow(QFrame::Raised);
     _imp->_separator->setMinimumWidth(100);
@@ -230,6 +248,7 @@ RenderingProgressDialog::RenderingProgressDialog(Gui* gui,
         QObject::connect( process.get(),SIGNAL( processCanceled() ),this,SLOT( onProcessCanceled() ) );
         QObject::connect( process.get(),SIGNAL( frameRendered(int) ),this,SLOT( onFrameRendered(int) ) );
         QObject::connect( process.get(),SIGNAL( frameProgress(int) ),this,SLOT( onCurrentFrameProgress(int) ) );
+        QObject::connect( process.get(),SIGNAL( parallelRendersChanged(int,double) ),this,SLOT( onParallelRendersChanged(int,double) ) );
         QObject::connect( process.get(),SIGNAL( processFinished(int) ),this,SLOT( onProcessFinished(int) ) );
         QObject::connect( process.get(),SIGNAL( deleted() ),this,SLOT( onProcessDeleted() ) );
     }
@@ -247,6 +266,7 @@ RenderingProgressDialog::onProcessDeleted()
     QObject::disconnect( _imp->_process.get(),SIGNAL( processCanceled() ),this,SLOT( onProcessCanceled() ) );
     QObject::disconnect( _imp->_process.get(),SIGNAL( frameRendered(int) ),this,SLOT( onFrameRendered(int) ) );
     QObject::disconnect( _imp->_process.get(),SIGNAL( frameProgress(int) ),this,SLOT( onCurrentFrameProgress(int) ) );
+    QObject::disconnect( _imp->_process.get(),SIGNAL( parallelRendersChanged(int,double) ),this,SLOT( onParallelRendersChanged(int,double) ) );
     QObject::disconnect( _imp->_process.get(),SIGNAL( processFinished(int) ),this,SLOT( onProcessFinished(int) ) );
     QObject::disconnect( _imp->_process.get(),SIGNAL( deleted() ),this,SLOT( onProcessDeleted() ) );
 }
@@ -53,6 +53,8 @@ public slots:
 
     void onCurrentFrameProgress(int);
 
+    void onParallelRendersChanged(int parallelRenders,double frameMemory);
+
     void onProcessCanceled();
 
     void onProcessFinished(int);
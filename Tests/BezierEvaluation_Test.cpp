@@ -0,0 +1,156 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <limits>
+#include <list>
+
+#include <gtest/gtest.h>
+
+#include "BaseTest.h"
+
+#include "Engine/AppManager.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/Node.h"
+#include "Engine/Rect.h"
+#include "Engine/RotoContext.h"
+
+using namespace Natron;
+
+namespace {
+///Number of points per Bezier segment of the evaluations
+#define BEZIER_TEST_N_POINTS_PER_SEGMENT 20
+
+struct BezierTestEvaluation
+{
+    std::list<Natron::Point> points;
+    std::list<Natron::Point> featherPoints;
+    RectD bbox;
+    RectD featherBbox;
+    RectD boundingBox;
+};
+
+void
+setEmptyBbox(RectD* bbox)
+{
+    bbox->x1 = bbox->y1 = std::numeric_limits<double>::infinity();
+    bbox->x2 = bbox->y2 = -std::numeric_limits<double>::infinity();
+}
+
+///Makes the 3 look-ups of the cache of evaluations: the curve, the feather curve and the bounding box
+void
+evaluateBezier(const Bezier & bezier,
+               int time,
+               BezierTestEvaluation* evaluation)
+{
+    setEmptyBbox(&evaluation->bbox);
+    setEmptyBbox(&evaluation->featherBbox);
+    bezier.evaluateAtTime_DeCasteljau(time, 0, BEZIER_TEST_N_POINTS_PER_SEGMENT, &evaluation->points, &evaluation->bbox);
+    bezier.evaluateFeatherPointsAtTime_DeCasteljau(time, 0, BEZIER_TEST_N_POINTS_PER_SEGMENT, true,
+                                                   &evaluation->featherPoints, &evaluation->featherBbox);
+    evaluation->boundingBox = bezier.getBoundingBox(time);
+}
+
+void
+expectSamePoints(const std::list<Natron::Point> & a,
+                 const std::list<Natron::Point> & b)
+{
+    ASSERT_EQ( a.size(), b.size() );
+    std::list<Natron::Point>::const_iterator itB = b.begin();
+    for (std::list<Natron::Point>::const_iterator itA = a.begin(); itA != a.end(); ++itA, ++itB) {
+        EXPECT_EQ(itA->x, itB->x);
+        EXPECT_EQ(itA->y, itB->y);
+    }
+}
+
+void
+expectSameEvaluation(const BezierTestEvaluation & a,
+                     const BezierTestEvaluation & b)
+{
+    expectSamePoints(a.points, b.points);
+    expectSamePoints(a.featherPoints, b.featherPoints);
+    EXPECT_TRUE(a.bbox == b.bbox);
+    EXPECT_TRUE(a.featherBbox == b.featherBbox);
+    EXPECT_TRUE(a.boundingBox == b.boundingBox);
+}
+
+///Checks that the cached evaluation of bezier is the one computed after forgetting the cache
+void
+expectSameAsUncached(Bezier* bezier,
+                     int time,
+                     const BezierTestEvaluation & evaluation)
+{
+    bezier->incrementPointsAge();
+    U64 hits = bezier->getEvaluationsCacheHits();
+    BezierTestEvaluation uncached;
+    evaluateBezier(*bezier, time, &uncached);
+    EXPECT_EQ( hits, bezier->getEvaluationsCacheHits() );
+    expectSameEvaluation(evaluation, uncached);
+}
+}
+
+TEST_F(BaseTest,BezierEvaluationCache)
+{
+    boost::shared_ptr<Node> node = createNode(_dotGeneratorPluginID);
+    ASSERT_TRUE(node);
+    boost::shared_ptr<RotoContext> context( new RotoContext( node.get() ) );
+    context->createBaseLayer();
+    int time = context->getTimelineCurrentTime();
+
+    boost::shared_ptr<Bezier> bezier = context->makeBezier(0, 0, "Bezier");
+    bezier->addControlPoint(100, 0);
+    bezier->addControlPoint(100, 100);
+    bezier->addControlPoint(0, 100);
+    bezier->setCurveFinished(true);
+
+    ///The second evaluation at the same time is read from the cache
+    BezierTestEvaluation first;
+    evaluateBezier(*bezier, time, &first);
+    U64 hits = bezier->getEvaluationsCacheHits();
+    BezierTestEvaluation second;
+    evaluateBezier(*bezier, time, &second);
+    EXPECT_EQ( hits + 3, bezier->getEvaluationsCacheHits() );
+    expectSameEvaluation(first, second);
+    expectSameAsUncached(bezier.get(), time, second);
+
+    ///Moving a control point, its feather point follows
+    hits = bezier->getEvaluationsCacheHits();
+    bezier->movePointByIndex(1, time, 10., 0.);
+    BezierTestEvaluation moved;
+    evaluateBezier(*bezier, time, &moved);
+    EXPECT_EQ( hits, bezier->getEvaluationsCacheHits() );
+    EXPECT_EQ(first.bbox.x2 + 10., moved.bbox.x2);
+    EXPECT_EQ(first.boundingBox.x2 + 10., moved.boundingBox.x2);
+    expectSameAsUncached(bezier.get(), time, moved);
+
+    ///Moving a feather point only
+    hits = bezier->getEvaluationsCacheHits();
+    bezier->moveFeatherByIndex(2, time, 0., 20.);
+    BezierTestEvaluation feathered;
+    evaluateBezier(*bezier, time, &feathered);
+    EXPECT_EQ( hits, bezier->getEvaluationsCacheHits() );
+    EXPECT_TRUE(feathered.bbox == moved.bbox);
+    EXPECT_EQ(moved.featherBbox.y2 + 20., feathered.featherBbox.y2);
+    EXPECT_GT(feathered.boundingBox.y2, moved.boundingBox.y2);
+    expectSameAsUncached(bezier.get(), time, feathered);
+
+    ///Moving the track a control point is slaved to
+    boost::shared_ptr<Double_Knob> track = Natron::createKnob<Double_Knob>(node->getLiveInstance(), "Track", 2, false);
+    for (int i = 0; i < 2; ++i) {
+        track->setValueAtTime(time, 0., i);
+        track->setValueAtTime(time + 10, 0., i);
+    }
+    bezier->getControlPoints().front()->slaveTo(time + 10, track);
+    BezierTestEvaluation slaved;
+    evaluateBezier(*bezier, time, &slaved);
+    expectSameEvaluation(feathered, slaved);
+
+    track->setValueAtTime(time, -30., 1);
+    BezierTestEvaluation trackMoved;
+    evaluateBezier(*bezier, time, &trackMoved);
+    EXPECT_EQ(-30., trackMoved.bbox.y1);
+    EXPECT_LT(trackMoved.boundingBox.y1, slaved.boundingBox.y1);
+    expectSameAsUncached(bezier.get(), time, trackMoved);
+}
@@ -0,0 +1,508 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <vector>
+#include <map>
+#include <list>
+#include <cstring>
+#include <iostream>
+#include <gtest/gtest.h>
+
+#include <QtCore/QThread>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#include "BaseTest.h"
+#include "Engine/Cache.h"
+#include "Engine/CacheEvictionPolicy.h"
+#include "Engine/CacheSegmentStore.h"
+#include "Engine/CacheTOCFile.h"
+#include "Engine/CacheSharedIndex.h"
+#include "Engine/CacheStatistics.h"
+#include "Engine/Image.h"
+#include "Engine/Timer.h"
+
+using namespace Natron;
+
+namespace {
+
+///Number of distinct entries living in the cache during the benchmark
+#define CACHE_TEST_N_ENTRIES 4096
+
+///Number of look-ups made by each thread
+#define CACHE_TEST_N_LOOKUPS 200000
+
+class CacheLookupThread
+    : public QThread
+{
+    const Natron::Cache<Natron::Image>* _cache;
+    const std::vector<Natron::ImageKey>* _keys;
+    int _offset;
+    int _hits;
+
+public:
+
+    CacheLookupThread(const Natron::Cache<Natron::Image>* cache,
+                      const std::vector<Natron::ImageKey>* keys,
+                      int offset)
+    : QThread()
+    , _cache(cache)
+    , _keys(keys)
+    , _offset(offset)
+    , _hits(0)
+    {
+    }
+
+    int getHits() const
+    {
+        return _hits;
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        int nKeys = (int)_keys->size();
+        for (int i = 0; i < CACHE_TEST_N_LOOKUPS; ++i) {
+            std::list<ImagePtr> ret;
+            if ( _cache->get( (*_keys)[(_offset + i * 7) % nKeys], &ret ) ) {
+                ++_hits;
+            }
+        }
+    }
+};
+
+///Runs CACHE_TEST_N_LOOKUPS look-ups on nThreads threads and returns the elapsed time in seconds
+double
+runConcurrentLookups(const Natron::Cache<Natron::Image>& cache,
+                     const std::vector<Natron::ImageKey>& keys,
+                     int nThreads)
+{
+    std::vector<CacheLookupThread*> threads;
+    for (int i = 0; i < nThreads; ++i) {
+        threads.push_back( new CacheLookupThread(&cache,&keys,i * 13) );
+    }
+
+    TimeLapse timer;
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->start();
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->wait();
+    }
+    double elapsed = timer.getTimeSinceCreation();
+
+    for (int i = 0; i < nThreads; ++i) {
+        EXPECT_EQ(CACHE_TEST_N_LOOKUPS, threads[i]->getHits());
+        delete threads[i];
+    }
+    return elapsed;
+}
+
+class CacheTest
+    : public BaseTest
+{
+protected:
+
+    void fillCache(Natron::Cache<Natron::Image>* cache,
+                   int nEntries,
+                   std::vector<Natron::ImageKey>* keys)
+    {
+        std::map<int, std::vector<RangeD> > framesNeeded;
+        RectD rod(0,0,256,256);
+        for (int i = 0; i < nEntries; ++i) {
+            Natron::ImageKey key = Natron::Image::makeKey(i + 1,false,0,0);
+            boost::shared_ptr<ImageParams> params = Natron::Image::makeParams(0,rod,1.,0,false,
+                                                                              Natron::eImageComponentRGBA,
+                                                                              Natron::eImageBitDepthFloat,
+                                                                              framesNeeded);
+            ImageLocker locker(NULL);
+            ImagePtr image;
+            ASSERT_FALSE( cache->getOrCreate(key,params,&locker,&image) );
+            ASSERT_TRUE(image);
+            keys->push_back(key);
+        }
+    }
+};
+
+}
+
+///Look-ups of entries with different hash keys should not serialize on a single lock:
+///the throughput printed here is expected to grow with the number of threads.
+TEST_F(CacheTest,ContentionBenchmark) {
+    Natron::Cache<Natron::Image> cache("CacheTest",1,(U64)1 << 40,1.);
+    std::vector<Natron::ImageKey> keys;
+    fillCache(&cache,CACHE_TEST_N_ENTRIES,&keys);
+
+    int maxThreads = std::max(1,QThread::idealThreadCount());
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        double elapsed = runConcurrentLookups(cache,keys,nThreads);
+        double lookupsPerSec = elapsed > 0 ? ( (double)nThreads * CACHE_TEST_N_LOOKUPS ) / elapsed : 0.;
+        std::cout << "Cache look-ups with " << nThreads << " thread(s): "
+                  << (int)lookupsPerSec << " look-ups/s" << std::endl;
+    }
+}
+
+///Cache hits only take the bucket lock for reading, the average latency of a hit
+///should stay roughly constant as readers are added.
+TEST_F(CacheTest,HitLatencyBenchmark) {
+    Natron::Cache<Natron::Image> cache("CacheTest",1,(U64)1 << 40,1.);
+    std::vector<Natron::ImageKey> keys;
+    fillCache(&cache,CACHE_TEST_N_ENTRIES,&keys);
+
+    const int nReaders[3] = { 1, 8, 32 };
+    for (int i = 0; i < 3; ++i) {
+        double elapsed = runConcurrentLookups(cache,keys,nReaders[i]);
+        ///Each thread does CACHE_TEST_N_LOOKUPS hits in sequence
+        double nsPerHit = elapsed * 1e9 / CACHE_TEST_N_LOOKUPS;
+        std::cout << "Cache hit latency with " << nReaders[i] << " reader thread(s): "
+                  << nsPerHit << " ns" << std::endl;
+    }
+}
+
+TEST_F(CacheTest,EvictionPolicies) {
+    typedef Natron::CacheEvictionPolicyI<Natron::Image> EvictionPolicy;
+    typedef EvictionPolicy::CandidatesList CandidatesList;
+
+    Natron::Cache<Natron::Image> cache("CacheTest",1,(U64)1 << 40,1.);
+    std::vector<Natron::ImageKey> keys;
+    fillCache(&cache,4,&keys);
+
+    ///getCopy() does not count as a cache hit
+    std::list<ImagePtr> entries;
+    cache.getCopy(&entries);
+    ASSERT_EQ(4, (int)entries.size());
+    std::vector<ImagePtr> images(entries.begin(),entries.end());
+
+    ///Candidates are given least recently used first
+    CandidatesList candidates;
+    for (int i = 0; i < 4; ++i) {
+        candidates.push_back( std::make_pair(images[i]->getHashKey(),images[i]) );
+    }
+
+    ///LRU evicts the first candidate
+    boost::scoped_ptr<EvictionPolicy> lru( Natron::createCacheEvictionPolicy<Natron::Image>(Natron::eCacheEvictionPolicyLRU) );
+    EXPECT_TRUE( lru->selectVictim(candidates) == candidates.begin() );
+
+    ///Cost-aware evicts the cheapest image to render again, all images having the same size
+    for (int i = 0; i < 4; ++i) {
+        images[i]->addComputeTime(i == 2 ? 0.001 : 1.);
+    }
+    boost::scoped_ptr<EvictionPolicy> costAware( Natron::createCacheEvictionPolicy<Natron::Image>(Natron::eCacheEvictionPolicyCostAware) );
+    EXPECT_EQ( images[2], costAware->selectVictim(candidates)->second );
+
+    ///ARC: 0 and 3 are recent, 1 and 2 were hit and are frequent
+    images[1]->markAccessed();
+    images[2]->markAccessed();
+    boost::scoped_ptr<EvictionPolicy> arc( Natron::createCacheEvictionPolicy<Natron::Image>(Natron::eCacheEvictionPolicyARC) );
+
+    ///Half of the candidates are recent, which does not exceed the initial target: the LRU frequent entry goes
+    CandidatesList::const_iterator victim = arc->selectVictim(candidates);
+    EXPECT_EQ( images[1], victim->second );
+
+    ///Missing an evicted frequent entry means frequent entries should be kept longer
+    arc->onEntryEvicted(victim->second);
+    arc->onMiss(victim->first);
+    EXPECT_EQ( images[0], arc->selectVictim(candidates)->second );
+}
+
+///Look-ups and evictions are counted in total and by node
+TEST_F(CacheTest,Statistics) {
+    Natron::Cache<Natron::Image> cache("CacheTest",1,(U64)1 << 40,1.);
+    std::vector<Natron::ImageKey> keys;
+    ///Each entry is made by a different node, the node hashes are 1 to 4
+    fillCache(&cache,4,&keys);
+
+    std::list<ImagePtr> entries;
+    EXPECT_TRUE( cache.get(keys[0],&entries) );
+    EXPECT_TRUE( cache.get(keys[0],&entries) );
+    EXPECT_TRUE( cache.get(keys[1],&entries) );
+    entries.clear();
+    EXPECT_FALSE( cache.get(Natron::Image::makeKey(5,false,0,0),&entries) );
+
+    cache.removeEntry( keys[2].getHash() );
+    cache.removeAllImagesFromCacheWithMatchingKey(4);
+
+    Natron::CacheStatistics stats;
+    cache.getStatistics(&stats);
+    EXPECT_EQ( std::string("CacheTest"), stats.cacheName );
+    EXPECT_EQ( (U64)3, stats.total.hits );
+    ///fillCache() created the entries after missing them
+    EXPECT_EQ( (U64)5, stats.total.misses );
+    EXPECT_EQ( (U64)1, stats.total.evictions[Natron::eCacheEvictionReasonRemoved] );
+    EXPECT_EQ( (U64)1, stats.total.evictions[Natron::eCacheEvictionReasonInvalidated] );
+    EXPECT_EQ( (U64)2, stats.total.getEvictionsCount() );
+    EXPECT_EQ( (U64)2, stats.total.entriesCount );
+    EXPECT_EQ( (U64)2, stats.nodes[1].hits );
+    EXPECT_EQ( (U64)1, stats.nodes[1].misses );
+    EXPECT_EQ( (U64)1, stats.nodes[2].hits );
+    EXPECT_EQ( (U64)1, stats.nodes[5].misses );
+    EXPECT_EQ( (U64)0, stats.nodes[3].entriesCount );
+    EXPECT_EQ( (U64)1, stats.nodes[3].removedEntriesCount );
+    EXPECT_GE( stats.nodes[3].getAverageLifetime(), 0. );
+
+    ///Resetting the counters keeps the entries count
+    cache.resetStatistics();
+    cache.getStatistics(&stats);
+    EXPECT_EQ( (U64)0, stats.total.getLookupsCount() );
+    EXPECT_EQ( (U64)0, stats.total.getEvictionsCount() );
+    EXPECT_EQ( (U64)2, stats.total.entriesCount );
+    EXPECT_EQ( (U64)1, stats.nodes[1].entriesCount );
+}
+
+///The tiles allocated on demand and the bitmap of a tiled image are given back to the RAM total when it is destroyed
+TEST_F(CacheTest,TiledImageMemory) {
+    Natron::Cache<Natron::Image> cache("CacheTest",1,(U64)1 << 40,1.);
+    std::size_t startSize = cache.getMemoryCacheSize();
+
+    {
+        std::map<int, std::vector<RangeD> > framesNeeded;
+        RectD rod(0,0,NATRON_IMAGE_TILE_SIZE * 4,NATRON_IMAGE_TILE_SIZE * 4);
+        Natron::ImageKey key = Natron::Image::makeKey(1,false,0,0);
+        boost::shared_ptr<ImageParams> params = Natron::Image::makeParams(0,rod,1.,0,false,
+                                                                          Natron::eImageComponentRGBA,
+                                                                          Natron::eImageBitDepthFloat,
+                                                                          framesNeeded);
+        params->setTiled(true);
+        ImageLocker locker(NULL);
+        ImagePtr image;
+        ASSERT_FALSE( cache.getOrCreate(key,params,&locker,&image) );
+        ASSERT_TRUE(image);
+        ASSERT_TRUE( image->isTiled() );
+
+        ///Touch two tiles
+        ASSERT_TRUE( image->pixelAt(0,0) != NULL );
+        ASSERT_TRUE( image->pixelAt(NATRON_IMAGE_TILE_SIZE * 2,NATRON_IMAGE_TILE_SIZE) != NULL );
+        EXPECT_EQ( (std::size_t)2, image->getAllocatedTilesCount() );
+        EXPECT_EQ( startSize + image->size(), cache.getMemoryCacheSize() );
+
+        cache.removeEntry(image);
+    }
+
+    EXPECT_EQ( startSize, cache.getMemoryCacheSize() );
+}
+
+///Entries moved from the memory portion to the disk portion are written to their backing file
+///by the write-back thread and can then be read back.
+TEST_F(CacheTest,AsynchronousWriteBack) {
+    ///8MiB in memory, the rest on disk
+    Natron::Cache<Natron::Image> cache("NodeCache",1,(U64)64 << 20,0.125);
+
+    std::map<int, std::vector<RangeD> > framesNeeded;
+    RectD rod(0,0,256,256);
+    std::vector<Natron::ImageKey> keys;
+    for (int i = 0; i < 32; ++i) {
+        Natron::ImageKey key = Natron::Image::makeKey(i + 1,false,0,0);
+        ///A cost of 1 makes the image stored on disk
+        boost::shared_ptr<ImageParams> params = Natron::Image::makeParams(1,rod,1.,0,false,
+                                                                          Natron::eImageComponentRGBA,
+                                                                          Natron::eImageBitDepthFloat,
+                                                                          framesNeeded);
+        ImageLocker locker(NULL);
+        ImagePtr image;
+        ASSERT_FALSE( cache.getOrCreate(key,params,&locker,&image) );
+        ASSERT_TRUE(image);
+        image->allocateMemory();
+        keys.push_back(key);
+    }
+
+    cache.waitForWriteBack();
+    EXPECT_EQ( 0, cache.getWriteBackQueueDepth() );
+    EXPECT_EQ( (std::size_t)0, cache.getWriteBackQueueSize() );
+    EXPECT_GT( cache.getWriteBackBytesWritten(), (U64)0 );
+    ///The memory portion is trimmed before an entry is created, hence the extra entry
+    EXPECT_LE( cache.getMemoryCacheSize(), (std::size_t)9 << 20 );
+    ///All images are packed in a single segment file
+    EXPECT_EQ( 1, cache.getSegmentStore()->getSegmentsCount() );
+    std::cout << "Cache write-back bandwidth: " << printAsRAM( (U64)cache.getWriteBackBandwidth() ).toStdString() << "/s" << std::endl;
+
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        std::list<ImagePtr> ret;
+        EXPECT_TRUE( cache.get(keys[i],&ret) );
+    }
+
+    ///Remove the backing files
+    cache.waitForWriteBack();
+    cache.clear();
+}
+
+///Regions are packed in the same segment file, survive the store and can be moved out of a mostly empty segment.
+TEST_F(CacheTest,SegmentStore) {
+    QString path = QDir::tempPath() + QDir::separator() + "NatronCacheSegmentTest";
+    QDir().mkpath(path);
+    QDir dir(path);
+    QStringList files = dir.entryList(QDir::Files);
+    for (int i = 0; i < files.size(); ++i) {
+        dir.remove(files[i]);
+    }
+
+    int seg1,seg2;
+    std::size_t offset1,offset2;
+    U64 tag;
+    {
+        CacheSegmentStore store( path.toStdString() );
+        ASSERT_TRUE( store.allocate(100,&seg1,&offset1) );
+        ASSERT_TRUE( store.allocate(1000,&seg2,&offset2) );
+        EXPECT_EQ(seg1, seg2);
+        EXPECT_EQ( (std::size_t)NATRON_CACHE_SEGMENT_HEADER_SIZE, offset1 );
+        EXPECT_EQ( (std::size_t)0, offset2 % NATRON_CACHE_SEGMENT_ALIGNMENT );
+        EXPECT_GE( offset2, (std::size_t)100 );
+
+        std::memset(store.getData(seg2,offset2),42,1000);
+        EXPECT_TRUE( store.flush(seg2,offset2,1000) );
+        store.discard(seg2,offset2,1000);
+        EXPECT_EQ( 42, store.getData(seg2,offset2)[999] );
+
+        ///Entries larger than a segment get their own segment, removed with the entry
+        int bigSeg;
+        std::size_t bigOffset;
+        ASSERT_TRUE( store.allocate( (std::size_t)NATRON_CACHE_SEGMENT_SIZE + 1,&bigSeg,&bigOffset ) );
+        EXPECT_NE(seg1, bigSeg);
+        EXPECT_EQ( 2, store.getSegmentsCount() );
+        store.release(bigSeg,bigOffset,(std::size_t)NATRON_CACHE_SEGMENT_SIZE + 1);
+        EXPECT_EQ( 1, store.getSegmentsCount() );
+
+        store.release(seg1,offset1,100);
+        EXPECT_GT( store.getFragmentedSize(), (std::size_t)0 );
+        tag = store.getSegmentTag(seg2);
+        EXPECT_NE( (U64)0, tag );
+    }
+
+    ///Restore the region left in the segment file by the previous store
+    CacheSegmentStore store( path.toStdString() );
+    EXPECT_FALSE( store.restoreRegion(seg2,offset2,1000) );
+    std::map<int,U64> pinned;
+    pinned[seg2] = tag + 1;
+    store.pinSegments(pinned);
+    EXPECT_FALSE( store.restoreRegion(seg2,offset2,1000) );
+    pinned[seg2] = tag;
+    store.pinSegments(pinned);
+    EXPECT_FALSE( store.restoreRegion(seg2 + 1,NATRON_CACHE_SEGMENT_HEADER_SIZE,100) );
+    ASSERT_TRUE( store.restoreRegion(seg2,offset2,1000) );
+    EXPECT_EQ( 42, store.getData(seg2,offset2)[0] );
+
+    ///Pinned segments are not compacted
+    std::list<int> toCompact;
+    store.getSegmentsToCompact(&toCompact);
+    EXPECT_TRUE( toCompact.empty() );
+    store.unpinSegments();
+
+    ///The segment of the previous session is almost empty: move the region to a new segment
+    store.getSegmentsToCompact(&toCompact);
+    ASSERT_EQ( 1, (int)toCompact.size() );
+    EXPECT_EQ( seg2, toCompact.front() );
+    int seg = seg2;
+    std::size_t offset = offset2;
+    ASSERT_TRUE( store.relocate(&seg,&offset,1000) );
+    EXPECT_NE(seg2, seg);
+    EXPECT_EQ( 42, store.getData(seg,offset)[500] );
+    EXPECT_EQ( 1, store.getSegmentsCount() );
+    EXPECT_EQ( (std::size_t)0, store.getFragmentedSize() );
+
+    store.release(seg,offset,1000);
+    store.removeUnusedSegmentFiles();
+}
+
+TEST_F(CacheTest,TableOfContentsFile) {
+    QString path = QDir::tempPath() + QDir::separator() + "NatronCacheTOCTest." NATRON_CACHE_FILE_EXT;
+    std::string filePath = path.toStdString();
+
+    std::vector<CacheTOCFile::Entry> entries;
+    for (int i = 0; i < 100; ++i) {
+        CacheTOCFile::Entry entry;
+        ///2 entries share each hash key
+        entry.hash = (U64)( (i * 7919) % 50 );
+        entry.segment = i % 3;
+        entry.offset = NATRON_CACHE_SEGMENT_HEADER_SIZE + i * NATRON_CACHE_SEGMENT_ALIGNMENT;
+        entry.length = i + 1;
+        entry.blob = std::string(i,(char)i);
+        entries.push_back(entry);
+    }
+    CacheTOCFile::SegmentTags segments;
+    segments[0] = 10;
+    segments[1] = 11;
+    segments[2] = 12;
+    ASSERT_TRUE( CacheTOCFile::write(filePath,1,segments,&entries) );
+
+    EXPECT_FALSE( CacheTOCFile::open(filePath,2) );
+    boost::shared_ptr<CacheTOCFile> toc = CacheTOCFile::open(filePath,1);
+    ASSERT_TRUE(toc);
+    EXPECT_EQ( (U64)100, toc->getEntriesCount() );
+    EXPECT_EQ( segments, toc->getSegments() );
+
+    std::list<CacheTOCFile::Entry> taken;
+    toc->takeEntries(12,&taken);
+    ASSERT_EQ( 2, (int)taken.size() );
+    for (std::list<CacheTOCFile::Entry>::iterator it = taken.begin(); it != taken.end(); ++it) {
+        EXPECT_EQ( (U64)12, it->hash );
+        EXPECT_EQ( (U64)it->blob.size() + 1, it->length );
+        EXPECT_EQ( NATRON_CACHE_SEGMENT_HEADER_SIZE + it->blob.size() * NATRON_CACHE_SEGMENT_ALIGNMENT, it->offset );
+        EXPECT_EQ( (int)it->blob.size() % 3, it->segment );
+    }
+
+    ///Records are handed out only once
+    taken.clear();
+    toc->takeEntries(12,&taken);
+    EXPECT_TRUE( taken.empty() );
+    toc->takeEntries(1000,&taken);
+    EXPECT_TRUE( taken.empty() );
+    toc->takeAllRemainingEntries(&taken);
+    EXPECT_EQ( 98, (int)taken.size() );
+
+    toc.reset();
+    QFile::remove(path);
+    EXPECT_FALSE( CacheTOCFile::open(filePath,1) );
+}
+
+TEST_F(CacheTest,SharedIndex) {
+    QString path = QDir::tempPath() + QDir::separator() + "NatronCacheSharedIndexTest." NATRON_CACHE_FILE_EXT;
+    QFile::remove(path);
+
+    ///Each index behaves as a different process
+    CacheSharedIndex writer(path.toStdString(),1);
+    CacheSharedIndex reader(path.toStdString(),1);
+
+    CacheTOCFile::Entry entry;
+    entry.hash = 42;
+    entry.segment = 3;
+    entry.offset = NATRON_CACHE_SEGMENT_HEADER_SIZE;
+    entry.length = 1000;
+    entry.blob = "key";
+    writer.publish(entry,7);
+    entry.offset += 1024;
+    writer.publish(entry,7);
+
+    std::list<CacheTOCFile::Entry> entries;
+    CacheTOCFile::SegmentTags segments;
+    ///A process does not read back its own entries
+    writer.takeEntries(42,&entries,&segments);
+    EXPECT_TRUE( entries.empty() );
+
+    reader.takeEntries(42,&entries,&segments);
+    ASSERT_EQ( 2, (int)entries.size() );
+    EXPECT_EQ( (U64)7, segments[3] );
+    EXPECT_EQ( std::string("key"), entries.front().blob );
+    EXPECT_EQ( (U64)1000, entries.front().length );
+
+    ///Entries are handed out once
+    entries.clear();
+    reader.takeEntries(42,&entries,&segments);
+    EXPECT_TRUE( entries.empty() );
+
+    ///Released entries are no longer visible to processes that did not take them yet
+    writer.unpublish(42,7,NATRON_CACHE_SEGMENT_HEADER_SIZE);
+    writer.takeEntries(0,&entries,&segments);
+    CacheSharedIndex lateReader(path.toStdString(),1);
+    lateReader.takeEntries(42,&entries,&segments);
+    ASSERT_EQ( 1, (int)entries.size() );
+    EXPECT_EQ( (U64)NATRON_CACHE_SEGMENT_HEADER_SIZE + 1024, entries.front().offset );
+
+    ///An index written by another version is discarded
+    entries.clear();
+    CacheSharedIndex otherVersion(path.toStdString(),2);
+    otherVersion.takeEntries(42,&entries,&segments);
+    EXPECT_TRUE( entries.empty() );
+}
@@ -4,6 +4,9 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <stdexcept>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <QString>
@@ -101,3 +104,54 @@ TEST(Curve,Basic)
 }
 
 
+
+TEST(Curve,BatchEvaluation)
+{
+    Curve c;
+
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(0.,10.) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(4.,-5.) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(7.,3.,0.,0.,Natron::eKeyframeTypeConstant) ) );
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(10.,8.,0.,0.,Natron::eKeyframeTypeLinear) ) );
+
+    // increasing times, then decreasing times: the batch gives the same values as getValueAt()
+    std::vector<double> times;
+    for (double t = -3.; t <= 13.; t += 0.25) {
+        times.push_back(t);
+    }
+    for (double t = 13.; t >= -3.; t -= 0.5) {
+        times.push_back(t);
+    }
+    std::vector<double> values( times.size() );
+    c.getValuesAt(&times.front(), (int)times.size(), true, &values.front());
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        EXPECT_EQ( c.getValueAt(times[i]), values[i] );
+    }
+    EXPECT_EQ( 3., c.getValueAt(8.5) ); // constant interpolation
+
+    // the evaluation follows the changes of the keyframes
+    EXPECT_FALSE( c.addKeyFrame( KeyFrame(7.,1.,0.,0.,Natron::eKeyframeTypeConstant) ) );
+    EXPECT_EQ( 1., c.getValueAt(8.5) );
+    c.removeKeyFrameWithTime(7.);
+    KeyFrame k;
+    EXPECT_FALSE( c.getKeyFrameWithTime(7., &k) );
+    EXPECT_TRUE( c.getKeyFrameWithTime(10., &k) );
+    EXPECT_EQ( 8., k.getValue() );
+    EXPECT_TRUE( c.getKeyFrameWithIndex(2, &k) );
+    EXPECT_EQ( 10., k.getTime() );
+    EXPECT_FALSE( c.getKeyFrameWithIndex(3, &k) );
+
+    // a curve without keyframe is not animated
+    Curve c2;
+    double value;
+    EXPECT_FALSE( c2.getValueAtIfAnimated(2., true, &value) );
+    EXPECT_TRUE( c2.addKeyFrame( KeyFrame(0.,42.) ) );
+    EXPECT_TRUE( c2.getValueAtIfAnimated(2., true, &value) );
+    EXPECT_EQ( 42., value );
+    EXPECT_TRUE( c.getValueAtIfAnimated(2., true, &value) );
+    EXPECT_EQ( c.getValueAt(2.), value );
+
+    c.clearKeyFrames();
+    EXPECT_FALSE( c.getValueAtIfAnimated(2., true, &value) );
+    EXPECT_THROW( c.getValueAt(2.), std::runtime_error );
+}
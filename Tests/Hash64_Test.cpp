@@ -11,6 +11,7 @@
 
 #include <cstdlib>
 #include <gtest/gtest.h>
+#include <QtCore/QString>
 #include "Engine/Hash64.h"
 
 TEST(Hash64,GeneralTest) {
@@ -65,3 +66,46 @@ TEST(Hash64,GeneralTest) {
     EXPECT_NE( hash1.value(), hash2.value() );
     EXPECT_NE(hash1, hash2);
 }
+
+TEST(Hash64,OrderAndStrings) {
+    Hash64 hash1;
+    Hash64 hash2;
+
+    hash1.append<int>(1);
+    hash1.append<int>(2);
+    hash1.computeHash();
+    hash2.append<int>(2);
+    hash2.append<int>(1);
+    hash2.computeHash();
+    EXPECT_NE(hash1, hash2) << "The order of the elements matters.";
+
+    ///appending after computing continues the same hash
+    hash2.reset();
+    hash2.append<int>(1);
+    hash2.computeHash();
+    hash2.append<int>(2);
+    hash2.computeHash();
+    EXPECT_EQ(hash1, hash2);
+
+    hash1.reset();
+    hash1.append<U64>(0);
+    hash1.computeHash();
+    ASSERT_TRUE( hash1.valid() ) << "Null elements make a valid hash.";
+
+    ///strings are split differently
+    hash1.reset();
+    Hash64_appendQString( &hash1, QString("abcd") );
+    Hash64_appendQString( &hash1, QString("e") );
+    hash1.computeHash();
+    hash2.reset();
+    Hash64_appendQString( &hash2, QString("abc") );
+    Hash64_appendQString( &hash2, QString("de") );
+    hash2.computeHash();
+    EXPECT_NE(hash1, hash2);
+
+    hash2.reset();
+    Hash64_appendQString( &hash2, QString("abcd") );
+    Hash64_appendQString( &hash2, QString("e") );
+    hash2.computeHash();
+    EXPECT_EQ(hash1, hash2);
+}
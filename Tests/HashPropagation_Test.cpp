@@ -0,0 +1,201 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <vector>
+#include <gtest/gtest.h>
+#include "Engine/Hash64.h"
+#include "Engine/HashPropagation.h"
+#include "Engine/Timer.h"
+
+namespace {
+
+///A node of a synthetic graph, hashed like Natron::Node: its own age and the hash of its inputs
+struct TestNode
+{
+    std::vector<TestNode*> inputs;
+    std::list<TestNode*> outputs;
+    U64 age;
+    Hash64 hash;
+    int hashCount;
+
+    TestNode()
+        : inputs()
+          , outputs()
+          , age(1)
+          , hash()
+          , hashCount(0)
+    {
+    }
+
+    void getOutputs_mt_safe(std::list<TestNode*> & o) const
+    {
+        o = outputs;
+    }
+
+    bool recomputeOwnHash()
+    {
+        ++hashCount;
+        U64 oldHash = hash.value();
+        hash.reset();
+        hash.append(age);
+        for (U32 i = 0; i < inputs.size(); ++i) {
+            hash.append(inputs[i]->hash.value() + i);
+        }
+        hash.computeHash();
+
+        return hash.value() != oldHash;
+    }
+
+    ///What Node::computeHash() used to do: rehash every output, once per path
+    void computeHashRecursive()
+    {
+        recomputeOwnHash();
+        for (std::list<TestNode*>::iterator it = outputs.begin(); it != outputs.end(); ++it) {
+            (*it)->computeHashRecursive();
+        }
+    }
+};
+
+void
+connect(TestNode* input,
+        TestNode* output)
+{
+    output->inputs.push_back(input);
+    input->outputs.push_back(output);
+}
+
+///A chain of count nodes
+void
+makeDeepGraph(int count,
+              std::vector<TestNode>* nodes)
+{
+    nodes->resize(count);
+    for (int i = 1; i < count; ++i) {
+        connect(&(*nodes)[i - 1], &(*nodes)[i]);
+    }
+}
+
+///depth diamonds in a row: each one splits in 2 branches that are merged back, there are 2^depth paths
+///from the first node to the last one
+void
+makeDiamondGraph(int depth,
+                 std::vector<TestNode>* nodes)
+{
+    nodes->resize(depth * 3 + 1);
+    for (int i = 0; i < depth; ++i) {
+        TestNode* top = &(*nodes)[i * 3];
+        TestNode* left = &(*nodes)[i * 3 + 1];
+        TestNode* right = &(*nodes)[i * 3 + 2];
+        TestNode* merge = &(*nodes)[i * 3 + 3];
+        connect(top, left);
+        connect(top, right);
+        connect(left, merge);
+        connect(right, merge);
+    }
+}
+
+void
+resetHashCounts(std::vector<TestNode>* nodes)
+{
+    for (std::size_t i = 0; i < nodes->size(); ++i) {
+        (*nodes)[i].hashCount = 0;
+    }
+}
+}
+
+TEST(HashPropagation,TopologicalOrder) {
+    std::vector<TestNode> nodes;
+    makeDiamondGraph(10, &nodes);
+
+    std::list<TestNode*> sorted;
+    Natron::HashPropagation::getDownstreamNodesSorted(&nodes[0], &sorted);
+    ASSERT_TRUE( sorted.size() == nodes.size() );
+
+    ///every node comes after its inputs
+    std::vector<TestNode*> visited;
+    for (std::list<TestNode*>::iterator it = sorted.begin(); it != sorted.end(); ++it) {
+        for (std::size_t i = 0; i < (*it)->inputs.size(); ++i) {
+            ASSERT_TRUE( std::find(visited.begin(), visited.end(), (*it)->inputs[i]) != visited.end() );
+        }
+        visited.push_back(*it);
+    }
+
+    ///only the nodes downstream are sorted
+    sorted.clear();
+    Natron::HashPropagation::getDownstreamNodesSorted(&nodes[nodes.size() - 4], &sorted);
+    EXPECT_EQ(sorted.size(), (std::size_t)4);
+}
+
+TEST(HashPropagation,SameHashesAsRecursiveUpdate) {
+    std::vector<TestNode> recursive;
+    std::vector<TestNode> incremental;
+    makeDiamondGraph(8, &recursive);
+    makeDiamondGraph(8, &incremental);
+    recursive[0].computeHashRecursive();
+    std::list<TestNode*> changed;
+    Natron::HashPropagation::updateDownstreamHashes(&incremental[0], &changed);
+    EXPECT_EQ( changed.size(), incremental.size() );
+
+    ///change a node in the middle: only it and the nodes downstream are rehashed, once
+    recursive[12].age = incremental[12].age = 2;
+    resetHashCounts(&incremental);
+    recursive[12].computeHashRecursive();
+    changed.clear();
+    Natron::HashPropagation::updateDownstreamHashes(&incremental[12], &changed);
+    for (std::size_t i = 0; i < incremental.size(); ++i) {
+        EXPECT_EQ( incremental[i].hash.value(), recursive[i].hash.value() );
+        EXPECT_EQ( incremental[i].hashCount, i < 12 ? 0 : 1 );
+    }
+    EXPECT_EQ( changed.size(), incremental.size() - 12 );
+
+    ///an update that does not change the hash stops at the node
+    resetHashCounts(&incremental);
+    changed.clear();
+    Natron::HashPropagation::updateDownstreamHashes(&incremental[12], &changed);
+    EXPECT_EQ(changed.size(), (std::size_t)1);
+    EXPECT_EQ(incremental[12].hashCount, 1);
+    EXPECT_EQ(incremental[13].hashCount, 1);
+    EXPECT_EQ(incremental[15].hashCount, 0);
+}
+
+TEST(HashPropagation,Benchmark) {
+    for (int shape = 0; shape < 2; ++shape) {
+        std::vector<TestNode> nodes;
+        if (shape == 0) {
+            makeDeepGraph(2000, &nodes);
+        } else {
+            makeDiamondGraph(16, &nodes);
+        }
+        const int iterations = 10;
+
+        resetHashCounts(&nodes);
+        TimeLapse recursiveTimer;
+        for (int i = 0; i < iterations; ++i) {
+            ++nodes[0].age;
+            nodes[0].computeHashRecursive();
+        }
+        double recursiveTime = recursiveTimer.getTimeSinceCreation();
+        int recursiveCount = nodes.back().hashCount;
+
+        resetHashCounts(&nodes);
+        TimeLapse incrementalTimer;
+        for (int i = 0; i < iterations; ++i) {
+            ++nodes[0].age;
+            std::list<TestNode*> changed;
+            Natron::HashPropagation::updateDownstreamHashes(&nodes[0], &changed);
+        }
+        double incrementalTime = incrementalTimer.getTimeSinceCreation();
+        EXPECT_EQ(nodes.back().hashCount, iterations);
+
+        std::cout << (shape == 0 ? "Deep graph of " : "Diamond graph of ") << nodes.size() << " nodes: "
+                  << recursiveTime * 1000. / iterations << " ms per update with the recursive hash ("
+                  << recursiveCount / iterations << " hashes of the last node), "
+                  << incrementalTime * 1000. / iterations << " ms with the topological update" << std::endl;
+    }
+}
@@ -0,0 +1,84 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+#include <gtest/gtest.h>
+#include "Engine/Image.h"
+#include "Engine/ImageStatistics.h"
+
+using namespace Natron;
+
+TEST(ImageStatistics,SinglePassMatchesPerChannelPasses) {
+    RectI bounds(0,0,300,200);
+    RectD rod(0,0,300,200);
+    boost::shared_ptr<ImageParams> params = Image::makeParams(0, rod, bounds, 1., 0, false,
+                                                              eImageComponentRGBA, eImageBitDepthFloat,
+                                                              std::map<int, std::vector<RangeD> >());
+    boost::shared_ptr<Image> img( new Image(ImageKey(), params) );
+    float* pixels = (float*)img->pixelAt(bounds.x1, bounds.y1);
+    for (int i = 0; i < bounds.width() * bounds.height() * 4; ++i) {
+        pixels[i] = std::rand() / (float)RAND_MAX * 2.f - 0.5f;
+    }
+
+    ///the same portion as the viewer would use, partially outside of the image
+    const RectI rect(20,10,350,150);
+    const double histogramMin = 0.;
+    const double histogramMax = 1.;
+    const int binsCount = 100;
+
+    ///one pass per channel, like the viewer auto-contrast and the histogram panel used to do
+    double refMin[ImageStatistics::eChannelCount];
+    double refMax[ImageStatistics::eChannelCount];
+    double refSum[ImageStatistics::eChannelCount];
+    std::vector<float> refHistograms[ImageStatistics::eChannelCount];
+    for (int c = 0; c < ImageStatistics::eChannelCount; ++c) {
+        refMin[c] = std::numeric_limits<double>::infinity();
+        refMax[c] = -std::numeric_limits<double>::infinity();
+        refSum[c] = 0.;
+        refHistograms[c].resize(binsCount, 0.f);
+        for (int y = rect.y1; y < std::min(rect.y2, bounds.y2); ++y) {
+            for (int x = rect.x1; x < std::min(rect.x2, bounds.x2); ++x) {
+                const float* pix = (const float*)img->pixelAt(x, y);
+                double v = c < 4 ? pix[c] : 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
+                refMin[c] = std::min(refMin[c], v);
+                refMax[c] = std::max(refMax[c], v);
+                refSum[c] += v;
+                float f = (float)v;
+                if ( (histogramMin <= f) && (f < histogramMax) ) {
+                    refHistograms[c][(int)( (f - histogramMin) / ( (histogramMax - histogramMin) / binsCount ) )] += 1.f;
+                }
+            }
+        }
+    }
+
+    for (int multiThreaded = 0; multiThreaded < 2; ++multiThreaded) {
+        ImageStatistics stats;
+        stats.compute(img, rect, histogramMin, histogramMax, binsCount, multiThreaded);
+        ASSERT_TRUE( stats.isComputedFor( img, RectI(20,10,300,150) ) );
+        ASSERT_TRUE( !stats.isComputedFor( img, RectI(0,0,300,150) ) );
+        ASSERT_TRUE( stats.hasHistograms(histogramMin, histogramMax, binsCount) );
+        ASSERT_TRUE( !stats.hasHistograms(histogramMin, histogramMax, binsCount * 2) );
+        EXPECT_EQ(stats.getPixelsCount(), 280 * 140);
+        for (int c = 0; c < ImageStatistics::eChannelCount; ++c) {
+            ImageStatistics::ChannelEnum channel = (ImageStatistics::ChannelEnum)c;
+            EXPECT_EQ(stats.getMin(channel), refMin[c]);
+            EXPECT_EQ(stats.getMax(channel), refMax[c]);
+            ASSERT_TRUE(std::fabs( stats.getMean(channel) - refSum[c] / stats.getPixelsCount() ) < 1e-9);
+            ASSERT_TRUE(stats.getHistogram(channel) == refHistograms[c]);
+        }
+    }
+
+    ///without histograms, only the min, max and mean are computed
+    ImageStatistics stats;
+    stats.compute(img, rect, 0., 0., 0, true);
+    ASSERT_TRUE( stats.getHistogram(ImageStatistics::eChannelRed).empty() );
+    ASSERT_TRUE( !stats.hasHistograms(0., 0., 0) );
+    EXPECT_EQ(stats.getMax(ImageStatistics::eChannelAlpha), refMax[ImageStatistics::eChannelAlpha]);
+}
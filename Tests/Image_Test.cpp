@@ -9,9 +9,160 @@
  *
  */
 
+#include <cstdlib>
 #include <cstring>
+#include <iostream>
+#include <vector>
 #include <gtest/gtest.h>
 #include "Engine/Image.h"
+#include "Engine/ImageSIMD.h"
+#include "Engine/Timer.h"
+
+namespace {
+
+///Returns true if all the pixels of rect in the bitmap have the given state
+bool
+bitmapHasState(const Natron::Bitmap & bm,
+               const RectI & rect,
+               char state)
+{
+    std::vector<char> row( rect.width() );
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        bm.getRowStates(y, rect.x1, rect.x2, &row.front());
+        for (int x = 0; x < rect.width(); ++x) {
+            if (row[x] != state) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+///The bitmap as it was stored before, one char per pixel, used as a reference
+class ReferenceBitmap
+{
+public:
+
+    ReferenceBitmap(const RectI & bounds)
+        : _bounds(bounds)
+        , _map(bounds.area(), 0)
+    {
+    }
+
+    void markForRendered(const RectI & roi)
+    {
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            memset( &_map[(y - _bounds.y1) * _bounds.width() + roi.x1 - _bounds.x1], 1, roi.width() );
+        }
+    }
+
+    char at(int x,int y) const
+    {
+        return _map[(y - _bounds.y1) * _bounds.width() + x - _bounds.x1];
+    }
+
+    ///The previous implementation of Bitmap::minimalNonMarkedBbox(), without the trimap
+    RectI minimalNonMarkedBbox(const RectI & roi) const
+    {
+        RectI bbox;
+        roi.intersect(_bounds, &bbox);
+        //find bottom
+        for (int i = bbox.bottom(); i < bbox.top(); ++i) {
+            if ( !memchr( &_map[(i - _bounds.y1) * _bounds.width()], 0, _bounds.width() ) ) {
+                bbox.set_bottom(bbox.bottom() + 1);
+            } else {
+                break;
+            }
+        }
+        //find top
+        for (int i = bbox.top() - 1; i >= bbox.bottom(); --i) {
+            if ( !memchr( &_map[(i - _bounds.y1) * _bounds.width()], 0, _bounds.width() ) ) {
+                bbox.set_top(bbox.top() - 1);
+            } else {
+                break;
+            }
+        }
+        if ( bbox.isNull() ) {
+            return bbox;
+        }
+        //find left
+        for (int j = bbox.left(); j < bbox.right(); ++j) {
+            bool marked = true;
+            for (int i = bbox.bottom(); i < bbox.top() && marked; ++i) {
+                marked = at(j, i) != 0;
+            }
+            if (!marked) {
+                break;
+            }
+            bbox.set_left(bbox.left() + 1);
+        }
+        //find right
+        for (int j = bbox.right() - 1; j >= bbox.left(); --j) {
+            bool marked = true;
+            for (int i = bbox.bottom(); i < bbox.top() && marked; ++i) {
+                marked = at(j, i) != 0;
+            }
+            if (!marked) {
+                break;
+            }
+            bbox.set_right(bbox.right() - 1);
+        }
+
+        return bbox;
+    }
+
+private:
+
+    RectI _bounds;
+    std::vector<char> _map;
+};
+
+///Fills all the pixels of a contiguous image with pseudo random values, including out of range floats
+void
+fillRandom(Natron::Image* img)
+{
+    const RectI & bounds = img->getBounds();
+    int count = bounds.width() * bounds.height() * img->getComponentsCount();
+    unsigned char* pixels = img->pixelAt(bounds.x1, bounds.y1);
+
+    for (int i = 0; i < count; ++i) {
+        switch ( img->getBitDepth() ) {
+        case Natron::eImageBitDepthByte:
+            pixels[i] = (unsigned char)(std::rand() % 256);
+            break;
+        case Natron::eImageBitDepthShort:
+            ( (unsigned short*)pixels )[i] = (unsigned short)(std::rand() % 65536);
+            break;
+        case Natron::eImageBitDepthFloat:
+            ( (float*)pixels )[i] = std::rand() / (float)RAND_MAX * 2.f - 0.5f;
+            break;
+        case Natron::eImageBitDepthNone:
+            break;
+        }
+    }
+}
+
+///Returns true if both images have the same bounds and bitwise identical pixels
+bool
+samePixels(const Natron::Image & a,
+           const Natron::Image & b)
+{
+    const RectI & bounds = a.getBounds();
+    if ( !( bounds == b.getBounds() ) ) {
+        return false;
+    }
+    size_t rowSize = bounds.width() * a.getComponentsCount() * Natron::getSizeOfForBitDepth( a.getBitDepth() );
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        if ( memcmp(a.pixelAt(bounds.x1, y), b.pixelAt(bounds.x1, y), rowSize) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
 
 
 TEST(BitmapTest,SimpleRect) {
@@ -29,9 +180,8 @@ TEST(BitmapTest,SimpleRect) {
 
     ASSERT_TRUE(rod == nonRenderedRectsUnion);
 
-    ///assert that the "underlying" bitmap is clean
-    const char* map = bm.getBitmap();
-    ASSERT_TRUE( !memchr( map,1,rod.area() ) );
+    ///assert that the bitmap is clean
+    ASSERT_TRUE( bitmapHasState(bm,rod,0) );
 
     RectI halfRoD(0,0,100,50);
     bm.markForRendered(halfRoD);
@@ -44,15 +194,13 @@ TEST(BitmapTest,SimpleRect) {
     }
 
 
-    ///assert that the underlying bitmap is marked as expected
-    const char* start = map;
+    ///assert that the bitmap is marked as expected
 
     ///check that there are only ones in the rendered half
-    ASSERT_TRUE( !memchr( start,0,halfRoD.area() ) );
+    ASSERT_TRUE( bitmapHasState(bm,halfRoD,1) );
 
     ///check that there are only 0s in the non rendered half
-    start = map + halfRoD.area();
-    ASSERT_TRUE( !memchr( start,1,halfRoD.area() ) );
+    ASSERT_TRUE( bitmapHasState(bm,nonRenderedHalf,0) );
 
     ///mark for renderer the other half of the rod
     bm.markForRendered(nonRenderedHalf);
@@ -61,7 +209,127 @@ TEST(BitmapTest,SimpleRect) {
     nonRenderedRects.clear();
     bm.minimalNonMarkedRects(rod, nonRenderedRects);
     ASSERT_TRUE( nonRenderedRects.empty() );
-    ASSERT_TRUE( !memchr( map,0,rod.area() ) );
+    ASSERT_TRUE( bitmapHasState(bm,rod,1) );
+}
+
+TEST(BitmapTest,RandomRects) {
+    RectI bounds(-50,-20,350,180);
+    Natron::Bitmap bm(bounds);
+    ReferenceBitmap ref(bounds);
+
+    srand(2000);
+    for (int i = 0; i < 200; ++i) {
+        int x1 = bounds.x1 + rand() % bounds.width();
+        int y1 = bounds.y1 + rand() % bounds.height();
+        RectI rect( x1, y1, std::min(bounds.x2, x1 + 1 + rand() % 80), std::min(bounds.y2, y1 + 1 + rand() % 80) );
+        bm.markForRendered(rect);
+        ref.markForRendered(rect);
+
+        RectI roi( bounds.x1 + rand() % 100, bounds.y1 + rand() % 50, bounds.x2 - rand() % 100, bounds.y2 - rand() % 50 );
+
+        ///the bounding box is the smallest one enclosing the pixels that are not rendered
+        RectI refBbox;
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            for (int x = roi.x1; x < roi.x2; ++x) {
+                if ( !ref.at(x, y) ) {
+                    refBbox = refBbox.isNull() ? RectI(x, y, x + 1, y + 1) : refBbox;
+                    refBbox.merge(x, y, x + 1, y + 1);
+                }
+            }
+        }
+        RectI bbox = bm.minimalNonMarkedBbox(roi);
+        ASSERT_TRUE( bbox.isNull() == refBbox.isNull() );
+        ASSERT_TRUE( bbox.isNull() || bbox == refBbox );
+
+        ///the rectangles cover all the pixels that are not rendered
+        std::list<RectI> rects;
+        bm.minimalNonMarkedRects(roi, rects);
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            for (int x = roi.x1; x < roi.x2; ++x) {
+                if ( ref.at(x, y) ) {
+                    continue;
+                }
+                bool covered = false;
+                for (std::list<RectI>::iterator it = rects.begin(); it != rects.end(); ++it) {
+                    covered |= ( it->x1 <= x && x < it->x2 && it->y1 <= y && y < it->y2 );
+                }
+                ASSERT_TRUE(covered);
+            }
+        }
+    }
+
+    ///clearing a portion makes it not rendered again
+    RectI cleared(0,0,20,20);
+    bm.clear(cleared);
+    ASSERT_TRUE( bitmapHasState(bm,cleared,0) );
+}
+
+#if NATRON_ENABLE_TRIMAP
+TEST(BitmapTest,Trimap) {
+    RectI rod(0,0,100,100);
+    Natron::Bitmap bm(rod);
+
+    ///the bottom half is rendered, the top half is being rendered by another thread
+    bm.markForRendered( RectI(0,0,100,50) );
+    bm.markForRendering( RectI(0,50,100,100) );
+
+    bool isBeingRenderedElsewhere = false;
+    std::list<RectI> rects;
+    bm.minimalNonMarkedRects_trimap(rod, rects, &isBeingRenderedElsewhere);
+    ASSERT_TRUE( rects.empty() );
+    ASSERT_TRUE(isBeingRenderedElsewhere);
+
+    ///nothing is being rendered in the bottom half
+    isBeingRenderedElsewhere = false;
+    RectI bbox = bm.minimalNonMarkedBbox_trimap(RectI(0,0,100,50), &isBeingRenderedElsewhere);
+    ASSERT_TRUE( bbox.isNull() );
+    ASSERT_TRUE(!isBeingRenderedElsewhere);
+
+    ///pixels being rendered are not copied
+    Natron::Bitmap copy(rod);
+    copy.copyBitmapPortion(rod, bm);
+    ASSERT_TRUE( bitmapHasState(copy,RectI(0,0,100,50),1) );
+    ASSERT_TRUE( bitmapHasState(copy,RectI(0,50,100,100),0) );
+}
+#endif
+
+///Compares the time taken to find what is left to render in a 4K image that is rendered but for a
+///small region, with the spans and with the previous char per pixel map which has to scan most of the image
+TEST(BitmapTest,RestToRenderBenchmark) {
+    RectI bounds(0,0,4096,2160);
+    Natron::Bitmap bm(bounds);
+    ReferenceBitmap ref(bounds);
+
+    ///render the image by tiles of 256x256 except the ones intersecting the hole
+    RectI hole(1800,900,2100,1100);
+    for (int y = bounds.y1; y < bounds.y2; y += 256) {
+        for (int x = bounds.x1; x < bounds.x2; x += 256) {
+            RectI tile(x, y, x + 256, y + 256);
+            tile.intersect(bounds, &tile);
+            if ( !tile.intersects(hole) ) {
+                bm.markForRendered(tile);
+                ref.markForRendered(tile);
+            }
+        }
+    }
+
+    const int nQueries = 20;
+    RectI bbox,refBbox;
+    TimeLapse spansTimer;
+    for (int i = 0; i < nQueries; ++i) {
+        bbox = bm.minimalNonMarkedBbox(bounds);
+    }
+    double spansElapsed = spansTimer.getTimeSinceCreation();
+
+    TimeLapse refTimer;
+    for (int i = 0; i < nQueries; ++i) {
+        refBbox = ref.minimalNonMarkedBbox(bounds);
+    }
+    double refElapsed = refTimer.getTimeSinceCreation();
+
+    ASSERT_TRUE(bbox == refBbox);
+    std::cout << "Rest to render of a 4K image: " << spansElapsed * 1000. / nQueries << " ms with spans, "
+              << refElapsed * 1000. / nQueries << " ms with a char per pixel" << std::endl;
 }
 
 TEST(ImageKeyTest,Equality) {
@@ -104,3 +372,135 @@ TEST(ImageKeyTest,Difference) {
     ASSERT_TRUE(keyHash1 != keyHash2);
 }
 
+
+TEST(ImageTest,TiledStorage) {
+    RectI bounds(0,0,600,300);
+    RectD rod(0,0,600,300);
+    boost::shared_ptr<Natron::ImageParams> params = Natron::Image::makeParams(0, rod, bounds, 1., 0, false,
+                                                                              Natron::eImageComponentRGBA, Natron::eImageBitDepthFloat,
+                                                                              std::map<int, std::vector<RangeD> >());
+    params->setTiled(true);
+    Natron::Image img(Natron::ImageKey(), params);
+    ASSERT_TRUE( img.isTiled() );
+
+    ///no memory is used until pixels are written
+    ASSERT_TRUE(img.getAllocatedTilesCount() == 0);
+    ASSERT_TRUE(img.size() == 0);
+
+    ///writing in a single tile allocates only that tile
+    img.fill(RectI(10,10,20,20), 1., 0.5, 0.25, 1.);
+    ASSERT_TRUE(img.getAllocatedTilesCount() == 1);
+    ASSERT_TRUE(img.size() == NATRON_IMAGE_TILE_SIZE * NATRON_IMAGE_TILE_SIZE * 4 * sizeof(float));
+
+    ///a rectangle across a tile corner allocates the 4 tiles
+    img.fill(RectI(250,250,270,270), 0., 1., 0., 1.);
+    ASSERT_TRUE(img.getAllocatedTilesCount() == 4);
+
+    ///reading pixels does not allocate
+    const Natron::Image & constImg = img;
+    const float* pix = (const float*)constImg.pixelAt(550, 10);
+    ASSERT_TRUE(pix[0] == 0. && pix[3] == 0.);
+    ASSERT_TRUE(img.getAllocatedTilesCount() == 4);
+
+    ///the rows of a tile have the stride of its width, the last tiles are clipped to the bounds
+    ASSERT_TRUE( img.getTileBounds(10, 10) == RectI(0, 0, NATRON_IMAGE_TILE_SIZE, NATRON_IMAGE_TILE_SIZE) );
+    ASSERT_TRUE( img.getTileBounds(550, 260) == RectI(2 * NATRON_IMAGE_TILE_SIZE, NATRON_IMAGE_TILE_SIZE, 600, 300) );
+    ASSERT_TRUE( (const float*)constImg.pixelAt(10, 11) - (const float*)constImg.pixelAt(10, 10) == NATRON_IMAGE_TILE_SIZE * 4 );
+
+    ///contiguous views hold the same pixels
+    RectI viewBounds(200,200,300,300);
+    boost::shared_ptr<Natron::Image> view = img.makeContiguousView(viewBounds);
+    ASSERT_TRUE( !view->isTiled() && view->getBounds() == viewBounds );
+    for (int y = viewBounds.y1; y < viewBounds.y2; ++y) {
+        for (int x = viewBounds.x1; x < viewBounds.x2; ++x) {
+            ASSERT_TRUE( !memcmp( view->pixelAt(x, y), constImg.pixelAt(x, y), 4 * sizeof(float) ) );
+        }
+    }
+
+    ///pasting back a contiguous image writes across the tiles
+    view->fill(viewBounds, 0., 0., 1., 1.);
+    img.pasteFrom(*view, viewBounds, false);
+    ASSERT_TRUE( ( (const float*)constImg.pixelAt(255, 255) )[2] == 1. );
+    ASSERT_TRUE( ( (const float*)constImg.pixelAt(299, 299) )[2] == 1. );
+
+    ///mipmaps are identical to those of the same image that is not tiled
+    Natron::Image contiguous(Natron::eImageComponentRGBA, rod, bounds, 0, 1., Natron::eImageBitDepthFloat, false);
+    contiguous.pasteFrom(img, bounds, false);
+    RectI halfBounds(0,0,300,150);
+    Natron::Image tiledHalf(Natron::eImageComponentRGBA, rod, halfBounds, 1, 1., Natron::eImageBitDepthFloat, false);
+    Natron::Image contiguousHalf(Natron::eImageComponentRGBA, rod, halfBounds, 1, 1., Natron::eImageBitDepthFloat, false);
+    img.downscaleMipMap(bounds, 0, 1, false, true, &tiledHalf);
+    contiguous.downscaleMipMap(bounds, 0, 1, false, true, &contiguousHalf);
+    for (int y = halfBounds.y1; y < halfBounds.y2; ++y) {
+        ASSERT_TRUE( !memcmp( tiledHalf.pixelAt(0, y), contiguousHalf.pixelAt(0, y), halfBounds.width() * 4 * sizeof(float) ) );
+    }
+}
+
+///Tiled and contiguous images holding the same pixels must match when the cache compares their params
+TEST(ImageTest,TiledParamsEquality) {
+    RectI bounds(0,0,600,300);
+    RectD rod(0,0,600,300);
+    std::map<int, std::vector<RangeD> > framesNeeded;
+    boost::shared_ptr<Natron::ImageParams> contiguous = Natron::Image::makeParams(0, rod, bounds, 1., 0, false,
+                                                                                  Natron::eImageComponentRGBA, Natron::eImageBitDepthFloat,
+                                                                                  framesNeeded);
+    boost::shared_ptr<Natron::ImageParams> tiled( new Natron::ImageParams(*contiguous) );
+    tiled->setTiled(true);
+    ASSERT_TRUE(tiled->getElementsCount() == 0);
+    ASSERT_TRUE(*tiled == *contiguous);
+    ASSERT_TRUE(*contiguous == *tiled);
+
+    boost::shared_ptr<Natron::ImageParams> otherBounds = Natron::Image::makeParams(0, rod, RectI(0,0,300,600), 1., 0, false,
+                                                                                   Natron::eImageComponentRGBA, Natron::eImageBitDepthFloat,
+                                                                                   framesNeeded);
+    ASSERT_TRUE(*tiled != *otherBounds);
+}
+
+TEST(ImageTest,SIMDMipMapsMatchScalar) {
+    const Natron::ImageBitDepthEnum depths[3] = {
+        Natron::eImageBitDepthByte, Natron::eImageBitDepthShort, Natron::eImageBitDepthFloat
+    };
+    const Natron::ImageComponentsEnum components[3] = {
+        Natron::eImageComponentRGBA, Natron::eImageComponentAlpha, Natron::eImageComponentRGB
+    };
+    ///odd and negative bounds, so that the first and last columns and rows are partial blocks
+    const RectI bounds(-37,-21,203,117);
+    const RectD rod(-37,-21,203,117);
+    const RectI halfBounds(-19,-11,102,59);
+    const RectI evenRoI(-36,-20,200,116);
+    const RectI quarterBounds(-9,-5,50,29);
+
+    const Natron::SIMDInstructionSetEnum supported = Natron::ImageSIMD::getSupportedInstructionSet();
+    std::srand(2015);
+
+    for (int d = 0; d < 3; ++d) {
+        for (int c = 0; c < 3; ++c) {
+            Natron::Image src(components[c], rod, bounds, 0, 1., depths[d], true);
+            fillRandom(&src);
+            src.markForRendered( RectI(-10,-5,150,80) );
+
+            ///the scalar code is the reference
+            Natron::ImageSIMD::setInstructionSet(Natron::eSIMDInstructionSetNone);
+            Natron::Image refHalf(components[c], rod, halfBounds, 1, 1., depths[d], true);
+            src.downscaleMipMap(bounds, 0, 1, true, false, &refHalf);
+            Natron::Image refQuarter(components[c], rod, quarterBounds, 2, 1., depths[d], false);
+            src.downscaleMipMap(evenRoI, 0, 2, false, true, &refQuarter);
+            Natron::Image refUpscaled(components[c], rod, evenRoI, 0, 1., depths[d], false);
+            refQuarter.upscaleMipMap(quarterBounds, 2, 0, &refUpscaled);
+
+            for (int set = Natron::eSIMDInstructionSetSSE2; set <= supported; ++set) {
+                Natron::ImageSIMD::setInstructionSet( (Natron::SIMDInstructionSetEnum)set );
+                Natron::Image half(components[c], rod, halfBounds, 1, 1., depths[d], true);
+                src.downscaleMipMap(bounds, 0, 1, true, false, &half);
+                ASSERT_TRUE( samePixels(half, refHalf) );
+                Natron::Image quarter(components[c], rod, quarterBounds, 2, 1., depths[d], false);
+                src.downscaleMipMap(evenRoI, 0, 2, false, true, &quarter);
+                ASSERT_TRUE( samePixels(quarter, refQuarter) );
+                Natron::Image upscaled(components[c], rod, evenRoI, 0, 1., depths[d], false);
+                refQuarter.upscaleMipMap(quarterBounds, 2, 0, &upscaled);
+                ASSERT_TRUE( samePixels(upscaled, refUpscaled) );
+            }
+        }
+    }
+    Natron::ImageSIMD::setInstructionSet(supported);
+}
@@ -0,0 +1,111 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "BaseTest.h"
+
+#include "Engine/AppInstance.h"
+#include "Engine/EffectInstance.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/KnobsSnapshot.h"
+#include "Engine/Node.h"
+#include "Engine/TimeLine.h"
+
+namespace {
+///The snapshot only compares the addresses of the knobs, we don't need actual knobs
+const KnobI*
+fakeKnob(const char* address)
+{
+    return reinterpret_cast<const KnobI*>(address);
+}
+}
+
+TEST(KnobsSnapshot,Lookups)
+{
+    char knobs[8];
+    KnobsSnapshot snapshot(10.);
+
+    EXPECT_EQ(10., snapshot.getTime());
+    EXPECT_EQ(0, snapshot.getKnobsCount());
+
+    // added out of order, the look-ups must still find them
+    for (int i = 7; i >= 0; i -= 2) {
+        std::vector<double> values(3);
+        std::vector<bool> timeInvariant(3);
+        for (int d = 0; d < 3; ++d) {
+            values[d] = i * 10 + d;
+            timeInvariant[d] = (d == 0);
+        }
+        snapshot.addValues(fakeKnob(&knobs[i]), values, timeInvariant);
+    }
+    std::vector<std::string> strings(1, "foo");
+    snapshot.addValues( fakeKnob(&knobs[2]), strings, std::vector<bool>(1, false) );
+    EXPECT_EQ(5, snapshot.getKnobsCount());
+
+    for (int i = 7; i >= 0; i -= 2) {
+        for (int d = 0; d < 3; ++d) {
+            double value = -1.;
+            EXPECT_TRUE( snapshot.getValue(fakeKnob(&knobs[i]), d, 10., &value) );
+            EXPECT_EQ(i * 10 + d, value);
+        }
+    }
+
+    double value;
+    std::string str;
+
+    // knobs which are not in the snapshot, or another type, or out of range dimensions
+    EXPECT_FALSE( snapshot.getValue(fakeKnob(&knobs[0]), 0, 10., &value) );
+    EXPECT_FALSE( snapshot.getValue(fakeKnob(&knobs[2]), 0, 10., &value) );
+    EXPECT_FALSE( snapshot.getValue(fakeKnob(&knobs[3]), 0, 10., &str) );
+    EXPECT_FALSE( snapshot.getValue(fakeKnob(&knobs[3]), 3, 10., &value) );
+    EXPECT_FALSE( snapshot.getValue(fakeKnob(&knobs[3]), -1, 10., &value) );
+    EXPECT_TRUE( snapshot.getValue(fakeKnob(&knobs[2]), 0, 10., &str) );
+    EXPECT_EQ("foo", str);
+
+    // at another time, only the time invariant dimensions are in the snapshot
+    EXPECT_TRUE( snapshot.getValue(fakeKnob(&knobs[5]), 0, 11., &value) );
+    EXPECT_EQ(50., value);
+    EXPECT_FALSE( snapshot.getValue(fakeKnob(&knobs[5]), 1, 11., &value) );
+    EXPECT_FALSE( snapshot.getValue(fakeKnob(&knobs[2]), 0, 11., &str) );
+}
+
+///A knob changed between two frames is read with its new value, even though the hash given to the render is the same
+TEST_F(BaseTest,KnobsSnapshotInvalidation)
+{
+    boost::shared_ptr<Natron::Node> node = createNode(_dotGeneratorPluginID);
+    ASSERT_TRUE(node);
+    Natron::EffectInstance* effect = node->getLiveInstance();
+    ASSERT_TRUE(effect != NULL);
+
+    Double_Knob* knob = NULL;
+    const std::vector< boost::shared_ptr<KnobI> > & knobs = node->getKnobs();
+    for (std::size_t i = 0; i < knobs.size() && !knob; ++i) {
+        knob = dynamic_cast<Double_Knob*>( knobs[i].get() );
+    }
+    ASSERT_TRUE(knob != NULL);
+    ASSERT_FALSE( knob->isAnimated(0) );
+
+    U64 nodeHash = node->getHashValue();
+    const TimeLine* timeline = _app->getTimeLine().get();
+    double oldValue = knob->getValue(0);
+
+    effect->setParallelRenderArgs(1, 0, false, false, false, nodeHash, 0, false, timeline);
+    EXPECT_EQ( oldValue, knob->getValue(0) );
+    effect->invalidateParallelRenderArgs();
+
+    knob->setValue(oldValue + 1., 0);
+    double newValue = knob->getValue(0);
+    ASSERT_NE(oldValue, newValue);
+
+    effect->setParallelRenderArgs(1, 0, false, false, false, nodeHash, 0, false, timeline);
+    EXPECT_EQ( newValue, knob->getValue(0) );
+    EXPECT_EQ( newValue, knob->getValueAtTime(1., 0) );
+    effect->invalidateParallelRenderArgs();
+}
@@ -5,8 +5,14 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
 #include <gtest/gtest.h>
+#include "Engine/ImageSIMD.h"
 #include "Engine/Lut.h"
+#include "Engine/Rect.h"
+#include "Engine/Timer.h"
 
 using namespace Natron::Color;
 
@@ -30,3 +36,90 @@ TEST(Lut,IntConversions) {
         EXPECT_EQ( i, uint8xxToChar( charToUint8xx(i) ) );
     }
 }
+
+TEST(Lut,BatchConversions) {
+    const Lut* lut = LutManager::sRGBLut();
+    lut->validate();
+
+    ///every index of the float table, with random low bits, including NaNs and infinities
+    std::vector<float> floats(0x10000);
+    for (int i = 0; i < 0x10000; ++i) {
+        unsigned int bits = ( (unsigned int)i << 16 ) | (unsigned int)(std::rand() & 0xFFFF);
+        std::memcpy( &floats[i], &bits, sizeof(float) );
+    }
+    std::vector<unsigned char> bytes(1000);
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = (unsigned char)(std::rand() % 256);
+    }
+    std::vector<unsigned short> shorts(1000);
+    for (std::size_t i = 0; i < shorts.size(); ++i) {
+        shorts[i] = (unsigned short)(std::rand() % 65536);
+    }
+
+    const Natron::SIMDInstructionSetEnum supported = Natron::ImageSIMD::getSupportedInstructionSet();
+    for (int set = Natron::eSIMDInstructionSetNone; set <= supported; ++set) {
+        Natron::ImageSIMD::setInstructionSet( (Natron::SIMDInstructionSetEnum)set );
+
+        ///odd counts so that the scalar remainder is used too
+        std::vector<unsigned short> uint8xx(floats.size() - 3);
+        lut->toColorSpaceUint8xxFromLinearFloatFast(&floats.front(), &uint8xx.front(), (int)uint8xx.size());
+        std::vector<unsigned char> uint8(floats.size() - 3);
+        lut->toColorSpaceUint8FromLinearFloatFast(&floats.front(), &uint8.front(), (int)uint8.size());
+        for (std::size_t i = 0; i < uint8xx.size(); ++i) {
+            EXPECT_EQ( uint8xx[i], lut->toColorSpaceUint8xxFromLinearFloatFast(floats[i]) );
+            EXPECT_EQ( uint8[i], lut->toColorSpaceUint8FromLinearFloatFast(floats[i]) );
+        }
+
+        std::vector<float> fromBytes(bytes.size() - 1);
+        lut->fromColorSpaceUint8ToLinearFloatFast(&bytes.front(), &fromBytes.front(), (int)fromBytes.size());
+        for (std::size_t i = 0; i < fromBytes.size(); ++i) {
+            EXPECT_EQ( fromBytes[i], lut->fromColorSpaceUint8ToLinearFloatFast(bytes[i]) );
+        }
+
+        std::vector<float> fromShorts( shorts.size() );
+        lut->fromColorSpaceUint16ToLinearFloatFast(&shorts.front(), &fromShorts.front(), (int)fromShorts.size());
+        for (std::size_t i = 0; i < fromShorts.size(); ++i) {
+            EXPECT_EQ( fromShorts[i], lut->fromColorSpaceUint16ToLinearFloatFast(shorts[i]) );
+        }
+    }
+    Natron::ImageSIMD::setInstructionSet(supported);
+}
+
+TEST(Lut,ThroughputBenchmark) {
+    const Lut* lut = LutManager::sRGBLut();
+    lut->validate();
+
+    ///a HD RGBA image, converted to 8 bits and back like the viewer and the readers do
+    RectI bounds(0,0,1920,1080);
+    std::size_t nPixels = (std::size_t)bounds.width() * bounds.height();
+    std::vector<float> linear(nPixels * 4);
+    for (std::size_t i = 0; i < linear.size(); ++i) {
+        linear[i] = std::rand() / (float)RAND_MAX;
+    }
+    std::vector<unsigned char> packed(nPixels * 4);
+    std::vector<float> unpacked(nPixels * 4);
+
+    const Natron::SIMDInstructionSetEnum supported = Natron::ImageSIMD::getSupportedInstructionSet();
+    const Natron::SIMDInstructionSetEnum sets[2] = { Natron::eSIMDInstructionSetNone, supported };
+    const int iterations = 5;
+    for (int s = 0; s < 2; ++s) {
+        Natron::ImageSIMD::setInstructionSet(sets[s]);
+
+        TimeLapse toTimer;
+        for (int i = 0; i < iterations; ++i) {
+            lut->to_byte_packed(&packed.front(), &linear.front(), bounds, bounds, bounds, PACKING_RGBA, PACKING_RGBA, true, false);
+        }
+        double toTime = toTimer.getTimeSinceCreation();
+
+        TimeLapse fromTimer;
+        for (int i = 0; i < iterations; ++i) {
+            lut->from_byte_packed(&unpacked.front(), &packed.front(), bounds, bounds, bounds, PACKING_RGBA, PACKING_RGBA, false, false);
+        }
+        double fromTime = fromTimer.getTimeSinceCreation();
+
+        std::cout << "Lut throughput with instruction set " << (int)sets[s] << ": "
+                  << nPixels * iterations / toTime / 1e6 << " Mpixels/s to 8 bits, "
+                  << nPixels * iterations / fromTime / 1e6 << " Mpixels/s from 8 bits" << std::endl;
+    }
+    Natron::ImageSIMD::setInstructionSet(supported);
+}
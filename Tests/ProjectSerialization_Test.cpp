@@ -0,0 +1,140 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <QDir>
+#include <QFile>
+
+#include "BaseTest.h"
+
+#include "Engine/AppInstance.h"
+#include "Engine/AppManager.h"
+#include "Engine/Curve.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/Node.h"
+#include "Engine/Project.h"
+#include "Engine/ProjectBinarySerialization.h"
+#include "Engine/ProjectSerialization.h"
+#include "Engine/Settings.h"
+#include "Engine/Timer.h"
+
+///Number of nodes of the generated project and keyframes set on each dimension of their double parameters
+#define PROJECT_TEST_N_NODES 300
+#define PROJECT_TEST_N_KEYFRAMES 20
+
+using namespace Natron;
+
+namespace {
+///The double parameters of node, which get keyframes in the generated project
+std::vector<Double_Knob*>
+getDoubleKnobs(const boost::shared_ptr<Node> & node)
+{
+    std::vector<Double_Knob*> ret;
+    const std::vector< boost::shared_ptr<KnobI> > & knobs = node->getKnobs();
+
+    for (std::size_t i = 0; i < knobs.size(); ++i) {
+        Double_Knob* isDouble = dynamic_cast<Double_Knob*>( knobs[i].get() );
+        if ( isDouble && isDouble->canAnimate() ) {
+            ret.push_back(isDouble);
+        }
+    }
+
+    return ret;
+}
+}
+
+///Saves and loads a generated project in both formats, checks the loaded projects and prints the timings
+TEST_F(BaseTest,ProjectLoadSaveBenchmark)
+{
+    for (int i = 0; i < PROJECT_TEST_N_NODES; ++i) {
+        boost::shared_ptr<Node> node = createNode(_dotGeneratorPluginID);
+        ASSERT_TRUE(node);
+        std::vector<Double_Knob*> knobs = getDoubleKnobs(node);
+        for (std::size_t k = 0; k < knobs.size(); ++k) {
+            for (int d = 0; d < knobs[k]->getDimension(); ++d) {
+                for (int t = 0; t < PROJECT_TEST_N_KEYFRAMES; ++t) {
+                    knobs[k]->setValueAtTime(t * 5, i + k + d + t * 0.5, d);
+                }
+            }
+        }
+    }
+
+    boost::shared_ptr<Node> checkedNode = _app->getProject()->getCurrentNodes().back();
+    std::string checkedNodeName = checkedNode->getName();
+    std::vector<Double_Knob*> checkedKnobs = getDoubleKnobs(checkedNode);
+    ASSERT_FALSE( checkedKnobs.empty() );
+    std::string checkedKnobName = checkedKnobs[0]->getName();
+    double checkedValue = checkedKnobs[0]->getValueAtTime(12.5, 0);
+
+    QString path = QDir::tempPath() + QDir::separator();
+    for (int binary = 0; binary < 2; ++binary) {
+        appPTR->getCurrentSettings()->setSaveProjectsAsBinary(binary == 1);
+        QString name = binary ? "NatronProjectTest.binary." NATRON_PROJECT_FILE_EXT : "NatronProjectTest.xml." NATRON_PROJECT_FILE_EXT;
+
+        TimeLapse saveTimer;
+        QString filePath = _app->getProject()->saveProject(path, name, false);
+        double saveTime = saveTimer.getTimeSinceCreation();
+        ASSERT_FALSE( filePath.isEmpty() );
+        EXPECT_EQ( binary == 1, Natron::isBinaryProjectFile( filePath.toStdString() ) );
+        qint64 fileSize = QFile(filePath).size();
+
+        TimeLapse loadTimer;
+        ASSERT_TRUE( _app->getProject()->loadProject(path, name) );
+        double loadTime = loadTimer.getTimeSinceCreation();
+
+        EXPECT_EQ( (std::size_t)PROJECT_TEST_N_NODES, _app->getProject()->getCurrentNodes().size() );
+        boost::shared_ptr<Node> loadedNode = _app->getProject()->getNodeByName(checkedNodeName);
+        ASSERT_TRUE(loadedNode);
+        Double_Knob* loadedKnob = dynamic_cast<Double_Knob*>( loadedNode->getKnobByName(checkedKnobName).get() );
+        ASSERT_TRUE(loadedKnob != NULL);
+        EXPECT_EQ( PROJECT_TEST_N_KEYFRAMES, loadedKnob->getCurve(0)->getKeyFramesCount() );
+        EXPECT_EQ( checkedValue, loadedKnob->getValueAtTime(12.5, 0) );
+
+        std::cout << (binary ? "Binary" : "XML") << " project of " << PROJECT_TEST_N_NODES << " nodes: "
+                  << fileSize / 1024 << " KiB, saved in " << saveTime * 1000. << " ms, loaded in "
+                  << loadTime * 1000. << " ms" << std::endl;
+        QFile::remove(filePath);
+    }
+    appPTR->getCurrentSettings()->setSaveProjectsAsBinary(false);
+}
+
+///A binary project written against another version of the boost archive library is rejected before its archives are read
+TEST_F(BaseTest,BinaryProjectArchiveVersionMismatch)
+{
+    std::ostringstream file;
+    ProjectSerialization project( _app );
+    Natron::writeBinaryProject(file, true, project, std::string() );
+
+    std::string data = file.str();
+    ASSERT_LT( (std::size_t)(NATRON_PROJECT_BINARY_MAGIC_SIZE + 2 * sizeof(U32)), data.size() );
+    U32 archiveVersion;
+    std::memcpy(&archiveVersion, &data[NATRON_PROJECT_BINARY_MAGIC_SIZE + sizeof(U32)], sizeof(archiveVersion) );
+
+    bool bgProject;
+    std::string projectGuiXml;
+    {
+        std::istringstream stream(data);
+        ProjectSerialization loaded( _app );
+        EXPECT_NO_THROW( Natron::readBinaryProject(stream, _app, &bgProject, &loaded, &projectGuiXml) );
+        EXPECT_TRUE(bgProject);
+    }
+
+    ++archiveVersion;
+    std::memcpy(&data[NATRON_PROJECT_BINARY_MAGIC_SIZE + sizeof(U32)], &archiveVersion, sizeof(archiveVersion) );
+    {
+        std::istringstream stream(data);
+        ProjectSerialization loaded( _app );
+        EXPECT_THROW( Natron::readBinaryProject(stream, _app, &bgProject, &loaded, &projectGuiXml), std::invalid_argument );
+    }
+}
@@ -0,0 +1,31 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+#include "Engine/Rect.h"
+
+TEST(RectI,SplitIntoTilesCoversRect) {
+    const RectI rect(-10, 5, 1910, 1085);
+    const int tilePixelsCounts[] = { 1, 100, 1920, 8192, 1920 * 1080, 1920 * 1080 * 2 };
+
+    for (int t = 0; t < 6; ++t) {
+        std::vector<RectI> tiles = RectI::splitRectIntoTiles(rect, tilePixelsCounts[t]);
+        std::vector<int> covered(rect.area(), 0);
+        for (std::size_t i = 0; i < tiles.size(); ++i) {
+            ASSERT_TRUE( tiles[i].area() <= tilePixelsCounts[t] );
+            ASSERT_TRUE( rect.contains(tiles[i]) );
+            for (int y = tiles[i].y1; y < tiles[i].y2; ++y) {
+                for (int x = tiles[i].x1; x < tiles[i].x2; ++x) {
+                    ++covered[(y - rect.y1) * rect.width() + x - rect.x1];
+                }
+            }
+        }
+        EXPECT_EQ( (int)std::count( covered.begin(), covered.end(), 1 ), rect.area() );
+    }
+    EXPECT_TRUE( RectI::splitRectIntoTiles(RectI(), 100).empty() );
+}
@@ -0,0 +1,88 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <climits>
+#include <list>
+#include <map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "BaseTest.h"
+
+#include "Engine/AppManager.h"
+#include "Engine/Cache.h"
+#include "Engine/Image.h"
+#include "Engine/OutputSchedulerThread.h"
+#include "Engine/RenderMemoryCounter.h"
+
+using namespace Natron;
+
+TEST(RenderMemoryCounter,Peak)
+{
+    RenderMemoryCounter counter;
+
+    counter.notifyAllocated(100);
+    counter.notifyAllocated(50);
+    counter.notifyFreed(120);
+    counter.notifyAllocated(60);
+    EXPECT_EQ( (std::size_t)90, counter.getCurrentMemory() );
+    EXPECT_EQ( (std::size_t)150, counter.getPeakMemory() );
+
+    ///Freeing memory allocated before the counter was created doesn't make the frame hold less than nothing
+    counter.notifyFreed(1000);
+    EXPECT_EQ( (std::size_t)0, counter.getCurrentMemory() );
+    EXPECT_EQ( (std::size_t)150, counter.getPeakMemory() );
+}
+
+TEST(RenderMemoryCounter,MaxParallelRendersInMemoryBudget)
+{
+    std::size_t budget = (std::size_t)1 << 30;
+
+    EXPECT_EQ( INT_MAX, OutputSchedulerThread::getMaxParallelRendersInMemoryBudget(budget, 0.) );
+    EXPECT_EQ( 4, OutputSchedulerThread::getMaxParallelRendersInMemoryBudget(budget, budget / 4.) );
+    EXPECT_EQ( 3, OutputSchedulerThread::getMaxParallelRendersInMemoryBudget(budget, budget / 3.5) );
+    ///A frame larger than the budget is still rendered
+    EXPECT_EQ( 1, OutputSchedulerThread::getMaxParallelRendersInMemoryBudget(budget, budget * 2.) );
+    EXPECT_EQ( INT_MAX, OutputSchedulerThread::getMaxParallelRendersInMemoryBudget(budget, 1e-3) );
+}
+
+///The tiles of a tiled image allocated on demand are accounted to the frame as well as its bitmap
+TEST_F(BaseTest,RenderMemoryCounterTiledImage)
+{
+    Natron::Cache<Natron::Image> cache("RenderMemoryTest",1,(U64)1 << 40,1.);
+    boost::shared_ptr<RenderMemoryCounter> counter(new RenderMemoryCounter);
+    std::size_t imageSize;
+    {
+        RenderMemoryCounterSetter counterSetter(counter);
+        EXPECT_EQ( counter, appPTR->getThreadRenderMemoryCounter() );
+
+        std::map<int, std::vector<RangeD> > framesNeeded;
+        RectD rod(0,0,NATRON_IMAGE_TILE_SIZE * 4,NATRON_IMAGE_TILE_SIZE * 4);
+        boost::shared_ptr<ImageParams> params = Natron::Image::makeParams(0,rod,1.,0,false,
+                                                                          Natron::eImageComponentRGBA,
+                                                                          Natron::eImageBitDepthFloat,
+                                                                          framesNeeded);
+        params->setTiled(true);
+        ImageLocker locker(NULL);
+        ImagePtr image;
+        ASSERT_FALSE( cache.getOrCreate(Natron::Image::makeKey(1,false,0,0),params,&locker,&image) );
+        ASSERT_TRUE(image);
+        std::size_t sizeWithoutTiles = image->size();
+        EXPECT_EQ( sizeWithoutTiles, counter->getCurrentMemory() );
+
+        ASSERT_TRUE( image->pixelAt(0,0) != NULL );
+        imageSize = image->size();
+        EXPECT_GT(imageSize, sizeWithoutTiles);
+        EXPECT_EQ( imageSize, counter->getCurrentMemory() );
+
+        cache.removeEntry(image);
+    }
+    EXPECT_FALSE( appPTR->getThreadRenderMemoryCounter() );
+
+    EXPECT_EQ( (std::size_t)0, counter->getCurrentMemory() );
+    EXPECT_EQ( imageSize, counter->getPeakMemory() );
+}
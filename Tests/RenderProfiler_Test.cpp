@@ -0,0 +1,130 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <QtCore/QThread>
+#include "Engine/RenderProfiler.h"
+#include "Engine/Timer.h"
+
+using namespace Natron;
+
+namespace {
+int
+countOccurences(const std::string & str,
+                const std::string & pattern)
+{
+    int count = 0;
+
+    for (std::size_t pos = str.find(pattern); pos != std::string::npos; pos = str.find(pattern, pos + 1)) {
+        ++count;
+    }
+
+    return count;
+}
+
+///A render thread recording the spans of a node, like EffectInstance::renderRoI
+class SpansThread
+    : public QThread
+{
+public:
+
+    SpansThread(const std::string & nodeName,
+                int spansCount)
+        : QThread()
+          , nodeName(nodeName)
+          , spansCount(spansCount)
+    {
+    }
+
+private:
+
+    virtual void run()
+    {
+        for (int i = 0; i < spansCount; ++i) {
+            double startTime = RenderProfiler::getCurrentTime();
+            RenderProfiler::addSpan(nodeName, kRenderProfilerCategoryAction, "render", i, startTime,
+                                    RenderProfiler::getCurrentTime() - startTime);
+        }
+    }
+
+    std::string nodeName;
+    int spansCount;
+};
+}
+
+TEST(RenderProfiler,ChromeTrace) {
+    ///nothing is recorded before the profiler is started
+    RenderProfiler::addSpan("Blur1", kRenderProfilerCategoryAction, "render", 0, RenderProfiler::getCurrentTime(), 0.);
+    {
+        RenderProfilerSpan span(0, kRenderProfilerCategoryRender, "renderRoI", 0);
+    }
+    RenderProfiler::start("");
+    EXPECT_EQ(RenderProfiler::getSpansCount(), 0);
+
+    std::vector<SpansThread*> threads;
+    threads.push_back( new SpansThread("Blur1", 100) );
+    threads.push_back( new SpansThread("Merge \"A\"\\B", 50) );
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->start();
+    }
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->wait();
+        delete threads[i];
+    }
+    {
+        RenderProfilerSpan span(0, kRenderProfilerCategoryCache, "cache lookup", 7);
+        span.setName("cache hit");
+    }
+    EXPECT_EQ(RenderProfiler::getSpansCount(), 151);
+
+    std::stringstream trace;
+    RenderProfiler::writeChromeTrace(trace);
+    std::string json = trace.str();
+    EXPECT_EQ(json.compare(0, 16, "{\"traceEvents\":["), 0);
+    EXPECT_EQ(countOccurences(json, "\"ph\":\"X\""), 151);
+    EXPECT_EQ(countOccurences(json, "\"name\":\"Blur1 render\""), 100);
+    ///the names are escaped
+    EXPECT_EQ(countOccurences(json, "\"node\":\"Merge \\\"A\\\"\\\\B\""), 50);
+    EXPECT_EQ(countOccurences(json, "\"name\":\"cache hit\",\"cat\":\"cache\""), 1);
+    EXPECT_EQ(countOccurences(json, "\"frame\":7}"), 3);
+    ///each thread has its own track
+    EXPECT_EQ(countOccurences(json, "\"tid\":3,"), 1);
+    EXPECT_EQ(countOccurences(json, "\"tid\":4,"), 0);
+
+    ///restarting discards the spans
+    RenderProfiler::start("");
+    EXPECT_EQ(RenderProfiler::getSpansCount(), 0);
+    RenderProfiler::addSpan("Blur1", kRenderProfilerCategoryAction, "render", 0, RenderProfiler::getCurrentTime(), 0.);
+    EXPECT_EQ(RenderProfiler::getSpansCount(), 1);
+    EXPECT_TRUE( RenderProfiler::stop() );
+    EXPECT_TRUE( !RenderProfiler::isRecording() );
+}
+
+TEST(RenderProfiler,Overhead) {
+    const int spansCount = 1000000;
+    double times[2];
+
+    for (int recording = 0; recording < 2; ++recording) {
+        if (recording) {
+            RenderProfiler::start("");
+        }
+        TimeLapse timer;
+        for (int i = 0; i < spansCount; ++i) {
+            RenderProfilerSpan span(0, kRenderProfilerCategoryAction, "isIdentity", i);
+        }
+        times[recording] = timer.getTimeSinceCreation();
+        if (recording) {
+            EXPECT_EQ(RenderProfiler::getSpansCount(), spansCount);
+            EXPECT_TRUE( RenderProfiler::stop() );
+        }
+    }
+    std::cout << "Profiler span: " << times[0] * 1e9 / spansCount << " ns when not recording, "
+              << times[1] * 1e9 / spansCount << " ns when recording" << std::endl;
+}
@@ -0,0 +1,241 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#ifndef Q_MOC_RUN
+#include <boost/bind.hpp>
+#endif
+#include "Engine/Rect.h"
+#include "Engine/TaskScheduler.h"
+#include "Engine/Timer.h"
+
+using namespace Natron;
+
+namespace {
+void
+countTask(std::vector<int>* counts,
+          int i)
+{
+    ++(*counts)[i];
+}
+
+void
+nestedTask(TaskScheduler* scheduler,
+           QAtomicInt* leaves,
+           int depth,
+           int)
+{
+    if (depth == 0) {
+        leaves->fetchAndAddOrdered(1);
+    } else {
+        scheduler->parallelFor( 4, boost::bind(&nestedTask, scheduler, leaves, depth - 1, _1) );
+    }
+}
+
+void
+throwingTask(QAtomicInt* calls,
+             int i)
+{
+    calls->fetchAndAddOrdered(1);
+    if (i == 3) {
+        throw std::runtime_error("task 3 failed");
+    }
+}
+}
+
+TEST(TaskScheduler,RunsEveryTaskOnce) {
+    for (int threadsCount = 0; threadsCount < 4; ++threadsCount) {
+        TaskScheduler scheduler(threadsCount);
+        std::vector<int> counts(1000, 0);
+        scheduler.parallelFor( (int)counts.size(), boost::bind(&countTask, &counts, _1) );
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            EXPECT_EQ(counts[i], 1);
+        }
+    }
+}
+
+TEST(TaskScheduler,NestedLoops) {
+    ///more nested loops than threads: with a thread pool, the waiting threads would block all the workers
+    for (int threadsCount = 0; threadsCount < 3; ++threadsCount) {
+        TaskScheduler scheduler(threadsCount);
+        QAtomicInt leaves(0);
+        nestedTask(&scheduler, &leaves, 4, 0);
+        EXPECT_EQ( (int)leaves, 4 * 4 * 4 * 4 );
+    }
+}
+
+TEST(TaskScheduler,Exceptions) {
+    TaskScheduler scheduler(2);
+    QAtomicInt calls(0);
+    bool thrown = false;
+    try {
+        scheduler.parallelFor( 10, boost::bind(&throwingTask, &calls, _1) );
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    ASSERT_TRUE(thrown);
+    EXPECT_EQ( (int)calls, 10 );
+}
+
+namespace {
+///A chain of nodes processing an image, each node splitting its rows in bands like the tiles of an effect
+struct ChainRender
+{
+    TaskScheduler* scheduler; //< NULL to render the bands in the calling thread
+    int width, height, nodesCount, bandsCount;
+    QMutex busyTimeMutex;
+    double busyTime; //< the time spent in the bands by all the threads
+
+    void renderBand(const std::vector<float>* src,
+                    std::vector<float>* dst,
+                    int band)
+    {
+        TimeLapse timer;
+        int y1 = height * band / bandsCount;
+        int y2 = height * (band + 1) / bandsCount;
+
+        for (int i = y1 * width; i < y2 * width; ++i) {
+            (*dst)[i] = std::sqrt( (*src)[i] * 0.9f + 0.1f );
+        }
+        QMutexLocker l(&busyTimeMutex);
+        busyTime += timer.getTimeSinceCreation();
+    }
+
+    void renderFrame()
+    {
+        std::vector<float> src(width * height, 0.5f);
+        std::vector<float> dst(width * height);
+
+        for (int n = 0; n < nodesCount; ++n) {
+            if (scheduler) {
+                scheduler->parallelFor( bandsCount, boost::bind(&ChainRender::renderBand, this, &src, &dst, _1) );
+            } else {
+                for (int band = 0; band < bandsCount; ++band) {
+                    renderBand(&src, &dst, band);
+                }
+            }
+            src.swap(dst);
+        }
+    }
+};
+
+///A thread rendering frames, like the parallel renders of a playback
+class FrameRenderThread
+    : public QThread
+{
+public:
+
+    FrameRenderThread(ChainRender* chain,
+                      int framesCount)
+        : QThread()
+          , chain(chain)
+          , framesCount(framesCount)
+    {
+    }
+
+private:
+
+    virtual void run()
+    {
+        for (int i = 0; i < framesCount; ++i) {
+            chain->renderFrame();
+        }
+    }
+
+    ChainRender* chain;
+    int framesCount;
+};
+}
+
+TEST(TaskScheduler,ChainBenchmark) {
+    ///the frames are rendered by the threads of the global thread pool: when it was full, the effects rendered
+    ///their tiles in the thread of the frame, even when some cores were idle
+    const int threadsCount = std::max( 1, QThread::idealThreadCount() );
+    const int framesCount = 8;
+    TaskScheduler scheduler(threadsCount);
+
+    for (int useScheduler = 0; useScheduler < 2; ++useScheduler) {
+        ChainRender chain;
+        chain.scheduler = useScheduler ? &scheduler : 0;
+        chain.width = 1920;
+        chain.height = 1080;
+        chain.nodesCount = 10;
+        chain.bandsCount = 4 * threadsCount;
+        chain.busyTime = 0.;
+
+        ///one frame is in flight for every 2 cores, the last one of a sequence is usually alone
+        int frameThreadsCount = std::max(1, threadsCount / 2);
+        std::vector<FrameRenderThread*> frameThreads;
+        TimeLapse timer;
+        for (int i = 0; i < frameThreadsCount; ++i) {
+            frameThreads.push_back( new FrameRenderThread(&chain, framesCount) );
+            frameThreads.back()->start();
+        }
+        for (int i = 0; i < frameThreadsCount; ++i) {
+            frameThreads[i]->wait();
+            delete frameThreads[i];
+        }
+        double time = timer.getTimeSinceCreation();
+
+        std::cout << "10-node chain, " << frameThreadsCount * framesCount << " frames on " << frameThreadsCount << " threads, "
+                  << (useScheduler ? "bands in the task scheduler: " : "bands in the thread of the frame: ")
+                  << time * 1000. << " ms, core utilization "
+                  << 100. * chain.busyTime / (time * threadsCount) << "%" << std::endl;
+    }
+}
+
+namespace {
+///An image whose bottom rows are much more expensive to render, like the area of a Roto mask in a frame
+struct UnevenRender
+{
+    int width;
+    std::vector<float> dst;
+
+    void renderTile(const std::vector<RectI>* tiles,
+                    int i)
+    {
+        const RectI & tile = (*tiles)[i];
+
+        for (int y = tile.y1; y < tile.y2; ++y) {
+            int iterations = y < 64 ? 64 : 1;
+            for (int x = tile.x1; x < tile.x2; ++x) {
+                float v = 0.5f;
+                for (int k = 0; k < iterations; ++k) {
+                    v = std::sqrt(v * 0.9f + 0.1f);
+                }
+                dst[y * width + x] = v;
+            }
+        }
+    }
+};
+}
+
+TEST(TaskScheduler,TilesBenchmark) {
+    ///one strip per thread waits for the thread rendering the expensive strip, small tiles are picked by the threads that are done
+    const int threadsCount = std::max( 1, QThread::idealThreadCount() );
+    TaskScheduler scheduler(threadsCount - 1);
+    const RectI rect(0, 0, 1920, 1080);
+
+    for (int useTiles = 0; useTiles < 2; ++useTiles) {
+        UnevenRender render;
+        render.width = rect.width();
+        render.dst.resize( rect.area() );
+        std::vector<RectI> tiles = useTiles ? RectI::splitRectIntoTiles(rect, NATRON_HOST_SMP_CACHE_SIZE / (2 * 4 * sizeof(float)))
+                                   : RectI::splitRectIntoSmallerRect(rect, threadsCount);
+        TimeLapse timer;
+        scheduler.parallelFor( (int)tiles.size(), boost::bind(&UnevenRender::renderTile, &render, &tiles, _1) );
+        std::cout << "Uneven 1920x1080 render on " << threadsCount << " threads in " << tiles.size()
+                  << (useTiles ? " cache-sized tiles: " : " strips: ") << timer.getTimeSinceCreation() * 1000. << " ms" << std::endl;
+    }
+}
@@ -153,11 +153,23 @@ SOURCES += \
     google-test/src/gtest_main.cc \
     google-mock/src/gmock-all.cc \
     BaseTest.cpp \
+    BezierEvaluation_Test.cpp \
     Hash64_Test.cpp \
+    HashPropagation_Test.cpp \
     Image_Test.cpp \
+    ImageStatistics_Test.cpp \
     Lut_Test.cpp \
+    Rect_Test.cpp \
+    RenderMemoryCounter_Test.cpp \
+    RenderProfiler_Test.cpp \
+    RotoRasterizer_Test.cpp \
     File_Knob_Test.cpp \
-    Curve_Test.cpp
+    KnobsSnapshot_Test.cpp \
+    ProjectSerialization_Test.cpp \
+    Curve_Test.cpp \
+    Cache_Test.cpp \
+    TaskScheduler_Test.cpp \
+    ViewerTexture_Test.cpp
 
 HEADERS += \
     BaseTest.h
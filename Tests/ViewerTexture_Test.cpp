@@ -0,0 +1,134 @@
+//  Natron
+//
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <gtest/gtest.h>
+#include "Engine/ImageSIMD.h"
+#include "Engine/Lut.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewerTexture.h"
+
+using namespace Natron;
+
+namespace {
+
+///Converts a whole RGBA float frame to a texture, the way the viewer does it for each of its rows
+void
+convertFrame(const std::vector<float> & frame,
+             int width,
+             int height,
+             const Color::Lut* colorSpace,
+             bool luminance,
+             std::vector<U32>* texture8,
+             std::vector<float>* texture32)
+{
+    ViewerTexture::Row row;
+    row.resize(width);
+    for (int y = 0; y < height; ++y) {
+        ViewerTexture::readFloatRow(&frame[y * width * 4], 4, 1, 0, 1, 2, false, &row);
+        if (texture8) {
+            ViewerTexture::applyGainOffset(1.5, 0.01, luminance, &row);
+            ViewerTexture::writeRow8bits(colorSpace, y, &row, &(*texture8)[y * width]);
+        } else {
+            ViewerTexture::applyGainOffset(1., 0., luminance, &row);
+            ViewerTexture::writeRow32bits(row, &(*texture32)[y * width * 4]);
+        }
+    }
+}
+
+}
+
+TEST(ViewerTexture,SIMDMatchesScalar) {
+    const Color::Lut* sRGB = Color::LutManager::sRGBLut();
+    sRGB->validate();
+
+    ///an odd width so that the scalar remainders are used, with out of range values and NaNs
+    const int width = 203;
+    const int height = 7;
+    std::vector<float> frame(width * height * 4);
+    for (std::size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = std::rand() / (float)RAND_MAX * 1.4f - 0.2f;
+    }
+    frame[4] = std::numeric_limits<float>::quiet_NaN();
+    frame[40] = std::numeric_limits<float>::infinity();
+
+    const SIMDInstructionSetEnum supported = ImageSIMD::getSupportedInstructionSet();
+    const Color::Lut* colorSpaces[2] = { 0, sRGB };
+    for (int c = 0; c < 2; ++c) {
+        for (int luminance = 0; luminance < 2; ++luminance) {
+            ImageSIMD::setInstructionSet(eSIMDInstructionSetNone);
+            std::vector<U32> ref8(width * height);
+            std::vector<float> ref32(width * height * 4);
+            convertFrame(frame, width, height, colorSpaces[c], luminance, &ref8, 0);
+            convertFrame(frame, width, height, colorSpaces[c], luminance, 0, &ref32);
+
+            for (int set = eSIMDInstructionSetSSE2; set <= supported; ++set) {
+                ImageSIMD::setInstructionSet( (SIMDInstructionSetEnum)set );
+                std::vector<U32> texture8(width * height);
+                std::vector<float> texture32(width * height * 4);
+                convertFrame(frame, width, height, colorSpaces[c], luminance, &texture8, 0);
+                convertFrame(frame, width, height, colorSpaces[c], luminance, 0, &texture32);
+                ASSERT_TRUE(texture8 == ref8);
+                ASSERT_TRUE( !memcmp( &texture32.front(), &ref32.front(), texture32.size() * sizeof(float) ) );
+            }
+        }
+    }
+    ImageSIMD::setInstructionSet(supported);
+
+    ///the 8 bits linear texture is quantized like Color::floatToInt
+    ViewerTexture::Row row;
+    row.resize(width);
+    ViewerTexture::readFloatRow(&frame.front(), 4, 1, 0, 1, 2, true, &row);
+    std::vector<U32> texture8(width);
+    ViewerTexture::writeRow8bits(0, 0, &row, &texture8.front());
+    for (int x = 0; x < width; ++x) {
+        EXPECT_EQ( (int)( (texture8[x] >> 16) & 0xff ), x == 1 ? 0 : Color::floatToInt<256>(frame[x * 4]) );
+        EXPECT_EQ( (int)(texture8[x] >> 24), 255 );
+    }
+}
+
+TEST(ViewerTexture,PlaybackBenchmark) {
+    const Color::Lut* sRGB = Color::LutManager::sRGBLut();
+    sRGB->validate();
+
+    const int sizes[2][2] = { { 2048, 1080 }, { 4096, 2160 } };
+    const char* names[2] = { "2K", "4K" };
+    const SIMDInstructionSetEnum supported = ImageSIMD::getSupportedInstructionSet();
+    const SIMDInstructionSetEnum sets[2] = { eSIMDInstructionSetNone, supported };
+    const int frames = 3;
+
+    for (int s = 0; s < 2; ++s) {
+        const int width = sizes[s][0];
+        const int height = sizes[s][1];
+        std::vector<float> frame( (std::size_t)width * height * 4 );
+        for (std::size_t i = 0; i < frame.size(); ++i) {
+            frame[i] = std::rand() / (float)RAND_MAX;
+        }
+        std::vector<U32> texture8( (std::size_t)width * height );
+        std::vector<float> texture32( (std::size_t)width * height * 4 );
+
+        for (int i = 0; i < 2; ++i) {
+            ImageSIMD::setInstructionSet(sets[i]);
+            TimeLapse timer8;
+            for (int f = 0; f < frames; ++f) {
+                convertFrame(frame, width, height, sRGB, false, &texture8, 0);
+            }
+            double ms8 = timer8.getTimeSinceCreation() * 1000. / frames;
+            TimeLapse timer32;
+            for (int f = 0; f < frames; ++f) {
+                convertFrame(frame, width, height, sRGB, false, 0, &texture32);
+            }
+            double ms32 = timer32.getTimeSinceCreation() * 1000. / frames;
+            std::cout << "Viewer texture of a " << names[s] << " float frame with instruction set " << (int)sets[i] << ": "
+                      << ms8 << " ms/frame in 8 bits sRGB, " << ms32 << " ms/frame in 32 bits" << std::endl;
+        }
+    }
+    ImageSIMD::setInstructionSet(supported);
+}